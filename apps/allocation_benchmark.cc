@@ -0,0 +1,159 @@
+#include "fd_adapter.hh"
+#include "ipv4_datagram.hh"
+#include "packet_pool.hh"
+#include "socket.hh"
+#include "tcp_over_ip.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t packets_per_run = 100'000;
+constexpr size_t payload_size = 1460;
+
+static size_t heap_allocations = 0;  //!< Calls to operator new so far
+
+void *operator new(const size_t size) {
+    heap_allocations++;
+    void *const ret = malloc(size);
+    if (ret == nullptr) {
+        throw bad_alloc();
+    }
+    return ret;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, const size_t) noexcept { free(ptr); }
+
+//! An adapter whose addresses are set, so that it can wrap and unwrap segments without a device
+class LoopbackAdapter : public TCPOverIPv4Adapter {
+  public:
+    LoopbackAdapter() {
+        config_mutable().source = {"10.144.0.1", 40000};
+        config_mutable().destination = {"10.144.0.1", 40000};
+    }
+};
+
+//! Run `per_packet` packets_per_run times and print the allocations and time it averaged
+//! (heap allocations count both operator new and the PacketPool's own calls to malloc)
+template <typename Function>
+static void report(const string &path, Function &&per_packet) {
+    per_packet();  // warm up
+    const size_t first_count = heap_allocations;
+    const PacketPool::Stats first_stats = PacketPool::thread_stats();
+    const auto first_time = steady_clock::now();
+    for (size_t i = 0; i < packets_per_run; i++) {
+        per_packet();
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    const PacketPool::Stats stats = PacketPool::thread_stats();
+    const size_t heap = heap_allocations - first_count + stats.mallocs - first_stats.mallocs;
+    cout << fixed << setprecision(2) << path << double(heap) / packets_per_run << " heap allocations, "
+         << double(stats.allocations - first_stats.allocations) / packets_per_run << " pool blocks, "
+         << duration / packets_per_run << " ns per packet\n";
+}
+
+int main() {
+    try {
+        LoopbackAdapter adapter;
+        const string payload(payload_size, 'x');
+        InternetChecksum payload_checksum;
+        payload_checksum.add(payload);
+        const Buffer payload_buffer{string(payload)};
+
+        // wrap a data segment in an IPv4 datagram, as a TUN adapter writes it
+        report("send TCP/IPv4          : ", [&] {
+            TCPSegment seg;
+            seg.header().ack = true;
+            seg.set_payload(payload_buffer, payload_checksum);
+            const Buffer datagram = adapter.serialize_tcp_in_ip(seg);
+            if (datagram.size() != IPv4Header::LENGTH + TCPHeader::LENGTH + payload_size) {
+                throw runtime_error("wrong datagram size");
+            }
+        });
+
+        // read a datagram from a socket, then parse it and the segment inside
+        UDPSocket sender, receiver;
+        receiver.bind(Address("127.0.0.1", 0));
+        sender.connect(receiver.local_address());
+        TCPSegment outgoing;
+        outgoing.header().ack = true;
+        outgoing.set_payload(payload_buffer, payload_checksum);
+        const string incoming = adapter.serialize_tcp_in_ip(outgoing).copy();
+
+        // ... into a fresh string, as a TUN device used to be read
+        report("receive TCP/IPv4 string: ", [&] {
+            sender.send(incoming);
+            InternetDatagram ip_dgram;
+            if (ip_dgram.parse(receiver.read()) != ParseResult::NoError) {
+                throw runtime_error("could not parse the datagram");
+            }
+            if (not adapter.unwrap_tcp_in_ip(ip_dgram)) {
+                throw runtime_error("could not unwrap the segment");
+            }
+        });
+
+        // ... or into a pooled block the size of an Ethernet MTU, as a TUN device is read now
+        report("receive TCP/IPv4 pooled: ", [&] {
+            sender.send(incoming);
+            InternetDatagram ip_dgram;
+            if (ip_dgram.parse(receiver.read_buffer(1500)) != ParseResult::NoError) {
+                throw runtime_error("could not parse the datagram");
+            }
+            if (not adapter.unwrap_tcp_in_ip(ip_dgram)) {
+                throw runtime_error("could not unwrap the segment");
+            }
+        });
+
+
+        // write a data segment to a UDP socket
+        UDPSocket peer;
+        peer.bind(Address("127.0.0.1", 0));
+        UDPSocket local;
+        local.bind(Address("127.0.0.1", 0));
+        const Address local_address = local.local_address();
+        TCPOverUDPSocketAdapter udp_adapter{move(local)};
+        udp_adapter.config_mut().destination = peer.local_address();
+        string sink;  // drains the peer without allocating, once it has grown
+        report("send TCP/UDP           : ", [&] {
+            TCPSegment seg;
+            seg.header().ack = true;
+            seg.set_payload(payload_buffer, payload_checksum);
+            udp_adapter.write(seg);
+            udp_adapter.flush();
+            peer.read(sink, 65536);
+        });
+
+        // read a segment from a UDP socket
+        const string incoming_segment = outgoing.serialize().concatenate();
+        report("receive TCP/UDP        : ", [&] {
+            peer.sendto(local_address, incoming_segment);
+            if (not udp_adapter.read()) {
+                throw runtime_error("could not unwrap the segment");
+            }
+        });
+
+        // a bare acknowledgment, as the receiving side sends one per packet or two
+        report("send ACK               : ", [&] {
+            TCPSegment seg;
+            seg.header().ack = true;
+            const Buffer datagram = adapter.serialize_tcp_in_ip(seg);
+            if (datagram.size() != IPv4Header::LENGTH + TCPHeader::LENGTH) {
+                throw runtime_error("wrong datagram size");
+            }
+        });
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+using Kernel = InternetChecksum::Kernel;
+
+constexpr size_t bytes_per_run = 1 << 30;
+
+//! Checksum `bytes_per_run` bytes in pieces of `size`, starting at an odd address
+void run(const string &name, const Kernel kernel, const size_t size) {
+    const string storage(size + 1, 'x');
+    const string_view data = string_view(storage).substr(1);
+    const size_t iterations = bytes_per_run / size;
+
+    uint16_t result = 0;
+    const auto first_time = steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        InternetChecksum check{result};
+        check.add(data, kernel);
+        result = check.value();
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+
+    cout << setw(9) << name << setw(8) << size << " B: " << setw(7) << iterations * size / double(duration)
+         << " GB/s  " << setw(7) << duration / double(iterations) << " ns/call  (" << result << ")\n";
+}
+
+int main() {
+    try {
+        const pair<string, Kernel> kernels[] = {{"bytewise", Kernel::Bytewise},
+                                                {"word64", Kernel::Word64},
+                                                {"sse2", Kernel::SSE2},
+                                                {"avx2", Kernel::AVX2},
+                                                {"neon", Kernel::NEON}};
+
+        cout << fixed << setprecision(2);
+        for (const size_t size : {20, 64, 576, 1460, 65536}) {
+            for (const auto &[name, kernel] : kernels) {
+                if (InternetChecksum::supported(kernel)) {
+                    run(name, kernel, size);
+                }
+            }
+            cout << "\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include "io_uring.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t datagram_count = 500'000;
+constexpr size_t datagram_size = 1000;
+constexpr size_t burst = 32;
+
+//! Block until `fd` is readable
+void wait_readable(const FileDescriptor &fd) {
+    pollfd pfd{fd.fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, -1));
+}
+
+//! A pair of connected UDP sockets on the loopback interface
+pair<UDPSocket, UDPSocket> socket_pair() {
+    UDPSocket sender, receiver;
+    receiver.bind(Address("127.0.0.1", 0));
+    sender.bind(Address("127.0.0.1", 0));
+    sender.connect(receiver.local_address());
+    receiver.connect(sender.local_address());
+    return {move(sender), move(receiver)};
+}
+
+void report(const string &engine, const steady_clock::time_point first_time) {
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    cout << fixed << setprecision(0);
+    cout << engine << datagram_count * 1e9 / double(duration) << " datagrams/s\n";
+}
+
+//! One write(2) per datagram, then poll(2) and one read(2) per datagram
+void poll_loop() {
+    auto [sender, receiver] = socket_pair();
+    const string payload(datagram_size, 'x');
+
+    const auto first_time = steady_clock::now();
+    for (size_t sent = 0; sent < datagram_count; sent += burst) {
+        for (size_t i = 0; i < burst; i++) {
+            sender.write(payload);
+        }
+        for (size_t i = 0; i < burst; i++) {
+            wait_readable(receiver);
+            if (receiver.read().size() != datagram_size) {
+                throw runtime_error("short datagram");
+            }
+        }
+    }
+    report("poll     : ", first_time);
+}
+
+//! One sendmmsg(2) per burst, then recvmmsg(2) for whatever has arrived (optionally with UDP GSO/GRO)
+void mmsg_loop(const bool offload) {
+    auto [sender, receiver] = socket_pair();
+    if (offload and not(sender.enable_segmentation_offload() and receiver.enable_receive_offload())) {
+        cout << "gso/gro  : not available\n";
+        return;
+    }
+    const string payload(datagram_size, 'x');
+    const vector<BufferViewList> payloads(burst, payload);
+    vector<UDPSocket::received_datagram> datagrams;
+
+    const auto first_time = steady_clock::now();
+    for (size_t sent = 0; sent < datagram_count; sent += burst) {
+        sender.send_batch(payloads);
+        for (size_t received = 0; received < burst;) {
+            wait_readable(receiver);
+            const size_t count = receiver.recv_batch(datagrams, burst);
+            for (size_t i = 0; i < count; i++) {
+                if (datagrams[i].payload.size() != datagram_size) {
+                    throw runtime_error("short datagram");
+                }
+            }
+            received += count;
+        }
+    }
+    report(offload ? "gso/gro  : " : "mmsg     : ", first_time);
+}
+
+//! A burst of writes per io_uring_enter(2), reads reaped from the completion queue
+void uring_loop() {
+    auto [sender, receiver] = socket_pair();
+    IOUringEngine tx{sender}, rx{receiver};
+    const BufferList payload{string(datagram_size, 'x')};
+
+    const auto first_time = steady_clock::now();
+    for (size_t sent = 0; sent < datagram_count; sent += burst) {
+        for (size_t i = 0; i < burst; i++) {
+            tx.write(payload);
+        }
+        tx.flush();
+        for (size_t received = 0; received < burst;) {
+            const auto datagram = rx.read();
+            if (not datagram) {
+                wait_readable(rx);
+                continue;
+            }
+            if (datagram->size() != datagram_size) {
+                throw runtime_error("short datagram");
+            }
+            received++;
+        }
+    }
+    report("io_uring : ", first_time);
+}
+
+int main() {
+    try {
+        poll_loop();
+        mmsg_loop(false);
+        mmsg_loop(true);
+        if (IOUring::available()) {
+            uring_loop();
+        } else {
+            cout << "io_uring : not available\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
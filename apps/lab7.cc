@@ -106,6 +106,14 @@ class NetworkInterfaceAdapter : public TCPOverIPv4Adapter {
 
         return {};
     }
+    vector<TCPSegment> read_batch() {
+        vector<TCPSegment> ret;
+        auto seg = read();
+        if (seg) {
+            ret.push_back(move(seg.value()));
+        }
+        return ret;
+    }
     void write(TCPSegment &seg) {
         _interface.send_datagram(wrap_tcp_in_ip(seg), _next_hop);
         send_pending();
@@ -251,8 +259,7 @@ void program_body(bool is_client, const string &bounce_host, const string &bounc
                     cerr << "Exiting...\n";
                     return;
                 }
-                router.interface(host_side).tick(50);
-                router.interface(internet_side).tick(50);
+                router.tick(50);
                 if (exit_flag) {
                     return;
                 }
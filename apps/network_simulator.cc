@@ -1,10 +1,17 @@
 #include "arp_message.hh"
+#include "icmp_message.hh"
 #include "router.hh"
 #include "util.hh"
 
 #include <iostream>
 #include <list>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -78,6 +85,12 @@ class Host {
 
     std::list<InternetDatagram> _expecting_to_receive{};
 
+    //! ICMP errors, as the router would send them (but for the checksum)
+    std::list<ICMPMessage> _expecting_icmp{};
+
+    //! While collecting, what arrives (unchecked)
+    std::optional<std::vector<InternetDatagram>> _collected{};
+
     bool expecting(const InternetDatagram &expected) const {
         for (const auto &x : _expecting_to_receive) {
             if (x.serialize().concatenate() == expected.serialize().concatenate()) {
@@ -87,6 +100,23 @@ class Host {
         return false;
     }
 
+    //! Is `dgram` an expected ICMP error? (If so, no longer expect it.)
+    bool expected_icmp(const InternetDatagram &dgram) {
+        ICMPMessage message;
+        if (dgram.header().proto != IPv4Header::PROTO_ICMP or dgram.header().dst != _my_address.ipv4_numeric() or
+            message.parse(dgram.payload().concatenate()) != ParseResult::NoError) {
+            return false;
+        }
+        for (auto it = _expecting_icmp.begin(); it != _expecting_icmp.end(); ++it) {
+            if (it->type == message.type and it->code == message.code and it->rest == message.rest and
+                it->data == message.data) {
+                _expecting_icmp.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
     void remove_expectation(const InternetDatagram &expected) {
         for (auto it = _expecting_to_receive.begin(); it != _expecting_to_receive.end(); ++it) {
             if (it->serialize().concatenate() == expected.serialize().concatenate()) {
@@ -103,11 +133,16 @@ class Host {
         , _interface(random_host_ethernet_address(), _my_address)
         , _next_hop(next_hop) {}
 
-    InternetDatagram send_to(const Address &destination, const uint8_t ttl = 64) {
+    InternetDatagram send_to(const Address &destination,
+                             const uint8_t ttl = 64,
+                             const size_t padding = 0,
+                             const bool df = true) {
         InternetDatagram dgram;
         dgram.header().src = _my_address.ipv4_numeric();
         dgram.header().dst = destination.ipv4_numeric();
-        dgram.payload() = "random payload: {" + to_string(rd()) + "}";
+        dgram.header().id = rd();
+        dgram.header().df = df;
+        dgram.payload() = "random payload: {" + to_string(rd()) + "}" + string(padding, '.');
         dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
         dgram.header().ttl = ttl;
 
@@ -123,13 +158,124 @@ class Host {
 
     AsyncNetworkInterface &interface() { return _interface; }
 
+    //! Send a TCP-like datagram (just the ports, then some text) of the flow from `src_port` to `dst_port`
+    InternetDatagram send_flow_to(const Address &destination, const uint16_t src_port, const uint16_t dst_port) {
+        string payload(4, 0);
+        NetUnparser::store_u16(payload.data(), src_port);
+        NetUnparser::store_u16(payload.data() + 2, dst_port);
+        payload += "random payload: {" + to_string(rd()) + "}";
+
+        InternetDatagram dgram;
+        dgram.header().src = _my_address.ipv4_numeric();
+        dgram.header().dst = destination.ipv4_numeric();
+        dgram.payload() = move(payload);
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        dgram.header().ttl = 64;
+
+        _interface.send_datagram(dgram, _next_hop);
+        return dgram;
+    }
+
+    //! \brief Send a datagram to `destination` whose header carries IP `options` (a multiple of 4 bytes long)
+    //! \details InternetDatagram cannot serialize options, so they are written into the frame the interface
+    //! queued (which needs the next hop's Ethernet address to be known already).
+    //! \returns the datagram as sent
+    string send_with_options_to(const Address &destination, const string &options, const uint8_t ttl) {
+        InternetDatagram dgram;
+        dgram.header().src = _my_address.ipv4_numeric();
+        dgram.header().dst = destination.ipv4_numeric();
+        dgram.header().hlen = (IPv4Header::LENGTH + options.size()) / 4;
+        dgram.payload() = "random payload: {" + to_string(rd()) + "}";
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        dgram.header().ttl = ttl;
+
+        _interface.send_datagram(dgram, _next_hop);
+        if (_interface.frames_out().empty() or
+            _interface.frames_out().back().header().type != EthernetHeader::TYPE_IPv4) {
+            throw runtime_error("Host " + _name + " does not know its next hop's Ethernet address");
+        }
+
+        string sent = dgram.serialize().concatenate();
+        sent.replace(IPv4Header::LENGTH, options.size(), options);
+        NetUnparser::store_u16(sent.data() + 10, 0);
+        InternetChecksum check;
+        check.add(string_view{sent}.substr(0, dgram.header().hlen * 4));
+        NetUnparser::store_u16(sent.data() + 10, check.value());
+        _interface.frames_out().back().payload() = string{sent};
+
+        cerr << "Host " << _name << " trying to send datagram with options: " << dgram.header().summary() << "\n";
+
+        return sent;
+    }
+
+    //! Send an ICMP error message (about `offending`) to `destination`
+    InternetDatagram send_icmp_error_to(const Address &destination,
+                                        const InternetDatagram &offending,
+                                        const uint8_t ttl) {
+        ICMPMessage message;
+        message.type = ICMPMessage::TYPE_TIME_EXCEEDED;
+        message.data = offending.serialize().concatenate().substr(0, offending.header().hlen * 4 + 8);
+
+        InternetDatagram dgram;
+        dgram.header().src = _my_address.ipv4_numeric();
+        dgram.header().dst = destination.ipv4_numeric();
+        dgram.header().proto = IPv4Header::PROTO_ICMP;
+        dgram.payload() = message.serialize();
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        dgram.header().ttl = ttl;
+
+        _interface.send_datagram(dgram, _next_hop);
+
+        cerr << "Host " << _name << " trying to send ICMP error (with next hop = " << _next_hop.ip()
+             << "): " << dgram.header().summary() << "\n";
+
+        return dgram;
+    }
+
     void expect(const InternetDatagram &expected) { _expecting_to_receive.push_back(expected); }
 
+    //! Keep whatever arrives from now on, unchecked, for take_collected()
+    void collect() { _collected.emplace(); }
+
+    //! Stop collecting, and return what was collected
+    std::vector<InternetDatagram> take_collected() {
+        auto ret = move(_collected.value());
+        _collected.reset();
+        return ret;
+    }
+
+    //! Expect an ICMP error of `type` and `code` (and type-specific word `rest`) about `offending` (as sent)
+    void expect_icmp(const uint8_t type,
+                     const uint8_t code,
+                     const InternetDatagram &offending,
+                     const uint32_t rest = 0) {
+        expect_icmp(type, code, offending.serialize().concatenate(), rest);
+    }
+
+    //! Expect an ICMP error quoting `offending`, given as the bytes sent
+    void expect_icmp(const uint8_t type, const uint8_t code, const string &offending, const uint32_t rest = 0) {
+        ICMPMessage message;
+        message.type = type;
+        message.code = code;
+        message.rest = rest;
+        message.data = offending.substr(0, 4 * (offending.at(0) & 0xf) + 8);
+        _expecting_icmp.push_back(message);
+    }
+
     const string &name() { return _name; }
 
     void check() {
+        while (_collected.has_value() and not _interface.datagrams_out().empty()) {
+            _collected->push_back(move(_interface.datagrams_out().front()));
+            _interface.datagrams_out().pop();
+        }
+
         while (not _interface.datagrams_out().empty()) {
             const auto &dgram_received = _interface.datagrams_out().front();
+            if (expected_icmp(dgram_received)) {
+                _interface.datagrams_out().pop();
+                continue;
+            }
             if (not expecting(dgram_received)) {
                 throw runtime_error("Host " + _name +
                                     " received unexpected Internet datagram: " + dgram_received.header().summary() +
@@ -144,6 +290,11 @@ class Host {
             throw runtime_error("Host " + _name + " did NOT receive an expected Internet datagram: " +
                                 expected.header().summary() + " payload=\"" + expected.payload().concatenate() + "\"");
         }
+
+        if (not _expecting_icmp.empty()) {
+            throw runtime_error("Host " + _name +
+                                " did NOT receive an expected " + _expecting_icmp.front().to_string());
+        }
     }
 };
 
@@ -257,6 +408,10 @@ class Network {
         }
     }
 
+    Router &router() { return _router; }
+
+    AsyncNetworkInterface &router_uun3() { return _router.interface(uun3_id); }
+
     Host &host(const string &name) {
         auto it = _hosts.find(name);
         if (it == _hosts.end()) {
@@ -334,10 +489,167 @@ void network_simulator() {
     cout << green << "\n\nSuccess! Testing TTL expiration..." << normal << "\n\n";
     {
         auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 1);
+        network.host("applesauce").expect_icmp(
+            ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, dgram_sent);
         network.simulate();
 
         dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 0);
+        network.host("applesauce").expect_icmp(
+            ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, dgram_sent);
+        network.simulate();
+
+        // the error quotes a header with options as it was sent (NOP, NOP, NOP, end of options)
+        const string sent_with_options =
+            network.host("applesauce").send_with_options_to({"1.2.3.4"}, string{"\x01\x01\x01\x00", 4}, 1);
+        network.host("applesauce").expect_icmp(
+            ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, sent_with_options);
+        network.simulate();
+    }
+
+    cout << green << "\n\nSuccess! Testing that an ICMP error never causes another..." << normal << "\n\n";
+    {
+        InternetDatagram offending;
+        offending.header().src = ip("1.2.3.4");
+        offending.header().dst = network.host("applesauce").address().ipv4_numeric();
+        offending.payload() = string("a datagram that did not arrive");
+        offending.header().len = offending.header().hlen * 4 + offending.payload().size();
+        network.host("applesauce").send_icmp_error_to({"1.2.3.4"}, offending, 1);
+        network.simulate();
+    }
+
+    cout << green << "\n\nSuccess! Testing an unreachable destination..." << normal << "\n\n";
+    {
+        network.router().remove_route(ip("0.0.0.0"), 0);
+        auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"});
+        network.host("applesauce").expect_icmp(
+            ICMPMessage::TYPE_DESTINATION_UNREACHABLE, ICMPMessage::CODE_NET_UNREACHABLE, dgram_sent);
+        network.simulate();
+        network.router().add_route(ip("0.0.0.0"), 0, network.host("default_router").address(), 0);
+    }
+
+    cout << green << "\n\nSuccess! Testing a datagram too big for the next hop..." << normal << "\n\n";
+    {
+        network.router_uun3().set_mtu(576);
+        auto dgram_sent = network.host("applesauce").send_to(network.host("dm42").address(), 64, 600);
+        network.host("applesauce").expect_icmp(
+            ICMPMessage::TYPE_DESTINATION_UNREACHABLE, ICMPMessage::CODE_FRAGMENTATION_NEEDED, dgram_sent, 576);
+        network.simulate();
+
+        dgram_sent = network.host("applesauce").send_to(network.host("dm42").address(), 64, 500);
+        dgram_sent.header().ttl--;
+        network.host("dm42").expect(dgram_sent);
+        network.simulate();
+        network.router_uun3().set_mtu(1500);
+    }
+
+    cout << green << "\n\nSuccess! Testing a datagram that may be fragmented..." << normal << "\n\n";
+    {
+        // three fragments cross uun3, and dm42 puts them back together
+        network.router_uun3().set_mtu(576);
+        auto dgram_sent = network.host("applesauce").send_to(network.host("dm42").address(), 64, 1400, false);
+        dgram_sent.header().ttl--;
+        network.host("dm42").expect(dgram_sent);
+        network.simulate();
+        if (network.host("dm42").interface().reassembler().pending() != 0) {
+            throw runtime_error("fragmentation: fragments left over");
+        }
+        network.router_uun3().set_mtu(1500);
+    }
+
+    cout << green << "\n\nSuccess! Testing the ICMP rate limit..." << normal << "\n\n";
+    {
+        network.router().set_icmp_rate_limit(10, 5);
+        for (unsigned int i = 0; i < 20; i++) {
+            const auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 1);
+            if (i < 5) {
+                network.host("applesauce").expect_icmp(
+                    ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, dgram_sent);
+            }
+        }
+        network.simulate();
+
+        // a tenth of a second later (told to the router, or only to one of its interfaces), there is room
+        // for one more
+        for (const bool whole_router : {true, false}) {
+            if (whole_router) {
+                network.router().tick(100);
+            } else {
+                network.router().interface(0).tick(100);
+            }
+            for (unsigned int i = 0; i < 3; i++) {
+                const auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 1);
+                if (i == 0) {
+                    network.host("applesauce").expect_icmp(
+                        ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, dgram_sent);
+                }
+            }
+            network.simulate();
+        }
+    }
+
+    cout << green << "\n\nSuccess! Testing flows spread over two paths..." << normal << "\n\n";
+    {
+        const auto id = network.router().add_multipath(
+            {{{0, network.host("default_router").address()}, 1}, {{5, network.host("hs_router").address()}, 1}});
+        network.router().add_route(ip("203.0.113.0"), 24, id);
+        network.host("default_router").collect();
+        network.host("hs_router").collect();
+
+        // each flow, sent twice, must keep to one path; with 64 flows, both paths carry some
+        constexpr uint16_t flows = 64;
+        for (unsigned int copy = 0; copy < 2; copy++) {
+            for (uint16_t flow = 0; flow < flows; flow++) {
+                network.host("applesauce").send_flow_to({"203.0.113.7"}, 40000 + flow, 443);
+            }
+            network.simulate();
+        }
+
+        map<uint16_t, set<string>> paths;  // source port => the hosts that its flow reached
+        size_t received = 0;
+        for (const string name : {"default_router", "hs_router"}) {
+            for (const auto &dgram : network.host(name).take_collected()) {
+                paths[NetParser::load_u16(dgram.payload().concatenate().data())].insert(name);
+                received++;
+            }
+        }
+        if (received != 2 * flows or paths.size() != flows) {
+            throw runtime_error("multipath: datagrams lost");
+        }
+        set<string> used;
+        for (const auto &[port, hosts] : paths) {
+            if (hosts.size() != 1) {
+                throw runtime_error("multipath: a flow took both paths");
+            }
+            used.insert(*hosts.begin());
+        }
+        if (used.size() != 2) {
+            throw runtime_error("multipath: every flow took the same path");
+        }
+    }
+
+    cout << green << "\n\nSuccess! Testing the route cache..." << normal << "\n\n";
+    {
+        network.router().set_route_cache_entries(64);
+        for (unsigned int i = 0; i < 3; i++) {
+            auto dgram_sent = network.host("applesauce").send_to(network.host("cherrypie").address());
+            dgram_sent.header().ttl--;
+            network.host("cherrypie").expect(dgram_sent);
+            network.simulate();
+        }
+        if (network.router().route_cache_hits() != 2 or network.router().route_cache_misses() != 1) {
+            throw runtime_error("route cache: a repeated destination missed");
+        }
+
+        // once cherrypie's route is gone, its cached match is too
+        network.router().remove_route(ip("192.168.0.0"), 24);
+        auto dgram_sent = network.host("applesauce").send_to(network.host("cherrypie").address());
+        dgram_sent.header().ttl--;
+        network.host("default_router").expect(dgram_sent);
         network.simulate();
+        if (network.router().route_cache_misses() != 2) {
+            throw runtime_error("route cache: a removed route left a stale match");
+        }
+        network.router().add_route(ip("192.168.0.0"), 24, {}, 3);
     }
 
     cout << "\n\n\033[32;1mCongratulations! All datagrams were routed successfully.\033[m\n";
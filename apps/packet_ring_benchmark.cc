@@ -0,0 +1,116 @@
+#include "packet_ring.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t chunk_size = 64 * 1024;
+
+//! Write `total` bytes (a multiple of chunk_size) to the connection, then close it
+void produce(TCPOverPacketRingSpongeSocket &sock, const size_t total) {
+    const string chunk(chunk_size, 'x');
+    for (size_t written = 0; written < total; written += chunk.size()) {
+        sock.write(chunk);
+    }
+    sock.wait_until_closed();
+}
+
+//! Read the connection to its end, then report how fast the bytes arrived
+void consume(TCPOverPacketRingSpongeSocket &sock, const size_t total, const string &who) {
+    string chunk;
+    size_t received = 0;
+    const auto first_time = steady_clock::now();
+    while (not sock.eof()) {
+        sock.read(chunk, chunk_size);
+        received += chunk.size();
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    sock.wait_until_closed();
+
+    if (received != total) {
+        throw runtime_error(who + " received " + to_string(received) + " bytes, expected " + to_string(total));
+    }
+    cout << fixed << setprecision(2) << who << " received " << total / (1024 * 1024) << " MiB at "
+         << 8.0 * total / double(duration) << " Gbit/s\n";
+}
+
+TCPConfig tcp_config() {
+    TCPConfig ret;
+    ret.rt_timeout = 100;  // keeps the active closer's linger short
+    return ret;
+}
+
+//! \brief Measure TCP throughput between two sponge stacks linked by a shared-memory PacketRing
+//! \details The companion (a forked child) listens; this process connects. With `send`, this process
+//! produces the bytes and the companion consumes them; with `receive`, the other way around. Either
+//! way, packets cross between the processes without a system call (beyond a doorbell per burst), so
+//! what is measured is the stacks' own protocol processing.
+int main(int argc, char *argv[]) {
+    try {
+        if (argc > 3 or (argc > 1 and string(argv[1]) != "send" and string(argv[1]) != "receive")) {
+            cerr << "Usage: " << argv[0] << " [send|receive] [MiB]\n";
+            return EXIT_FAILURE;
+        }
+        const bool send = argc < 2 or string(argv[1]) == "send";
+        const size_t total = (argc > 2 ? stoul(argv[2]) : 64) * 1024 * 1024;
+
+        FdAdapterConfig local_config;
+        local_config.source = {"169.254.0.1", 1234};
+        local_config.destination = {"169.254.0.2", 5678};
+        FdAdapterConfig companion_config;
+        companion_config.source = local_config.destination;
+        companion_config.destination = local_config.source;
+
+        auto [local_end, companion_end] = PacketRingEndpoint::make_pair();
+
+        // fork before either stack starts its thread
+        const pid_t companion = SystemCall("fork", fork());
+        if (companion == 0) {
+            try {
+                TCPOverPacketRingSpongeSocket sock{TCPOverPacketRingAdapter{move(companion_end)}};
+                sock.listen_and_accept(tcp_config(), companion_config);
+                if (send) {
+                    consume(sock, total, "companion");
+                } else {
+                    produce(sock, total);
+                }
+            } catch (const exception &e) {
+                cerr << "companion: " << e.what() << "\n";
+                _exit(EXIT_FAILURE);
+            }
+            cout.flush();
+            _exit(EXIT_SUCCESS);
+        }
+
+        {
+            TCPOverPacketRingSpongeSocket sock{TCPOverPacketRingAdapter{move(local_end)}};
+            sock.connect(tcp_config(), local_config);
+            if (send) {
+                produce(sock, total);
+            } else {
+                consume(sock, total, "stack");
+            }
+        }
+
+        int status = 0;
+        SystemCall("waitpid", waitpid(companion, &status, 0));
+        if (not WIFEXITED(status) or WEXITSTATUS(status) != EXIT_SUCCESS) {
+            throw runtime_error("companion process failed");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
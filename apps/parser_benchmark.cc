@@ -0,0 +1,132 @@
+#include "arp_message.hh"
+#include "ethernet_header.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_header.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <pcap/pcap.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t parses_per_run = 4'000'000;
+
+//! The headers of every TCP/IPv4 packet of a capture, each as a Buffer starting at that header
+struct Corpus {
+    vector<Buffer> frames{};  //!< Ethernet frames
+    vector<Buffer> ip{};      //!< IPv4 datagrams
+    vector<Buffer> tcp{};     //!< TCP segments
+    vector<Buffer> arp{};     //!< ARP messages, made up from the addresses in the capture
+};
+
+static Corpus load(const char *filename) {
+    array<char, PCAP_ERRBUF_SIZE> errbuf{};
+    pcap_t *pcap = pcap_open_offline(filename, errbuf.data());
+    if (pcap == nullptr) {
+        throw runtime_error(string("pcap_open_offline: ") + errbuf.data());
+    }
+    if (pcap_datalink(pcap) != DLT_EN10MB) {
+        pcap_close(pcap);
+        throw runtime_error("expected a capture of Ethernet frames");
+    }
+
+    Corpus corpus;
+    pcap_pkthdr hdr{};
+    const uint8_t *pkt = nullptr;
+    while ((pkt = pcap_next(pcap, &hdr)) != nullptr) {
+        string frame(reinterpret_cast<const char *>(pkt), hdr.caplen);
+        NetParser p{string(frame)};
+        EthernetHeader eth;
+        if (eth.parse(p) != ParseResult::NoError or eth.type != EthernetHeader::TYPE_IPv4) {
+            continue;
+        }
+        IPv4Header ip;
+        if (ip.parse(p) != ParseResult::NoError or ip.proto != IPv4Header::PROTO_TCP) {
+            continue;
+        }
+
+        Buffer buffer{move(frame)};
+        corpus.frames.push_back(buffer);
+        buffer.remove_prefix(EthernetHeader::LENGTH);
+        corpus.ip.push_back(buffer);
+        buffer.remove_prefix(4 * ip.hlen);
+        corpus.tcp.push_back(buffer);
+
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REQUEST;
+        arp.sender_ethernet_address = eth.src;
+        arp.sender_ip_address = ip.src;
+        arp.target_ip_address = ip.dst;
+        corpus.arp.emplace_back(arp.serialize());
+    }
+    pcap_close(pcap);
+
+    if (corpus.frames.empty()) {
+        throw runtime_error("no TCP/IPv4 packets in the capture");
+    }
+    return corpus;
+}
+
+//! Parse the buffers round-robin with `parse_one`, which returns whether it succeeded
+template <typename ParseOne>
+static void run(const string &name, const vector<Buffer> &buffers, ParseOne &&parse_one) {
+    size_t failures = 0;
+    const auto first_time = steady_clock::now();
+    for (size_t i = 0; i < parses_per_run; i++) {
+        failures += not parse_one(buffers[i % buffers.size()]);
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+
+    if (failures) {
+        throw runtime_error(name + ": " + to_string(failures) + " parses failed");
+    }
+    cout << setw(10) << name << ": " << setw(6) << duration / double(parses_per_run) << " ns/header\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc != 2) {
+            cerr << "Usage: " << argv[0] << " <capture.pcap>\n\n"
+                 << "Times the header parsers over the TCP/IPv4 packets of an Ethernet capture,\n"
+                 << "for example tests/ipv4_parser.data.\n";
+            return EXIT_FAILURE;
+        }
+
+        const Corpus corpus = load(argv[1]);
+        cout << fixed << setprecision(1);
+        cout << corpus.frames.size() << " packets\n";
+
+        run("Ethernet", corpus.frames, [](const Buffer &buffer) {
+            NetParser p{buffer};
+            EthernetHeader header;
+            return header.parse(p) == ParseResult::NoError;
+        });
+        run("IPv4", corpus.ip, [](const Buffer &buffer) {
+            NetParser p{buffer};
+            IPv4Header header;
+            return header.parse(p) == ParseResult::NoError;
+        });
+        run("TCP", corpus.tcp, [](const Buffer &buffer) {
+            NetParser p{buffer};
+            TCPHeader header;
+            return header.parse(p) == ParseResult::NoError;
+        });
+        run("ARP", corpus.arp, [](const Buffer &buffer) {
+            ARPMessage message;
+            return message.parse(buffer) == ParseResult::NoError;
+        });
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
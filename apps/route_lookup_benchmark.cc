@@ -0,0 +1,288 @@
+#include "route_cache.hh"
+#include "route_table.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t lookups_per_run = 1 << 24;
+unsigned int work_steps = 0;
+
+//! A synthetic full table: prefix lengths drawn from roughly the mix of today's IPv4 BGP table
+//! (mostly /24, then /22, /23 and so on), with prefixes scattered over the unicast space
+vector<pair<uint32_t, uint8_t>> make_table(const size_t count, mt19937 &rd) {
+    // weights, in percent, for lengths 8..32 (the few routes longer than /24 exercise the second level)
+    const vector<double> weights{0.0002, 0.0002, 0.0007, 0.003, 0.01, 0.02, 0.05, 0.1, 1.4,
+                                 0.5,    0.9,    2.7,    3.5,   5,    13,   11,   60,  0.2,
+                                 0.1,    0.05,   0.05,   0.03,  0.03, 0.02, 0.02};
+    discrete_distribution<int> length_dist(weights.begin(), weights.end());
+    uniform_int_distribution<uint32_t> address_dist{0x01000000, 0xdfffffff};
+
+    // distinct prefixes, so that withdrawing one always removes a route
+    set<pair<uint32_t, uint8_t>> seen;
+    vector<pair<uint32_t, uint8_t>> ret;
+    ret.reserve(count);
+    while (ret.size() < count) {
+        const uint8_t prefix_length = 8 + length_dist(rd);
+        const pair<uint32_t, uint8_t> prefix{address_dist(rd) & (UINT32_MAX << (32 - prefix_length)), prefix_length};
+        if (seen.insert(prefix).second) {
+            ret.push_back(prefix);
+        }
+    }
+    return ret;
+}
+
+//! The table Router used to keep: one std::map probe per prefix length, longest first
+class MapTable {
+    map<pair<uint32_t, uint8_t>, RouteTable::NextHop> _routes{};
+
+  public:
+    void add(const uint32_t prefix, const uint8_t prefix_length, const RouteTable::NextHop &next_hop) {
+        _routes.emplace(pair{prefix, prefix_length}, next_hop);
+    }
+
+    const RouteTable::NextHop *lookup(const uint32_t destination) const {
+        for (int prefix_length = 32; prefix_length >= 0; prefix_length--) {
+            const uint32_t mask = prefix_length == 0 ? 0 : UINT32_MAX << (32 - prefix_length);
+            const auto it = _routes.find({destination & mask, prefix_length});
+            if (it != _routes.end()) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+//! RouteTable behind a RouteCache, as Router looks destinations up
+class CachedTable {
+    const RouteTable &_table;
+    mutable RouteCache _cache;
+
+  public:
+    CachedTable(const RouteTable &table, const size_t entries) : _table(table), _cache(entries) {}
+
+    const RouteTable::NextHop *lookup(const uint32_t destination) const {
+        _cache.sync(_table.generation());
+        RouteTable::Match match;
+        if (not _cache.find(destination, match)) {
+            match = _table.match(destination);
+            _cache.insert(destination, match);
+        }
+        return _table.next_hop(match, 0);
+    }
+
+    const RouteCache &cache() const { return _cache; }
+};
+
+//! Print the rate of `count` lookups that took `duration` ns
+void report(const string &name, const size_t count, const int64_t duration, const size_t found) {
+    cout << setw(28) << name << ": " << setw(8) << 1000.0 * count / double(duration)
+         << " M lookups/s  " << setw(7) << double(duration) / count << " ns/lookup  (" << found << ")\n";
+}
+
+//! Stands in for the rest of a router's work on one datagram (a chain of dependent operations that
+//! fills the processor's out-of-order window, as parsing and sending a datagram does)
+size_t other_work(size_t state) {
+    for (unsigned int i = 0; i < work_steps; i++) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+    }
+    return state;
+}
+
+//! Look up every destination, one at a time, and report the rate
+template <typename Table>
+void run(const string &name, const Table &table, const vector<uint32_t> &destinations) {
+    size_t found = 0;
+    const auto first_time = steady_clock::now();
+    for (const uint32_t destination : destinations) {
+        const RouteTable::NextHop *const hop = table.lookup(destination);
+        found += hop == nullptr ? 0 : hop->interface_num + 1;
+        found = other_work(found);
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    report(name, destinations.size(), duration, found);
+}
+
+//! Look up the destinations `batch_size` at a time, as Router does, and report the rate
+void run_batched(const string &name,
+                 const RouteTable &table,
+                 const vector<uint32_t> &destinations,
+                 const size_t batch_size) {
+    vector<const RouteTable::NextHop *> hops(batch_size);
+    size_t found = 0;
+    const auto first_time = steady_clock::now();
+    for (size_t first = 0; first < destinations.size(); first += batch_size) {
+        const size_t count = min(batch_size, destinations.size() - first);
+        table.lookup(destinations.data() + first, hops.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            found += hops[i] == nullptr ? 0 : hops[i]->interface_num + 1;
+            found = other_work(found);
+        }
+    }
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+    report(name, destinations.size(), duration, found);
+}
+
+//! \brief Forward on another thread (looking up `destinations` in batches, as fast as it can) for a
+//! second, while this thread withdraws and re-announces table prefixes at `updates_per_second`
+void run_with_updates(RouteTable &table,
+                      const vector<uint32_t> &destinations,
+                      const vector<pair<uint32_t, uint8_t>> &prefixes,
+                      const RouteTable::NextHop &hop,
+                      const size_t updates_per_second) {
+    atomic<bool> done{false};
+    size_t looked_up = 0;
+    thread forwarder([&] {
+        RCUDomain::Reader reader{table.rcu()};
+        array<const RouteTable::NextHop *, RouteTable::BATCH_SIZE> hops{};
+        for (size_t first = 0; not done; first = (first + hops.size()) % destinations.size()) {
+            table.lookup(destinations.data() + first, hops.data(), hops.size());
+            reader.quiescent();
+            looked_up += hops.size();
+        }
+    });
+
+    // every millisecond, withdraw a few prefixes (in bulk) and re-announce those withdrawn the time before
+    constexpr auto tick = milliseconds{1};
+    const size_t per_tick = updates_per_second / 2000;
+    vector<pair<uint32_t, uint8_t>> withdrawn;
+    vector<RouteTable::Route> announced;
+    size_t window = 0;
+    size_t updates = 0;
+    int64_t longest = 0;
+    const auto first_time = steady_clock::now();
+    for (auto next_tick = first_time; next_tick < first_time + seconds{1}; next_tick += tick) {
+        this_thread::sleep_until(next_tick);
+        if (per_tick == 0) {
+            continue;
+        }
+        announced.clear();
+        for (const auto &[prefix, prefix_length] : withdrawn) {
+            announced.push_back({prefix, prefix_length, hop});
+        }
+        // the window moves on by exactly its size, so no prefix is withdrawn twice or re-announced early
+        withdrawn.clear();
+        for (size_t i = 0; i < per_tick; i++) {
+            withdrawn.push_back(prefixes.at((window + i) % prefixes.size()));
+        }
+        window = (window + per_tick) % prefixes.size();
+
+        const auto update_time = steady_clock::now();
+        table.remove(withdrawn);
+        table.add(announced);
+        longest = max<int64_t>(longest, duration_cast<microseconds>(steady_clock::now() - update_time).count());
+        updates += withdrawn.size() + announced.size();
+    }
+    done = true;
+    forwarder.join();
+    const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+
+    cout << setw(8) << updates * 1e9 / double(duration) << " updates/s (longest batch " << setw(4) << longest
+         << " µs): forwarding at " << setw(6) << 1000.0 * looked_up / double(duration) << " M lookups/s\n";
+
+    // leave the table whole for the next run
+    announced.clear();
+    for (const auto &[prefix, prefix_length] : withdrawn) {
+        announced.push_back({prefix, prefix_length, hop});
+    }
+    table.add(announced);
+}
+
+//! \brief Measure longest-prefix-match lookups in a synthetic table the size of the IPv4 BGP table
+//! \details Destinations are drawn both uniformly over the address space (where most match only the
+//! default route) and from inside the table's prefixes, and mostly from a few thousand hot destinations
+//! (to compare the table with and without a RouteCache in front). The old per-length std::map search runs on a
+//! smaller sample of the same destinations, for comparison. With a second argument, each lookup is
+//! followed by that many steps of other, dependent work: without it, a processor overlaps the cache
+//! misses of consecutive lookups by itself, and batching has little left to hide. Finally, one thread
+//! forwards while another applies route updates, at several rates.
+int main(int argc, char *argv[]) {
+    try {
+        if (argc > 3) {
+            cerr << "Usage: " << argv[0] << " [prefixes] [work per datagram]\n";
+            return EXIT_FAILURE;
+        }
+        const size_t count = argc > 1 ? stoul(argv[1]) : 900'000;
+        work_steps = argc > 2 ? stoul(argv[2]) : 0;
+
+        auto rd = get_random_generator();
+        const auto prefixes = make_table(count, rd);
+        uniform_int_distribution<size_t> hop_dist{0, 63};
+        vector<RouteTable::NextHop> hops;
+        for (size_t i = 0; i < 64; i++) {
+            hops.push_back({i % 8, Address::from_ipv4_numeric(0x0a000001 + i)});
+        }
+
+        RouteTable table;
+        const auto first_time = steady_clock::now();
+        table.add(0, 0, hops.front());
+        for (const auto &[prefix, prefix_length] : prefixes) {
+            table.add(prefix, prefix_length, hops.at(hop_dist(rd)));
+        }
+        const auto duration = duration_cast<milliseconds>(steady_clock::now() - first_time).count();
+        cout << fixed << setprecision(2) << "RouteTable: " << table.size() << " routes added in " << duration
+             << " ms\n";
+
+        MapTable map_table;
+        map_table.add(0, 0, hops.front());
+        for (const auto &[prefix, prefix_length] : prefixes) {
+            map_table.add(prefix, prefix_length, hops.at(hop_dist(rd)));
+        }
+
+        vector<uint32_t> uniform(lookups_per_run);
+        vector<uint32_t> routed(lookups_per_run);
+        vector<uint32_t> hot(lookups_per_run);
+        uniform_int_distribution<uint32_t> address_dist;
+        uniform_int_distribution<size_t> prefix_dist{0, prefixes.size() - 1};
+        for (size_t i = 0; i < lookups_per_run; i++) {
+            uniform.at(i) = address_dist(rd);
+            const auto &[prefix, prefix_length] = prefixes.at(prefix_dist(rd));
+            routed.at(i) = prefix | (address_dist(rd) & ~(UINT32_MAX << (32 - prefix_length)));
+        }
+        // 90% of lookups go to 3000 hot destinations, the rest anywhere in the table
+        uniform_int_distribution<size_t> hot_dist{0, 2999};
+        for (size_t i = 0; i < lookups_per_run; i++) {
+            hot.at(i) = address_dist(rd) % 10 == 0 ? routed.at(i) : routed.at(hot_dist(rd));
+        }
+
+        run("RouteTable, uniform", table, uniform);
+        run("RouteTable, routed", table, routed);
+        for (const size_t batch_size : {16, 32, 64}) {
+            run_batched("batches of " + to_string(batch_size) + ", uniform", table, uniform, batch_size);
+            run_batched("batches of " + to_string(batch_size) + ", routed", table, routed, batch_size);
+        }
+        run("RouteTable, hot", table, hot);
+        for (const auto &[name, destinations] : {pair{"hot", &hot}, pair{"routed", &routed}}) {
+            const CachedTable cached{table, 4096};
+            run("with route cache, " + string(name), cached, *destinations);
+            cout << setw(30) << "" << 100.0 * cached.cache().hits() / destinations->size() << "% hits\n";
+        }
+        run("std::map, uniform", map_table, vector<uint32_t>(uniform.begin(), uniform.begin() + (1 << 20)));
+        run("std::map, routed", map_table, vector<uint32_t>(routed.begin(), routed.begin() + (1 << 20)));
+
+        for (const size_t updates_per_second : {0, 10'000, 100'000}) {
+            run_with_updates(table, routed, prefixes, hops.front(), updates_per_second);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
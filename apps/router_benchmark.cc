@@ -0,0 +1,184 @@
+#include "router.hh"
+#include "util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+auto rd = get_random_generator();
+
+EthernetAddress random_ethernet_address() {
+    EthernetAddress addr;
+    for (auto &byte : addr) {
+        byte = rd();
+    }
+    addr.at(0) |= 0x02;  // private
+    addr.at(0) &= 0xfe;  // unicast
+    return addr;
+}
+
+uint32_t ip(const string &str) { return Address{str}.ipv4_numeric(); }
+
+//! A host (or next-hop router) on one of the router's networks, as in the network_simulator topology
+struct Site {
+    Address address;  //!< The host's own address
+    Address gateway;  //!< The router's address on the host's network
+    Address sink;     //!< A destination that the router forwards to this host
+};
+
+//! network_simulator's router and hosts (with a host added on eth1 and one on mit5, so that every
+//! interface carries traffic)
+const vector<Site> sites{
+    {Address{"171.67.76.1"}, Address{"171.67.76.46"}, Address{"1.2.3.4"}},            // default_router
+    {Address{"10.0.0.2"}, Address{"10.0.0.1"}, Address{"10.0.0.2"}},                  // applesauce (eth0)
+    {Address{"172.16.0.2"}, Address{"172.16.0.1"}, Address{"172.16.0.2"}},            // eth1
+    {Address{"192.168.0.2"}, Address{"192.168.0.1"}, Address{"192.168.0.2"}},         // cherrypie (eth2)
+    {Address{"198.178.229.42"}, Address{"198.178.229.1"}, Address{"198.178.229.42"}},  // dm42 (uun3)
+    {Address{"143.195.0.1"}, Address{"143.195.0.2"}, Address{"143.195.131.17"}},      // hs_router (hs4)
+    {Address{"128.30.0.1"}, Address{"128.30.76.255"}, Address{"128.30.5.5"}},         // mit5
+};
+
+void add_routes(Router &router) {
+    router.add_route(ip("0.0.0.0"), 0, sites[0].address, 0);
+    router.add_route(ip("10.0.0.0"), 8, {}, 1);
+    router.add_route(ip("172.16.0.0"), 16, {}, 2);
+    router.add_route(ip("192.168.0.0"), 24, {}, 3);
+    router.add_route(ip("198.178.229.0"), 24, {}, 4);
+    router.add_route(ip("143.195.0.0"), 17, sites[5].address, 5);
+    router.add_route(ip("143.195.128.0"), 18, sites[5].address, 5);
+    router.add_route(ip("143.195.192.0"), 19, sites[5].address, 5);
+    router.add_route(ip("128.30.76.255"), 16, sites[6].address, 6);
+}
+
+//! Each host's thread sends to every other host in turn, as fast as the router takes its frames,
+//! and counts the datagrams it receives
+void run_host(Router &router, const size_t n, const atomic<bool> &done, atomic<uint64_t> &received) {
+    const Site &site = sites[n];
+    NetworkInterface interface{random_ethernet_address(), site.address};
+    auto &frames = interface.frames_out();
+    const string payload(512, 'x');
+    unsigned int seq = 0;
+    uint64_t count = 0;
+
+    const auto send = [&] {
+        InternetDatagram dgram;
+        dgram.header().src = site.address.ipv4_numeric();
+        dgram.header().dst = sites[(n + 1 + seq++ % (sites.size() - 1)) % sites.size()].sink.ipv4_numeric();
+        dgram.payload() = string(payload);
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        dgram.header().ttl = 64;
+        interface.send_datagram(dgram, site.gateway);
+    };
+
+    // frames cross the "wire" as one buffer each
+    const auto exchange = [&] {
+        while (not frames.empty()) {
+            frames.front().payload() = frames.front().payload().concatenate();
+            if (not router.push_frame(n, move(frames.front()))) {
+                break;
+            }
+            frames.pop();
+        }
+        bool idle = true;
+        while (auto frame = router.pop_frame(n)) {
+            frame->payload() = frame->payload().concatenate();
+            if (interface.recv_frame(frame.value()).has_value()) {
+                count++;
+            }
+            idle = false;
+        }
+        received.store(count, memory_order_relaxed);
+        if (idle) {
+            this_thread::yield();
+        }
+    };
+
+    // learn the router's Ethernet address before sending in earnest (rather than queue datagrams for it)
+    send();
+    while (not done.load(memory_order_relaxed) and
+           (frames.empty() or frames.back().header().type != EthernetHeader::TYPE_IPv4)) {
+        exchange();
+    }
+
+    while (not done.load(memory_order_relaxed)) {
+        // keep a few frames ready, so that the router's inbound queue never runs dry
+        while (frames.size() < 64) {
+            send();
+        }
+        exchange();
+    }
+}
+
+//! Forward between the hosts with `workers` worker threads, and report the rate over `duration`
+void run(const size_t workers, const milliseconds duration) {
+    Router router;
+    for (const auto &site : sites) {
+        router.add_interface({random_ethernet_address(), site.gateway});
+    }
+    add_routes(router);
+    router.start(workers);
+
+    atomic<bool> done{false};
+    vector<unique_ptr<atomic<uint64_t>>> received;
+    vector<thread> hosts;
+    for (size_t n = 0; n < sites.size(); n++) {
+        received.push_back(make_unique<atomic<uint64_t>>(0));
+        hosts.emplace_back(run_host, ref(router), n, cref(done), ref(*received.back()));
+    }
+    const auto total = [&] {
+        uint64_t sum = 0;
+        for (const auto &r : received) {
+            sum += r->load(memory_order_relaxed);
+        }
+        return sum;
+    };
+
+    // let ARP settle before measuring
+    this_thread::sleep_for(milliseconds{200});
+    const uint64_t first_received = total(), first_dropped = router.dropped();
+    const auto first_time = steady_clock::now();
+    this_thread::sleep_for(duration);
+    const uint64_t delivered = total() - first_received, dropped = router.dropped() - first_dropped;
+    const auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+
+    done = true;
+    for (auto &host : hosts) {
+        host.join();
+    }
+    router.stop();
+
+    cout << setw(2) << workers << " workers: " << setw(8) << fixed << setprecision(3)
+         << 1000.0 * delivered / double(elapsed) << " M datagrams/s delivered, " << setw(10) << dropped
+         << " dropped between workers\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc > 2) {
+            cerr << "Usage: " << argv[0] << " [milliseconds per run]\n";
+            return EXIT_FAILURE;
+        }
+        const milliseconds duration{argc > 1 ? stoul(argv[1]) : 1000};
+
+        cout << sites.size() << " interfaces, one host thread each, on " << thread::hardware_concurrency()
+             << " CPUs\n";
+        for (const size_t workers : {1, 2, 4, 7}) {
+            run(workers, duration);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
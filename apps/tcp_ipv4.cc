@@ -32,7 +32,9 @@ static void show_usage(const char *argv0, const char *msg) {
 
          << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
-         << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
+         << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n"
+         << "   -u              Move datagrams through io_uring                 (poll + read/write)\n"
+         << "   -o              Offload checksums and segmentation (vnet hdr)   (computed here)\n\n"
 
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
          << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
@@ -52,10 +54,12 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, bool, char *, IOEngine, bool> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
     char *tundev = nullptr;
+    IOEngine engine = IOEngine::Poll;
+    bool offload = false;
 
     int curr = 1;
     bool listen = false;
@@ -93,6 +97,14 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
             tundev = argv[curr + 1];
             curr += 2;
 
+        } else if (strncmp("-u", argv[curr], 3) == 0) {
+            engine = IOEngine::IOUring;
+            curr += 1;
+
+        } else if (strncmp("-o", argv[curr], 3) == 0) {
+            offload = true;
+            curr += 1;
+
         } else if (strncmp("-Lu", argv[curr], 3) == 0) {
             check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
             float lossrate = strtof(argv[curr + 1], nullptr);
@@ -131,7 +143,7 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
         c_filt.source = {source_address, source_port};
     }
 
-    return make_tuple(c_fsm, c_filt, listen, tundev);
+    return make_tuple(c_fsm, c_filt, listen, tundev, engine, offload);
 }
 
 int main(int argc, char **argv) {
@@ -141,9 +153,9 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
 
-        auto [c_fsm, c_filt, listen, tun_dev_name] = get_config(argc, argv);
-        LossyTCPOverIPv4SpongeSocket tcp_socket(LossyTCPOverIPv4OverTunFdAdapter(
-            TCPOverIPv4OverTunFdAdapter(TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name))));
+        auto [c_fsm, c_filt, listen, tun_dev_name, engine, offload] = get_config(argc, argv);
+        LossyTCPOverIPv4SpongeSocket tcp_socket(LossyTCPOverIPv4OverTunFdAdapter(TCPOverIPv4OverTunFdAdapter(
+            TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name, false, offload), engine)));
 
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
@@ -28,6 +28,8 @@ static void show_usage(const char *argv0, const char *msg) {
 
          << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
+         << "   -g              Use UDP segmentation/receive offload            (off)\n\n"
+
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
          << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
 
@@ -46,12 +48,13 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, bool, bool> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
 
     int curr = 1;
     bool listen = false;
+    bool offload = false;
 
     while (argc - curr > 2) {
         if (strncmp("-l", argv[curr], 3) == 0) {
@@ -68,6 +71,10 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
             c_fsm.rt_timeout = strtol(argv[curr + 1], nullptr, 0);
             curr += 2;
 
+        } else if (strncmp("-g", argv[curr], 3) == 0) {
+            offload = true;
+            curr += 1;
+
         } else if (strncmp("-Lu", argv[curr], 3) == 0) {
             check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
             float lossrate = strtof(argv[curr + 1], nullptr);
@@ -100,7 +107,7 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
         c_filt.destination = {argv[argc - 2], argv[argc - 1]};
     }
 
-    return make_tuple(c_fsm, c_filt, listen);
+    return make_tuple(c_fsm, c_filt, listen, offload);
 }
 
 int main(int argc, char **argv) {
@@ -111,14 +118,15 @@ int main(int argc, char **argv) {
         }
 
         // handle configuration and UDP setup from cmdline arguments
-        auto [c_fsm, c_filt, listen] = get_config(argc, argv);
+        auto [c_fsm, c_filt, listen, offload] = get_config(argc, argv);
 
         // build a TCP FSM on top of the UDP socket
         UDPSocket udp_sock;
         if (listen) {
             udp_sock.bind(c_filt.source);
         }
-        LossyTCPOverUDPSpongeSocket tcp_socket(LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock))));
+        LossyTCPOverUDPSpongeSocket tcp_socket(
+            LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock), offload)));
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
         } else {
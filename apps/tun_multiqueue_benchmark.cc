@@ -0,0 +1,109 @@
+#include "socket.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+#include "tun.hh"
+#include "tun_steering.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t bytes_per_connection = 4 * 1024 * 1024;
+constexpr uint16_t first_source_port = 40000;
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " <tundev> <device address> <stack address> [queues]\n\n"
+         << "Runs one TCPSpongeSocket per queue of the multi-queue TUN device <tundev>, each in its own thread,\n"
+         << "with a TunSteering reading every queue and handing each connection its own segments,\n"
+         << "sending to a Linux TCP server listening on <device address> (the device's own address).\n"
+         << "<stack address> is the source address of the CS144 connections (on the device's subnet).\n\n"
+         << "Create the device with:\n"
+         << "    ip tuntap add mode tun multi_queue user `username` name <tundev>\n";
+}
+
+//! Accept one connection per queue and count what arrives until every sender is done
+static void run_server(TCPSocket &listener, const size_t connections, atomic<size_t> &bytes_received) {
+    vector<thread> readers;
+    for (size_t i = 0; i < connections; i++) {
+        readers.emplace_back([&, connection = listener.accept()]() mutable {
+            while (not connection.eof()) {
+                bytes_received += connection.read().size();
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+}
+
+//! One worker: a CS144 TCP connection on its own shard (and queue) of the device
+static void run_client(TunSteering &steering, const size_t shard, const FdAdapterConfig &c_ad) {
+    TCPOverIPv4OverSteeredTunSpongeSocket sock(TCPOverIPv4OverSteeredTunAdapter(steering, shard));
+    sock.connect(TCPConfig{}, c_ad);
+
+    const string chunk(65536, 'x');
+    for (size_t sent = 0; sent < bytes_per_connection; sent += chunk.size()) {
+        sock.write(chunk);
+    }
+    sock.wait_until_closed();
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc < 4 or argc > 5) {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        const string tundev = argv[1];
+        const size_t queue_count = argc == 5 ? stoul(argv[4]) : 4;
+
+        TCPSocket listener;
+        listener.set_reuseaddr();
+        listener.bind(Address(argv[2], 0));
+        listener.listen();
+        const Address server_address = listener.local_address();
+
+        TunSteering steering{open_queues<TunFD>(tundev, queue_count)};
+        atomic<size_t> bytes_received{0};
+
+        const auto first_time = steady_clock::now();
+
+        thread server([&] { run_server(listener, queue_count, bytes_received); });
+        vector<thread> workers;
+        for (size_t i = 0; i < queue_count; i++) {
+            FdAdapterConfig c_ad{};
+            c_ad.source = {argv[3], to_string(first_source_port + i)};
+            c_ad.destination = server_address;
+            workers.emplace_back(run_client, ref(steering), i, c_ad);
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        server.join();
+
+        const auto duration = duration_cast<nanoseconds>(steady_clock::now() - first_time).count();
+        if (bytes_received != queue_count * bytes_per_connection) {
+            throw runtime_error("received " + to_string(bytes_received) + " bytes, expected " +
+                                to_string(queue_count * bytes_per_connection));
+        }
+
+        cout << fixed << setprecision(2);
+        cout << queue_count << " queue" << (queue_count == 1 ? "" : "s") << ": " << bytes_received * 8e3 / duration
+             << " Mbit/s aggregate, " << steering.dropped() << " datagrams not steered\n";
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -7,6 +7,23 @@ add_test(NAME t_wrapping_ints_unwrap      COMMAND wrapping_integers_unwrap)
 add_test(NAME t_wrapping_ints_wrap        COMMAND wrapping_integers_wrap)
 add_test(NAME t_wrapping_ints_roundtrip   COMMAND wrapping_integers_roundtrip)
 
+add_test(NAME t_checksum_fuzz        COMMAND checksum_fuzz)
+add_test(NAME t_serialize_into       COMMAND serialize_into)
+add_test(NAME t_packet_pool          COMMAND packet_pool)
+add_test(NAME t_buffer_list          COMMAND buffer_list)
+add_test(NAME t_packet_ring          COMMAND packet_ring)
+add_test(NAME t_packet_socket        COMMAND packet_socket)
+set_tests_properties(t_packet_socket PROPERTIES SKIP_RETURN_CODE 77)
+add_test(NAME t_io_uring_engine      COMMAND io_uring_engine)
+set_tests_properties(t_io_uring_engine PROPERTIES SKIP_RETURN_CODE 77)
+add_test(NAME t_mmsg_batch           COMMAND udp_batch)
+add_test(NAME t_tun_steering         COMMAND tun_steering)
+set_tests_properties(t_tun_steering PROPERTIES SKIP_RETURN_CODE 77)
+add_test(NAME t_tso_coalescing       COMMAND tso_coalescing)
+add_test(NAME t_fd_write             COMMAND fd_write)
+add_test(NAME t_tun_mtu              COMMAND tun_mtu)
+set_tests_properties(t_tun_mtu PROPERTIES SKIP_RETURN_CODE 77)
+
 add_test(NAME t_recv_connect         COMMAND recv_connect)
 add_test(NAME t_recv_transmit        COMMAND recv_transmit)
 add_test(NAME t_recv_window          COMMAND recv_window)
@@ -41,7 +58,10 @@ add_test(NAME t_webget               COMMAND "${PROJECT_SOURCE_DIR}/tests/webget
 
 add_test(NAME arp_network_interface    COMMAND net_interface)
 
-add_test(NAME router_test    COMMAND network_simulator)
+add_test(NAME router_test       COMMAND network_simulator)
+add_test(NAME t_route_table     COMMAND route_table)
+add_test(NAME t_router_workers  COMMAND router_workers)
+add_test(NAME t_fragments       COMMAND ipv4_fragments)
 
 add_test(NAME t_tcp_parser           COMMAND tcp_parser "${PROJECT_SOURCE_DIR}/tests/ipv4_parser.data")
 add_test(NAME t_ipv4_parser          COMMAND ipv4_parser "${PROJECT_SOURCE_DIR}/tests/ipv4_parser.data")
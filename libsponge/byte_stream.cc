@@ -39,6 +39,15 @@ std::string ByteStream::read(const size_t len) {
     return ans;
 }
 
+//! \param[in] len bytes will be popped and returned
+//! \param[in,out] check is the checksum to which the bytes are added
+//! \returns a Buffer
+Buffer ByteStream::read(const size_t len, InternetChecksum &check) {
+    auto ans = rb_.peek_front_n(len, check);
+    pop_output(len);
+    return ans;
+}
+
 void ByteStream::end_input() { eof_input_ = true; }
 
 bool ByteStream::input_ended() const { return eof_input_; }
@@ -1,6 +1,9 @@
 #ifndef SPONGE_LIBSPONGE_BYTE_STREAM_HH
 #define SPONGE_LIBSPONGE_BYTE_STREAM_HH
 
+#include "buffer.hh"
+#include "util.hh"
+
 #include <cstddef>
 #include <string>
 #include <vector>
@@ -40,6 +43,19 @@ class ByteStream {
             return s;
         }
 
+        // copied straight into the packet's storage, which (unlike a std::string) needn't be zeroed first
+        Buffer peek_front_n(const size_t length, InternetChecksum &check) const {
+            if (length == 0) {
+                return {};
+            }
+            const size_t len_to_end = std::min(length, capacity_ - front_);
+            PacketBuffer payload{length};
+            char *const out = payload.prepend(length);
+            check.copy_and_checksum({queue.data() + front_, len_to_end}, out);
+            check.copy_and_checksum({queue.data(), length - len_to_end}, out + len_to_end);
+            return payload.release();
+        }
+
         bool empty() const { return !size_; }
 
         bool full() const { return size_ == capacity_; }
@@ -89,6 +105,10 @@ class ByteStream {
     //! \returns a string
     std::string read(const size_t len);
 
+    //! Read the next "len" bytes of the stream, adding them to `check` as they are copied
+    //! \returns a Buffer
+    Buffer read(const size_t len, InternetChecksum &check);
+
     //! \returns `true` if the stream input has ended
     bool input_ended() const;
 
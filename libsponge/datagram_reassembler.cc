@@ -0,0 +1,155 @@
+#include "datagram_reassembler.hh"
+
+#include <iterator>
+
+using namespace std;
+
+//! Largest IPv4 datagram, in bytes
+static constexpr size_t MAX_DATAGRAM = 65535;
+
+DatagramReassembler::DatagramReassembler(const size_t capacity, const size_t timeout)
+    : capacity_(capacity), timeout_(timeout) {}
+
+void DatagramReassembler::discard(const Key &key) {
+    const auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        return;
+    }
+    held_ -= it->second.charge;
+    pending_.erase(it);
+    discarded_++;
+}
+
+bool DatagramReassembler::discard_oldest(const Key &keep) {
+    for (auto it = arrivals_.begin(); it != arrivals_.end(); ++it) {
+        const auto entry = pending_.find(it->second);
+        if (entry == pending_.end() or entry->second.serial != it->first) {
+            continue;
+        }
+        if (it->second == keep) {
+            continue;
+        }
+        discard(it->second);
+        arrivals_.erase(it);
+        return true;
+    }
+    return false;
+}
+
+//! \param[in] dgram the datagram received (with its checksum verified)
+optional<IPv4Datagram> DatagramReassembler::push(IPv4Datagram &&dgram) {
+    const IPv4Header &header = dgram.header();
+    if (header.offset == 0 and not header.mf) {
+        return move(dgram);
+    }
+
+    const Key key{header.src, header.dst, header.proto, header.id};
+    const size_t start = 8 * size_t{header.offset};
+    string payload = dgram.payload().concatenate();
+    const size_t end = start + payload.size();
+
+    // a fragment that cannot be part of any datagram condemns the others of its datagram too
+    if ((header.mf and payload.size() % 8 != 0) or payload.empty() or
+        end + 4 * size_t{header.hlen} > MAX_DATAGRAM) {
+        discard(key);
+        return nullopt;
+    }
+
+    forget_stale();
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        Reassembly reassembly;
+        reassembly.serial = next_serial_++;
+        reassembly.deadline = time_ + timeout_;
+        it = pending_.emplace(key, move(reassembly)).first;
+        arrivals_.emplace_back(it->second.serial, key);
+    }
+    Reassembly &reassembly = it->second;
+
+    // so does one that disagrees with the others about where the datagram ends
+    const auto &pieces = reassembly.pieces;
+    const bool past_end =
+        reassembly.total.has_value() and (end > *reassembly.total or (not header.mf and end != *reassembly.total));
+    const bool before_end =
+        not header.mf and not pieces.empty() and prev(pieces.end())->first + prev(pieces.end())->second.size() > end;
+    if (past_end or before_end) {
+        discard(key);
+        return nullopt;
+    }
+
+    // and so does one that overlaps another, unless it duplicates it
+    const auto same = pieces.find(start);
+    if (same != pieces.end() and same->second == payload) {
+        return nullopt;
+    }
+    const auto next = pieces.lower_bound(start);
+    const bool overlaps_next = next != pieces.end() and next->first < end;
+    const bool overlaps_prev = next != pieces.begin() and prev(next)->first + prev(next)->second.size() > start;
+    if (overlaps_next or overlaps_prev) {
+        discard(key);
+        return nullopt;
+    }
+
+    // make room, oldest datagrams first
+    const size_t charge = payload.size() + FRAGMENT_OVERHEAD;
+    while (held_ + charge > capacity_ and discard_oldest(key)) {
+    }
+    if (held_ + charge > capacity_) {
+        discard(key);
+        return nullopt;
+    }
+
+    if (start == 0) {
+        reassembly.header = header;
+    }
+    if (not header.mf) {
+        reassembly.total = end;
+    }
+    reassembly.received += payload.size();
+    reassembly.charge += charge;
+    held_ += charge;
+    reassembly.pieces.emplace(start, move(payload));
+
+    // without overlaps, as many bytes as the payload's length cover all of it
+    if (not reassembly.header.has_value() or reassembly.total != reassembly.received) {
+        return nullopt;
+    }
+    IPv4Datagram whole;
+    whole.header() = *reassembly.header;
+    whole.header().mf = false;
+    whole.header().offset = 0;
+    whole.header().len = 4 * whole.header().hlen + *reassembly.total;
+    string data;
+    data.reserve(*reassembly.total);
+    for (const auto &piece : reassembly.pieces) {
+        data += piece.second;
+    }
+    whole.payload() = move(data);
+
+    held_ -= reassembly.charge;
+    pending_.erase(it);
+    return whole;
+}
+
+void DatagramReassembler::forget_stale() {
+    while (not arrivals_.empty()) {
+        const auto &[serial, key] = arrivals_.front();
+        const auto it = pending_.find(key);
+        if (it != pending_.end() and it->second.serial == serial) {
+            return;
+        }
+        arrivals_.pop_front();
+    }
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void DatagramReassembler::tick(const size_t ms_since_last_tick) {
+    time_ += ms_since_last_tick;
+    for (forget_stale(); not arrivals_.empty(); forget_stale()) {
+        const Key key = arrivals_.front().second;
+        if (pending_.at(key).deadline > time_) {
+            break;
+        }
+        discard(key);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef SPONGE_LIBSPONGE_DATAGRAM_REASSEMBLER_HH
+#define SPONGE_LIBSPONGE_DATAGRAM_REASSEMBLER_HH
+
+#include "ipv4_datagram.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+
+//! \brief A class that puts [IPv4 fragments](\ref rfc::rfc791) (possibly out of order, possibly
+//! duplicated) back together into the datagrams they came from, in bounded memory.
+//!
+//! Fragments belong to the same datagram if they agree in source, destination, protocol and
+//! identification. A datagram whose fragments do not all arrive within the timeout is discarded, as is
+//! one whose fragments overlap (other than exact duplicates) or claim a length past 65535 bytes. When
+//! the fragments held would take more than the capacity, the oldest datagrams are discarded to make
+//! room.
+class DatagramReassembler {
+  private:
+    //! <source, destination, protocol, identification>
+    using Key = std::tuple<uint32_t, uint32_t, uint8_t, uint16_t>;
+
+    //! A datagram being put back together
+    struct Reassembly {
+        uint64_t serial = 0;                     //!< Tells it from earlier ones of the same key
+        size_t deadline = 0;                     //!< When it is discarded, in ms
+        std::optional<IPv4Header> header{};      //!< The first fragment's header, once it arrived
+        std::optional<size_t> total{};           //!< The payload's length, once the last fragment arrived
+        std::map<size_t, std::string> pieces{};  //!< Payload offset => the bytes there
+        size_t received = 0;                     //!< Payload bytes held
+        size_t charge = 0;                       //!< Memory charged for it
+    };
+
+    size_t capacity_;
+    size_t timeout_;
+
+    std::map<Key, Reassembly> pending_{};
+    std::deque<std::pair<uint64_t, Key>> arrivals_{};  //!< <serial, key>, oldest first (some long gone)
+    uint64_t next_serial_{0};
+
+    size_t held_{0};         //!< Memory charged for the fragments held
+    size_t time_{0};         //!< ms since construction
+    uint64_t discarded_{0};  //!< Datagrams discarded, ever
+
+    //! Discard the datagram of `key`
+    void discard(const Key &key);
+
+    //! Discard the oldest datagram other than that of `keep`, if there is one
+    bool discard_oldest(const Key &keep);
+
+    //! Drop the arrivals at the front whose datagram is gone
+    void forget_stale();
+
+  public:
+    //! Default capacity, in bytes
+    static constexpr size_t CAPACITY = 256 * 1024;
+
+    //! Default timeout, in ms (as Linux's)
+    static constexpr size_t TIMEOUT = 30'000;
+
+    //! Memory charged for each fragment held, besides its payload, so that tiny fragments do not
+    //! take more memory than the capacity says
+    static constexpr size_t FRAGMENT_OVERHEAD = 64;
+
+    //! \brief Construct a `DatagramReassembler` that holds up to `capacity` bytes of fragments, each
+    //! datagram for up to `timeout` ms
+    DatagramReassembler(const size_t capacity = CAPACITY, const size_t timeout = TIMEOUT);
+
+    //! \brief Take a datagram, which may be a fragment
+    //! \returns the datagram, if it is not a fragment, or the whole datagram, if it is the missing
+    //! fragment of one
+    std::optional<IPv4Datagram> push(IPv4Datagram &&dgram);
+
+    //! \brief Called periodically when time elapses (it discards datagrams whose time is up)
+    void tick(const size_t ms_since_last_tick);
+
+    //! Bytes of memory charged for the fragments held
+    size_t bytes_held() const { return held_; }
+
+    //! Datagrams with fragments held
+    size_t pending() const { return pending_.size(); }
+
+    //! Datagrams discarded (timed out, overlapping, too long or evicted), ever
+    uint64_t discarded() const { return discarded_; }
+};
+
+#endif  // SPONGE_LIBSPONGE_DATAGRAM_REASSEMBLER_HH
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <iostream>
 #include <optional>
+#include <utility>
 
 using namespace std;
 
@@ -64,22 +65,61 @@ void NetworkInterface::send_datagram(const InternetDatagram &dgram, const Addres
     // convert IP address of next hop to raw 32-bit representation (used in ARP header)
     const uint32_t next_hop_ip = next_hop.ipv4_numeric();
 
-    // Send datagram directly if find non-expiring ip->ethernet mapping
-    const auto it = map_.find(next_hop_ip);
-    if (it != map_.end() && ms_since_last_tick_ - it->second.second < IP_TO_ETHERNET_LIMIT) {
-        frames_out_.emplace(generate_ip_frame(it->second.first, dgram));
+    // Send datagram directly if find ip->ethernet mapping (tick() has dropped lapsed ones)
+    const auto it = neighbor_slots_.find(next_hop_ip);
+    if (it != neighbor_slots_.end()) {
+        frames_out_.emplace(generate_ip_frame(neighbors_[it->second].ethernet_address, dgram));
         return;
     }
 
-    // Send ARP if never send it before or expiring
-    const auto already_sent_it = already_sent_arp_.find(next_hop_ip);
-    if (already_sent_it == already_sent_arp_.end() || ms_since_last_tick_ - already_sent_it->second >= ARP_TIME_LIMIT) {
+    // Send ARP unless a request is still awaiting its reply (tick() drops those older than ARP_TIME_LIMIT)
+    if (arp_requests_.emplace(next_hop_ip, ms_since_last_tick_).second) {
         frames_out_.emplace(generate_arp_frame(EMPTY_ADDRESS, next_hop_ip, ARPMessage::OPCODE_REQUEST));
-        already_sent_arp_.emplace(next_hop_ip, ms_since_last_tick_);
+        arp_request_times_.emplace_back(ms_since_last_tick_, next_hop_ip);
     }
 
-    // Buffer the IPv4 datagram
-    buffer_[next_hop_ip].emplace_back(dgram);
+    hold(next_hop_ip, dgram);
+}
+
+void NetworkInterface::hold(const uint32_t next_hop_ip, const InternetDatagram &dgram) {
+    const size_t size = dgram.header().len;
+    const auto it = pending_.try_emplace(next_hop_ip).first;
+    Pending &pending = it->second;
+    const auto fits = [&] {
+        return pending.datagrams.size() < pending_limits_.datagrams_per_neighbor &&
+               pending.bytes + size <= pending_limits_.bytes_per_neighbor &&
+               pending_datagrams_ < pending_limits_.datagrams && pending_bytes_ + size <= pending_limits_.bytes;
+    };
+
+    if (pending_limits_.policy == DropPolicy::Head) {
+        while (!pending.datagrams.empty() && !fits()) {
+            const size_t dropped = pending.datagrams.front().header().len;
+            pending.datagrams.pop_front();
+            pending.bytes -= dropped;
+            pending_datagrams_--;
+            pending_bytes_ -= dropped;
+            pending_overflows_++;
+        }
+    }
+
+    if (!fits()) {
+        pending_overflows_++;
+        if (pending.datagrams.empty()) {
+            pending_.erase(it);
+        }
+        return;
+    }
+
+    pending.datagrams.push_back(dgram);
+    pending.bytes += size;
+    pending_datagrams_++;
+    pending_bytes_ += size;
+}
+
+void NetworkInterface::release(const unordered_map<uint32_t, Pending>::iterator it) {
+    pending_datagrams_ -= it->second.datagrams.size();
+    pending_bytes_ -= it->second.bytes;
+    pending_.erase(it);
 }
 
 //! \param[in] frame the incoming Ethernet frame
@@ -91,21 +131,28 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
 
     if (header.type == EthernetHeader::TYPE_IPv4) {
         IPv4Datagram dgram;
-        if (dgram.parse(frame.payload()) == ParseResult::NoError) {
-            return dgram;
+        if (dgram.parse(frame.payload()) != ParseResult::NoError) {
+            return nullopt;
+        }
+        // a router forwards the fragments of other hosts' datagrams as they are
+        if (dgram.header().dst == ip_address_.ipv4_numeric()) {
+            return reassembler_.push(move(dgram));
         }
+        return dgram;
     } else if (header.type == EthernetHeader::TYPE_ARP) {
         ARPMessage msg;
         if (msg.parse(frame.payload()) == ParseResult::NoError) {
-            map_.emplace(msg.sender_ip_address, pair{msg.sender_ethernet_address, ms_since_last_tick_});
-
-            // Send buffered ipv4 datagram
-            const auto it = buffer_.find(msg.sender_ip_address);
-            if (it != buffer_.end()) {
-                for (const auto &dgram : it->second) {
+            // Every ARP message (request or reply) refreshes the sender's mapping, and answers our request
+            learn(msg.sender_ip_address, msg.sender_ethernet_address);
+            arp_requests_.erase(msg.sender_ip_address);
+
+            // Send the datagrams held for the sender
+            const auto it = pending_.find(msg.sender_ip_address);
+            if (it != pending_.end()) {
+                for (const auto &dgram : it->second.datagrams) {
                     frames_out_.emplace(generate_ip_frame(msg.sender_ethernet_address, dgram));
                 }
-                buffer_.erase(it);
+                release(it);
             }
 
             // If target ip address matches => send a reply
@@ -120,4 +167,79 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
 }
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
-void NetworkInterface::tick(const size_t ms_since_last_tick) { ms_since_last_tick_ += ms_since_last_tick; }
+void NetworkInterface::tick(const size_t ms_since_last_tick) {
+    ms_since_last_tick_ += ms_since_last_tick;
+    reassembler_.tick(ms_since_last_tick);
+
+    // mappings lapse oldest first
+    while (oldest_ != NONE && neighbors_[oldest_].expires <= ms_since_last_tick_) {
+        forget(oldest_);
+    }
+
+    // so do ARP requests (skipping those answered since, or sent again after a reply), and with one
+    // unanswered, the datagrams held for its next hop are dropped
+    while (!arp_request_times_.empty()) {
+        const auto [sent, ip] = arp_request_times_.front();
+        const auto it = arp_requests_.find(ip);
+        if (it != arp_requests_.end() && it->second == sent) {
+            if (sent + ARP_TIME_LIMIT > ms_since_last_tick_) {
+                break;
+            }
+            arp_requests_.erase(it);
+            const auto held = pending_.find(ip);
+            if (held != pending_.end()) {
+                pending_timeouts_ += held->second.datagrams.size();
+                release(held);
+            }
+        }
+        arp_request_times_.pop_front();
+    }
+}
+
+void NetworkInterface::learn(const uint32_t ip_address, const EthernetAddress &ethernet_address) {
+    uint32_t slot = NONE;
+    const auto it = neighbor_slots_.find(ip_address);
+    if (it != neighbor_slots_.end()) {
+        slot = it->second;
+        unlink(slot);
+    } else {
+        if (neighbor_slots_.size() >= MAX_NEIGHBORS) {
+            forget(oldest_);
+        }
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(neighbors_.size());
+            neighbors_.emplace_back();
+        }
+        neighbor_slots_.emplace(ip_address, slot);
+    }
+
+    Neighbor &neighbor = neighbors_[slot];
+    neighbor.ip_address = ip_address;
+    neighbor.ethernet_address = ethernet_address;
+    neighbor.expires = ms_since_last_tick_ + IP_TO_ETHERNET_LIMIT;
+
+    // heard from just now: the newest
+    neighbor.older = newest_;
+    neighbor.newer = NONE;
+    if (newest_ != NONE) {
+        neighbors_[newest_].newer = slot;
+    } else {
+        oldest_ = slot;
+    }
+    newest_ = slot;
+}
+
+void NetworkInterface::unlink(const uint32_t slot) {
+    const Neighbor &neighbor = neighbors_[slot];
+    (neighbor.older != NONE ? neighbors_[neighbor.older].newer : oldest_) = neighbor.newer;
+    (neighbor.newer != NONE ? neighbors_[neighbor.newer].older : newest_) = neighbor.older;
+}
+
+void NetworkInterface::forget(const uint32_t slot) {
+    unlink(slot);
+    neighbor_slots_.erase(neighbors_[slot].ip_address);
+    free_slots_.push_back(slot);
+}
@@ -2,6 +2,7 @@
 #define SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
 
 #include "address.hh"
+#include "datagram_reassembler.hh"
 #include "ethernet_frame.hh"
 #include "ethernet_header.hh"
 #include "ipv4_datagram.hh"
@@ -10,10 +11,12 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <map>
+#include <deque>
 #include <optional>
 #include <queue>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 //! \brief A "network interface" that connects IP (the internet layer, or network layer)
 //! with Ethernet (the network access layer, or link layer).
@@ -37,6 +40,23 @@
 //! request or reply, the network interface processes the frame
 //! and learns or replies as necessary.
 class NetworkInterface {
+  public:
+    //! Which datagram a full pending queue drops
+    enum class DropPolicy {
+        Tail,  //!< The one arriving
+        Head,  //!< The oldest held for the same next hop (then the one arriving, if still not enough)
+    };
+
+    //! \brief Bounds on the datagrams held while their next hop's Ethernet address is unknown
+    //! \details A datagram's size is its total length. Applies to datagrams held from then on.
+    struct PendingLimits {
+        size_t datagrams_per_neighbor = 256;    //!< Most datagrams held for one next hop
+        size_t bytes_per_neighbor = 256 << 10;  //!< Most bytes held for one next hop
+        size_t datagrams = 4096;                //!< Most datagrams held in all
+        size_t bytes = 4 << 20;                 //!< Most bytes held in all
+        DropPolicy policy = DropPolicy::Tail;   //!< Which datagram to drop when one would exceed them
+    };
+
   private:
     //! Ethernet (known as hardware, network-access-layer, or link-layer) address of the interface
     EthernetAddress ethernet_address_;
@@ -47,15 +67,53 @@ class NetworkInterface {
     //! outbound queue of Ethernet frames that the NetworkInterface wants sent
     std::queue<EthernetFrame> frames_out_{};
 
-    //! Store the ip -> (Ethernet Address mappings, ms since last tick)
-    std::unordered_map<uint32_t, std::pair<EthernetAddress, size_t>> map_{};
-
-    //! Remember the ARP request already sent
-    //! IP => ms since last tick
-    std::map<uint32_t, size_t> already_sent_arp_{};
-
-    //! Buffer the incoming IPPacket
-    std::unordered_map<uint32_t, std::vector<IPv4Datagram>> buffer_{};
+    //! A neighbor's Ethernet address, as last heard from it (in an ARP message)
+    struct Neighbor {
+        uint32_t ip_address = 0;
+        EthernetAddress ethernet_address{};
+        size_t expires = 0;     //!< When the mapping lapses
+        uint32_t newer = NONE;  //!< The slot of the neighbor heard from next (NONE if this is the newest)
+        uint32_t older = NONE;  //!< The slot of the neighbor heard from before (NONE if this is the oldest)
+    };
+
+    constexpr static uint32_t NONE = UINT32_MAX;
+
+    //! \brief The neighbor cache: slots, linked from the neighbor heard from longest ago to the newest
+    //! \details Every mapping lasts as long from when it was last heard, so this order is both the LRU
+    //! order, in which a full cache evicts, and the order in which mappings lapse, in which tick()
+    //! expires them: each in O(1).
+    std::vector<Neighbor> neighbors_{};
+    std::unordered_map<uint32_t, uint32_t> neighbor_slots_{};  //!< IP => slot
+    std::vector<uint32_t> free_slots_{};                       //!< Slots of neighbors forgotten
+    uint32_t oldest_{NONE};
+    uint32_t newest_{NONE};
+
+    //! ARP requests awaiting replies: IP => when sent
+    std::unordered_map<uint32_t, size_t> arp_requests_{};
+
+    //! <when sent, IP> of the ARP requests, oldest first (including some answered since)
+    std::deque<std::pair<size_t, uint32_t>> arp_request_times_{};
+
+    //! Datagrams awaiting the Ethernet address of their next hop, oldest first
+    struct Pending {
+        std::deque<IPv4Datagram> datagrams{};
+        size_t bytes = 0;
+    };
+
+    //! Next hop's IP => its pending datagrams (only while it has some)
+    std::unordered_map<uint32_t, Pending> pending_{};
+
+    //! \name Pending datagrams: limits, totals and drops
+    //!@{
+    PendingLimits pending_limits_{};
+    size_t pending_datagrams_{0};
+    size_t pending_bytes_{0};
+    uint64_t pending_overflows_{0};
+    uint64_t pending_timeouts_{0};
+    //!@}
+
+    //! Puts fragments of datagrams addressed to the interface back together
+    DatagramReassembler reassembler_{};
 
     //! time passed
     size_t ms_since_last_tick_{0};
@@ -64,16 +122,38 @@ class NetworkInterface {
     constexpr static size_t IP_TO_ETHERNET_LIMIT{30000};
     constexpr static EthernetAddress EMPTY_ADDRESS = {0, 0, 0, 0, 0, 0};
 
+    //! Remember (or refresh) that `ip_address` is at `ethernet_address`, evicting the oldest mapping if
+    //! the cache is full
+    void learn(const uint32_t ip_address, const EthernetAddress &ethernet_address);
+
+    //! Forget the neighbor in `slot`
+    void forget(const uint32_t slot);
+
+    //! Take the neighbor in `slot` out of the LRU order
+    void unlink(const uint32_t slot);
+
+    //! Hold `dgram` until `next_hop_ip` is resolved, within the pending limits
+    void hold(const uint32_t next_hop_ip, const InternetDatagram &dgram);
+
+    //! Stop holding the datagrams of `it` (sent or dropped)
+    void release(const std::unordered_map<uint32_t, Pending>::iterator it);
+
     EthernetFrame generate_ip_frame(const EthernetAddress &dst, const IPv4Datagram &payload);
     EthernetFrame generate_arp_frame(const EthernetAddress &dst, const uint32_t ip_address, const uint16_t opcode);
 
   public:
+    //! Most neighbors whose Ethernet address the interface remembers
+    constexpr static size_t MAX_NEIGHBORS{1024};
+
     //! \brief Construct a network interface with given Ethernet (network-access-layer) and IP (internet-layer) addresses
     NetworkInterface(const EthernetAddress &ethernet_address, const Address &ip_address);
 
     //! \brief Access queue of Ethernet frames awaiting transmission
     std::queue<EthernetFrame> &frames_out() { return frames_out_; }
 
+    //! \brief The interface's IP address
+    const Address &ip_address() const { return ip_address_; }
+
     //! \brief Sends an IPv4 datagram, encapsulated in an Ethernet frame (if it knows the Ethernet destination address).
 
     //! Will need to use [ARP](\ref rfc::rfc826) to look up the Ethernet destination address for the next hop
@@ -82,13 +162,43 @@ class NetworkInterface {
 
     //! \brief Receives an Ethernet frame and responds appropriately.
 
-    //! If type is IPv4, returns the datagram.
+    //! If type is IPv4, returns the datagram. A fragment of a datagram addressed to the interface is
+    //! held until the rest arrive, and the whole datagram is returned then.
     //! If type is ARP request, learn a mapping from the "sender" fields, and send an ARP reply.
     //! If type is ARP reply, learn a mapping from the "sender" fields.
     std::optional<InternetDatagram> recv_frame(const EthernetFrame &frame);
 
     //! \brief Called periodically when time elapses
     void tick(const size_t ms_since_last_tick);
+
+    //! Milliseconds that have elapsed, as told by tick()
+    size_t time_ms() const { return ms_since_last_tick_; }
+
+    //! \brief Number of neighbors whose Ethernet address the interface remembers
+    size_t neighbors() const { return neighbor_slots_.size(); }
+
+    //! \name Datagrams awaiting ARP resolution
+    //! \brief Held per next hop until its ARP reply arrives, and dropped if its ARP request lapses
+    //! unanswered, or beyond the limits.
+    //!@{
+    const PendingLimits &pending_limits() const { return pending_limits_; }
+    void set_pending_limits(const PendingLimits &limits) { pending_limits_ = limits; }
+
+    //! Datagrams held now
+    size_t pending_datagrams() const { return pending_datagrams_; }
+
+    //! Bytes held now
+    size_t pending_bytes() const { return pending_bytes_; }
+
+    //! Datagrams dropped to keep within the limits, ever
+    uint64_t pending_overflows() const { return pending_overflows_; }
+
+    //! Datagrams dropped as their next hop's ARP request lapsed unanswered, ever
+    uint64_t pending_timeouts() const { return pending_timeouts_; }
+    //!@}
+
+    //! \brief The fragments held for reassembly
+    const DatagramReassembler &reassembler() const { return reassembler_; }
 };
 
 #endif  // SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
@@ -0,0 +1,65 @@
+#include "route_cache.hh"
+
+using namespace std;
+
+RouteCache::RouteCache(const size_t entries) {
+    if (entries == 0) {
+        return;
+    }
+    _set_count = 1;
+    while (_set_count * WAYS < entries) {
+        _set_count *= 2;
+        _set_bits++;
+    }
+    _sets = make_unique<Set[]>(_set_count);
+}
+
+//! \details Fibonacci hashing: the high bits of the product depend on all of the destination's bits, so
+//! the destinations of one subnet spread over all the sets.
+RouteCache::Set &RouteCache::set_of(const uint32_t destination) const {
+    const uint32_t hash = destination * 0x9e3779b1U;
+    return _sets[_set_bits == 0 ? 0 : hash >> (32 - _set_bits)];
+}
+
+void RouteCache::sync(const uint64_t generation) {
+    if (generation == _generation) {
+        return;
+    }
+    _generation = generation;
+    for (size_t i = 0; i < _set_count; i++) {
+        _sets[i].matches.fill(RouteTable::Match{});
+    }
+}
+
+bool RouteCache::find(const uint32_t destination, RouteTable::Match &match) {
+    if (_set_count == 0) {
+        return false;
+    }
+    const Set &set = set_of(destination);
+    for (size_t way = 0; way < WAYS; way++) {
+        if (set.destinations[way] == destination and set.matches[way] != RouteTable::Match{}) {
+            match = set.matches[way];
+            _hits++;
+            return true;
+        }
+    }
+    _misses++;
+    return false;
+}
+
+void RouteCache::insert(const uint32_t destination, const RouteTable::Match match) {
+    if (_set_count == 0) {
+        return;
+    }
+    // a destination that missed several times in a row (before any insert) keeps one way
+    Set &set = set_of(destination);
+    size_t way = 0;
+    while (way < WAYS and set.matches[way] != RouteTable::Match{} and set.destinations[way] != destination) {
+        way++;
+    }
+    if (way == WAYS) {
+        way = _victim++ % WAYS;
+    }
+    set.destinations[way] = destination;
+    set.matches[way] = match;
+}
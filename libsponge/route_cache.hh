@@ -0,0 +1,68 @@
+#ifndef SPONGE_LIBSPONGE_ROUTE_CACHE_HH
+#define SPONGE_LIBSPONGE_ROUTE_CACHE_HH
+
+#include "route_table.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+//! \brief A small cache of destinations' route matches, in front of a RouteTable
+//! \details Four-way set-associative: a destination hashes to one set, whose four destinations and
+//! matches fill half a cache line (and never straddle two), so a hit costs one cache line, and the table
+//! is not consulted. A miss replaces an empty way, or else one chosen round-robin.
+//!
+//! The cache holds matches rather than next hops, so that a route through a multipath group still picks
+//! the member by flow (RouteTable::next_hop()), and changing a group's members leaves it valid. Any other
+//! change to the routes empties it (see sync()). Not thread-safe: each routing thread keeps its own.
+class RouteCache {
+  public:
+    //! Destinations per set
+    static constexpr size_t WAYS = 4;
+
+  private:
+    //! One set: way `i` maps `destinations[i]` to `matches[i]`, unless `matches[i]` is empty
+    struct alignas(32) Set {
+        std::array<uint32_t, WAYS> destinations{};
+        std::array<RouteTable::Match, WAYS> matches{};
+    };
+
+    std::unique_ptr<Set[]> _sets{};
+    size_t _set_count = 0;
+    unsigned int _set_bits = 0;  //!< log2(_set_count)
+    uint64_t _generation = 0;    //!< The table's generation that the cached matches belong to
+    size_t _victim = 0;          //!< The way a miss replaces next, when its set is full
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+
+    //! The set that `destination` belongs to
+    Set &set_of(const uint32_t destination) const;
+
+  public:
+    //! \param[in] entries is the number of destinations to hold (rounded up to a power of two, at least
+    //! WAYS); 0 disables the cache
+    explicit RouteCache(const size_t entries);
+
+    //! Empty the cache, unless `generation` is the table's generation (RouteTable::generation()) that it
+    //! was last synced to, and remember it
+    void sync(const uint64_t generation);
+
+    //! \brief Find the match of `destination`, counting a hit or miss
+    //! \returns `false` if the cache does not hold it
+    bool find(const uint32_t destination, RouteTable::Match &match);
+
+    //! Hold `match` for `destination`, which find() has missed
+    void insert(const uint32_t destination, const RouteTable::Match match);
+
+    //! Number of destinations the cache holds at most
+    size_t entries() const { return _set_count * WAYS; }
+
+    //! Lookups that the cache answered, ever
+    uint64_t hits() const { return _hits; }
+
+    //! Lookups that it did not, ever
+    uint64_t misses() const { return _misses; }
+};
+
+#endif  // SPONGE_LIBSPONGE_ROUTE_CACHE_HH
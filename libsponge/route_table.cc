@@ -0,0 +1,399 @@
+#include "route_table.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <sys/mman.h>
+
+using namespace std;
+
+//! \details Each entry packs, from the top: a 25-bit value, a group flag, and a 6-bit depth. In an
+//! answer, the value is a next hop (1-based, 0 meaning no route but the default), or with its top bit
+//! set a multipath group, and the depth is the length of the route it came from; in a /24 entry with
+//! the flag set, the value is a group number.
+namespace {
+
+constexpr uint32_t DEPTH_MASK = 0x3f;
+constexpr uint32_t GROUP_FLAG = 0x40;
+constexpr unsigned VALUE_SHIFT = 7;
+
+constexpr uint32_t MULTIPATH_FLAG = uint32_t{1} << 24;
+
+constexpr size_t TBL24_SIZE = size_t{1} << 24;
+constexpr size_t GROUP_SIZE = 256;
+
+//! \name Storage that never moves once readers may see it
+//!@{
+constexpr size_t GROUPS_PER_CHUNK = 256;
+constexpr size_t MAX_GROUPS = size_t{1} << 20;
+constexpr size_t NEXT_HOPS_PER_CHUNK = 256;
+constexpr size_t MAX_NEXT_HOPS = size_t{1} << 20;
+constexpr size_t MULTIPATHS_PER_CHUNK = 64;
+constexpr size_t MAX_MULTIPATHS = size_t{1} << 16;
+//!@}
+
+constexpr uint32_t mask(const uint8_t prefix_length) {
+    return prefix_length == 0 ? 0 : UINT32_MAX << (32 - prefix_length);
+}
+
+uint8_t depth(const uint32_t entry) { return entry & DEPTH_MASK; }
+
+//! Entries are read by lookups while an update may be writing them
+uint32_t load(const uint32_t &entry) { return __atomic_load_n(&entry, __ATOMIC_ACQUIRE); }
+
+//! Everything an entry refers to is written before the entry itself
+void store(uint32_t &entry, const uint32_t value) { __atomic_store_n(&entry, value, __ATOMIC_RELEASE); }
+
+}  // namespace
+
+void RouteTable::Unmap::operator()(uint32_t *tbl24) const { ::munmap(tbl24, TBL24_SIZE * sizeof(uint32_t)); }
+
+RouteTable::RouteTable()
+    : _tbl24([] {
+        void *const ret = ::mmap(nullptr,
+                                 TBL24_SIZE * sizeof(uint32_t),
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                 -1,
+                                 0);
+        if (ret == MAP_FAILED) {
+            throw unix_error("mmap route table");
+        }
+        return static_cast<uint32_t *>(ret);
+    }())
+    , _groups(MAX_GROUPS / GROUPS_PER_CHUNK)
+    , _next_hops(MAX_NEXT_HOPS / NEXT_HOPS_PER_CHUNK)
+    , _multipaths(MAX_MULTIPATHS / MULTIPATHS_PER_CHUNK) {}
+
+uint32_t RouteTable::intern(const NextHop &hop) {
+    const auto key = make_pair(hop.interface_num,
+                               hop.address.has_value() ? optional<uint32_t>{hop.address->ipv4_numeric()} : nullopt);
+    const auto it = _hop_ids.find(key);
+    if (it != _hop_ids.end()) {
+        return it->second;
+    }
+    if (_next_hop_count == MAX_NEXT_HOPS) {
+        throw runtime_error("RouteTable: too many distinct next hops");
+    }
+    auto &chunk = _next_hops[_next_hop_count / NEXT_HOPS_PER_CHUNK];
+    if (not chunk) {
+        chunk = make_unique<NextHop[]>(NEXT_HOPS_PER_CHUNK);
+    }
+    chunk[_next_hop_count % NEXT_HOPS_PER_CHUNK] = hop;
+    return _hop_ids[key] = ++_next_hop_count;
+}
+
+RouteTable::Multipath &RouteTable::multipath(const MultipathId id) const {
+    return _multipaths[id / MULTIPATHS_PER_CHUNK][id % MULTIPATHS_PER_CHUNK];
+}
+
+//! \details Shares are apportioned by largest remainder. A bucket keeps its member if the member is
+//! still in the group and has not yet had its share; the buckets left over go round the members that
+//! are short, so that each member's buckets spread over the table.
+void RouteTable::assign(Multipath &paths, const vector<Member> &members) {
+    map<uint32_t, uint64_t> weights;  // next-hop value => weight
+    uint64_t total = 0;
+    for (const auto &member : members) {
+        weights[intern(member.next_hop)] += member.weight;
+        total += member.weight;
+    }
+    if (total == 0) {
+        throw runtime_error("RouteTable: a multipath group needs a member of nonzero weight");
+    }
+
+    map<uint32_t, size_t> shares;
+    vector<pair<uint64_t, uint32_t>> remainders;  // <remainder, next-hop value>
+    size_t assigned = 0;
+    for (const auto &[value, weight] : weights) {
+        shares[value] = weight * MULTIPATH_BUCKETS / total;
+        assigned += shares[value];
+        remainders.emplace_back(weight * MULTIPATH_BUCKETS % total, value);
+    }
+    sort(remainders.begin(), remainders.end(), greater<>());
+    for (size_t i = 0; assigned < MULTIPATH_BUCKETS; i++, assigned++) {
+        shares[remainders[i].second]++;
+    }
+
+    vector<size_t> free_buckets;
+    for (size_t bucket = 0; bucket < MULTIPATH_BUCKETS; bucket++) {
+        const auto it = shares.find(paths.buckets[bucket]);
+        if (it != shares.end() and it->second > 0) {
+            it->second--;
+        } else {
+            free_buckets.push_back(bucket);
+        }
+    }
+
+    auto next = shares.begin();
+    const auto advance = [&] {
+        if (++next == shares.end()) {
+            next = shares.begin();
+        }
+    };
+    for (const size_t bucket : free_buckets) {
+        while (next->second == 0) {
+            advance();
+        }
+        store(paths.buckets[bucket], next->first);
+        next->second--;
+        advance();
+    }
+}
+
+uint32_t *RouteTable::group(const uint32_t number) const {
+    return &_groups[number / GROUPS_PER_CHUNK][number % GROUPS_PER_CHUNK * GROUP_SIZE];
+}
+
+uint32_t RouteTable::allocate_group(const uint32_t entry) {
+    while (not _retired_groups.empty() and _rcu.reclaimable(_retired_groups.front().first)) {
+        _free_groups.push_back(_retired_groups.front().second);
+        _retired_groups.pop_front();
+    }
+
+    uint32_t number = 0;
+    if (not _free_groups.empty()) {
+        number = _free_groups.back();
+        _free_groups.pop_back();
+    } else {
+        if (_group_count == MAX_GROUPS) {
+            throw runtime_error("RouteTable: too many /24s split by longer routes");
+        }
+        auto &chunk = _groups[_group_count / GROUPS_PER_CHUNK];
+        if (not chunk) {
+            chunk = make_unique<uint32_t[]>(GROUPS_PER_CHUNK * GROUP_SIZE);
+        }
+        number = _group_count++;
+    }
+    fill(group(number), group(number) + GROUP_SIZE, entry);
+    return number;
+}
+
+//! \details Readers may still be following `slot`'s old value, so the group is retired, to be reused
+//! once they cannot be.
+void RouteTable::settle(uint32_t &slot) {
+    const uint32_t number = slot >> VALUE_SHIFT;
+    const uint32_t *const entries = group(number);
+    const bool uniform = all_of(entries, entries + GROUP_SIZE, [&](const uint32_t e) { return e == entries[0]; });
+    if (not uniform or depth(entries[0]) > 24) {
+        return;
+    }
+    store(slot, entries[0]);
+    _retired_groups.emplace_back(_rcu.retire(), number);
+}
+
+//! \details A range of /24s (for a route as long as or shorter than /24) is set entry by entry, along
+//! with any groups under them. Part of a /24 (for a longer route) is set in its group, which the /24
+//! is first split into if it was not already, and which is published only once complete.
+void RouteTable::set_range(const uint32_t network,
+                           const uint8_t prefix_length,
+                           const uint32_t entry,
+                           const uint8_t min_depth) {
+    const auto set = [&](uint32_t *first, const size_t count) {
+        for (uint32_t *it = first; it != first + count; it++) {
+            if (depth(*it) >= min_depth and depth(*it) <= prefix_length) {
+                store(*it, entry);
+            }
+        }
+    };
+
+    if (prefix_length <= 24) {
+        uint32_t *const first = _tbl24.get() + (network >> 8);
+        for (uint32_t *it = first; it != first + (size_t{1} << (24 - prefix_length)); it++) {
+            if (*it & GROUP_FLAG) {
+                set(group(*it >> VALUE_SHIFT), GROUP_SIZE);
+                settle(*it);
+            } else {
+                set(it, 1);
+            }
+        }
+        return;
+    }
+
+    uint32_t &slot = _tbl24[network >> 8];
+    if (slot & GROUP_FLAG) {
+        set(group(slot >> VALUE_SHIFT) + (network & 0xff), size_t{1} << (32 - prefix_length));
+        settle(slot);
+    } else {
+        const uint32_t number = allocate_group(slot);
+        set(group(number) + (network & 0xff), size_t{1} << (32 - prefix_length));
+        store(slot, number << VALUE_SHIFT | GROUP_FLAG);
+    }
+}
+
+void RouteTable::add_locked(const uint32_t prefix, const uint8_t prefix_length, const NextHop &next_hop) {
+    add_value(prefix, prefix_length, intern(next_hop));
+}
+
+void RouteTable::add_value(const uint32_t prefix, const uint8_t prefix_length, const uint32_t value) {
+    if (prefix_length > 32) {
+        throw runtime_error("RouteTable: prefix length longer than 32 bits");
+    }
+    if (prefix_length == 0) {
+        store(_default, value);
+        return;
+    }
+    const uint32_t network = prefix & mask(prefix_length);
+    _routes[{network, prefix_length}] = value;
+    set_range(network, prefix_length, value << VALUE_SHIFT | prefix_length, 0);
+}
+
+//! \details The entries that the route decided are exactly those of its range at its depth: they
+//! take the answer of the longest route that covers the removed one.
+void RouteTable::remove_locked(const uint32_t prefix, const uint8_t prefix_length) {
+    if (prefix_length == 0) {
+        store(_default, 0);
+        return;
+    }
+    const uint32_t network = prefix & mask(prefix_length);
+    if (_routes.erase({network, prefix_length}) == 0) {
+        return;
+    }
+
+    uint32_t replacement = 0;
+    for (uint8_t length = prefix_length - 1; length > 0; length--) {
+        const auto it = _routes.find({network & mask(length), length});
+        if (it != _routes.end()) {
+            replacement = it->second << VALUE_SHIFT | length;
+            break;
+        }
+    }
+    set_range(network, prefix_length, replacement, prefix_length);
+}
+
+void RouteTable::add(const uint32_t prefix, const uint8_t prefix_length, const NextHop &next_hop) {
+    lock_guard<mutex> lock{_mutex};
+    add_locked(prefix, prefix_length, next_hop);
+    _generation.fetch_add(1, memory_order_release);
+}
+
+void RouteTable::add(const vector<Route> &routes) {
+    lock_guard<mutex> lock{_mutex};
+    for (const auto &route : routes) {
+        add_locked(route.prefix, route.prefix_length, route.next_hop);
+    }
+    _generation.fetch_add(1, memory_order_release);
+}
+
+RouteTable::MultipathId RouteTable::add_multipath(const vector<Member> &members) {
+    lock_guard<mutex> lock{_mutex};
+    if (_multipath_count == MAX_MULTIPATHS) {
+        throw runtime_error("RouteTable: too many multipath groups");
+    }
+    auto &chunk = _multipaths[_multipath_count / MULTIPATHS_PER_CHUNK];
+    if (not chunk) {
+        chunk = make_unique<Multipath[]>(MULTIPATHS_PER_CHUNK);
+    }
+    assign(multipath(_multipath_count), members);
+    return _multipath_count++;
+}
+
+void RouteTable::set_multipath(const MultipathId id, const vector<Member> &members) {
+    lock_guard<mutex> lock{_mutex};
+    if (id >= _multipath_count) {
+        throw runtime_error("RouteTable: no such multipath group");
+    }
+    assign(multipath(id), members);
+}
+
+//! \param[in] prefix the address prefix (bits past `prefix_length` are ignored)
+//! \param[in] prefix_length the number of high-order bits of `prefix` that a destination must match
+//! \param[in] multipath the group (from add_multipath()) whose members datagrams that match go to
+void RouteTable::add(const uint32_t prefix, const uint8_t prefix_length, const MultipathId multipath) {
+    lock_guard<mutex> lock{_mutex};
+    if (multipath >= _multipath_count) {
+        throw runtime_error("RouteTable: no such multipath group");
+    }
+    add_value(prefix, prefix_length, multipath | MULTIPATH_FLAG);
+    _generation.fetch_add(1, memory_order_release);
+}
+
+void RouteTable::remove(const uint32_t prefix, const uint8_t prefix_length) {
+    lock_guard<mutex> lock{_mutex};
+    remove_locked(prefix, prefix_length);
+    _generation.fetch_add(1, memory_order_release);
+}
+
+void RouteTable::remove(const vector<pair<uint32_t, uint8_t>> &prefixes) {
+    lock_guard<mutex> lock{_mutex};
+    for (const auto &[prefix, prefix_length] : prefixes) {
+        remove_locked(prefix, prefix_length);
+    }
+    _generation.fetch_add(1, memory_order_release);
+}
+
+RouteTable::Match RouteTable::match(const uint32_t destination) const {
+    uint32_t entry = load(_tbl24[destination >> 8]);
+    if (entry & GROUP_FLAG) {
+        entry = load(group(entry >> VALUE_SHIFT)[destination & 0xff]);
+    }
+    return Match{entry >> VALUE_SHIFT};
+}
+
+void RouteTable::match(const uint32_t *destinations, Match *matches, const size_t count) const {
+    array<uint32_t, BATCH_SIZE> entries{};
+    for (size_t first = 0; first < count; first += BATCH_SIZE) {
+        const uint32_t *const batch = destinations + first;
+        const size_t size = min(BATCH_SIZE, count - first);
+
+        for (size_t i = 0; i < size; i++) {
+            __builtin_prefetch(&_tbl24[batch[i] >> 8]);
+        }
+        for (size_t i = 0; i < size; i++) {
+            entries[i] = load(_tbl24[batch[i] >> 8]);
+            if (entries[i] & GROUP_FLAG) {
+                __builtin_prefetch(&group(entries[i] >> VALUE_SHIFT)[batch[i] & 0xff]);
+            }
+        }
+        for (size_t i = 0; i < size; i++) {
+            if (entries[i] & GROUP_FLAG) {
+                entries[i] = load(group(entries[i] >> VALUE_SHIFT)[batch[i] & 0xff]);
+            }
+            matches[first + i] = Match{entries[i] >> VALUE_SHIFT};
+        }
+    }
+}
+
+const RouteTable::NextHop *RouteTable::next_hop(const Match match, const uint32_t flow_hash) const {
+    if (match == Match{}) {
+        return nullptr;
+    }
+    uint32_t value = match._value != 0 ? match._value : load(_default);
+    if (value & MULTIPATH_FLAG) {
+        value = load(multipath(value & ~MULTIPATH_FLAG).buckets[flow_hash % MULTIPATH_BUCKETS]);
+    }
+    if (value == 0) {
+        return nullptr;
+    }
+    return &_next_hops[(value - 1) / NEXT_HOPS_PER_CHUNK][(value - 1) % NEXT_HOPS_PER_CHUNK];
+}
+
+const RouteTable::NextHop *RouteTable::lookup(const uint32_t destination, const uint32_t flow_hash) const {
+    return next_hop(match(destination), flow_hash);
+}
+
+void RouteTable::lookup(const uint32_t *destinations,
+                        const NextHop **next_hops,
+                        const size_t count,
+                        const uint32_t *flow_hashes) const {
+    array<Match, BATCH_SIZE> matches{};
+    for (size_t first = 0; first < count; first += BATCH_SIZE) {
+        const size_t size = min(BATCH_SIZE, count - first);
+        match(destinations + first, matches.data(), size);
+        for (size_t i = 0; i < size; i++) {
+            next_hops[first + i] = next_hop(matches[i], flow_hashes != nullptr ? flow_hashes[first + i] : 0);
+        }
+    }
+}
+
+size_t RouteTable::size() const {
+    lock_guard<mutex> lock{_mutex};
+    return _routes.size() + (_default != 0);
+}
+
+size_t RouteTable::groups_in_use() const {
+    lock_guard<mutex> lock{_mutex};
+    return _group_count - _free_groups.size() - _retired_groups.size();
+}
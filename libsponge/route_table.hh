@@ -0,0 +1,220 @@
+#ifndef SPONGE_LIBSPONGE_ROUTE_TABLE_HH
+#define SPONGE_LIBSPONGE_ROUTE_TABLE_HH
+
+#include "address.hh"
+#include "rcu.hh"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//! \brief An IPv4 longest-prefix-match table, laid out as DIR-24-8
+//! \details The first 24 bits of an address index a table with one entry per /24, which holds either
+//! the answer for the whole /24 or, where some route is longer than /24, the number of a group of 256
+//! entries indexed by the last 8 bits. A lookup is thus one or two memory accesses, whatever the number
+//! of routes. The /24 table is 64 MiB of address space, mapped lazily: only the parts that routes cover
+//! are ever touched, and the default route is kept aside rather than written into every entry.
+//!
+//! Routes may change while other threads look them up. Every entry is one word, which updates replace
+//! atomically, so a lookup sees each entry either before or after an update and never waits for one.
+//! A group that updates leave unused is reused only once every thread that looks up concurrently with
+//! updates (through a RCUDomain::Reader of rcu()) has passed a quiescent state. Updates are serialized.
+//!
+//! A route may also lead to a multipath group (for ECMP), whose members share its traffic by weight:
+//! a lookup picks the member from the datagram's flow hash, so that each flow keeps to one path.
+class RouteTable {
+  public:
+    //! Where a matching datagram goes
+    struct NextHop {
+        size_t interface_num = 0;          //!< The index of the interface to send it out on
+        std::optional<Address> address{};  //!< The next hop's address (empty if the network is directly attached)
+    };
+
+    //! A member of a multipath group
+    struct Member {
+        NextHop next_hop{};   //!< Where the member's share of the traffic goes
+        uint32_t weight = 1;  //!< The member's share, relative to the other members' weights
+    };
+
+    //! Identifies a multipath group
+    using MultipathId = uint32_t;
+
+    //! Buckets of a multipath group, which flow hashes index and which each hold one member
+    static constexpr size_t MULTIPATH_BUCKETS = 1024;
+
+    //! \brief What a destination's longest-prefix route leads to (a next hop or a multipath group, or
+    //! the default route), from which next_hop() picks the next hop
+    //! \details Small and cheap to compare, for caching. A default-constructed Match matches nothing.
+    class Match {
+      private:
+        friend class RouteTable;
+        uint32_t _value = UINT32_MAX;
+        explicit Match(const uint32_t value) : _value(value) {}
+
+      public:
+        Match() = default;
+        bool operator==(const Match &other) const { return _value == other._value; }
+        bool operator!=(const Match &other) const { return _value != other._value; }
+    };
+
+    //! A forwarding rule, for bulk updates
+    struct Route {
+        uint32_t prefix;        //!< The address prefix (bits past `prefix_length` are ignored)
+        uint8_t prefix_length;  //!< The number of high-order bits of `prefix` that a destination must match
+        NextHop next_hop;       //!< Where datagrams that match go
+    };
+
+  private:
+    //! Unmaps the /24 table
+    struct Unmap {
+        void operator()(uint32_t *tbl24) const;
+    };
+
+    std::unique_ptr<uint32_t[], Unmap> _tbl24;           //!< One entry per /24
+    std::vector<std::unique_ptr<uint32_t[]>> _groups;    //!< Groups of 256 entries, allocated in chunks
+    std::vector<std::unique_ptr<NextHop[]>> _next_hops;  //!< Entry values index these, allocated in chunks
+
+    //! The member (as a next-hop value) of each bucket
+    struct Multipath {
+        std::array<uint32_t, MULTIPATH_BUCKETS> buckets{};
+    };
+
+    std::vector<std::unique_ptr<Multipath[]>> _multipaths;  //!< Multipath groups, allocated in chunks
+
+    //! \name Writer's state (guarded by `_mutex`)
+    //!@{
+    mutable std::mutex _mutex{};
+    uint32_t _group_count = 0;                                                  //!< Groups ever used
+    std::vector<uint32_t> _free_groups{};                                       //!< Groups ready for reuse
+    std::deque<std::pair<uint64_t, uint32_t>> _retired_groups{};                //!< <RCU token, group>
+    uint32_t _next_hop_count = 0;                                               //!< Next hops ever used
+    uint32_t _multipath_count = 0;                                              //!< Multipath groups made
+    std::map<std::pair<size_t, std::optional<uint32_t>>, uint32_t> _hop_ids{};  //!< Next hop => its value
+    std::map<std::pair<uint32_t, uint8_t>, uint32_t> _routes{};                 //!< <prefix, length> => next-hop value
+    //!@}
+
+    uint32_t _default = 0;  //!< Next-hop value of the /0 route (0 if none)
+
+    std::atomic<uint64_t> _generation{0};  //!< Advanced once every add or remove is complete
+
+    RCUDomain _rcu{};
+
+    //! The value (1-based index into _next_hops) that stands for `hop`
+    uint32_t intern(const NextHop &hop);
+
+    //! Multipath group number `id`
+    Multipath &multipath(const MultipathId id) const;
+
+    //! Hand the buckets of `paths` to `members`, by weight, moving as few as possible
+    void assign(Multipath &paths, const std::vector<Member> &members);
+
+    //! The 256 entries of group number `number`
+    uint32_t *group(const uint32_t number) const;
+
+    //! The number of a group that no reader can be looking at, with every entry set to `entry`
+    uint32_t allocate_group(const uint32_t entry);
+
+    //! If the group that `slot` points to answers all its addresses alike, put that answer in `slot`
+    void settle(uint32_t &slot);
+
+    //! Set the entries that `network`/`prefix_length` covers to `entry`, where a route of a length in
+    //! [`min_depth`, `prefix_length`] decided them
+    void set_range(const uint32_t network, const uint8_t prefix_length, const uint32_t entry, const uint8_t min_depth);
+
+    void add_locked(const uint32_t prefix, const uint8_t prefix_length, const NextHop &next_hop);
+    void add_value(const uint32_t prefix, const uint8_t prefix_length, const uint32_t value);
+    void remove_locked(const uint32_t prefix, const uint8_t prefix_length);
+
+  public:
+    RouteTable();
+
+    //! \brief Add a route, replacing any route for the same prefix
+    //! \param[in] prefix the address prefix (bits past `prefix_length` are ignored)
+    //! \param[in] prefix_length the number of high-order bits of `prefix` that a destination must match
+    //! \param[in] next_hop where datagrams that match go
+    void add(const uint32_t prefix, const uint8_t prefix_length, const NextHop &next_hop);
+
+    //! Add routes, as add() would one by one
+    void add(const std::vector<Route> &routes);
+
+    //! \brief Make a multipath group, whose members share its traffic by weight
+    //! \details Each member gets a share of the group's buckets in proportion to its weight. Groups
+    //! last as long as the table does.
+    //! \returns the group's id, for add() and set_multipath()
+    MultipathId add_multipath(const std::vector<Member> &members);
+
+    //! \brief Change the members of a multipath group (adding, removing or reweighting them)
+    //! \details Resilient: a bucket changes hands only if its member left the group or has more than its
+    //! new share, so only flows that must move do. Removing a member moves only the flows it had.
+    void set_multipath(const MultipathId id, const std::vector<Member> &members);
+
+    //! Add a route through a multipath group, replacing any route for the same prefix
+    void add(const uint32_t prefix, const uint8_t prefix_length, const MultipathId multipath);
+
+    //! \brief Remove the route for a prefix, if there is one
+    //! \details Destinations that matched it fall back to the longest remaining route that matches them.
+    void remove(const uint32_t prefix, const uint8_t prefix_length);
+
+    //! Remove the routes for some <prefix, prefix length> pairs, as remove() would one by one
+    void remove(const std::vector<std::pair<uint32_t, uint8_t>> &prefixes);
+
+    //! \brief The next hop of the longest-prefix route that matches `destination`, or `nullptr` if none does
+    //! \param[in] destination is the address to look up
+    //! \param[in] flow_hash picks the member of a multipath group that the route leads to
+    //! \note The next hop stays valid as long as the table does, even once no route uses it.
+    const NextHop *lookup(const uint32_t destination, const uint32_t flow_hash = 0) const;
+
+    //! Most destinations that the batched lookup() resolves in one pass
+    static constexpr size_t BATCH_SIZE = 32;
+
+    //! \brief Look up `count` destinations, storing the result for `destinations[i]` in `next_hops[i]`
+    //! (with flow hash `flow_hashes[i]`, if given)
+    //! \details Resolves the destinations level by level, a batch at a time: first prefetching the /24
+    //! entries of the whole batch, then reading them and prefetching the group entries they point to,
+    //! and finally reading those. The cache misses of a batch thus overlap, instead of each lookup
+    //! waiting for its own in turn.
+    void lookup(const uint32_t *destinations,
+                const NextHop **next_hops,
+                const size_t count,
+                const uint32_t *flow_hashes = nullptr) const;
+
+    //! \name Lookup in two steps
+    //! lookup() is next_hop() of match(): the longest-prefix match, then the choice of a next hop. The
+    //! match of a destination can be cached, until generation() changes.
+    //!@{
+
+    //! What the longest-prefix route that matches `destination` leads to
+    Match match(const uint32_t destination) const;
+
+    //! \brief Match `count` destinations, storing the result for `destinations[i]` in `matches[i]`
+    //! \details In batches, as the batched lookup() does.
+    void match(const uint32_t *destinations, Match *matches, const size_t count) const;
+
+    //! \brief The next hop that `match` leads to, for a datagram of flow hash `flow_hash` (or `nullptr`)
+    const NextHop *next_hop(const Match match, const uint32_t flow_hash) const;
+
+    //! \brief Changes (once complete) with every add or remove, after which any match may have changed
+    //! \details Changing a multipath group's members does not change it: matches stay the same.
+    uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+    //!@}
+
+    //! Threads that look up while another thread updates must each register a reader with this, and be
+    //! quiescent between lookups
+    RCUDomain &rcu() { return _rcu; }
+
+    //! Number of routes in the table
+    size_t size() const;
+
+    //! Groups of 256 entries that the table uses (for routes longer than /24)
+    size_t groups_in_use() const;
+};
+
+#endif  // SPONGE_LIBSPONGE_ROUTE_TABLE_HH
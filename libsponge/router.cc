@@ -2,12 +2,155 @@
 
 #include "address.hh"
 #include "ethernet_frame.hh"
+#include "icmp_message.hh"
+#include "spsc_queue.hh"
+#include "util.hh"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <iostream>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 
+//! \details Queues and counters are indexed by interface and worker number, and sized by start(); the
+//! queues of each <worker, egress interface> pair exist only where the worker does not own the interface.
+class Router::Workers {
+  public:
+    //! A datagram on its way from the worker that routed it to the one that owns its egress interface
+    struct Handoff {
+        InternetDatagram dgram{};
+        const RouteTable::NextHop *hop = nullptr;  //!< Next hops stay put as long as the table does
+    };
+
+    //! One worker's counts, on a cache line of its own
+    struct alignas(64) Counters {
+        atomic<uint64_t> forwarded{0};
+        atomic<uint64_t> dropped{0};
+        atomic<uint64_t> route_cache_hits{0};
+        atomic<uint64_t> route_cache_misses{0};
+    };
+
+    //! Most items a worker takes from one queue before turning to the next, so that none starves the rest
+    static constexpr size_t BURST = 64;
+
+    const size_t count;                                       //!< Number of workers
+    vector<unique_ptr<SPSCQueue<EthernetFrame>>> inbound{};   //!< Per interface, from push_frame()
+    vector<unique_ptr<SPSCQueue<EthernetFrame>>> outbound{};  //!< Per interface, for pop_frame()
+    vector<unique_ptr<SPSCQueue<Handoff>>> handoffs{};        //!< Per [worker * interfaces + egress interface]
+    vector<unique_ptr<Counters>> counters{};                  //!< Per worker
+    vector<TokenBucket> limiters{};                           //!< Per worker, a share of the ICMP rate limit
+    atomic<bool> running{true};
+    vector<thread> threads{};
+
+    Workers(const size_t workers,
+            const size_t interfaces,
+            const size_t queue_capacity,
+            const uint64_t icmp_rate,
+            const uint64_t icmp_burst)
+        : count(workers) {
+        for (size_t n = 0; n < interfaces; n++) {
+            inbound.push_back(make_unique<SPSCQueue<EthernetFrame>>(queue_capacity));
+            outbound.push_back(make_unique<SPSCQueue<EthernetFrame>>(queue_capacity));
+        }
+        for (size_t worker = 0; worker < count; worker++) {
+            for (size_t n = 0; n < interfaces; n++) {
+                handoffs.push_back(n % count == worker ? nullptr : make_unique<SPSCQueue<Handoff>>(queue_capacity));
+            }
+            counters.push_back(make_unique<Counters>());
+            limiters.emplace_back((icmp_rate + count - 1) / count, (icmp_burst + count - 1) / count);
+        }
+    }
+
+    ~Workers() { join(); }
+
+    Workers(const Workers &other) = delete;
+    Workers &operator=(const Workers &other) = delete;
+
+    //! Serve the interfaces of worker number `worker` until `running` is cleared
+    void run(Router &router, const size_t worker);
+
+    //! Stop every worker, and wait until they have
+    void join() {
+        running.store(false, memory_order_release);
+        for (auto &thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    uint64_t forwarded() const {
+        uint64_t sum = 0;
+        for (const auto &c : counters) {
+            sum += c->forwarded.load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t dropped() const {
+        uint64_t sum = 0;
+        for (const auto &c : counters) {
+            sum += c->dropped.load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t route_cache_hits() const {
+        uint64_t sum = 0;
+        for (const auto &c : counters) {
+            sum += c->route_cache_hits.load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t route_cache_misses() const {
+        uint64_t sum = 0;
+        for (const auto &c : counters) {
+            sum += c->route_cache_misses.load(memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+namespace {
+
+//! \details The ports are left out for fragments (which may not have them), so that all the fragments
+//! of a datagram go the same way.
+uint32_t flow_hash(const InternetDatagram &dgram, const uint32_t seed) {
+    const IPv4Header &header = dgram.header();
+    uint32_t ports = 0;
+    if ((header.proto == IPv4Header::PROTO_TCP or header.proto == IPv4Header::PROTO_UDP) and header.offset == 0 and
+        not header.mf and not dgram.payload().buffers().empty()) {
+        const string_view transport = dgram.payload().buffers()[0].str();
+        if (transport.size() >= 4) {
+            ports = NetParser::load_u32(transport.data());
+        }
+    }
+
+    // multiply-xorshift mixing (as in MurmurHash3's finalizer)
+    uint64_t hash = (uint64_t{header.src} << 32 | header.dst) ^ seed;
+    hash ^= (uint64_t{ports} << 8 | header.proto) * 0x9e3779b97f4a7c15;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return static_cast<uint32_t>(hash);
+}
+
+}  // namespace
+
+Router::Router() : flow_seed_(get_random_generator()()) {
+    // between calls to route(), the routes are not in use
+    reader_.offline();
+}
+
+Router::~Router() { stop(); }
+
 // Given an incoming Internet datagram, the router decides
 // (1) which interface to send it out on, and
 // (2) what next hop address to send it to.
@@ -20,48 +163,383 @@ void Router::add_route(const uint32_t route_prefix,
                        const uint8_t prefix_length,
                        const optional<Address> next_hop,
                        const size_t interface_num) {
-    cerr << "DEBUG: adding route " << Address::from_ipv4_numeric(route_prefix).ip() << "/" << int(prefix_length)
-         << " => " << (next_hop.has_value() ? next_hop->ip() : "(direct)") << " on interface " << interface_num << "\n";
-    if (!prefix_length) {
-        table_.emplace(pair{0, 0}, pair{interface_num, move(next_hop)});
-        return;
-    }
+    table_.add(route_prefix, prefix_length, {interface_num, next_hop});
+}
+
+//! \param[in] members The next hops, and their weights
+RouteTable::MultipathId Router::add_multipath(const vector<RouteTable::Member> &members) {
+    return table_.add_multipath(members);
+}
+
+//! \param[in] id The group to change
+//! \param[in] members The group's new next hops, and their weights
+void Router::set_multipath(const RouteTable::MultipathId id, const vector<RouteTable::Member> &members) {
+    table_.set_multipath(id, members);
+}
 
-    const uint32_t ip{(static_cast<uint32_t>(~0) << (32 - prefix_length)) & route_prefix};
-    table_.emplace(pair{ip, prefix_length}, pair{interface_num, move(next_hop)});
+//! \param[in] route_prefix The "up-to-32-bit" IPv4 address prefix to match the datagram's destination against
+//! \param[in] prefix_length The number of high-order bits of route_prefix that must match
+//! \param[in] multipath The group (from add_multipath) that spreads the matching datagrams
+void Router::add_route(const uint32_t route_prefix,
+                       const uint8_t prefix_length,
+                       const RouteTable::MultipathId multipath) {
+    table_.add(route_prefix, prefix_length, multipath);
 }
 
-//! \param[in] dgram The datagram to be routed
-//
+//! \param[in] routes The routes to add, as add_route would one by one
+void Router::add_routes(const vector<RouteTable::Route> &routes) { table_.add(routes); }
+
+//! \param[in] route_prefix The prefix of the route to remove
+//! \param[in] prefix_length The length of that prefix
+void Router::remove_route(const uint32_t route_prefix, const uint8_t prefix_length) {
+    table_.remove(route_prefix, prefix_length);
+}
+
+//! \param[in] prefixes The <prefix, prefix length> pairs of the routes to remove
+void Router::remove_routes(const vector<pair<uint32_t, uint8_t>> &prefixes) { table_.remove(prefixes); }
+
 //! When next NetworkInterface receives packet:
 //!   - if it's a router, it collects the packet and route it again
 //!   - if it's a host, it delivers the packet to the application
-void Router::route_one_datagram(InternetDatagram &dgram) {
-    if (dgram.header().ttl == 0 || --dgram.header().ttl == 0)
-        return;
+template <typename Forward>
+void Router::route_batch(vector<InternetDatagram> &batch,
+                         const size_t ingress,
+                         RouteCache &cache,
+                         TokenBucket &limiter,
+                         const Forward &forward) {
+    // the misses are matched in the table together, and then cached
+    array<RouteTable::Match, RouteTable::BATCH_SIZE> matches{};
+    array<uint32_t, RouteTable::BATCH_SIZE> missed{};
+    array<RouteTable::Match, RouteTable::BATCH_SIZE> missed_matches{};
+    array<size_t, RouteTable::BATCH_SIZE> missed_index{};
+    size_t misses = 0;
+    cache.sync(table_.generation());
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (not cache.find(batch[i].header().dst, matches[i])) {
+            missed[misses] = batch[i].header().dst;
+            missed_index[misses++] = i;
+        }
+    }
+    table_.match(missed.data(), missed_matches.data(), misses);
+    for (size_t m = 0; m < misses; m++) {
+        matches[missed_index[m]] = missed_matches[m];
+        cache.insert(missed[m], missed_matches[m]);
+    }
 
-    const uint32_t ip{dgram.header().dst};
-    {
-        int8_t prefix_length{32};
-        for (uint32_t mask{~static_cast<uint32_t>(0)}; prefix_length >= 0; mask <<= 1, --prefix_length) {
-            const auto it = table_.find({mask & ip, prefix_length});
-            if (it != table_.end()) {
-                auto &interface = Router::interface(it->second.first);
-                interface.send_datagram(dgram,
-                                        it->second.second.value_or(Address::from_ipv4_numeric(dgram.header().dst)));
-                break;
+    array<const RouteTable::NextHop *, RouteTable::BATCH_SIZE> hops{};
+    for (size_t i = 0; i < batch.size(); i++) {
+        hops[i] = table_.next_hop(matches[i], flow_hash(batch[i], flow_seed_));
+    }
+
+    const auto answer = [&](const InternetDatagram &dgram,
+                            const uint8_t type,
+                            const uint8_t code,
+                            const uint32_t rest) {
+        if (not limiter.take()) {
+            return;
+        }
+        auto error = icmp_error(dgram, ingress, type, code, rest);
+        if (not error.has_value()) {
+            limiter.give_back();
+            return;
+        }
+        const RouteTable::NextHop *const hop =
+            table_.lookup(error->header().dst, flow_hash(error.value(), flow_seed_));
+        if (hop != nullptr) {
+            forward(error.value(), *hop);
+        }
+    };
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        InternetDatagram &dgram = batch[i];
+        if (dgram.header().ttl <= 1) {
+            answer(dgram, ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED_IN_TRANSIT, 0);
+            continue;
+        }
+        if (hops[i] == nullptr) {
+            answer(dgram, ICMPMessage::TYPE_DESTINATION_UNREACHABLE, ICMPMessage::CODE_NET_UNREACHABLE, 0);
+            continue;
+        }
+        const size_t egress = hops[i]->interface_num;
+        if (dgram.header().df and egress < interfaces_.size() and dgram.header().len > interfaces_[egress].mtu()) {
+            // the next-hop MTU goes in the low 16 bits (RFC 1191)
+            answer(dgram,
+                   ICMPMessage::TYPE_DESTINATION_UNREACHABLE,
+                   ICMPMessage::CODE_FRAGMENTATION_NEEDED,
+                   min<size_t>(interfaces_[egress].mtu(), UINT16_MAX));
+            continue;
+        }
+        dgram.decrement_ttl();
+        if (egress < interfaces_.size() and dgram.header().len > interfaces_[egress].mtu()) {
+            for (auto &piece : dgram.fragment(interfaces_[egress].mtu())) {
+                forward(piece, *hops[i]);
             }
+            continue;
+        }
+        forward(dgram, *hops[i]);
+    }
+    batch.clear();
+}
+
+//! \details As [RFC 1812](https://tools.ietf.org/html/rfc1812) (§4.3.2.7) requires, no error reports
+//! an ICMP error, a fragment other than the first, or a datagram not sent from and to a single host.
+//! The error quotes the offending datagram's header as received (options, checksum and all, before any
+//! change the router made to it) and the first 8 bytes of its payload.
+optional<InternetDatagram> Router::icmp_error(const InternetDatagram &offending,
+                                              const size_t ingress,
+                                              const uint8_t type,
+                                              const uint8_t code,
+                                              const uint32_t rest) const {
+    const IPv4Header &header = offending.header();
+    const auto unicast = [](const uint32_t address) {
+        const uint8_t first = address >> 24;
+        return first != 0 and first != 127 and first < 224;
+    };
+    if (header.offset != 0 or not unicast(header.src) or not unicast(header.dst)) {
+        return nullopt;
+    }
+
+    // a datagram the router did not parse (e.g. a test's) has no received bytes to quote
+    string quoted{offending.received_header()};
+    if (quoted.empty()) {
+        quoted = header.serialize();
+    }
+    const size_t header_length = quoted.size();
+    for (const Buffer &buffer : offending.payload().buffers()) {
+        if (quoted.size() == header_length + ICMPMessage::QUOTED_PAYLOAD) {
+            break;
         }
+        quoted += buffer.str().substr(0, header_length + ICMPMessage::QUOTED_PAYLOAD - quoted.size());
+    }
+    if (header.proto == IPv4Header::PROTO_ICMP and quoted.size() > header_length and
+        ICMPMessage::is_error(quoted[header_length])) {
+        return nullopt;
     }
+
+    ICMPMessage message;
+    message.type = type;
+    message.code = code;
+    message.rest = rest;
+    message.data = move(quoted);
+
+    InternetDatagram error;
+    error.header().src = interfaces_.at(ingress).ip_address().ipv4_numeric();
+    error.header().dst = header.src;
+    error.header().proto = IPv4Header::PROTO_ICMP;
+    error.header().ttl = ICMP_TTL;
+    error.payload() = message.serialize();
+    error.header().len = error.header().hlen * 4 + error.payload().size();
+    return error;
+}
+
+void Router::send(const InternetDatagram &dgram, const RouteTable::NextHop &hop) {
+    interfaces_.at(hop.interface_num)
+        .send_datagram(dgram, hop.address.value_or(Address::from_ipv4_numeric(dgram.header().dst)));
 }
 
 void Router::route() {
+    if (workers_) {
+        throw runtime_error("Router: route() called while workers run");
+    }
+    reader_.quiescent();
+
+    size_t now = icmp_refilled_at_;
+    for (const auto &interface : interfaces_) {
+        now = max(now, interface.time_ms());
+    }
+    icmp_limiter_.tick(now - icmp_refilled_at_);
+    icmp_refilled_at_ = now;
+
     // Go through all the interfaces, and route every incoming datagram to its proper outgoing interface.
-    for (auto &interface : interfaces_) {
-        auto &queue = interface.datagrams_out();
+    const auto forward = [&](InternetDatagram &dgram, const RouteTable::NextHop &hop) { send(dgram, hop); };
+    for (size_t n = 0; n < interfaces_.size(); n++) {
+        auto &queue = interfaces_[n].datagrams_out();
         while (not queue.empty()) {
-            route_one_datagram(queue.front());
-            queue.pop();
+            while (not queue.empty() and batch_.size() < RouteTable::BATCH_SIZE) {
+                batch_.push_back(move(queue.front()));
+                queue.pop();
+            }
+            route_batch(batch_, n, route_cache_, icmp_limiter_, forward);
+            reader_.quiescent();
+        }
+    }
+
+    // between calls, the routes are not in use
+    reader_.offline();
+}
+
+//! \details A worker never blocks: when it finds nothing to do, it yields the CPU and looks again.
+void Router::Workers::run(Router &router, const size_t worker) {
+    using namespace chrono;
+
+    RCUDomain::Reader reader{router.table_.rcu()};
+    const size_t interfaces = router.interfaces_.size();
+    Counters &counts = *counters[worker];
+    uint64_t forwarded = 0, dropped = 0;
+    RouteCache cache{router.route_cache_entries_};
+
+    const auto forward = [&](InternetDatagram &dgram, const RouteTable::NextHop &hop) {
+        if (hop.interface_num >= interfaces) {
+            dropped++;
+        } else if (hop.interface_num % count == worker) {
+            router.send(dgram, hop);
+            forwarded++;
+        } else if (handoffs[worker * interfaces + hop.interface_num]->push({move(dgram), &hop})) {
+            forwarded++;
+        } else {
+            dropped++;
+        }
+    };
+
+    vector<InternetDatagram> batch{};
+    EthernetFrame frame{};
+    Handoff handoff{};
+    auto last_tick = steady_clock::now();
+
+    while (running.load(memory_order_acquire)) {
+        bool idle = true;
+
+        for (size_t n = worker; n < interfaces; n += count) {
+            AsyncNetworkInterface &interface = router.interfaces_[n];
+
+            for (size_t i = 0; i < BURST and inbound[n]->pop(frame); i++) {
+                interface.recv_frame(frame);
+                idle = false;
+            }
+
+            auto &queue = interface.datagrams_out();
+            while (not queue.empty()) {
+                while (not queue.empty() and batch.size() < RouteTable::BATCH_SIZE) {
+                    batch.push_back(move(queue.front()));
+                    queue.pop();
+                }
+                router.route_batch(batch, n, cache, limiters[worker], forward);
+            }
+
+            for (size_t from = 0; from < count; from++) {
+                const auto &handoff_queue = handoffs[from * interfaces + n];
+                for (size_t i = 0; handoff_queue and i < BURST and handoff_queue->pop(handoff); i++) {
+                    router.send(handoff.dgram, *handoff.hop);
+                    idle = false;
+                }
+            }
+        }
+
+        const auto elapsed = duration_cast<milliseconds>(steady_clock::now() - last_tick);
+        if (elapsed.count() > 0) {
+            for (size_t n = worker; n < interfaces; n += count) {
+                router.interfaces_[n].tick(elapsed.count());
+            }
+            limiters[worker].tick(elapsed.count());
+            last_tick += elapsed;
+        }
+
+        for (size_t n = worker; n < interfaces; n += count) {
+            auto &frames = router.interfaces_[n].frames_out();
+            while (not frames.empty() and outbound[n]->push(move(frames.front()))) {
+                frames.pop();
+            }
         }
+
+        counts.forwarded.store(forwarded, memory_order_relaxed);
+        counts.dropped.store(dropped, memory_order_relaxed);
+        counts.route_cache_hits.store(cache.hits(), memory_order_relaxed);
+        counts.route_cache_misses.store(cache.misses(), memory_order_relaxed);
+        reader.quiescent();
+        if (idle) {
+            this_thread::yield();
+        }
+    }
+}
+
+//! \details Each interface's queues are single-producer and single-consumer: the caller on one side,
+//! the worker that owns the interface on the other.
+void Router::start(const size_t workers, const size_t queue_capacity) {
+    if (workers_) {
+        throw runtime_error("Router: workers already started");
+    }
+    if (workers == 0) {
+        throw runtime_error("Router: start() needs at least one worker");
+    }
+    const size_t count = min(workers, max(interfaces_.size(), size_t{1}));
+    workers_ = make_unique<Workers>(count, interfaces_.size(), queue_capacity, icmp_rate_, icmp_burst_);
+    for (size_t worker = 0; worker < workers_->count; worker++) {
+        workers_->threads.emplace_back([this, worker] { workers_->run(*this, worker); });
+    }
+}
+
+//! \param[in] rate is the number of errors per second, on average
+//! \param[in] burst is the number of errors sent at once, after a quiet spell
+void Router::set_icmp_rate_limit(const uint64_t rate, const uint64_t burst) {
+    if (workers_) {
+        throw runtime_error("Router: ICMP rate limit changed while workers run");
+    }
+    icmp_rate_ = rate;
+    icmp_burst_ = burst;
+    icmp_limiter_ = TokenBucket{rate, burst};
+}
+
+void Router::set_route_cache_entries(const size_t entries) {
+    if (workers_) {
+        throw runtime_error("Router: route cache resized while workers run");
+    }
+    route_cache_entries_ = entries;
+    route_cache_hits_ += route_cache_.hits();
+    route_cache_misses_ += route_cache_.misses();
+    route_cache_ = RouteCache{entries};
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void Router::tick(const size_t ms_since_last_tick) {
+    if (workers_) {
+        throw runtime_error("Router: tick() called while workers run");
+    }
+    for (auto &interface : interfaces_) {
+        interface.tick(ms_since_last_tick);
     }
 }
+
+void Router::stop() {
+    if (not workers_) {
+        return;
+    }
+    workers_->join();
+    forwarded_ += workers_->forwarded();
+    dropped_ += workers_->dropped();
+    route_cache_hits_ += workers_->route_cache_hits();
+    route_cache_misses_ += workers_->route_cache_misses();
+    workers_.reset();
+}
+
+//! \param[in] N is the index of the interface that received `frame`
+//! \param[in] frame is the frame it received
+bool Router::push_frame(const size_t N, EthernetFrame &&frame) {
+    if (not workers_) {
+        throw runtime_error("Router: push_frame() called while no workers run");
+    }
+    return workers_->inbound.at(N)->push(move(frame));
+}
+
+//! \param[in] N is the index of the interface that sent the frame
+optional<EthernetFrame> Router::pop_frame(const size_t N) {
+    if (not workers_) {
+        throw runtime_error("Router: pop_frame() called while no workers run");
+    }
+    EthernetFrame frame{};
+    if (not workers_->outbound.at(N)->pop(frame)) {
+        return nullopt;
+    }
+    return frame;
+}
+
+uint64_t Router::forwarded() const { return forwarded_ + (workers_ ? workers_->forwarded() : 0); }
+
+uint64_t Router::dropped() const { return dropped_ + (workers_ ? workers_->dropped() : 0); }
+
+uint64_t Router::route_cache_hits() const {
+    return route_cache_hits_ + route_cache_.hits() + (workers_ ? workers_->route_cache_hits() : 0);
+}
+
+uint64_t Router::route_cache_misses() const {
+    return route_cache_misses_ + route_cache_.misses() + (workers_ ? workers_->route_cache_misses() : 0);
+}
@@ -2,12 +2,17 @@
 #define SPONGE_LIBSPONGE_ROUTER_HH
 
 #include "network_interface.hh"
+#include "route_cache.hh"
+#include "route_table.hh"
+#include "token_bucket.hh"
 
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <queue>
+#include <stdexcept>
 #include <unordered_map>
 
 //! \brief A wrapper for NetworkInterface that makes the host-side
@@ -18,6 +23,9 @@
 class AsyncNetworkInterface : public NetworkInterface {
     std::queue<InternetDatagram> _datagrams_out{};
 
+    //! Largest datagram the attached network carries, in bytes
+    size_t _mtu = 1500;
+
   public:
     using NetworkInterface::NetworkInterface;
 
@@ -40,23 +48,105 @@ class AsyncNetworkInterface : public NetworkInterface {
 
     //! Access queue of Internet datagrams that have been received
     std::queue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
+
+    //! Largest datagram the attached network carries, in bytes
+    size_t mtu() const { return _mtu; }
+
+    //! Set the largest datagram the attached network carries (at least 68 bytes, as every IPv4 link must)
+    void set_mtu(const size_t mtu) {
+        if (mtu < 68) {
+            throw std::runtime_error("AsyncNetworkInterface: MTU below 68 bytes");
+        }
+        _mtu = mtu;
+    }
 };
 
 //! \brief A router that has multiple network interfaces and
 //! performs longest-prefix-match routing between them.
 class Router {
+    //! The threads, queues and counters of parallel forwarding (see start())
+    class Workers;
+
     //! The router's collection of network interfaces
     std::vector<AsyncNetworkInterface> interfaces_{};
 
-    //! The <IP, prefix_len> => <# of Interface, Address>
-    std::map<std::pair<uint32_t, uint8_t>, std::pair<size_t, std::optional<Address>>> table_{};
+    //! The routes, for longest-prefix-match lookups
+    RouteTable table_{};
+
+    //! route() as a reader of `table_`, so that routes may change while it runs
+    RCUDomain::Reader reader_{table_.rcu()};
+
+    //! Mixed into flow hashes, so that routers in series do not all split flows alike
+    uint32_t flow_seed_;
+
+    //! Destinations per route cache (route()'s, and each worker's)
+    size_t route_cache_entries_ = ROUTE_CACHE_ENTRIES;
+
+    //! route()'s cache of route matches
+    RouteCache route_cache_{route_cache_entries_};
+
+    //! Datagrams taken from an interface's queue, to be routed together
+    std::vector<InternetDatagram> batch_{};
 
-    //! Send a single datagram from the appropriate outbound interface to the next hop,
-    //! as specified by the route with the longest prefix_length that matches the
-    //! datagram's destination address.
-    void route_one_datagram(InternetDatagram &dgram);
+    //! Present between start() and stop()
+    std::unique_ptr<Workers> workers_{};
+
+    //! \name ICMP error rate limit (per second, and burst)
+    //!@{
+    uint64_t icmp_rate_ = ICMP_RATE;
+    uint64_t icmp_burst_ = ICMP_BURST;
+    TokenBucket icmp_limiter_{icmp_rate_, icmp_burst_};  //!< For route(); each worker has its own share
+    size_t icmp_refilled_at_ = 0;                        //!< Interfaces' time when route() last refilled it
+    //!@}
+
+    //! Counts of the workers that have been stopped
+    uint64_t forwarded_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t route_cache_hits_ = 0;
+    uint64_t route_cache_misses_ = 0;
+
+    //! Look up the destinations of `batch` (received on interface `ingress`) in `cache`, and those it
+    //! misses in the table all at once, and hand each datagram that has a route and some TTL left to
+    //! `forward`, along with its next hop (as specified by the route with the longest prefix_length that
+    //! matches the datagram's destination address). Each datagram that cannot go on is answered, as
+    //! `limiter` allows, with an ICMP error that is handed to `forward` in turn. Clears `batch`.
+    template <typename Forward>
+    void route_batch(std::vector<InternetDatagram> &batch,
+                     const size_t ingress,
+                     RouteCache &cache,
+                     TokenBucket &limiter,
+                     const Forward &forward);
+
+    //! The ICMP error, from interface `ingress`, that reports `offending` to its source (if any may)
+    std::optional<InternetDatagram> icmp_error(const InternetDatagram &offending,
+                                               const size_t ingress,
+                                               const uint8_t type,
+                                               const uint8_t code,
+                                               const uint32_t rest) const;
+
+    //! Send `dgram` out on the interface of `hop`, to the next hop's address (or to the destination)
+    void send(const InternetDatagram &dgram, const RouteTable::NextHop &hop);
 
   public:
+    //! \name Default ICMP error rate limit
+    //!@{
+    static constexpr uint64_t ICMP_RATE = 1000;  //!< Errors per second
+    static constexpr uint64_t ICMP_BURST = 50;   //!< Errors sent at once, after a quiet spell
+    //!@}
+
+    //! TTL of the ICMP errors the router sends
+    static constexpr uint8_t ICMP_TTL = 64;
+
+    //! \brief Default number of destinations per route cache: none (off)
+    //! \details A hot destination's route table entry stays in the processor's caches, and a lookup
+    //! through the route cache cost more than one without it in route_lookup_benchmark.
+    static constexpr size_t ROUTE_CACHE_ENTRIES = 0;
+
+    Router();
+
+    //! Stops the workers, if they are running
+    ~Router();
+
     //! Add an interface to the router
     //! \param[in] interface an already-constructed network interface
     //! \returns The index of the interface after it has been added to the router
@@ -74,8 +164,97 @@ class Router {
                    const std::optional<Address> next_hop,
                    const size_t interface_num);
 
-    //! Route packets between the interfaces
+    //! \brief Make a group of next hops for equal-cost (or weighted) multipath routing
+    //! \details A route through the group spreads flows over the members by weight, keeping each flow
+    //! (datagrams alike in addresses, protocol and TCP or UDP ports) on one member.
+    RouteTable::MultipathId add_multipath(const std::vector<RouteTable::Member> &members);
+
+    //! \brief Change the members of a multipath group
+    //! \details Only flows whose member leaves (or loses share) move to another.
+    void set_multipath(const RouteTable::MultipathId id, const std::vector<RouteTable::Member> &members);
+
+    //! Add a route through a multipath group
+    void add_route(const uint32_t route_prefix, const uint8_t prefix_length, const RouteTable::MultipathId multipath);
+
+    //! \brief Add many routes at once
+    //! \details Like the other route updates, safe to call while another thread runs route().
+    void add_routes(const std::vector<RouteTable::Route> &routes);
+
+    //! Remove the route for a prefix (if there is one)
+    void remove_route(const uint32_t route_prefix, const uint8_t prefix_length);
+
+    //! Remove the routes for many prefixes at once
+    void remove_routes(const std::vector<std::pair<uint32_t, uint8_t>> &prefixes);
+
+    //! \brief Route packets between the interfaces
+    //! \details A datagram too big for the next hop's MTU is sent in fragments, unless it may not be
+    //! fragmented. A datagram that cannot be forwarded (as its TTL runs out, no route matches it, or it is
+    //! too big for the next hop's MTU and may not be fragmented) is dropped, and answered with an ICMP
+    //! Time Exceeded, Destination Unreachable or Fragmentation Needed error to its source, sent from the
+    //! interface it came in on. The errors are rate-limited (see set_icmp_rate_limit()).
     void route();
+
+    //! \brief Limit the ICMP errors the router sends to `burst` at once, and `rate` per second on average
+    //! \details Not while the workers run; they split the limit evenly among themselves.
+    void set_icmp_rate_limit(const uint64_t rate, const uint64_t burst);
+
+    //! \name Route cache
+    //! \brief Once enabled, the router looks each destination up in a cache of recent route matches (one
+    //! for route(), and one per worker) before the route table, and empties it whenever routes are added
+    //! or removed.
+    //!@{
+
+    //! \brief Size each route cache for `entries` destinations (0 disables them; 4096 take 32 KiB)
+    //! \details Not while the workers run.
+    void set_route_cache_entries(const size_t entries);
+
+    //! Lookups that a route cache answered, ever
+    uint64_t route_cache_hits() const;
+
+    //! Lookups that went on to the route table, ever
+    uint64_t route_cache_misses() const;
+    //!@}
+
+    //! \brief Called periodically when time elapses: ticks every interface (not while workers run)
+    //! \details route() refills its ICMP error rate limit by the time the interfaces have been ticked
+    //! through, so ticking them one by one refills it too.
+    void tick(const size_t ms_since_last_tick);
+
+    //! \name Parallel forwarding
+    //! \brief Between start() and stop(), worker threads own the interfaces (interface `N` belongs to
+    //! worker `N % workers`), and move datagrams between them through lock-free queues.
+    //! \details Each worker receives the frames that push_frame() queued for its interfaces, routes the
+    //! datagrams in batches, and hands each one to the worker that owns the egress interface, through
+    //! a single-producer queue per <worker, egress interface> pair (or sends it itself, if it owns the
+    //! egress interface too). It also sends what other workers handed it, ticks its interfaces by the
+    //! clock, and queues the frames they emit for pop_frame(). No lock is taken on the way: workers
+    //! share only the queues and (read-only) the routes, which may still change in the meantime.
+    //!
+    //! Meanwhile, neither route() nor interface() may be used, and each interface's frames must be
+    //! pushed from one thread at a time and popped from one thread at a time.
+    //!@{
+
+    //! \brief Hand the interfaces to `workers` threads (at most one per interface)
+    //! \param[in] workers is the number of worker threads
+    //! \param[in] queue_capacity is the number of frames (or datagrams) each queue holds (a power of two)
+    void start(const size_t workers, const size_t queue_capacity = 1024);
+
+    //! Join the workers and take back the interfaces (frames still queued are discarded)
+    void stop();
+
+    //! \brief Queue a frame that interface `N` received (only between start() and stop())
+    //! \returns `false`, leaving `frame` alone, if the interface's inbound queue is full
+    bool push_frame(const size_t N, EthernetFrame &&frame);
+
+    //! Take the next frame that interface `N` sent, if any (only between start() and stop())
+    std::optional<EthernetFrame> pop_frame(const size_t N);
+
+    //! Datagrams (ICMP errors included) that workers have sent (or handed to another worker to send), ever
+    uint64_t forwarded() const;
+
+    //! Datagrams that workers have dropped because the queue to another worker was full, ever
+    uint64_t dropped() const;
+    //!@}
 };
 
 #endif  // SPONGE_LIBSPONGE_ROUTER_HH
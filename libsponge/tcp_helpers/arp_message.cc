@@ -1,6 +1,7 @@
 #include "arp_message.hh"
 
 #include <arpa/inet.h>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 
@@ -9,31 +10,28 @@ using namespace std;
 ParseResult ARPMessage::parse(const Buffer buffer) {
     NetParser p{buffer};
 
-    if (p.buffer().size() < ARPMessage::LENGTH) {
+    const char *const raw = p.take(ARPMessage::LENGTH);
+    if (raw == nullptr) {
         return ParseResult::PacketTooShort;
     }
 
-    hardware_type = p.u16();
-    protocol_type = p.u16();
-    hardware_address_size = p.u8();
-    protocol_address_size = p.u8();
-    opcode = p.u16();
+    hardware_type = NetParser::load_u16(raw);
+    protocol_type = NetParser::load_u16(raw + 2);
+    hardware_address_size = NetParser::load_u8(raw + 4);
+    protocol_address_size = NetParser::load_u8(raw + 5);
+    opcode = NetParser::load_u16(raw + 6);
 
     if (not supported()) {
         return ParseResult::Unsupported;
     }
 
     // read sender addresses (Ethernet and IP)
-    for (auto &byte : sender_ethernet_address) {
-        byte = p.u8();
-    }
-    sender_ip_address = p.u32();
+    memcpy(sender_ethernet_address.data(), raw + 8, sender_ethernet_address.size());
+    sender_ip_address = NetParser::load_u32(raw + 14);
 
     // read target addresses (Ethernet and IP)
-    for (auto &byte : target_ethernet_address) {
-        byte = p.u8();
-    }
-    target_ip_address = p.u32();
+    memcpy(target_ethernet_address.data(), raw + 18, target_ethernet_address.size());
+    target_ip_address = NetParser::load_u32(raw + 24);
 
     return p.get_error();
 }
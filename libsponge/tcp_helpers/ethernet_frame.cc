@@ -22,3 +22,14 @@ BufferList EthernetFrame::serialize() const {
     ret.append(_payload);
     return ret;
 }
+
+//! \param[in,out] packet needs at least size() bytes of headroom
+void EthernetFrame::serialize_into(PacketBuffer &packet) const { serialize_into(packet.prepend(size())); }
+
+void EthernetFrame::serialize_into(char *out) const {
+    _header.serialize_into(out);
+    out += EthernetHeader::LENGTH;
+    for (const auto &buffer : _payload.buffers()) {
+        out += buffer.str().copy(out, buffer.size());
+    }
+}
@@ -17,6 +17,15 @@ class EthernetFrame {
     //! \brief Serialize the frame to a string
     BufferList serialize() const;
 
+    //! \brief Serialize the frame (payload, then header) into the headroom of `packet`
+    void serialize_into(PacketBuffer &packet) const;
+
+    //! \brief Serialize the frame into `out`, which must have room for size() bytes
+    void serialize_into(char *out) const;
+
+    //! \brief Size of the serialized frame
+    size_t size() const { return EthernetHeader::LENGTH + _payload.size(); }
+
     //! \name Accessors
     //!@{
     const EthernetHeader &header() const { return _header; }
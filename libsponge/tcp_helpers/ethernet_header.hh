@@ -33,6 +33,9 @@ struct EthernetHeader {
     //! Serialize the Ethernet fields to a string
     std::string serialize() const;
 
+    //! Serialize the Ethernet fields into the LENGTH bytes at `out`
+    void serialize_into(char *out) const;
+
     //! Return a string containing a header in human-readable format
     std::string to_string() const;
 };
@@ -6,8 +6,17 @@
 
 using namespace std;
 
-//! \details This function first attempts to parse a TCP segment from the next UDP
-//! payload recv()d from the socket.
+//! \param[in] sock is the UDP socket that will be owned by the adapter
+//! \param[in] offload asks the kernel to send runs of equal-size segments as one buffer (UDP_SEGMENT) and to
+//!            deliver them the same way (UDP_GRO); either is silently skipped if the kernel lacks it
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool offload) : _sock(move(sock)) {
+    if (offload) {
+        _sock.enable_segmentation_offload();
+        _sock.enable_receive_offload();
+    }
+}
+
+//! \details This function first attempts to parse a TCP segment from a UDP payload.
 //!
 //! If this succeeds, it then checks that the received segment is related to the
 //! current connection. When a TCP connection has been established, this means
@@ -17,10 +26,9 @@ using namespace std;
 //! and the TCP segment read from the wire includes a SYN, this function clears the
 //! `_listen` flag and calls calls connect() on the underlying UDP socket, with
 //! the result that future outgoing segments go to the sender of the SYN segment.
+//! \param[in] datagram is the received datagram (its payload is moved into the segment)
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
-    auto datagram = _sock.recv();
-
+optional<TCPSegment> TCPOverUDPSocketAdapter::unwrap_tcp_in_udp(UDPSocket::received_datagram &datagram) {
     // is it for us?
     if (not listening() and (datagram.source_address != config().destination)) {
         return {};
@@ -45,12 +53,46 @@ optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
     return seg;
 }
 
-//! Serialize a TCP segment and send it as the payload of a UDP datagram.
+//! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
+optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
+    auto datagram = _sock.recv();
+    return unwrap_tcp_in_udp(datagram);
+}
+
+//! \details One [recvmmsg(2)](\ref man2::recvmmsg) collects every datagram that is already waiting
+//! (with GRO, each may be a buffer of coalesced segments, which UDPSocket::recv_batch splits apart).
+//! \returns the valid segments related to the current connection, in the order they were received
+vector<TCPSegment> TCPOverUDPSocketAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    const size_t received = _sock.recv_batch(_received);
+    for (size_t i = 0; i < received; i++) {
+        auto seg = unwrap_tcp_in_udp(_received[i]);
+        if (seg) {
+            ret.push_back(move(seg.value()));
+        }
+    }
+    return ret;
+}
+
+//! Serialize a TCP segment and queue it as the payload of a UDP datagram.
+//! Full-size segments queued back to back go out as a single GSO buffer if offload is enabled.
 //! \param[in] seg is the TCP segment to write
 void TCPOverUDPSocketAdapter::write(TCPSegment &seg) {
     seg.header().sport = config().source.port();
     seg.header().dport = config().destination.port();
-    _sock.sendto(config().destination, seg.serialize(0));
+    PacketBuffer packet{4 * seg.header().doff + seg.payload().size()};
+    seg.serialize_into(packet);
+    _outbound.push_back(packet.release());
+}
+
+void TCPOverUDPSocketAdapter::flush() {
+    if (_outbound.empty()) {
+        return;
+    }
+    _outbound_views.assign(_outbound.begin(), _outbound.end());
+    _sock.sendto_batch(config().destination, _outbound_views);
+    _outbound_views.clear();
+    _outbound.clear();
 }
 
 //! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
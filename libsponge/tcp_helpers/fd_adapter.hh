@@ -10,6 +10,7 @@
 
 #include <optional>
 #include <utility>
+#include <vector>
 
 //! \brief Basic functionality for file descriptor adaptors
 //! \details See TCPOverUDPSocketAdapter and TCPOverIPv4OverTunFdAdapter for more information.
@@ -40,6 +41,9 @@ class FdAdapterBase {
 
     //! Called periodically when time elapses
     void tick(const size_t) {}
+
+    //! Called after a burst of writes, for adapters that batch datagrams
+    void flush() {}
 };
 
 //! \brief A FD adaptor that reads and writes TCP segments in UDP payloads
@@ -47,16 +51,32 @@ class TCPOverUDPSocketAdapter : public FdAdapterBase {
   private:
     UDPSocket _sock;
 
+    std::vector<UDPSocket::received_datagram> _received{};  //!< Storage reused by UDPSocket::recv_batch
+    std::vector<BufferList> _outbound{};                    //!< Serialized segments waiting for flush()
+    std::vector<BufferViewList> _outbound_views{};          //!< Storage reused by flush()
+
+    //! Parse a TCP segment from a UDP payload, if it belongs to the current connection
+    std::optional<TCPSegment> unwrap_tcp_in_udp(UDPSocket::received_datagram &datagram);
+
   public:
-    //! Construct from a UDPSocket sliced into a FileDescriptor
-    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock) : _sock(std::move(sock)) {}
+    //! Construct from a UDPSocket, optionally letting the kernel split and coalesce datagrams (UDP GSO/GRO)
+    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool offload = false);
 
     //! Attempts to read and return a TCP segment related to the current connection from a UDP payload
+    //! \note With offload enabled, a coalesced buffer yields one segment per call, and the rest on the calls
+    //! after it, which the socket does not poll readable for (see UDPSocket::held_datagrams()); read_batch()
+    //! returns them all at once.
     std::optional<TCPSegment> read();
 
-    //! Writes a TCP segment into a UDP payload
+    //! Reads every datagram already queued on the socket (up to a limit) and returns the related TCP segments
+    std::vector<TCPSegment> read_batch();
+
+    //! Queues a TCP segment to be sent as a UDP payload by the next flush()
     void write(TCPSegment &seg);
 
+    //! Sends all queued segments with [sendmmsg(2)](\ref man2::sendmmsg)
+    void flush();
+
     //! Access the underlying UDP socket
     operator UDPSocket &() { return _sock; }
 
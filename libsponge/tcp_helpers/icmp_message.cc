@@ -0,0 +1,55 @@
+#include "icmp_message.hh"
+
+#include "util.hh"
+
+#include <sstream>
+
+using namespace std;
+
+ParseResult ICMPMessage::parse(const Buffer buffer) {
+    InternetChecksum check;
+    check.add(buffer.str());
+    if (check.value() != 0) {
+        return ParseResult::BadChecksum;
+    }
+
+    NetParser p{buffer};
+    const char *const raw = p.take(HEADER_LENGTH);
+    if (raw == nullptr) {
+        return ParseResult::PacketTooShort;
+    }
+
+    type = NetParser::load_u8(raw);
+    code = NetParser::load_u8(raw + 1);
+    cksum = NetParser::load_u16(raw + 2);
+    rest = NetParser::load_u32(raw + 4);
+    data = p.buffer().copy();
+
+    return p.get_error();
+}
+
+string ICMPMessage::serialize() const {
+    string ret(HEADER_LENGTH, 0);
+    NetUnparser::store_u8(ret.data(), type);
+    NetUnparser::store_u8(ret.data() + 1, code);
+    NetUnparser::store_u32(ret.data() + 4, rest);
+    ret += data;
+
+    // checksum over the whole message, with the checksum field zero
+    InternetChecksum check;
+    check.add(ret);
+    NetUnparser::store_u16(ret.data() + 2, check.value());
+    return ret;
+}
+
+bool ICMPMessage::is_error(const uint8_t type) {
+    return type == TYPE_DESTINATION_UNREACHABLE or type == TYPE_SOURCE_QUENCH or type == TYPE_REDIRECT or
+           type == TYPE_TIME_EXCEEDED or type == TYPE_PARAMETER_PROBLEM;
+}
+
+string ICMPMessage::to_string() const {
+    stringstream ss{};
+    ss << "ICMP type=" << unsigned(type) << " code=" << unsigned(code) << " rest=" << rest
+       << " data_length=" << data.size();
+    return ss.str();
+}
@@ -0,0 +1,54 @@
+#ifndef SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
+#define SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
+
+#include "parser.hh"
+
+#include <cstdint>
+#include <string>
+
+//! \brief [ICMP](\ref rfc::rfc792) message
+struct ICMPMessage {
+    static constexpr size_t HEADER_LENGTH = 8;  //!< ICMP header length, including the type-specific word
+
+    //! \name Types, and codes of the error messages a router sends
+    //!@{
+    static constexpr uint8_t TYPE_DESTINATION_UNREACHABLE = 3;
+    static constexpr uint8_t TYPE_SOURCE_QUENCH = 4;
+    static constexpr uint8_t TYPE_REDIRECT = 5;
+    static constexpr uint8_t TYPE_TIME_EXCEEDED = 11;
+    static constexpr uint8_t TYPE_PARAMETER_PROBLEM = 12;
+
+    static constexpr uint8_t CODE_NET_UNREACHABLE = 0;       //!< No route to the destination
+    static constexpr uint8_t CODE_FRAGMENTATION_NEEDED = 4;  //!< Too big for the next hop, and DF set
+    static constexpr uint8_t CODE_TTL_EXCEEDED_IN_TRANSIT = 0;
+    //!@}
+
+    //! Bytes of the offending datagram's payload that an error message quotes, after its header
+    static constexpr size_t QUOTED_PAYLOAD = 8;
+
+    //! \name ICMP fields
+    //!@{
+    uint8_t type = 0;
+    uint8_t code = 0;
+    uint16_t cksum = 0;  //!< Checksum (computed by serialize())
+    uint32_t rest = 0;   //!< Type-specific word (for "fragmentation needed", the next hop's MTU)
+    std::string data{};  //!< For an error, the offending datagram's header and first 8 payload bytes
+    //!@}
+
+    //! Parse the ICMP message from a buffer, checking its checksum
+    ParseResult parse(const Buffer buffer);
+
+    //! Serialize the ICMP message, with its checksum
+    std::string serialize() const;
+
+    //! Is this an error message (which must never cause another)?
+    static bool is_error(const uint8_t type);
+
+    //! Return a string containing the ICMP message in human-readable format
+    std::string to_string() const;
+};
+
+//! \struct ICMPMessage
+//! This struct can be used to parse an existing ICMP message or to create a new one.
+
+#endif  // SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
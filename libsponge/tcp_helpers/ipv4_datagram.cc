@@ -5,17 +5,41 @@
 
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
+//! Offset of the checksum field within the IPv4 header
+static constexpr size_t CHECKSUM_OFFSET = 10;
+
+//! \details Bytes past the header's `len` (such as the padding of a short Ethernet frame) are dropped.
 ParseResult IPv4Datagram::parse(const Buffer buffer) {
+    _received = {};
+    _received_header_length = 0;
+
     NetParser p{buffer};
     _header.parse(p);
     _payload = p.buffer();
 
-    if (_payload.size() != _header.payload_length()) {
+    if (_payload.size() < _header.payload_length()) {
         return ParseResult::PacketTooShort;
     }
+    if (_payload.size() > _header.payload_length()) {
+        _payload = string{p.buffer().str().substr(0, _header.payload_length())};
+    }
+
+    // parse() has verified the checksum (options, which serialize() drops, would change it)
+    if (not p.error() and _header.hlen * 4 == IPv4Header::LENGTH) {
+        _checksummed_header = _header;
+    } else {
+        _checksummed_header.reset();
+    }
+
+    if (not p.error()) {
+        _received = buffer;
+        _received_header_length = 4 * size_t{_header.hlen};
+    }
 
     return p.get_error();
 }
@@ -25,17 +49,88 @@ BufferList IPv4Datagram::serialize() const {
         throw runtime_error("IPv4Datagram::serialize: payload is wrong size");
     }
 
+    string header_serialized(4 * _header.hlen, 0);
+    write_header(header_serialized.data());
+
+    BufferList ret;
+    ret.append(move(header_serialized));
+    ret.append(_payload);
+    return ret;
+}
+
+//! \param[in,out] packet needs at least the datagram's `len` bytes of headroom
+void IPv4Datagram::serialize_into(PacketBuffer &packet) const {
+    if (_payload.size() != _header.payload_length()) {
+        throw runtime_error("IPv4Datagram::serialize_into: payload is wrong size");
+    }
+
+    const auto &buffers = _payload.buffers();
+    for (auto it = buffers.rbegin(); it != buffers.rend(); ++it) {
+        packet.prepend(it->str());
+    }
+    serialize_header_into(packet);
+}
+
+void IPv4Datagram::write_header(char *const out) const {
+    if (checksum_known()) {
+        _header.serialize_into(out);
+        return;
+    }
+
     IPv4Header header_out = _header;
     header_out.cksum = 0;
-    const string header_zero_checksum = header_out.serialize();
+    header_out.serialize_into(out);
 
-    // calculate checksum -- taken over header only
+    // calculate checksum -- taken over header only -- and write it into place
     InternetChecksum check;
-    check.add(header_zero_checksum);
-    header_out.cksum = check.value();
+    check.add({out, 4 * size_t{_header.hlen}});
+    NetUnparser::store_u16(out + CHECKSUM_OFFSET, check.value());
+}
 
-    BufferList ret;
-    ret.append(header_out.serialize());
-    ret.append(_payload);
-    return ret;
+//! \details The TTL shares a 16-bit word with the protocol number, so the checksum is patched
+//! ([RFC 1624](https://tools.ietf.org/html/rfc1624)) rather than recomputed, and a datagram that
+//! arrived with a good checksum still has one without serialize() going over the header again.
+void IPv4Datagram::decrement_ttl() {
+    const bool checksummed = checksum_known();
+    const uint16_t old_word = (_header.ttl << 8) | _header.proto;
+    _header.ttl--;
+    const uint16_t new_word = (_header.ttl << 8) | _header.proto;
+
+    InternetChecksum check{static_cast<uint16_t>(~_header.cksum)};
+    check.replace(old_word, new_word);
+    _header.cksum = check.value();
+
+    if (checksummed) {
+        _checksummed_header = _header;
+    }
+}
+
+//! \details Every fragment but the last carries a multiple of 8 payload bytes (offsets count 8-byte
+//! units), and all carry the datagram's header, with `offset`, `mf` and `len` set. The last fragment
+//! keeps the datagram's `mf`, so that the fragments of a fragment are fragments of the same datagram.
+vector<IPv4Datagram> IPv4Datagram::fragment(const size_t mtu) const {
+    if (_header.len <= mtu) {
+        return {*this};
+    }
+    if (_header.df) {
+        throw runtime_error("IPv4Datagram::fragment: datagram may not be fragmented");
+    }
+    const size_t header_length = 4 * size_t{_header.hlen};
+    const size_t per_fragment = mtu < header_length ? 0 : (mtu - header_length) / 8 * 8;
+    if (per_fragment == 0) {
+        throw runtime_error("IPv4Datagram::fragment: MTU leaves no room for a payload");
+    }
+
+    const string payload = _payload.concatenate();
+    vector<IPv4Datagram> fragments;
+    for (size_t first = 0; first < payload.size(); first += per_fragment) {
+        IPv4Datagram piece;
+        piece._header = _header;
+        piece._payload = payload.substr(first, per_fragment);
+        piece._header.offset = _header.offset + first / 8;
+        piece._header.mf = _header.mf or first + per_fragment < payload.size();
+        piece._header.len = header_length + piece._payload.size();
+        fragments.push_back(move(piece));
+    }
+    return fragments;
 }
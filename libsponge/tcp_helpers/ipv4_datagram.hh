@@ -4,12 +4,31 @@
 #include "buffer.hh"
 #include "ipv4_header.hh"
 
+#include <optional>
+#include <string_view>
+#include <vector>
+
 //! \brief [IPv4](\ref rfc::rfc791) Internet datagram
 class IPv4Datagram {
   private:
     IPv4Header _header{};
     BufferList _payload{};
 
+    //! A header whose `cksum` is known to be right (as parsed, or as patched by decrement_ttl());
+    //! serialize() reuses the checksum while the header still matches it
+    std::optional<IPv4Header> _checksummed_header{};
+
+    //! The bytes parse() was given (empty unless it succeeded), whose first `_received_header_length` are
+    //! the header as received, options and all
+    Buffer _received{};
+    size_t _received_header_length{0};
+
+    //! Is `_header.cksum` known to be right?
+    bool checksum_known() const { return _checksummed_header and _checksummed_header.value() == _header; }
+
+    //! Write the header, with a correct checksum, into the `4 * hlen` bytes at `out`
+    void write_header(char *out) const;
+
   public:
     //! \brief Parse the segment from a string
     ParseResult parse(const Buffer buffer);
@@ -17,6 +36,21 @@ class IPv4Datagram {
     //! \brief Serialize the segment to a string
     BufferList serialize() const;
 
+    //! \brief Serialize the datagram (payload, then header) into the headroom of `packet`
+    void serialize_into(PacketBuffer &packet) const;
+
+    //! \brief Serialize just the header into the headroom of `packet`, in front of a payload already there
+    //! \details E.g. after TCPSegment::serialize_into(), so the segment is never held as a separate payload.
+    void serialize_header_into(PacketBuffer &packet) const { write_header(packet.prepend(4 * _header.hlen)); }
+
+    //! \brief Decrement the TTL, updating the header checksum incrementally
+    void decrement_ttl();
+
+    //! \brief Split the datagram into [fragments](\ref rfc::rfc791) of at most `mtu` bytes each (or
+    //! just copy it, if it fits)
+    //! \throws runtime_error if it does not fit and has `df` set, or `mtu` leaves no room for a payload
+    std::vector<IPv4Datagram> fragment(const size_t mtu) const;
+
     //! \name Accessors
     //!@{
     const IPv4Header &header() const { return _header; }
@@ -24,6 +58,9 @@ class IPv4Datagram {
 
     const BufferList &payload() const { return _payload; }
     BufferList &payload() { return _payload; }
+
+    //! The header's bytes as parsed, with any options and the checksum it arrived with (empty if not parsed)
+    std::string_view received_header() const { return _received.str().substr(0, _received_header_length); }
     //!@}
 };
 
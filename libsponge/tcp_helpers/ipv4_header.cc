@@ -3,6 +3,7 @@
 #include "util.hh"
 
 #include <arpa/inet.h>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 
@@ -18,33 +19,37 @@ using namespace std;
 //! - wrong IP version number
 //! - the header's `hlen` field is shorter than the minimum allowed
 //! - there is less data in the header than the `doff` field claims
-//! - there is less data in the full datagram than the `len` field claims
+//! - the `len` field is shorter than the header
+//! - there is less data in the full datagram than the `len` field claims (there may be more, such as
+//!   link-layer padding, which the caller should drop)
 //! - the checksum is bad
 ParseResult IPv4Header::parse(NetParser &p) {
-    Buffer original_serialized_version = p.buffer();
+    const string_view original_serialized_version = p.view();
 
-    const size_t data_size = p.buffer().size();
+    const size_t data_size = original_serialized_version.size();
     if (data_size < IPv4Header::LENGTH) {
         return ParseResult::PacketTooShort;
     }
 
-    const uint8_t first_byte = p.u8();
-    ver = first_byte >> 4;     // version
-    hlen = first_byte & 0x0f;  // header length
-    tos = p.u8();              // type of service
-    len = p.u16();             // length
-    id = p.u16();              // id
+    const char *const raw = p.take(IPv4Header::LENGTH);
 
-    const uint16_t fo_val = p.u16();
+    const uint8_t first_byte = NetParser::load_u8(raw);
+    ver = first_byte >> 4;               // version
+    hlen = first_byte & 0x0f;            // header length
+    tos = NetParser::load_u8(raw + 1);   // type of service
+    len = NetParser::load_u16(raw + 2);  // length
+    id = NetParser::load_u16(raw + 4);   // id
+
+    const uint16_t fo_val = NetParser::load_u16(raw + 6);
     df = static_cast<bool>(fo_val & 0x4000);  // don't fragment
     mf = static_cast<bool>(fo_val & 0x2000);  // more fragments
     offset = fo_val & 0x1fff;                 // offset
 
-    ttl = p.u8();     // ttl
-    proto = p.u8();   // proto
-    cksum = p.u16();  // checksum
-    src = p.u32();    // source address
-    dst = p.u32();    // destination address
+    ttl = NetParser::load_u8(raw + 8);      // ttl
+    proto = NetParser::load_u8(raw + 9);    // proto
+    cksum = NetParser::load_u16(raw + 10);  // checksum
+    src = NetParser::load_u32(raw + 12);    // source address
+    dst = NetParser::load_u32(raw + 16);    // destination address
 
     if (data_size < 4 * hlen) {
         return ParseResult::PacketTooShort;
@@ -55,7 +60,10 @@ ParseResult IPv4Header::parse(NetParser &p) {
     if (hlen < 5) {
         return ParseResult::HeaderTooShort;
     }
-    if (data_size != len) {
+    if (len < 4 * hlen) {
+        return ParseResult::PacketTooShort;
+    }
+    if (data_size < len) {
         return ParseResult::TruncatedPacket;
     }
 
@@ -66,7 +74,7 @@ ParseResult IPv4Header::parse(NetParser &p) {
     }
 
     InternetChecksum check;
-    check.add({original_serialized_version.str().data(), size_t(4 * hlen)});
+    check.add(original_serialized_version.substr(0, 4 * hlen));
     if (check.value()) {
         return ParseResult::BadChecksum;
     }
@@ -76,6 +84,13 @@ ParseResult IPv4Header::parse(NetParser &p) {
 
 //! Serialize the IPv4Header to a string (does not recompute the checksum)
 string IPv4Header::serialize() const {
+    string ret(4 * hlen, 0);
+    serialize_into(ret.data());
+    return ret;
+}
+
+//! \param[out] out receives the header, with any options zeroed (the checksum is not recomputed)
+void IPv4Header::serialize_into(char *const out) const {
     // sanity checks
     if (ver != 4) {
         throw runtime_error("wrong IP version");
@@ -84,29 +99,30 @@ string IPv4Header::serialize() const {
         throw runtime_error("IP header too short");
     }
 
-    string ret;
-    ret.reserve(4 * hlen);
-
     const uint8_t first_byte = (ver << 4) | (hlen & 0xf);
-    NetUnparser::u8(ret, first_byte);  // version and header length
-    NetUnparser::u8(ret, tos);         // type of service
-    NetUnparser::u16(ret, len);        // length
-    NetUnparser::u16(ret, id);         // id
+    NetUnparser::store_u8(out, first_byte);  // version and header length
+    NetUnparser::store_u8(out + 1, tos);     // type of service
+    NetUnparser::store_u16(out + 2, len);    // length
+    NetUnparser::store_u16(out + 4, id);     // id
 
     const uint16_t fo_val = (df ? 0x4000 : 0) | (mf ? 0x2000 : 0) | (offset & 0x1fff);
-    NetUnparser::u16(ret, fo_val);  // flags and offset
+    NetUnparser::store_u16(out + 6, fo_val);  // flags and offset
 
-    NetUnparser::u8(ret, ttl);    // time to live
-    NetUnparser::u8(ret, proto);  // protocol number
+    NetUnparser::store_u8(out + 8, ttl);    // time to live
+    NetUnparser::store_u8(out + 9, proto);  // protocol number
 
-    NetUnparser::u16(ret, cksum);  // checksum
+    NetUnparser::store_u16(out + 10, cksum);  // checksum
 
-    NetUnparser::u32(ret, src);  // src address
-    NetUnparser::u32(ret, dst);  // dst address
+    NetUnparser::store_u32(out + 12, src);  // src address
+    NetUnparser::store_u32(out + 16, dst);  // dst address
 
-    ret.resize(4 * hlen);  // expand header to advertised size
+    memset(out + LENGTH, 0, 4 * hlen - LENGTH);  // expand header to advertised size
+}
 
-    return ret;
+bool IPv4Header::operator==(const IPv4Header &other) const {
+    return ver == other.ver and hlen == other.hlen and tos == other.tos and len == other.len and id == other.id and
+           df == other.df and mf == other.mf and offset == other.offset and ttl == other.ttl and
+           proto == other.proto and cksum == other.cksum and src == other.src and dst == other.dst;
 }
 
 uint16_t IPv4Header::payload_length() const { return len - 4 * hlen; }
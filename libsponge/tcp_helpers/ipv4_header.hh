@@ -8,7 +8,9 @@
 struct IPv4Header {
     static constexpr size_t LENGTH = 20;         //!< [IPv4](\ref rfc::rfc791) header length, not including options
     static constexpr uint8_t DEFAULT_TTL = 128;  //!< A reasonable default TTL value
+    static constexpr uint8_t PROTO_ICMP = 1;     //!< Protocol number for [icmp](\ref rfc::rfc792)
     static constexpr uint8_t PROTO_TCP = 6;      //!< Protocol number for [tcp](\ref rfc::rfc793)
+    static constexpr uint8_t PROTO_UDP = 17;     //!< Protocol number for udp
 
     //! \struct IPv4Header
     //! ~~~{.txt}
@@ -52,6 +54,9 @@ struct IPv4Header {
     //! Serialize the IP fields
     std::string serialize() const;
 
+    //! Serialize the IP fields into the `4 * hlen` bytes at `out`
+    void serialize_into(char *out) const;
+
     //! Length of the payload
     uint16_t payload_length() const;
 
@@ -63,6 +68,9 @@ struct IPv4Header {
 
     //! Return a string containing a human-readable summary of the header
     std::string summary() const;
+
+    //! Are all the fields (including the checksum) equal?
+    bool operator==(const IPv4Header &other) const;
 };
 
 //! \struct IPv4Header
@@ -6,9 +6,11 @@
 #include "tcp_segment.hh"
 #include "util.hh"
 
+#include <algorithm>
 #include <optional>
 #include <random>
 #include <utility>
+#include <vector>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
 template <typename AdapterT>
@@ -47,6 +49,15 @@ class LossyFdAdapter {
         return ret;
     }
 
+    //! \brief Read a batch from the underlying AdapterT instance, potentially dropping each datagram
+    //! \returns the segments that survived
+    std::vector<TCPSegment> read_batch() {
+        auto ret = _adapter.read_batch();
+        ret.erase(std::remove_if(ret.begin(), ret.end(), [&](const TCPSegment &) { return _should_drop(false); }),
+                  ret.end());
+        return ret;
+    }
+
     //! \brief Write to the underlying AdapterT instance, potentially dropping the datagram to be written
     //! \param[in] seg is the packet to either write or drop
     void write(TCPSegment &seg) {
@@ -63,6 +74,7 @@ class LossyFdAdapter {
     void set_listening(const bool l) { _adapter.set_listening(l); }      //!< FdAdapterBase::set_listening passthrough
     const FdAdapterConfig &config() const { return _adapter.config(); }  //!< FdAdapterBase::config passthrough
     FdAdapterConfig &config_mut() { return _adapter.config_mut(); }      //!< FdAdapterBase::config_mut passthrough
+    void flush() { _adapter.flush(); }                                   //!< FdAdapterBase::flush passthrough
     void tick(const size_t ms_since_last_tick) {
         _adapter.tick(ms_since_last_tick);
     }  //!< FdAdapterBase::tick passthrough
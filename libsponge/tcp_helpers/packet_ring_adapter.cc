@@ -0,0 +1,49 @@
+#include "packet_ring_adapter.hh"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+//! \returns the valid segments, in the order they were published (while listening, only from the first SYN on)
+vector<TCPSegment> TCPOverPacketRingAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    _ring.answer_doorbell();
+    while (const auto packet = _ring.peek()) {
+        // the slot goes back to the peer as soon as it is parsed, so the segment keeps its own copy
+        PacketBuffer copy{packet->size()};
+        copy.prepend(packet.value());
+        _ring.pop();
+
+        TCPSegment seg;
+        if (seg.parse(copy.release()) != ParseResult::NoError) {
+            continue;
+        }
+        if (listening()) {
+            if (not seg.header().syn or seg.header().rst) {
+                continue;
+            }
+            set_listening(false);
+        }
+        ret.push_back(move(seg));
+    }
+    return ret;
+}
+
+//! \param[in] seg is the TCP segment to write
+void TCPOverPacketRingAdapter::write(TCPSegment &seg) {
+    seg.header().sport = config().source.port();
+    seg.header().dport = config().destination.port();
+
+    const size_t length = 4 * seg.header().doff + seg.payload().size();
+    if (length > _ring.slot_size()) {
+        throw runtime_error("TCPOverPacketRingAdapter: segment does not fit in a ring slot");
+    }
+    char *const slot = _ring.claim();
+    if (slot == nullptr) {
+        _dropped++;
+        return;
+    }
+    seg.serialize_into(slot);
+    _ring.publish(length);
+}
@@ -0,0 +1,44 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_RING_ADAPTER_HH
+#define SPONGE_LIBSPONGE_PACKET_RING_ADAPTER_HH
+
+#include "fd_adapter.hh"
+#include "packet_ring.hh"
+#include "tcp_segment.hh"
+
+#include <cstdint>
+#include <vector>
+
+//! \brief A FD adapter that exchanges bare TCP segments with a co-located process through shared memory
+//! \details Segments are serialized straight into a slot of the outgoing PacketRing and parsed out of the
+//! incoming one, so the kernel never copies a packet: the only system calls are the doorbells, one per
+//! burst. The link is point to point, so (like TCPOverUDPSocketAdapter) a listening adapter takes the
+//! first SYN as its connection, and the ports in the FdAdapterConfig label outgoing segments.
+class TCPOverPacketRingAdapter : public FdAdapterBase {
+  private:
+    PacketRingEndpoint _ring;
+    uint64_t _dropped = 0;  //!< Outgoing segments dropped because the ring was full
+
+  public:
+    //! Construct from one end of a shared-memory link
+    explicit TCPOverPacketRingAdapter(PacketRingEndpoint &&ring) : _ring(std::move(ring)) {}
+
+    //! Answers the doorbell and returns every segment waiting in the incoming ring
+    std::vector<TCPSegment> read_batch();
+
+    //! Serializes a TCP segment into the outgoing ring (or drops it, if the ring is full)
+    void write(TCPSegment &seg);
+
+    //! Rings the peer's doorbell, if it may be asleep
+    void flush() { _ring.flush(); }
+
+    //! Outgoing segments dropped so far because the peer fell behind
+    uint64_t dropped() const { return _dropped; }
+
+    //! Access the underlying endpoint (whose doorbell is what an EventLoop waits on)
+    operator PacketRingEndpoint &() { return _ring; }
+
+    //! Access the underlying endpoint
+    operator const PacketRingEndpoint &() const { return _ring; }
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_RING_ADAPTER_HH
@@ -0,0 +1,68 @@
+#include "packet_socket_adapter.hh"
+
+#include <utility>
+
+using namespace std;
+
+//! \param[in] socket is the packet socket that will be owned by the adapter
+//! \param[in] eth_address Ethernet address (local address) of the adapter
+//! \param[in] ip_address IP address (local address) of the adapter
+//! \param[in] next_hop IP address of the next hop (typically a router or default gateway)
+TCPOverIPv4OverPacketSocketAdapter::TCPOverIPv4OverPacketSocketAdapter(PacketSocket &&socket,
+                                                                       const EthernetAddress &eth_address,
+                                                                       const Address &ip_address,
+                                                                       const Address &next_hop)
+    : _socket(move(socket)), _interface(eth_address, ip_address), _next_hop(next_hop) {}
+
+vector<TCPSegment> TCPOverIPv4OverPacketSocketAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    while (const auto received = _socket.receive()) {
+        PacketBuffer copy{received->size()};
+        copy.prepend(received.value());
+        EthernetFrame frame;
+        if (frame.parse(copy.release()) != ParseResult::NoError) {
+            continue;
+        }
+
+        // Give the frame to the NetworkInterface. Get back an Internet datagram if frame was carrying one.
+        optional<InternetDatagram> ip_dgram = _interface.recv_frame(frame);
+        if (ip_dgram) {
+            auto seg = unwrap_tcp_in_ip(ip_dgram.value());
+            if (seg) {
+                ret.push_back(move(seg.value()));
+            }
+        }
+    }
+
+    // The incoming frames may have caused the NetworkInterface to send frames (e.g. ARP replies).
+    send_pending();
+    flush();
+    return ret;
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void TCPOverIPv4OverPacketSocketAdapter::tick(const size_t ms_since_last_tick) {
+    _interface.tick(ms_since_last_tick);
+    send_pending();
+    flush();
+}
+
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverPacketSocketAdapter::write(TCPSegment &seg) {
+    _interface.send_datagram(wrap_tcp_in_ip(seg), _next_hop);
+    send_pending();
+}
+
+void TCPOverIPv4OverPacketSocketAdapter::send_pending() {
+    while (not _interface.frames_out().empty()) {
+        const EthernetFrame &frame = _interface.frames_out().front();
+        char *const out = _socket.claim(frame.size());
+        if (out == nullptr) {
+            _dropped++;
+        } else {
+            frame.serialize_into(out);
+            _socket.commit(frame.size());
+        }
+        _interface.frames_out().pop();
+    }
+}
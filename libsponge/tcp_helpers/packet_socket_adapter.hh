@@ -0,0 +1,57 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_SOCKET_ADAPTER_HH
+#define SPONGE_LIBSPONGE_PACKET_SOCKET_ADAPTER_HH
+
+#include "network_interface.hh"
+#include "packet_socket.hh"
+#include "tcp_over_ip.hh"
+
+#include <cstdint>
+#include <vector>
+
+//! \brief A FD adapter for IPv4 datagrams in Ethernet frames, exchanged through a PacketSocket's rings
+//! \details The alternative to TCPOverIPv4OverEthernetAdapter for an interface that the kernel already
+//! has (a veth, say): the same NetworkInterface resolves next hops, but a burst of received frames costs
+//! no system call, and the frames sent in one burst share one. Each received frame is copied once, into
+//! a pooled buffer, since the segments parsed from it outlive the ring block it arrived in.
+class TCPOverIPv4OverPacketSocketAdapter : public TCPOverIPv4Adapter {
+  private:
+    PacketSocket _socket;
+
+    NetworkInterface _interface;  //!< NIC abstraction
+
+    Address _next_hop;  //!< IP address of the next hop
+
+    uint64_t _dropped = 0;  //!< Outgoing frames dropped because the transmit ring was full
+
+    void send_pending();  //!< Writes any pending Ethernet frames into the transmit ring
+
+  public:
+    //! Construct from a PacketSocket
+    explicit TCPOverIPv4OverPacketSocketAdapter(PacketSocket &&socket,
+                                                const EthernetAddress &eth_address,
+                                                const Address &ip_address,
+                                                const Address &next_hop);
+
+    //! Reads every frame already in the receive ring and returns the related TCP segments
+    std::vector<TCPSegment> read_batch();
+
+    //! Sends a TCP segment (in an IPv4 datagram, in an Ethernet frame) at the next flush()
+    void write(TCPSegment &seg);
+
+    //! Hands the frames written since the last flush to the kernel
+    void flush() { _socket.flush(); }
+
+    //! Called periodically when time elapses
+    void tick(const size_t ms_since_last_tick);
+
+    //! Outgoing frames dropped so far because the transmit ring was full
+    uint64_t dropped() const { return _dropped; }
+
+    //! Access the underlying packet socket
+    operator PacketSocket &() { return _socket; }
+
+    //! Access the underlying packet socket
+    operator const PacketSocket &() const { return _socket; }
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_SOCKET_ADAPTER_HH
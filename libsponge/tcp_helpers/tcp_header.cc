@@ -1,5 +1,6 @@
 #include "tcp_header.hh"
 
+#include <cstring>
 #include <sstream>
 
 using namespace std;
@@ -15,23 +16,28 @@ using namespace std;
 //! - there is less data in the header than the `doff` field claims
 //! - the checksum is bad
 ParseResult TCPHeader::parse(NetParser &p) {
-    sport = p.u16();                 // source port
-    dport = p.u16();                 // destination port
-    seqno = WrappingInt32{p.u32()};  // sequence number
-    ackno = WrappingInt32{p.u32()};  // ack number
-    doff = p.u8() >> 4;              // data offset
-
-    const uint8_t fl_b = p.u8();                  // byte including flags
-    urg = static_cast<bool>(fl_b & 0b0010'0000);  // binary literals and ' digit separator since C++14!!!
+    const char *const raw = p.take(TCPHeader::LENGTH);
+    if (raw == nullptr) {
+        return p.get_error();
+    }
+
+    sport = NetParser::load_u16(raw);                     // source port
+    dport = NetParser::load_u16(raw + 2);                 // destination port
+    seqno = WrappingInt32{NetParser::load_u32(raw + 4)};  // sequence number
+    ackno = WrappingInt32{NetParser::load_u32(raw + 8)};  // ack number
+    doff = NetParser::load_u8(raw + 12) >> 4;             // data offset
+
+    const uint8_t fl_b = NetParser::load_u8(raw + 13);  // byte including flags
+    urg = static_cast<bool>(fl_b & 0b0010'0000);        // binary literals and ' digit separator since C++14!!!
     ack = static_cast<bool>(fl_b & 0b0001'0000);
     psh = static_cast<bool>(fl_b & 0b0000'1000);
     rst = static_cast<bool>(fl_b & 0b0000'0100);
     syn = static_cast<bool>(fl_b & 0b0000'0010);
     fin = static_cast<bool>(fl_b & 0b0000'0001);
 
-    win = p.u16();    // window size
-    cksum = p.u16();  // checksum
-    uptr = p.u16();   // urgent pointer
+    win = NetParser::load_u16(raw + 14);    // window size
+    cksum = NetParser::load_u16(raw + 16);  // checksum
+    uptr = NetParser::load_u16(raw + 18);   // urgent pointer
 
     if (doff < 5) {
         return ParseResult::HeaderTooShort;
@@ -49,32 +55,34 @@ ParseResult TCPHeader::parse(NetParser &p) {
 
 //! Serialize the TCPHeader to a string (does not recompute the checksum)
 string TCPHeader::serialize() const {
+    string ret(4 * doff, 0);
+    serialize_into(ret.data());
+    return ret;
+}
+
+//! \param[out] out receives the header, with any options zeroed (the checksum is not recomputed)
+void TCPHeader::serialize_into(char *const out) const {
     // sanity check
     if (doff < 5) {
         throw runtime_error("TCP header too short");
     }
 
-    string ret;
-    ret.reserve(4 * doff);
-
-    NetUnparser::u16(ret, sport);              // source port
-    NetUnparser::u16(ret, dport);              // destination port
-    NetUnparser::u32(ret, seqno.raw_value());  // sequence number
-    NetUnparser::u32(ret, ackno.raw_value());  // ack number
-    NetUnparser::u8(ret, doff << 4);           // data offset
+    NetUnparser::store_u16(out, sport);                  // source port
+    NetUnparser::store_u16(out + 2, dport);              // destination port
+    NetUnparser::store_u32(out + 4, seqno.raw_value());  // sequence number
+    NetUnparser::store_u32(out + 8, ackno.raw_value());  // ack number
+    NetUnparser::store_u8(out + 12, doff << 4);          // data offset
 
     const uint8_t fl_b = (urg ? 0b0010'0000 : 0) | (ack ? 0b0001'0000 : 0) | (psh ? 0b0000'1000 : 0) |
                          (rst ? 0b0000'0100 : 0) | (syn ? 0b0000'0010 : 0) | (fin ? 0b0000'0001 : 0);
-    NetUnparser::u8(ret, fl_b);  // flags
-    NetUnparser::u16(ret, win);  // window size
+    NetUnparser::store_u8(out + 13, fl_b);  // flags
+    NetUnparser::store_u16(out + 14, win);  // window size
 
-    NetUnparser::u16(ret, cksum);  // checksum
+    NetUnparser::store_u16(out + 16, cksum);  // checksum
 
-    NetUnparser::u16(ret, uptr);  // urgent pointer
+    NetUnparser::store_u16(out + 18, uptr);  // urgent pointer
 
-    ret.resize(4 * doff);  // expand header to advertised size
-
-    return ret;
+    memset(out + LENGTH, 0, 4 * doff - LENGTH);  // expand header to advertised size
 }
 
 //! \returns A string with the header's contents
@@ -22,8 +22,11 @@ using namespace std;
 //! and the TCP segment read from the wire includes a SYN, this function clears the
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
+//! \param[in] ip_dgram is the datagram to unwrap
+//! \param[in] verify_checksum is `false` if the device reported the TCP checksum as already checked
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram) {
+optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram,
+                                                          const bool verify_checksum) {
     // is the IPv4 datagram for us?
     // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
     if (not listening() and (ip_dgram.header().dst != config().source.ipv4_numeric())) {
@@ -42,7 +45,8 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 
     // is the payload a valid TCP segment?
     TCPSegment tcp_seg;
-    if (ParseResult::NoError != tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum())) {
+    if (ParseResult::NoError !=
+        tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum(), verify_checksum)) {
         return {};
     }
 
@@ -70,9 +74,8 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
     return tcp_seg;
 }
 
-//! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
-//! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
+//! \param[in] seg is the TCP segment to be carried
+InternetDatagram TCPOverIPv4Adapter::datagram_for(TCPSegment &seg) {
     // set the port numbers in the TCP segment
     seg.header().sport = config().source.port();
     seg.header().dport = config().destination.port();
@@ -83,8 +86,30 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
     ip_dgram.header().dst = config().destination.ipv4_numeric();
     ip_dgram.header().len = ip_dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
 
+    return ip_dgram;
+}
+
+//! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
+//! \param[in] seg is the TCP segment to convert
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
+    InternetDatagram ip_dgram = datagram_for(seg);
+
     // set payload, calculating TCP checksum using information from IP header
     ip_dgram.payload() = seg.serialize(ip_dgram.header().pseudo_cksum());
 
     return ip_dgram;
 }
+
+//! \details The payload is copied once, straight into its place in a buffer sized for the whole datagram;
+//! the TCP header and then the IP header are written in front of it, so the datagram costs one allocation
+//! instead of a string per header and a BufferList around them.
+//! \param[in] seg is the TCP segment to convert
+Buffer TCPOverIPv4Adapter::serialize_tcp_in_ip(TCPSegment &seg) {
+    const InternetDatagram ip_dgram = datagram_for(seg);
+
+    PacketBuffer packet{ip_dgram.header().len};
+    seg.serialize_into(packet, ip_dgram.header().pseudo_cksum());
+    ip_dgram.serialize_header_into(packet);
+
+    return packet.release();
+}
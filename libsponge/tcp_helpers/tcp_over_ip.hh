@@ -10,10 +10,17 @@
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase {
+  private:
+    //! Set the segment's ports and make the header (only) of the IPv4 datagram that will carry it
+    InternetDatagram datagram_for(TCPSegment &seg);
+
   public:
-    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram);
+    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram, const bool verify_checksum = true);
 
     InternetDatagram wrap_tcp_in_ip(TCPSegment &seg);
+
+    //! \brief Like wrap_tcp_in_ip(), but serialized back to front into one contiguous datagram
+    Buffer serialize_tcp_in_ip(TCPSegment &seg);
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_OVER_IP_HH
@@ -3,17 +3,28 @@
 #include "parser.hh"
 #include "util.hh"
 
+#include <string>
+#include <utility>
 #include <variant>
 
 using namespace std;
 
+//! Offset of the checksum field within the TCP header
+static constexpr size_t CHECKSUM_OFFSET = 16;
+
 //! \param[in] buffer string/Buffer to be parsed
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum) {
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(buffer);
-    if (check.value()) {
-        return ParseResult::BadChecksum;
+//! \param[in] verify_checksum is `false` when the device already vouched for the checksum
+//!            (or the sender left it partial for the device to finish, as with checksum offload)
+ParseResult TCPSegment::parse(const Buffer buffer,
+                              const uint32_t datagram_layer_checksum,
+                              const bool verify_checksum) {
+    if (verify_checksum) {
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(buffer);
+        if (check.value()) {
+            return ParseResult::BadChecksum;
+        }
     }
 
     NetParser p{buffer};
@@ -26,20 +37,66 @@ size_t TCPSegment::length_in_sequence_space() const {
     return payload().str().size() + (header().syn ? 1 : 0) + (header().fin ? 1 : 0);
 }
 
+//! \param[in] payload is the new payload
+//! \param[in] payload_checksum is a checksum, started from zero, of exactly the bytes of `payload`
+void TCPSegment::set_payload(Buffer payload, const InternetChecksum &payload_checksum) {
+    _payload = move(payload);
+    _checksummed_payload = _payload;
+    _payload_checksum = payload_checksum;
+}
+
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
 BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
     TCPHeader header_out = _header;
     header_out.cksum = 0;
+    string header_serialized = header_out.serialize();
 
-    // calculate checksum -- taken over entire segment
+    // calculate checksum -- taken over entire segment -- and write it into place
     InternetChecksum check(datagram_layer_checksum);
-    check.add(header_out.serialize());
-    check.add(_payload);
-    header_out.cksum = check.value();
+    check.add(header_serialized);
+    if (payload_checksum_known()) {
+        check.add(_payload_checksum);
+    } else {
+        check.add(_payload);
+    }
+    const uint16_t cksum = check.value();
+    NetUnparser::store_u16(header_serialized.data() + CHECKSUM_OFFSET, cksum);
 
     BufferList ret;
-    ret.append(header_out.serialize());
+    ret.append(move(header_serialized));
     ret.append(_payload);
 
     return ret;
 }
+
+//! \details The payload is copied into `packet` (and summed on the way, unless set_payload() supplied
+//! its checksum), then the header is written in front of it and the checksum filled in there.
+//! \param[in,out] packet needs at least `4 * doff` plus the payload size bytes of headroom
+//! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
+void TCPSegment::serialize_into(PacketBuffer &packet, const uint32_t datagram_layer_checksum) const {
+    serialize_into(packet.prepend(4 * _header.doff + _payload.size()), datagram_layer_checksum);
+}
+
+void TCPSegment::serialize_into(char *out, const uint32_t datagram_layer_checksum) const {
+    const size_t header_length = 4 * _header.doff;
+    const string_view payload = _payload.str();
+    char *const payload_out = out + header_length;
+    InternetChecksum payload_checksum;
+    if (payload_checksum_known()) {
+        payload.copy(payload_out, payload.size());
+        payload_checksum = _payload_checksum;
+    } else {
+        payload_checksum.copy_and_checksum(payload, payload_out);
+    }
+
+    char *const header_out = out;
+    TCPHeader header_copy = _header;
+    header_copy.cksum = 0;
+    header_copy.serialize_into(header_out);
+
+    // calculate checksum -- taken over entire segment -- and write it into place
+    InternetChecksum check(datagram_layer_checksum);
+    check.add({header_out, header_length});
+    check.add(payload_checksum);
+    NetUnparser::store_u16(header_out + CHECKSUM_OFFSET, check.value());
+}
@@ -3,6 +3,7 @@
 
 #include "buffer.hh"
 #include "tcp_header.hh"
+#include "util.hh"
 
 #include <cstdint>
 
@@ -12,13 +13,33 @@ class TCPSegment {
     TCPHeader _header{};
     Buffer _payload{};
 
+    //! \brief The payload that `_payload_checksum` covers (see set_payload())
+    //! \details Holding on to it keeps its storage from being reused, so the sum is known to still
+    //! apply whenever `_payload` refers to the same bytes.
+    Buffer _checksummed_payload{};
+    InternetChecksum _payload_checksum{};  //!< Checksum (from zero) of `_checksummed_payload`
+
+    //! Does `_payload_checksum` cover the current payload?
+    bool payload_checksum_known() const {
+        return _payload.str().data() == _checksummed_payload.str().data() and
+               _payload.size() == _checksummed_payload.size();
+    }
+
   public:
     //! \brief Parse the segment from a string
-    ParseResult parse(const Buffer buffer, const uint32_t datagram_layer_checksum = 0);
+    ParseResult parse(const Buffer buffer,
+                      const uint32_t datagram_layer_checksum = 0,
+                      const bool verify_checksum = true);
 
     //! \brief Serialize the segment to a string
     BufferList serialize(const uint32_t datagram_layer_checksum = 0) const;
 
+    //! \brief Serialize the segment (payload, then header) into the headroom of `packet`
+    void serialize_into(PacketBuffer &packet, const uint32_t datagram_layer_checksum = 0) const;
+
+    //! \brief Serialize the segment into `out`, which must have room for the header and payload
+    void serialize_into(char *out, const uint32_t datagram_layer_checksum = 0) const;
+
     //! \name Accessors
     //!@{
     const TCPHeader &header() const { return _header; }
@@ -28,6 +49,10 @@ class TCPSegment {
     Buffer &payload() { return _payload; }
     //!@}
 
+    //! \brief Set the payload along with the checksum of its bytes, which serialize() then needn't recompute
+    //! \details See InternetChecksum::copy_and_checksum()
+    void set_payload(Buffer payload, const InternetChecksum &payload_checksum);
+
     //! \brief Segment's length in sequence space
     //! \note Equal to payload length plus one byte if SYN is set, plus one byte if FIN is set
     size_t length_in_sequence_space() const;
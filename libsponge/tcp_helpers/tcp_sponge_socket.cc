@@ -76,9 +76,8 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     _eventloop.add_rule(_datagram_adapter,
                         Direction::In,
                         [&] {
-                            auto seg = _datagram_adapter.read();
-                            if (seg) {
-                                _tcp->segment_received(move(seg.value()));
+                            for (auto &seg : _datagram_adapter.read_batch()) {
+                                _tcp->segment_received(move(seg));
                             }
 
                             // debugging output:
@@ -158,6 +157,7 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
                                 _datagram_adapter.write(_tcp->segments_out().front());
                                 _tcp->segments_out().pop();
                             }
+                            _datagram_adapter.flush();
                         },
                         [&] { return not _tcp->segments_out().empty(); });
 }
@@ -276,9 +276,18 @@ template class TCPSpongeSocket<TCPOverUDPSocketAdapter>;
 //! Specialization of TCPSpongeSocket for TCPOverIPv4OverTunFdAdapter
 template class TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
 
+//! Specialization of TCPSpongeSocket for TCPOverIPv4OverSteeredTunAdapter
+template class TCPSpongeSocket<TCPOverIPv4OverSteeredTunAdapter>;
+
 //! Specialization of TCPSpongeSocket for TCPOverIPv4OverEthernetAdapter
 template class TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
 
+//! Specialization of TCPSpongeSocket for TCPOverPacketRingAdapter
+template class TCPSpongeSocket<TCPOverPacketRingAdapter>;
+
+//! Specialization of TCPSpongeSocket for TCPOverIPv4OverPacketSocketAdapter
+template class TCPSpongeSocket<TCPOverIPv4OverPacketSocketAdapter>;
+
 //! Specialization of TCPSpongeSocket for LossyTCPOverUDPSocketAdapter
 template class TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 
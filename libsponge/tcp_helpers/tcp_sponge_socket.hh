@@ -6,6 +6,8 @@
 #include "fd_adapter.hh"
 #include "file_descriptor.hh"
 #include "network_interface.hh"
+#include "packet_ring_adapter.hh"
+#include "packet_socket_adapter.hh"
 #include "tcp_config.hh"
 #include "tcp_connection.hh"
 #include "tuntap_adapter.hh"
@@ -98,7 +100,10 @@ class TCPSpongeSocket : public LocalStreamSocket {
 
 using TCPOverUDPSpongeSocket = TCPSpongeSocket<TCPOverUDPSocketAdapter>;
 using TCPOverIPv4SpongeSocket = TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
+using TCPOverIPv4OverSteeredTunSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverSteeredTunAdapter>;
 using TCPOverIPv4OverEthernetSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
+using TCPOverPacketRingSpongeSocket = TCPSpongeSocket<TCPOverPacketRingAdapter>;
+using TCPOverIPv4OverPacketSocketSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverPacketSocketAdapter>;
 
 using LossyTCPOverUDPSpongeSocket = TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 using LossyTCPOverIPv4SpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAdapter>;
@@ -1,7 +1,245 @@
 #include "tuntap_adapter.hh"
 
+#include "util.hh"
+
+#include <limits>
+
 using namespace std;
 
+//! Offset of the checksum field within the TCP header
+static constexpr uint16_t TCP_CHECKSUM_OFFSET = 16;
+
+//! \param[in] tun TUN device that will be owned by the adapter
+//! \param[in] engine selects how datagrams are read and written (IOEngine::IOUring falls back to
+//!            IOEngine::Poll on kernels without io_uring)
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter(TunFD &&tun, const IOEngine engine) : _tun(move(tun)) {
+    if (engine == IOEngine::IOUring and IOUring::available()) {
+        // leave room for a maximum-size super-segment behind its vnet header
+        _uring.emplace(_tun, 32, 65536 + (_tun.vnet_hdr() ? sizeof(VirtioNetHeader) : 0));
+    }
+}
+
+//! \details With offload, the vnet header says whether the kernel has already checked (or, for
+//! traffic from the local stack, never computed) the TCP checksum; such segments are not verified
+//! again. A GRO-coalesced or TSO super-segment is accepted as one large TCP segment.
+optional<TCPSegment> TCPOverIPv4OverTunFdAdapter::unwrap_datagram(Buffer &&datagram) {
+    Buffer buffer{move(datagram)};
+    bool verify_checksum = true;
+    if (_tun.vnet_hdr()) {
+        VirtioNetHeader vnet{};
+        if (vnet.parse(buffer.str()) != ParseResult::NoError) {
+            return {};
+        }
+        verify_checksum = not(vnet.flags & (VirtioNetHeader::F_NEEDS_CSUM | VirtioNetHeader::F_DATA_VALID));
+        buffer.remove_prefix(sizeof(vnet));
+    }
+
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(move(buffer)) != ParseResult::NoError) {
+        return {};
+    }
+    return unwrap_tcp_in_ip(ip_dgram, verify_checksum);
+}
+
+optional<TCPSegment> TCPOverIPv4OverTunFdAdapter::read() {
+    if (_uring) {
+        auto datagram = _uring->read();
+        if (not datagram) {
+            return {};
+        }
+        return unwrap_datagram(move(datagram.value()));
+    }
+    return unwrap_datagram(_tun.read_packet());
+}
+
+//! \details With io_uring, every completed read is drained; otherwise this is a single read().
+vector<TCPSegment> TCPOverIPv4OverTunFdAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    if (not _uring) {
+        auto seg = read();
+        if (seg) {
+            ret.push_back(move(seg.value()));
+        }
+        return ret;
+    }
+
+    while (auto datagram = _uring->read()) {
+        auto seg = unwrap_datagram(move(datagram.value()));
+        if (seg) {
+            ret.push_back(move(seg.value()));
+        }
+    }
+    return ret;
+}
+
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverTunFdAdapter::write(TCPSegment &seg) {
+    if (_tun.vnet_hdr()) {
+        _outbound.push_back(seg);
+        return;
+    }
+    send_datagram(serialize_tcp_in_ip(seg));
+}
+
+void TCPOverIPv4OverTunFdAdapter::flush() {
+    for (size_t first = 0; first < _outbound.size();) {
+        const size_t count = run_length(_outbound, first);
+        send_datagram(wrap_run(_outbound, first, count, config()));
+        first += count;
+    }
+    _outbound.clear();
+
+    if (_uring) {
+        _uring->flush();
+    }
+}
+
+//! \details A run is a series of plain data segments (no SYN, FIN, RST or URG) with the same
+//! acknowledgment, window and header length, whose sequence numbers are contiguous and whose payloads
+//! all have the size of the first one (the last may be shorter) -- exactly what the kernel recreates
+//! when it cuts a super-segment into `gso_size` pieces.
+//! \param[in] segments are the queued segments
+//! \param[in] first is the index in `segments` of the first segment of the run
+//! \returns the number of segments in the run (at least one)
+size_t TCPOverIPv4OverTunFdAdapter::run_length(const vector<TCPSegment> &segments, const size_t first) {
+    const TCPHeader &head = segments[first].header();
+    const size_t mss = segments[first].payload().size();
+    if (mss == 0 or head.syn or head.fin or head.rst or head.urg) {
+        return 1;
+    }
+
+    const size_t max_payload = numeric_limits<uint16_t>::max() - IPv4Header::LENGTH - head.doff * 4;
+    size_t count = 1;
+    size_t payload_size = mss;
+    for (size_t i = first + 1; i < segments.size(); i++) {
+        const TCPSegment &prev = segments[i - 1];
+        const TCPSegment &next = segments[i];
+        const TCPHeader &header = next.header();
+        const size_t size = next.payload().size();
+
+        if (prev.payload().size() != mss or size == 0 or size > mss or payload_size + size > max_payload) {
+            break;
+        }
+        if (header.syn or header.fin or header.rst or header.urg or header.psh != head.psh) {
+            break;
+        }
+        if (header.ack != head.ack or header.ackno != head.ackno or header.win != head.win or
+            header.doff != head.doff or header.seqno != prev.header().seqno + prev.payload().size()) {
+            break;
+        }
+        payload_size += size;
+        count++;
+    }
+    return count;
+}
+
+//! \details The TCP checksum field is left holding the (uncomplemented) pseudo-header sum, and the
+//! vnet header asks the kernel to finish it (`VirtioNetHeader::F_NEEDS_CSUM`); if the run has more than
+//! one segment, it also asks the kernel to split the payload into `gso_size` pieces (TSO). The payloads
+//! are not copied.
+//! \param[in] segments are the queued segments
+//! \param[in] first is the index in `segments` of the first segment of the run
+//! \param[in] count is the number of segments in the run
+//! \param[in] cfg gives the datagram's addresses and the segment's ports
+BufferList TCPOverIPv4OverTunFdAdapter::wrap_run(const vector<TCPSegment> &segments,
+                                                 const size_t first,
+                                                 const size_t count,
+                                                 const FdAdapterConfig &cfg) {
+    TCPHeader tcp_header = segments[first].header();
+    tcp_header.sport = cfg.source.port();
+    tcp_header.dport = cfg.destination.port();
+
+    size_t payload_size = 0;
+    for (size_t i = first; i < first + count; i++) {
+        payload_size += segments[i].payload().size();
+    }
+
+    InternetDatagram ip_dgram;
+    ip_dgram.header().src = cfg.source.ipv4_numeric();
+    ip_dgram.header().dst = cfg.destination.ipv4_numeric();
+    ip_dgram.header().len = ip_dgram.header().hlen * 4 + tcp_header.doff * 4 + payload_size;
+
+    tcp_header.cksum = static_cast<uint16_t>(~InternetChecksum(ip_dgram.header().pseudo_cksum()).value());
+    ip_dgram.payload() = tcp_header.serialize();
+    for (size_t i = first; i < first + count; i++) {
+        ip_dgram.payload().append(segments[i].payload());
+    }
+
+    VirtioNetHeader vnet{};
+    vnet.flags = VirtioNetHeader::F_NEEDS_CSUM;
+    vnet.csum_start = ip_dgram.header().hlen * 4;
+    vnet.csum_offset = TCP_CHECKSUM_OFFSET;
+    if (count > 1) {
+        vnet.gso_type = VirtioNetHeader::GSO_TCPV4;
+        vnet.gso_size = segments[first].payload().size();
+        vnet.hdr_len = ip_dgram.header().hlen * 4 + tcp_header.doff * 4;
+    }
+
+    BufferList ret{vnet.serialize()};
+    ret.append(ip_dgram.serialize());
+    return ret;
+}
+
+void TCPOverIPv4OverTunFdAdapter::send_datagram(const BufferList &datagram) {
+    if (_uring) {
+        _uring->write(datagram);
+    } else {
+        _tun.write(datagram);
+    }
+}
+
+TCPOverIPv4OverTunFdAdapter::operator const FileDescriptor &() const {
+    if (_uring) {
+        return _uring.value();
+    }
+    return _tun;
+}
+
+TCPOverIPv4OverSteeredTunAdapter::TCPOverIPv4OverSteeredTunAdapter(TunSteering &steering, const size_t shard)
+    : _steering(&steering), _shard(shard), _inbox(steering.inbox(shard)), _queue(steering.queue(shard)) {}
+
+TCPOverIPv4OverSteeredTunAdapter::~TCPOverIPv4OverSteeredTunAdapter() {
+    if (_inbox) {
+        _steering->remove_shard(_shard);
+    }
+}
+
+void TCPOverIPv4OverSteeredTunAdapter::set_listening(const bool l) {
+    TCPOverIPv4Adapter::set_listening(l);
+    _steering->remove_shard(_shard);
+    _registered = false;
+    if (l) {
+        _steering->add_listener(config().source.port(), _shard);
+    }
+}
+
+vector<TCPSegment> TCPOverIPv4OverSteeredTunAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    for (auto &datagram : _inbox->drain()) {
+        InternetDatagram ip_dgram;
+        if (ip_dgram.parse(move(datagram)) != ParseResult::NoError) {
+            continue;
+        }
+        auto seg = unwrap_tcp_in_ip(ip_dgram);
+        if (seg) {
+            ret.push_back(move(seg.value()));
+        }
+    }
+    return ret;
+}
+
+//! \details The first write after connecting (or accepting, which clears the listening flag) registers the
+//! connection's 4-tuple, replacing the listener.
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverSteeredTunAdapter::write(TCPSegment &seg) {
+    if (not _registered and not listening()) {
+        _steering->remove_shard(_shard);
+        _steering->add_connection(config().source, config().destination, _shard);
+        _registered = true;
+    }
+    _queue.write(serialize_tcp_in_ip(seg));
+}
+
 //! \param[in] tap Raw network device that will be owned by the adapter
 //! \param[in] eth_address Ethernet address (local address) of the adapter
 //! \param[in] ip_address IP address (local address) of the adapter
@@ -19,7 +257,7 @@ TCPOverIPv4OverEthernetAdapter::TCPOverIPv4OverEthernetAdapter(TapFD &&tap,
 optional<TCPSegment> TCPOverIPv4OverEthernetAdapter::read() {
     // Read Ethernet frame from the raw device
     EthernetFrame frame;
-    if (frame.parse(_tap.read()) != ParseResult::NoError) {
+    if (frame.parse(_tap.read_packet()) != ParseResult::NoError) {
         return {};
     }
 
@@ -36,6 +274,15 @@ optional<TCPSegment> TCPOverIPv4OverEthernetAdapter::read() {
     return {};
 }
 
+vector<TCPSegment> TCPOverIPv4OverEthernetAdapter::read_batch() {
+    vector<TCPSegment> ret;
+    auto seg = read();
+    if (seg) {
+        ret.push_back(move(seg.value()));
+    }
+    return ret;
+}
+
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPOverIPv4OverEthernetAdapter::tick(const size_t ms_since_last_tick) {
     _interface.tick(ms_since_last_tick);
@@ -50,7 +297,10 @@ void TCPOverIPv4OverEthernetAdapter::write(TCPSegment &seg) {
 
 void TCPOverIPv4OverEthernetAdapter::send_pending() {
     while (not _interface.frames_out().empty()) {
-        _tap.write(_interface.frames_out().front().serialize());
+        const EthernetFrame &frame = _interface.frames_out().front();
+        PacketBuffer packet{frame.size()};
+        frame.serialize_into(packet);
+        _tap.write(packet.str());
         _interface.frames_out().pop();
     }
 }
@@ -2,44 +2,109 @@
 #define SPONGE_LIBSPONGE_TUNFD_ADAPTER_HH
 
 #include "ethernet_header.hh"
+#include "io_uring.hh"
 #include "network_interface.hh"
 #include "tun.hh"
+#include "tun_steering.hh"
 
+#include <memory>
 #include <optional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
   private:
     TunFD _tun;
 
+    std::optional<IOUringEngine> _uring{};  //!< Set when datagrams move through io_uring instead of read/write
+
+    std::vector<TCPSegment> _outbound{};  //!< With offload, segments waiting for flush() to coalesce them
+
+    //! Strip the vnet header (if any) and unwrap the TCP segment from a datagram read from the device
+    std::optional<TCPSegment> unwrap_datagram(Buffer &&datagram);
+
+    //! Write one serialized datagram to the device
+    void send_datagram(const BufferList &datagram);
+
   public:
-    //! Construct from a TunFD
-    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun) : _tun(std::move(tun)) {}
+    //! Construct from a TunFD, optionally moving datagrams through io_uring (if the kernel supports it)
+    //! \note If the TunFD was opened with `vnet_hdr`, checksums and segmentation are left to the kernel
+    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun, const IOEngine engine = IOEngine::Poll);
 
     //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
-    std::optional<TCPSegment> read() {
-        InternetDatagram ip_dgram;
-        if (ip_dgram.parse(_tun.read()) != ParseResult::NoError) {
-            return {};
-        }
-        return unwrap_tcp_in_ip(ip_dgram);
-    }
-
-    //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-    void write(TCPSegment &seg) { _tun.write(wrap_tcp_in_ip(seg).serialize()); }
-
-    //! Access the underlying TUN device
-    operator TunFD &() { return _tun; }
-
-    //! Access the underlying TUN device
-    operator const TunFD &() const { return _tun; }
+    std::optional<TCPSegment> read();
+
+    //! Reads every datagram that has already arrived (one, without io_uring) and returns the related TCP segments
+    std::vector<TCPSegment> read_batch();
+
+    //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device (or queues it, with offload)
+    void write(TCPSegment &seg);
+
+    //! Hands any batched datagrams (and, with offload, queued segments) to the kernel
+    void flush();
+
+    //! Access the descriptor to poll: the io_uring if one is in use, otherwise the TUN device
+    operator const FileDescriptor &() const;
+
+    //! \name TSO coalescing, as flush() does it with offload
+    //!@{
+
+    //! How many of `segments` starting at `first` can travel as one TCP super-segment
+    static size_t run_length(const std::vector<TCPSegment> &segments, const size_t first);
+
+    //! Wrap `count` of `segments` starting at `first` in one datagram, addressed as `cfg` says and preceded
+    //! by its vnet header
+    static BufferList wrap_run(const std::vector<TCPSegment> &segments,
+                               const size_t first,
+                               const size_t count,
+                               const FdAdapterConfig &cfg);
+    //!@}
 };
 
 //! Typedef for TCPOverIPv4OverTunFdAdapter
 using LossyTCPOverIPv4OverTunFdAdapter = LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
 
+//! \brief A FD adapter for one shard of a TunSteering: datagrams arrive through its inbox, and leave by its queue
+//! \details The adapter registers its flow with the TunSteering: the listening port while it listens, then its
+//! connection from the first segment it writes; the registration is removed when the adapter is destroyed.
+class TCPOverIPv4OverSteeredTunAdapter : public TCPOverIPv4Adapter {
+  private:
+    TunSteering *_steering;            //!< Where the shard's flows are registered
+    size_t _shard;                     //!< The shard this adapter serves
+    std::shared_ptr<TunInbox> _inbox;  //!< Datagrams steered to the shard (null once moved from)
+    FileDescriptor _queue;             //!< The shard's queue of the device, for writing
+    bool _registered = false;          //!< Is the current connection registered with the TunSteering?
+
+  public:
+    //! Construct for shard `shard` of `steering`, which must outlive the adapter
+    TCPOverIPv4OverSteeredTunAdapter(TunSteering &steering, const size_t shard);
+
+    //! Removes the shard's registrations
+    ~TCPOverIPv4OverSteeredTunAdapter();
+
+    //! Sets the listening flag, steering new connections to the listening port to this shard
+    void set_listening(const bool l);
+
+    //! Returns the TCP segments of the datagrams waiting in the inbox that belong to the current connection
+    std::vector<TCPSegment> read_batch();
+
+    //! Creates an IPv4 datagram from a TCP segment and writes it to the shard's queue
+    void write(TCPSegment &seg);
+
+    //! Access the descriptor to poll: the inbox
+    operator const FileDescriptor &() const { return *_inbox; }
+
+    //! \name Move-only (a moved-from adapter leaves the registrations alone)
+    //!@{
+    TCPOverIPv4OverSteeredTunAdapter(const TCPOverIPv4OverSteeredTunAdapter &other) = delete;
+    TCPOverIPv4OverSteeredTunAdapter &operator=(const TCPOverIPv4OverSteeredTunAdapter &other) = delete;
+    TCPOverIPv4OverSteeredTunAdapter(TCPOverIPv4OverSteeredTunAdapter &&other) = default;
+    TCPOverIPv4OverSteeredTunAdapter &operator=(TCPOverIPv4OverSteeredTunAdapter &&other) = delete;
+    //!@}
+};
+
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TAP device
 class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
   private:
@@ -60,6 +125,9 @@ class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
     //! Attempts to read and parse an Ethernet frame containing an IPv4 datagram that contains a TCP segment
     std::optional<TCPSegment> read();
 
+    //! Reads one Ethernet frame and returns the related TCP segment, if any
+    std::vector<TCPSegment> read_batch();
+
     //! Sends a TCP segment (in an IPv4 datagram, in an Ethernet frame).
     void write(TCPSegment &seg);
 
@@ -48,9 +48,10 @@ uint64_t TCPSender::assemble_segment(const uint64_t start) {
         --max_segment_size;
     }
 
-    // fill the payload
+    // fill the payload, summing it for the checksum as it is copied
     max_segment_size = min<uint64_t>({max_segment_size, buffer_size, TCPConfig::MAX_PAYLOAD_SIZE});
-    seg.payload() = stream_.read(max_segment_size);
+    InternetChecksum payload_checksum;
+    seg.set_payload(stream_.read(max_segment_size, payload_checksum), payload_checksum);
 
     // trim empty packets
     max_segment_size = seg.length_in_sequence_space();
@@ -3,6 +3,7 @@
 #include "util.hh"
 
 #include <arpa/inet.h>
+#include <array>
 #include <cstring>
 #include <memory>
 #include <netdb.h>
@@ -105,6 +106,21 @@ string Address::to_string() const {
     return ip_and_port.first + ":" + ::to_string(ip_and_port.second);
 }
 
+//! \details Read straight from the socket address (adapters label every outgoing segment with it)
+uint16_t Address::port() const {
+    if (_address.storage.ss_family == AF_INET and _size == sizeof(sockaddr_in)) {
+        sockaddr_in ipv4_addr{};
+        memcpy(&ipv4_addr, &_address.storage, _size);
+        return ntohs(ipv4_addr.sin_port);
+    }
+    if (_address.storage.ss_family == AF_INET6 and _size == sizeof(sockaddr_in6)) {
+        sockaddr_in6 ipv6_addr{};
+        memcpy(&ipv6_addr, &_address.storage, _size);
+        return ntohs(ipv6_addr.sin6_port);
+    }
+    return ip_port().second;
+}
+
 uint32_t Address::ipv4_numeric() const {
     if (_address.storage.ss_family != AF_INET or _size != sizeof(sockaddr_in)) {
         throw runtime_error("ipv4_numeric called on non-IPV4 address");
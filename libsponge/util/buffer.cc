@@ -1,17 +1,70 @@
 #include "buffer.hh"
 
+#include "packet_pool.hh"
+
+#include <new>
+
 using namespace std;
 
+BufferStorage::BufferStorage(string &&str, const uint8_t size_class)
+    : _string(move(str)), _data(_string.data()), _size(_string.size()), _size_class(size_class) {}
+
+BufferStorage::BufferStorage(char *data, const size_t size, const uint8_t size_class)
+    : _string(), _data(data), _size(size), _size_class(size_class) {}
+
+BufferStorage *BufferStorage::adopt(string &&str) {
+    uint8_t size_class = 0;
+    void *const block = PacketPool::allocate(sizeof(BufferStorage), size_class);
+    return new (block) BufferStorage(move(str), size_class);
+}
+
+BufferStorage *BufferStorage::allocate(const size_t size) {
+    uint8_t size_class = 0;
+    void *const block = PacketPool::allocate(sizeof(BufferStorage) + size, size_class);
+    char *const data = static_cast<char *>(block) + sizeof(BufferStorage);
+    return new (block) BufferStorage(data, size, size_class);
+}
+
+void BufferStorage::release() {
+    if (_refcount.fetch_sub(1, memory_order_acq_rel) == 1) {
+        const uint8_t size_class = _size_class;
+        this->~BufferStorage();
+        PacketPool::deallocate(this, size_class);
+    }
+}
+
 void Buffer::remove_prefix(const size_t n) {
     if (n > str().size()) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
-        _storage.reset();
+    if (_storage and _starting_offset == _storage->str().size()) {
+        _storage->release();
+        _storage = nullptr;
+    }
+}
+
+char *PacketBuffer::prepend(const size_t n) {
+    if (not _storage or n > _front) {
+        throw out_of_range("PacketBuffer::prepend");
+    }
+    _front -= n;
+    return _storage->data() + _front;
+}
+
+void PacketBuffer::prepend(const string_view data) { data.copy(prepend(data.size()), data.size()); }
+
+void PacketBuffer::truncate(const size_t size) {
+    if (size > this->size()) {
+        throw out_of_range("PacketBuffer::truncate");
+    }
+    if (_storage) {
+        _storage->shrink(_front + size);
     }
 }
 
+Buffer PacketBuffer::release() { return {exchange(_storage, nullptr), exchange(_front, 0)}; }
+
 void BufferList::append(const BufferList &other) {
     for (const auto &buf : other._buffers) {
         _buffers.push_back(buf);
@@ -49,19 +102,21 @@ size_t BufferList::size() const {
 }
 
 void BufferList::remove_prefix(size_t n) {
+    size_t consumed = 0;  // Buffers used up entirely
     while (n > 0) {
-        if (_buffers.empty()) {
+        if (consumed == _buffers.size()) {
             throw std::out_of_range("BufferList::remove_prefix");
         }
 
-        if (n < _buffers.front().str().size()) {
-            _buffers.front().remove_prefix(n);
+        if (n < _buffers[consumed].str().size()) {
+            _buffers[consumed].remove_prefix(n);
             n = 0;
         } else {
-            n -= _buffers.front().str().size();
-            _buffers.pop_front();
+            n -= _buffers[consumed].str().size();
+            consumed++;
         }
     }
+    _buffers.erase_front(consumed);
 }
 
 BufferViewList::BufferViewList(const BufferList &buffers) {
@@ -71,19 +126,25 @@ BufferViewList::BufferViewList(const BufferList &buffers) {
 }
 
 void BufferViewList::remove_prefix(size_t n) {
+    size_t consumed = 0;  // views used up entirely
     while (n > 0) {
-        if (_views.empty()) {
+        if (consumed == _views.size()) {
             throw std::out_of_range("BufferListView::remove_prefix");
         }
 
-        if (n < _views.front().size()) {
-            _views.front().remove_prefix(n);
+        if (n < _views[consumed].size()) {
+            _views[consumed].remove_prefix(n);
             n = 0;
         } else {
-            n -= _views.front().size();
-            _views.pop_front();
+            n -= _views[consumed].size();
+            consumed++;
         }
     }
+    // drop empty views too, so that the next as_iovecs() starts with data
+    while (consumed < _views.size() and _views[consumed].empty()) {
+        consumed++;
+    }
+    _views.erase_front(consumed);
 }
 
 size_t BufferViewList::size() const {
@@ -102,3 +163,11 @@ vector<iovec> BufferViewList::as_iovecs() const {
     }
     return ret;
 }
+
+size_t BufferViewList::as_iovecs(iovec *iovecs, const size_t capacity) const {
+    const size_t count = min(capacity, _views.size());
+    for (size_t i = 0; i < count; i++) {
+        iovecs[i] = {const_cast<char *>(_views[i].data()), _views[i].size()};
+    }
+    return count;
+}
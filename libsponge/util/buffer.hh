@@ -2,26 +2,108 @@
 #define SPONGE_LIBSPONGE_BUFFER_HH
 
 #include <algorithm>
-#include <deque>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <numeric>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/uio.h>
+#include <utility>
 #include <vector>
 
+//! \brief The reference-counted bytes behind a Buffer, kept in a PacketPool block
+//! \details The bytes either follow this header in the same block, or belong to a std::string the
+//! storage took over (by moving it, not copying it). Either way a Buffer costs a pool block rather
+//! than a trip to malloc.
+class BufferStorage {
+  private:
+    std::atomic<size_t> _refcount{1};  //!< Number of Buffers (or PacketBuffers) holding this storage
+    std::string _string;               //!< The string the bytes belong to, if any
+    char *_data;                       //!< The first byte
+    size_t _size;                      //!< Number of bytes
+    uint8_t _size_class;               //!< The PacketPool size class of the block holding this header
+
+    BufferStorage(std::string &&str, const uint8_t size_class);
+    BufferStorage(char *data, const size_t size, const uint8_t size_class);
+
+  public:
+    //! \brief Take over a string's bytes
+    static BufferStorage *adopt(std::string &&str);
+
+    //! \brief Allocate room for `size` bytes (uninitialized) in the same pool block as the header
+    static BufferStorage *allocate(const size_t size);
+
+    BufferStorage(const BufferStorage &other) = delete;
+    BufferStorage &operator=(const BufferStorage &other) = delete;
+    ~BufferStorage() = default;
+
+    //! \name Reference counting
+    //!@{
+    void acquire() { _refcount.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+    //!@}
+
+    //! \brief The bytes
+    std::string_view str() const { return {_data, _size}; }
+
+    //! \brief The bytes, for filling in before the storage is shared
+    char *data() { return _data; }
+
+    //! \brief Keep only the first `size` bytes
+    void shrink(const size_t size) { _size = std::min(_size, size); }
+};
+
 //! \brief A reference-counted read-only string that can discard bytes from the front
 class Buffer {
   private:
-    std::shared_ptr<std::string> _storage{};
-    size_t _starting_offset{};
+    BufferStorage *_storage = nullptr;  //!< Holds a reference, or `nullptr` if the Buffer is empty
+    size_t _starting_offset = 0;
+
+    friend class PacketBuffer;
+
+    //! \brief Take over one reference to `storage`, starting `offset` bytes in
+    Buffer(BufferStorage *storage, const size_t offset) : _storage(storage), _starting_offset(offset) {}
 
   public:
     Buffer() = default;
 
     //! \brief Construct by taking ownership of a string
-    Buffer(std::string &&str) noexcept : _storage(std::make_shared<std::string>(std::move(str))) {}
+    Buffer(std::string &&str) : _storage(str.empty() ? nullptr : BufferStorage::adopt(std::move(str))) {}
+
+    //! \name Copy and move (copies share the storage)
+    //!@{
+    Buffer(const Buffer &other) : _storage(other._storage), _starting_offset(other._starting_offset) {
+        if (_storage) {
+            _storage->acquire();
+        }
+    }
+
+    Buffer(Buffer &&other) noexcept
+        : _storage(std::exchange(other._storage, nullptr)), _starting_offset(other._starting_offset) {}
+
+    Buffer &operator=(const Buffer &other) {
+        Buffer copy{other};
+        std::swap(_storage, copy._storage);
+        _starting_offset = copy._starting_offset;
+        return *this;
+    }
+
+    Buffer &operator=(Buffer &&other) noexcept {
+        std::swap(_storage, other._storage);
+        _starting_offset = other._starting_offset;
+        return *this;
+    }
+
+    ~Buffer() {
+        if (_storage) {
+            _storage->release();
+        }
+    }
+    //!@}
 
     //! \name Expose contents as a std::string_view
     //!@{
@@ -29,7 +111,7 @@ class Buffer {
         if (not _storage) {
             return {};
         }
-        return {_storage->data() + _starting_offset, _storage->size() - _starting_offset};
+        return _storage->str().substr(_starting_offset);
     }
 
     operator std::string_view() const { return str(); }
@@ -49,14 +131,153 @@ class Buffer {
     void remove_prefix(const size_t n);
 };
 
+//! \brief A packet serialized back to front into one contiguous allocation (as with an skb or mbuf)
+//! \details All of the packet's space is reserved up front as headroom. The innermost layer prepend()s
+//! its payload and header, each enclosing layer prepend()s its own header in front of that, and
+//! release() hands over the finished packet as a single Buffer without copying it.
+class PacketBuffer {
+  private:
+    BufferStorage *_storage;  //!< Headroom followed by the packet so far (`nullptr` once released)
+    size_t _front;            //!< Offset of the first byte of the packet so far
+
+  public:
+    //! \brief Reserve room (from the PacketPool) for a packet of up to `capacity` bytes
+    explicit PacketBuffer(const size_t capacity) : _storage(BufferStorage::allocate(capacity)), _front(capacity) {}
+
+    PacketBuffer(const PacketBuffer &other) = delete;
+    PacketBuffer &operator=(const PacketBuffer &other) = delete;
+
+    PacketBuffer(PacketBuffer &&other) noexcept
+        : _storage(std::exchange(other._storage, nullptr)), _front(std::exchange(other._front, 0)) {}
+
+    PacketBuffer &operator=(PacketBuffer &&other) noexcept {
+        std::swap(_storage, other._storage);
+        std::swap(_front, other._front);
+        return *this;
+    }
+
+    ~PacketBuffer() {
+        if (_storage) {
+            _storage->release();
+        }
+    }
+
+    //! \brief Claim the `n` bytes in front of the packet so far
+    //! \returns where to write them
+    char *prepend(const size_t n);
+
+    //! \brief Copy `data` in front of the packet so far
+    void prepend(const std::string_view data);
+
+    //! \brief Keep only the first `size` bytes of the packet so far
+    //! \details E.g. after prepend()ing the whole capacity to receive into, and receiving less than that.
+    void truncate(const size_t size);
+
+    //! \brief The packet so far
+    std::string_view str() const { return _storage ? _storage->str().substr(_front) : std::string_view{}; }
+
+    //! \brief Size of the packet so far
+    size_t size() const { return str().size(); }
+
+    //! \brief Hand over the packet (leaving the PacketBuffer empty)
+    Buffer release();
+};
+
+//! \brief A vector that keeps up to `N` elements inline, and only moves them to the heap beyond that
+//! \details A packet is usually a header or two and a payload, so the lists of parts in BufferList and
+//! BufferViewList almost never need to allocate.
+template <typename T, size_t N>
+class SmallVector {
+  private:
+    std::array<T, N> _inline{};  //!< The elements, until there are more than `N`
+    std::vector<T> _heap{};      //!< The elements, after there have been more than `N`
+    size_t _size = 0;
+    bool _on_heap = false;
+
+  public:
+    using const_reverse_iterator = std::reverse_iterator<const T *>;
+
+    SmallVector() = default;
+    SmallVector(const SmallVector &other) = default;
+    SmallVector &operator=(const SmallVector &other) = default;
+
+    SmallVector(SmallVector &&other) noexcept
+        : _inline(std::move(other._inline))
+        , _heap(std::move(other._heap))
+        , _size(std::exchange(other._size, 0))
+        , _on_heap(std::exchange(other._on_heap, false)) {}
+
+    SmallVector &operator=(SmallVector &&other) noexcept {
+        _inline = std::move(other._inline);
+        _heap = std::move(other._heap);
+        _size = std::exchange(other._size, 0);
+        _on_heap = std::exchange(other._on_heap, false);
+        return *this;
+    }
+
+    ~SmallVector() = default;
+
+    //! \name Element access
+    //!@{
+    T *data() { return _on_heap ? _heap.data() : _inline.data(); }
+    const T *data() const { return _on_heap ? _heap.data() : _inline.data(); }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    T *begin() { return data(); }
+    T *end() { return data() + _size; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + _size; }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T &operator[](const size_t n) { return data()[n]; }
+    const T &operator[](const size_t n) const { return data()[n]; }
+    T &front() { return data()[0]; }
+    //!@}
+
+    //! \brief Append an element, moving everything to the heap if it is the first beyond `N`
+    void push_back(T value) {
+        if (not _on_heap and _size == N) {
+            _heap.reserve(2 * N);
+            for (auto &element : _inline) {
+                _heap.push_back(std::exchange(element, T{}));
+            }
+            _on_heap = true;
+        }
+        if (_on_heap) {
+            _heap.push_back(std::move(value));
+        } else {
+            _inline[_size] = std::move(value);
+        }
+        _size++;
+    }
+
+    //! \brief Remove the first `count` elements
+    void erase_front(const size_t count) {
+        std::move(begin() + count, end(), begin());
+        for (size_t i = _size - count; i < _size; i++) {
+            data()[i] = T{};
+        }
+        _size -= count;
+        if (_on_heap) {
+            _heap.resize(_size);
+        }
+    }
+};
+
 //! \brief A reference-counted discontiguous string that can discard bytes from the front
 //! \note Used to model packets that contain multiple sets of headers
 //! + a payload. This allows us to prepend headers (e.g., to
 //! encapsulate a TCP payload in a TCPSegment, and then encapsulate
 //! the TCPSegment in an IPv4Datagram) without copying the payload.
 class BufferList {
+  public:
+    //! \brief The parts of the list (header, payload, ...), kept inline up to a few
+    using Parts = SmallVector<Buffer, 4>;
+
   private:
-    std::deque<Buffer> _buffers{};
+    Parts _buffers{};
 
   public:
     //! \name Constructors
@@ -65,17 +286,17 @@ class BufferList {
     BufferList() = default;
 
     //! \brief Construct from a Buffer
-    BufferList(Buffer buffer) : _buffers{buffer} {}
+    BufferList(Buffer buffer) { _buffers.push_back(std::move(buffer)); }
 
     //! \brief Construct by taking ownership of a std::string
-    BufferList(std::string &&str) noexcept {
+    BufferList(std::string &&str) {
         Buffer buf{std::move(str)};
         append(buf);
     }
     //!@}
 
-    //! \brief Access the underlying queue of Buffers
-    const std::deque<Buffer> &buffers() const { return _buffers; }
+    //! \brief Access the underlying Buffers
+    const Parts &buffers() const { return _buffers; }
 
     //! \brief Append a BufferList
     void append(const BufferList &other);
@@ -96,7 +317,7 @@ class BufferList {
 
 //! \brief A non-owning temporary view (similar to std::string_view) of a discontiguous string
 class BufferViewList {
-    std::deque<std::string_view> _views{};
+    SmallVector<std::string_view, 4> _views{};
 
   public:
     //! \name Constructors
@@ -108,6 +329,9 @@ class BufferViewList {
     //! \brief Construct from a C string (must be NULL-terminated)
     BufferViewList(const char *s) : BufferViewList(std::string_view(s)) {}
 
+    //! \brief Construct from a Buffer
+    BufferViewList(const Buffer &buffer) : BufferViewList(buffer.str()) {}
+
     //! \brief Construct from a BufferList
     BufferViewList(const BufferList &buffers);
 
@@ -121,10 +345,17 @@ class BufferViewList {
     //! \brief Size of the string
     size_t size() const;
 
+    //! \brief Number of parts (one `iovec` each)
+    size_t parts() const { return _views.size(); }
+
     //! \brief Convert to a vector of `iovec` structures
     //! \note used for system calls that write discontiguous buffers,
     //! e.g. [writev(2)](\ref man2::writev) and [sendmsg(2)](\ref man2::sendmsg)
     std::vector<iovec> as_iovecs() const;
+
+    //! \brief Fill in a caller's array of `iovec` structures (no allocation)
+    //! \returns the number of entries filled in, fewer than parts() if `capacity` is too small
+    size_t as_iovecs(iovec *iovecs, const size_t capacity) const;
 };
 
 #endif  // SPONGE_LIBSPONGE_BUFFER_HH
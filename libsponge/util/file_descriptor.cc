@@ -3,11 +3,13 @@
 #include "util.hh"
 
 #include <algorithm>
+#include <array>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <vector>
 
 using namespace std;
 
@@ -73,13 +75,44 @@ string FileDescriptor::read(const size_t limit) {
     return ret;
 }
 
+//! \details Suits packet devices and sockets, where one read returns one packet: the block is sized
+//! for the largest packet expected, and the Buffer covers only the bytes actually read.
+//! \param[in] limit is the maximum number of bytes to read
+//! \returns a Buffer holding the bytes read
+Buffer FileDescriptor::read_buffer(const size_t limit) {
+    PacketBuffer packet{limit};
+    const ssize_t bytes_read = SystemCall("read", ::read(fd_num(), packet.prepend(limit), limit));
+    if (limit > 0 && bytes_read == 0) {
+        _internal_fd->_eof = true;
+    }
+    if (bytes_read > static_cast<ssize_t>(limit)) {
+        throw runtime_error("read() read more than requested");
+    }
+    packet.truncate(bytes_read);
+
+    register_read();
+
+    return packet.release();
+}
+
 size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
     size_t total_bytes_written = 0;
+    array<iovec, 16> iovecs;  // enough for most buffers; one with more parts gets a vector instead
+    vector<iovec> more_iovecs;
 
     do {
-        auto iovecs = buffer.as_iovecs();
+        const iovec *iov = iovecs.data();
+        size_t iovec_count = 0;
+        if (buffer.parts() <= iovecs.size()) {
+            iovec_count = buffer.as_iovecs(iovecs.data(), iovecs.size());
+        } else {
+            // still one writev, so that a datagram socket sends the whole buffer as one datagram
+            more_iovecs = buffer.as_iovecs();
+            iov = more_iovecs.data();
+            iovec_count = more_iovecs.size();
+        }
 
-        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iovecs.data(), iovecs.size()));
+        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iov, iovec_count));
         if (bytes_written == 0 and buffer.size() != 0) {
             throw runtime_error("write returned 0 given non-empty input buffer");
         }
@@ -61,6 +61,9 @@ class FileDescriptor {
     //! Read up to `limit` bytes into `str` (caller can allocate storage)
     void read(std::string &str, const size_t limit = std::numeric_limits<size_t>::max());
 
+    //! Read up to `limit` bytes into a block from the PacketPool, which is neither zero-filled nor copied
+    Buffer read_buffer(const size_t limit);
+
     //! Write a string, possibly blocking until all is written
     size_t write(const char *str, const bool write_all = true) { return write(BufferViewList(str), write_all); }
 
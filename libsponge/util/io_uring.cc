@@ -0,0 +1,458 @@
+#include "io_uring.hh"
+
+#include "util.hh"
+
+#include <cstring>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! \name Raw system call wrappers (glibc has none for io_uring)
+//!@{
+static int io_uring_setup(const unsigned entries, io_uring_params *params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(const int ring_fd,
+                          const unsigned to_submit,
+                          const unsigned min_complete,
+                          const unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(const int ring_fd, const unsigned opcode, const void *arg, const unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+//!@}
+
+//! Map one of the regions the kernel shares with us
+static void *map_ring(const int ring_fd, const size_t length, const off_t offset) {
+    void *ret = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    if (ret == MAP_FAILED) {
+        throw unix_error("mmap io_uring");
+    }
+    return ret;
+}
+
+//! Add a byte offset to the start of a mapped ring
+template <typename T>
+static T *ring_field(void *base, const unsigned offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+class IOUring::Rings {
+  public:
+    const size_t sq_length;    //!< Size of the submission ring mapping
+    const size_t cq_length;    //!< Size of the completion ring mapping
+    const size_t sqes_length;  //!< Size of the submission queue entry array mapping
+    void *const sq;            //!< The submission ring (head, tail, and index array)
+    void *const cq;            //!< The completion ring (head, tail, and completion entries)
+    io_uring_sqe *const sqes;  //!< The submission queue entries
+
+    unsigned *const sq_head;    //!< Advanced by the kernel as it consumes submissions
+    unsigned *const sq_tail;    //!< Advanced by us to publish submissions
+    const unsigned sq_mask;     //!< Mask to turn a submission ring position into an index
+    const unsigned sq_entries;  //!< Capacity of the submission ring
+    unsigned sqe_tail = 0;      //!< Position of the next submission queue entry to hand out
+
+    unsigned *const cq_head;   //!< Advanced by us as we consume completions
+    unsigned *const cq_tail;   //!< Advanced by the kernel to publish completions
+    const unsigned cq_mask;    //!< Mask to turn a completion ring position into an index
+    io_uring_cqe *const cqes;  //!< The completion entries
+
+    Rings(const int ring_fd, const io_uring_params &p)
+        : sq_length(p.sq_off.array + p.sq_entries * sizeof(unsigned))
+        , cq_length(p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe))
+        , sqes_length(p.sq_entries * sizeof(io_uring_sqe))
+        , sq(map_ring(ring_fd, sq_length, IORING_OFF_SQ_RING))
+        , cq(map_ring(ring_fd, cq_length, IORING_OFF_CQ_RING))
+        , sqes(static_cast<io_uring_sqe *>(map_ring(ring_fd, sqes_length, IORING_OFF_SQES)))
+        , sq_head(ring_field<unsigned>(sq, p.sq_off.head))
+        , sq_tail(ring_field<unsigned>(sq, p.sq_off.tail))
+        , sq_mask(*ring_field<unsigned>(sq, p.sq_off.ring_mask))
+        , sq_entries(*ring_field<unsigned>(sq, p.sq_off.ring_entries))
+        , cq_head(ring_field<unsigned>(cq, p.cq_off.head))
+        , cq_tail(ring_field<unsigned>(cq, p.cq_off.tail))
+        , cq_mask(*ring_field<unsigned>(cq, p.cq_off.ring_mask))
+        , cqes(ring_field<io_uring_cqe>(cq, p.cq_off.cqes)) {
+        // submission queue entry i always lives in slot i of the index array
+        unsigned *const sq_array = ring_field<unsigned>(sq, p.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; i++) {
+            sq_array[i] = i;
+        }
+        sqe_tail = *sq_tail;
+    }
+
+    ~Rings() {
+        ::munmap(sqes, sqes_length);
+        ::munmap(cq, cq_length);
+        ::munmap(sq, sq_length);
+    }
+
+    Rings(const Rings &other) = delete;
+    Rings &operator=(const Rings &other) = delete;
+};
+
+bool IOUring::available() {
+    static const bool supported = [] {
+        io_uring_params params{};
+        const int ring_fd = io_uring_setup(2, &params);
+        if (ring_fd < 0) {
+            return false;
+        }
+        ::close(ring_fd);
+        // IORING_OP_READ and reads at the current file position arrived together (Linux 5.6)
+        return (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+    }();
+    return supported;
+}
+
+//! \param[in] entries is the submission ring capacity (the kernel rounds it up to a power of two)
+IOUring::IOUring(const unsigned entries) : IOUring(entries, io_uring_params{}) {}
+
+//! \param[in] entries is the submission ring capacity
+//! \param[in] params receives the ring layout from the kernel, before the rings are mapped
+IOUring::IOUring(const unsigned entries, io_uring_params &&params)
+    : FileDescriptor(SystemCall("io_uring_setup", io_uring_setup(entries, &params)))
+    , _rings(make_unique<Rings>(fd_num(), params)) {}
+
+IOUring::~IOUring() = default;
+IOUring::IOUring(IOUring &&other) = default;
+IOUring &IOUring::operator=(IOUring &&other) = default;
+
+void *IOUring::next_sqe() {
+    Rings &r = *_rings;
+    if (r.sqe_tail - __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE) == r.sq_entries) {
+        submit();
+        if (r.sqe_tail - __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE) == r.sq_entries) {
+            throw runtime_error("io_uring submission queue is full");
+        }
+    }
+    io_uring_sqe *sqe = &r.sqes[r.sqe_tail & r.sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r.sqe_tail++;
+    _to_submit++;
+    return sqe;
+}
+
+//! \param[in] fd is the file descriptor to read from
+//! \param[in] buf is where to put the data
+//! \param[in] len is the maximum number of bytes to read
+//! \param[in] user_data is returned in the request's Completion
+void IOUring::prepare_read(const int fd, char *buf, const size_t len, const uint64_t user_data) {
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = -1;  // like read(2): use (and advance) the current file position, if any
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
+
+//! \param[in] fd is the file descriptor to read from
+//! \param[in] buf is where to put the data (inside a buffer passed to register_buffers())
+//! \param[in] len is the maximum number of bytes to read
+//! \param[in] buf_index is the index of the registered buffer containing `buf`
+//! \param[in] user_data is returned in the request's Completion
+void IOUring::prepare_read_fixed(const int fd,
+                                 char *buf,
+                                 const size_t len,
+                                 const uint16_t buf_index,
+                                 const uint64_t user_data) {
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->off = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->buf_index = buf_index;
+    sqe->user_data = user_data;
+}
+
+//! \param[in] fd is the file descriptor to write to
+//! \param[in] iov is the array of buffers to write
+//! \param[in] iovcnt is the number of buffers in `iov`
+//! \param[in] user_data is returned in the request's Completion
+void IOUring::prepare_writev(const int fd, const iovec *iov, const unsigned iovcnt, const uint64_t user_data) {
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = iovcnt;
+    sqe->user_data = user_data;
+}
+
+//! \param[in] target_user_data identifies the request to cancel
+//! \param[in] user_data is returned in the cancellation's own Completion
+void IOUring::prepare_cancel(const uint64_t target_user_data, const uint64_t user_data) {
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target_user_data;
+    sqe->user_data = user_data;
+}
+
+//! \param[in] user_data is returned in the request's Completion
+void IOUring::prepare_nop(const uint64_t user_data) {
+    auto *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_NOP;
+    sqe->fd = -1;
+    sqe->user_data = user_data;
+}
+
+//! \param[in] buffers are the memory regions to register (buffer indices follow their order)
+bool IOUring::register_buffers(const vector<iovec> &buffers) {
+    return io_uring_register(fd_num(), IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+}
+
+//! \param[in] wait_for is the number of completions to block for (0 never blocks)
+void IOUring::submit(const unsigned wait_for) {
+    if (_to_submit == 0 and wait_for == 0) {
+        return;
+    }
+
+    __atomic_store_n(_rings->sq_tail, _rings->sqe_tail, __ATOMIC_RELEASE);
+    const int submitted =
+        io_uring_enter(fd_num(), _to_submit, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0) {
+        // the kernel is short of memory or completion space: keep the requests and retry on the next call
+        if (errno == EINTR or errno == EAGAIN or errno == EBUSY) {
+            return;
+        }
+        throw unix_error("io_uring_enter");
+    }
+    _to_submit -= submitted;
+}
+
+optional<IOUring::Completion> IOUring::peek_completion() const {
+    const unsigned head = *_rings->cq_head;
+    if (head == __atomic_load_n(_rings->cq_tail, __ATOMIC_ACQUIRE)) {
+        return {};
+    }
+    const io_uring_cqe &cqe = _rings->cqes[head & _rings->cq_mask];
+    return Completion{cqe.user_data, cqe.res};
+}
+
+optional<IOUring::Completion> IOUring::pop_completion() {
+    auto ret = peek_completion();
+    if (ret) {
+        __atomic_store_n(_rings->cq_head, *_rings->cq_head + 1, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+//! Tags that tell the engine's completions apart (reads carry only their receive slot number)
+static constexpr uint64_t WRITE_TAG = uint64_t(1) << 63;
+static constexpr uint64_t CANCEL_TAG = uint64_t(1) << 62;
+static constexpr uint64_t WAKE_TAG = uint64_t(1) << 61;
+static constexpr uint64_t OWN_TAGS = WRITE_TAG | CANCEL_TAG | WAKE_TAG;
+
+class IOUringEngine::Arena {
+  public:
+    const size_t slot_size;  //!< Capacity of each receive slot
+    const size_t slots;      //!< Number of receive slots (one posted read each)
+    char *const base;        //!< Start of the mapping
+
+    Arena(const size_t slot_size_, const size_t slots_)
+        : slot_size(slot_size_)
+        , slots(slots_)
+        , base(static_cast<char *>(
+              ::mmap(nullptr, slot_size * slots, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))) {
+        if (base == MAP_FAILED) {
+            throw unix_error("mmap");
+        }
+    }
+
+    ~Arena() { ::munmap(base, slot_size * slots); }
+
+    char *slot(const size_t index) const { return base + index * slot_size; }
+
+    Arena(const Arena &other) = delete;
+    Arena &operator=(const Arena &other) = delete;
+};
+
+//! \param[in] fd is the TUN/TAP device or socket to read and write
+//! \param[in] queue_depth is the number of reads to keep posted
+//! \param[in] mtu is the largest datagram that will be read in full
+IOUringEngine::IOUringEngine(const FileDescriptor &fd, const size_t queue_depth, const size_t mtu)
+    : IOUring(4 * queue_depth)
+    , _fd(fd.duplicate())
+    , _arena(make_unique<Arena>(mtu, queue_depth))
+    , _writes(2 * queue_depth) {
+    for (size_t i = 0; i < _writes.size(); i++) {
+        _free_writes.push_back(_writes.size() - 1 - i);
+    }
+
+    // Pinning the arena saves the kernel from mapping the user pages on every read. It counts against
+    // RLIMIT_MEMLOCK, so plain reads into the same memory are the fallback.
+    _registered = register_buffers({{_arena->base, _arena->slot_size * _arena->slots}});
+
+    for (size_t i = 0; i < _arena->slots; i++) {
+        post_read(i);
+    }
+    submit();
+}
+
+IOUringEngine::~IOUringEngine() {
+    if (not _arena) {
+        return;
+    }
+
+    // Every posted read must complete (most with -ECANCELED) before the kernel loses sight of its target memory
+    try {
+        _posted -= _reads_done.size();
+        _reads_done.clear();
+        for (size_t i = 0; i < _arena->slots; i++) {
+            prepare_cancel(i, CANCEL_TAG | i);
+        }
+        submit();
+        while (_posted > 0) {
+            auto completion = pop_completion();
+            if (not completion) {
+                submit(1);
+                continue;
+            }
+            if (not(completion->user_data & OWN_TAGS)) {
+                _posted--;
+            }
+        }
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing IOUringEngine: " << e.what() << endl;
+    }
+}
+
+IOUringEngine::IOUringEngine(IOUringEngine &&other) = default;
+IOUringEngine &IOUringEngine::operator=(IOUringEngine &&other) = default;
+
+void IOUringEngine::post_read(const size_t slot) {
+    if (_registered) {
+        prepare_read_fixed(_fd.fd_num(), _arena->slot(slot), _arena->slot_size, 0, slot);
+    } else {
+        prepare_read(_fd.fd_num(), _arena->slot(slot), _arena->slot_size, slot);
+    }
+    _posted++;
+}
+
+//! \returns `true` if the completion belonged to a write (or a cancellation) and has been dealt with
+bool IOUringEngine::reap_write(const Completion &completion) {
+    if (completion.user_data & (CANCEL_TAG | WAKE_TAG)) {
+        return true;
+    }
+    if (not(completion.user_data & WRITE_TAG)) {
+        return false;
+    }
+
+    const size_t slot = completion.user_data & ~WRITE_TAG;
+    _writes.at(slot).reset();
+    _free_writes.push_back(slot);
+    if (completion.result < 0) {
+        throw unix_error("io_uring writev", -completion.result);
+    }
+    return true;
+}
+
+//! \details Completed reads are left in the queue, so the ring stays readable and the EventLoop comes back for them.
+void IOUringEngine::reap_writes() {
+    while (auto completion = peek_completion()) {
+        if (not(completion->user_data & OWN_TAGS)) {
+            return;
+        }
+        pop_completion();
+        reap_write(completion.value());
+    }
+}
+
+//! \details Read completions met on the way are set aside for read(), which takes them before the ring's.
+//! A no-op request then keeps the ring readable until they have all been taken.
+void IOUringEngine::wait_for_write() {
+    flush();
+    while (_free_writes.empty()) {
+        const auto completion = pop_completion();
+        if (not completion) {
+            submit(1);
+        } else if (not reap_write(completion.value())) {
+            _reads_done.push_back(completion.value());
+        }
+    }
+
+    if (not _reads_done.empty()) {
+        prepare_nop(WAKE_TAG);
+        submit();
+    }
+}
+
+//! \details At most one datagram is returned per call, and the rest of the completion queue is left
+//! untouched: that keeps the ring readable for as long as there is more to read.
+optional<Buffer> IOUringEngine::read() {
+    register_read();
+
+    while (true) {
+        optional<Completion> completion{};
+        if (not _reads_done.empty()) {
+            completion = _reads_done.front();
+            _reads_done.pop_front();
+        } else if (not(completion = pop_completion())) {
+            break;
+        }
+
+        if (reap_write(completion.value())) {
+            continue;
+        }
+
+        const size_t slot = completion->user_data;
+        _posted--;
+        if (completion->result < 0) {
+            post_read(slot);
+            if (completion->result == -EAGAIN or completion->result == -EINTR) {
+                continue;
+            }
+            throw unix_error("io_uring read", -completion->result);
+        }
+
+        // the slot is re-posted at once, so the datagram moves to a pooled block of just its size
+        PacketBuffer packet{size_t(completion->result)};
+        packet.prepend({_arena->slot(slot), size_t(completion->result)});
+        post_read(slot);
+        // re-posted reads wait for the next flush unless the queue has run dry
+        if (not peek_completion()) {
+            submit();
+        }
+        return packet.release();
+    }
+
+    submit();
+    return {};
+}
+
+//! \param[in] datagram is the datagram to send (its buffers are kept alive until the write completes)
+void IOUringEngine::write(const BufferList &datagram) {
+    register_write();
+    reap_writes();
+
+    if (_free_writes.empty()) {
+        // every write slot is still in flight: wait for one, so that datagrams still go out in order
+        wait_for_write();
+    }
+
+    const size_t slot = _free_writes.back();
+    _free_writes.pop_back();
+    PendingWrite &pending = _writes.at(slot).emplace();
+    pending.data = datagram;
+    const BufferViewList views{pending.data};
+    if (views.parts() <= pending.inline_iovecs.size()) {
+        const size_t count = views.as_iovecs(pending.inline_iovecs.data(), pending.inline_iovecs.size());
+        prepare_writev(_fd.fd_num(), pending.inline_iovecs.data(), count, WRITE_TAG | slot);
+    } else {
+        pending.iovecs = views.as_iovecs();
+        prepare_writev(_fd.fd_num(), pending.iovecs.data(), pending.iovecs.size(), WRITE_TAG | slot);
+    }
+}
+
+void IOUringEngine::flush() { submit(); }
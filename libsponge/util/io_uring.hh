@@ -0,0 +1,161 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_params;
+
+//! Selects how an FD adapter moves datagrams in and out of the kernel
+enum class IOEngine {
+    Poll,    //!< One [read(2)](\ref man2::read) or [writev(2)](\ref man2::writev) per datagram, woken by poll(2)
+    IOUring  //!< Reads kept posted and writes batched through an IOUringEngine (falls back to Poll if unavailable)
+};
+
+//! A minimal [io_uring](https://man7.org/linux/man-pages/man7/io_uring.7.html) instance driven by raw system calls
+class IOUring : public FileDescriptor {
+  public:
+    //! A completed request, as reported by the kernel
+    struct Completion {
+        uint64_t user_data;  //!< The value passed when the request was prepared
+        int32_t result;      //!< The request's return value (negative errno on failure)
+    };
+
+  private:
+    //! The submission and completion rings shared with the kernel (unmapped on destruction)
+    class Rings;
+    std::unique_ptr<Rings> _rings;
+
+    unsigned _to_submit = 0;  //!< Number of prepared requests not yet handed to the kernel
+
+    //! Get the next free submission queue entry, submitting queued requests first if the ring is full
+    void *next_sqe();
+
+    //! Set up the ring, then map it using the layout the kernel wrote into `params`
+    IOUring(const unsigned entries, io_uring_params &&params);
+
+  public:
+    //! Is io_uring supported (and permitted) by the running kernel?
+    static bool available();
+
+    //! Set up a ring with room for `entries` outstanding submissions
+    explicit IOUring(const unsigned entries);
+
+    //! Unmap the rings (the FDWrapper closes the ring's file descriptor)
+    ~IOUring();
+
+    //! \name Request preparation
+    //! Requests are queued in the submission ring and handed to the kernel by submit()
+    //!@{
+
+    //! Read up to `len` bytes from `fd` into `buf`
+    void prepare_read(const int fd, char *buf, const size_t len, const uint64_t user_data);
+
+    //! Read up to `len` bytes from `fd` into `buf`, which lies in registered buffer `buf_index`
+    void prepare_read_fixed(const int fd,
+                            char *buf,
+                            const size_t len,
+                            const uint16_t buf_index,
+                            const uint64_t user_data);
+
+    //! Write the `iovcnt` buffers in `iov` to `fd` (the iovecs must stay valid until the request completes)
+    void prepare_writev(const int fd, const iovec *iov, const unsigned iovcnt, const uint64_t user_data);
+
+    //! Cancel the outstanding request that was prepared with `target_user_data`
+    void prepare_cancel(const uint64_t target_user_data, const uint64_t user_data);
+
+    //! Do nothing, but complete (which makes the ring readable)
+    void prepare_nop(const uint64_t user_data);
+    //!@}
+
+    //! Pin memory with the kernel so that prepare_read_fixed() can skip per-request page mapping
+    //! \returns `false` if the kernel refused (e.g. RLIMIT_MEMLOCK is too small)
+    bool register_buffers(const std::vector<iovec> &buffers);
+
+    //! Hand all prepared requests to the kernel with one system call, optionally waiting for completions
+    void submit(const unsigned wait_for = 0);
+
+    //! Look at the oldest completion without consuming it
+    std::optional<Completion> peek_completion() const;
+
+    //! Consume the oldest completion
+    std::optional<Completion> pop_completion();
+
+    //! \name Move-only (like FileDescriptor)
+    //!@{
+    IOUring(IOUring &&other);
+    IOUring &operator=(IOUring &&other);
+    //!@}
+};
+
+//! \class IOUring
+//! The ring's file descriptor is readable whenever the completion queue is non-empty, so an
+//! IOUring can be handed to EventLoop::add_rule like any other FileDescriptor.
+
+//! Datagram I/O on a TUN/TAP device or socket through an IOUring
+class IOUringEngine : public IOUring {
+  private:
+    //! Memory for posted reads, unmapped on destruction
+    class Arena;
+
+    //! A batched write whose buffers must stay alive until the kernel reports completion
+    struct PendingWrite {
+        BufferList data{};
+        std::array<iovec, 4> inline_iovecs{};  //!< The iovecs of a datagram of a few parts
+        std::vector<iovec> iovecs{};           //!< The iovecs of a datagram with more parts than that
+    };
+
+    FileDescriptor _fd;                                //!< The device or socket being read and written
+    std::unique_ptr<Arena> _arena;                     //!< One receive slot per posted read
+    bool _registered = false;                          //!< Is the arena registered (use fixed reads)?
+    size_t _posted = 0;                                //!< Number of reads handed to the ring and not yet reaped
+    std::vector<std::optional<PendingWrite>> _writes;  //!< Outstanding writes, indexed by write slot
+    std::vector<size_t> _free_writes{};                //!< Write slots available for reuse
+    std::deque<Completion> _reads_done{};              //!< Read completions taken off the ring by wait_for_write()
+
+    void post_read(const size_t slot);              //!< Queue a read into the given receive slot
+    bool reap_write(const Completion &completion);  //!< Release a write slot, if this is a write completion
+    void reap_writes();                             //!< Consume completions up to the first read completion
+    void wait_for_write();                          //!< Block until a write slot is free
+
+  public:
+    //! Keep `queue_depth` reads of up to `mtu` bytes each posted on `fd`
+    IOUringEngine(const FileDescriptor &fd, const size_t queue_depth = 32, const size_t mtu = 65536);
+
+    //! Cancel posted reads before the receive memory goes away
+    ~IOUringEngine();
+
+    //! Return the next received datagram, if one has arrived (never blocks)
+    std::optional<Buffer> read();
+
+    //! \brief Queue a datagram for sending; nothing reaches the kernel until flush()
+    //! \details Unless every write slot is in flight: then it flushes, and blocks until a write completes.
+    void write(const BufferList &datagram);
+
+    //! Submit all queued writes (and re-posted reads) with a single system call
+    void flush();
+
+    //! \name Move-only (like FileDescriptor)
+    //!@{
+    IOUringEngine(IOUringEngine &&other);
+    IOUringEngine &operator=(IOUringEngine &&other);
+    //!@}
+};
+
+//! \class IOUringEngine
+//! An IOUringEngine amortises system calls at high packet rates: the kernel fills posted reads as
+//! datagrams arrive, so reading a datagram costs no system call at all, and a burst of writes is
+//! handed over in one [io_uring_enter(2)](https://man7.org/linux/man-pages/man2/io_uring_enter.2.html).
+//! The EventLoop should poll the engine itself (the ring), not the underlying device.
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
@@ -0,0 +1,185 @@
+#include "packet_pool.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t CLASS_COUNT = PacketPool::BLOCK_SIZES.size();
+constexpr size_t SLAB_SIZE = 256 * 1024;  //!< Bytes requested from malloc at a time
+
+//! Blocks carved from one slab, which is also how many move between a thread and the depot at once
+constexpr size_t batch_size(const size_t size_class) {
+    return max(SLAB_SIZE / PacketPool::BLOCK_SIZES.at(size_class), size_t{4});
+}
+
+//! A free block, linked through its first bytes
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+//! A singly-linked list of free blocks of one size class
+class FreeList {
+  private:
+    FreeBlock *_head = nullptr;
+    size_t _length = 0;
+
+  public:
+    bool empty() const { return _head == nullptr; }
+    size_t length() const { return _length; }
+
+    void push(void *block) {
+        FreeBlock *const free_block = new (block) FreeBlock{_head};
+        _head = free_block;
+        _length++;
+    }
+
+    void *pop() {
+        FreeBlock *const ret = _head;
+        _head = ret->next;
+        _length--;
+        return ret;
+    }
+
+    //! Move up to `count` blocks to `other`
+    void transfer(FreeList &other, const size_t count) {
+        for (size_t i = 0; i < count and not empty(); i++) {
+            other.push(pop());
+        }
+    }
+};
+
+//! Blocks that threads have handed back, for any thread to take
+struct Depot {
+    mutex lock{};
+    array<FreeList, CLASS_COUNT> lists{};
+};
+
+//! \details Never destroyed, so that Buffers freed while static objects are destroyed still have somewhere to go
+Depot &depot() {
+    static Depot *const the_depot = new Depot;
+    return *the_depot;
+}
+
+thread_local PacketPool::Stats counters{};  //!< The calling thread's PacketPool::Stats
+
+//! Malloc a slab and carve it into blocks on `list`
+void carve_slab(FreeList &list, const size_t size_class) {
+    const size_t block_size = PacketPool::BLOCK_SIZES.at(size_class);
+    const size_t count = batch_size(size_class);
+    char *const slab = static_cast<char *>(malloc(block_size * count));
+    if (slab == nullptr) {
+        throw bad_alloc();
+    }
+    counters.mallocs++;
+    for (size_t i = 0; i < count; i++) {
+        list.push(slab + i * block_size);
+    }
+}
+
+//! A thread's own free lists, handed over to the depot when the thread exits
+class ThreadCache {
+  public:
+    array<FreeList, CLASS_COUNT> lists{};
+
+    ThreadCache() = default;
+    ThreadCache(const ThreadCache &other) = delete;
+    ThreadCache &operator=(const ThreadCache &other) = delete;
+    ~ThreadCache();
+};
+
+//! Whether this thread's cache is yet to be used, in use, or already destroyed
+enum class CacheState : uint8_t { Unused, Alive, Destroyed };
+thread_local CacheState cache_state = CacheState::Unused;
+
+ThreadCache::~ThreadCache() {
+    cache_state = CacheState::Destroyed;
+    Depot &shared = depot();
+    const lock_guard<mutex> guard(shared.lock);
+    for (size_t size_class = 0; size_class < CLASS_COUNT; size_class++) {
+        lists.at(size_class).transfer(shared.lists.at(size_class), lists.at(size_class).length());
+    }
+}
+
+//! \returns the calling thread's cache, or `nullptr` if the thread is exiting and its cache is gone
+ThreadCache *thread_cache() {
+    if (cache_state == CacheState::Destroyed) {
+        return nullptr;
+    }
+    thread_local ThreadCache cache;
+    cache_state = CacheState::Alive;
+    return &cache;
+}
+
+}  // namespace
+
+//! \details Served from the calling thread's free list, refilled a batch at a time from the depot
+//! or, failing that, from a new slab.
+void *PacketPool::allocate(const size_t size, uint8_t &size_class) {
+    counters.allocations++;
+
+    const auto fits =
+        find_if(BLOCK_SIZES.begin(), BLOCK_SIZES.end(), [&](const size_t block) { return size <= block; });
+    size_class = static_cast<uint8_t>(fits - BLOCK_SIZES.begin());
+    if (size_class == UNPOOLED) {
+        void *const ret = malloc(size);
+        if (ret == nullptr) {
+            throw bad_alloc();
+        }
+        counters.mallocs++;
+        return ret;
+    }
+
+    ThreadCache *const cache = thread_cache();
+    if (cache == nullptr) {
+        Depot &shared = depot();
+        const lock_guard<mutex> guard(shared.lock);
+        FreeList &list = shared.lists.at(size_class);
+        if (list.empty()) {
+            carve_slab(list, size_class);
+        }
+        return list.pop();
+    }
+
+    FreeList &list = cache->lists.at(size_class);
+    if (list.empty()) {
+        Depot &shared = depot();
+        const lock_guard<mutex> guard(shared.lock);
+        shared.lists.at(size_class).transfer(list, batch_size(size_class));
+    }
+    if (list.empty()) {
+        carve_slab(list, size_class);
+    }
+    return list.pop();
+}
+
+//! \details The block joins the calling thread's free list (whichever thread allocated it); if that
+//! list has grown past two batches, one batch goes to the depot.
+void PacketPool::deallocate(void *block, const uint8_t size_class) {
+    if (size_class == UNPOOLED) {
+        free(block);
+        return;
+    }
+
+    ThreadCache *const cache = thread_cache();
+    if (cache == nullptr) {
+        Depot &shared = depot();
+        const lock_guard<mutex> guard(shared.lock);
+        shared.lists.at(size_class).push(block);
+        return;
+    }
+
+    FreeList &list = cache->lists.at(size_class);
+    list.push(block);
+    if (list.length() > 2 * batch_size(size_class)) {
+        Depot &shared = depot();
+        const lock_guard<mutex> guard(shared.lock);
+        list.transfer(shared.lists.at(size_class), batch_size(size_class));
+    }
+}
+
+PacketPool::Stats PacketPool::thread_stats() { return counters; }
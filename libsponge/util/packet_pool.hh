@@ -0,0 +1,40 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_POOL_HH
+#define SPONGE_LIBSPONGE_PACKET_POOL_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief A slab allocator for packet storage, with fixed size classes and per-thread free lists
+//! \details Blocks are carved out of large slabs and recycled through a free list belonging to the
+//! thread that frees them, so in steady state a packet buffer is allocated without a lock or a call
+//! to malloc. A thread whose list grows too long (or that exits) hands blocks over to a shared depot,
+//! which other threads refill from before carving a new slab. Slabs are never returned to the system.
+//! Requests larger than the biggest block fall through to malloc.
+class PacketPool {
+  public:
+    //! Block sizes, smallest first: bookkeeping-only blocks, small packets such as ACKs, an Ethernet
+    //! MTU, and the 64 KiB buffers used with segmentation and receive offload
+    static constexpr std::array<size_t, 4> BLOCK_SIZES{128, 512, 2048, 72 * 1024};
+
+    //! The size class of blocks that came straight from malloc
+    static constexpr uint8_t UNPOOLED = BLOCK_SIZES.size();
+
+    //! What the calling thread has done with the pool
+    struct Stats {
+        uint64_t allocations = 0;  //!< Blocks handed out
+        uint64_t mallocs = 0;      //!< Calls to malloc (new slabs and oversized blocks)
+    };
+
+    //! \brief Allocate a block of at least `size` bytes
+    //! \param[out] size_class identifies the block to deallocate()
+    static void *allocate(const size_t size, uint8_t &size_class);
+
+    //! \brief Return a block to the pool
+    static void deallocate(void *block, const uint8_t size_class);
+
+    //! \brief The calling thread's statistics so far
+    static Stats thread_stats();
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_POOL_HH
@@ -0,0 +1,155 @@
+#include "packet_ring.hh"
+
+#include "util.hh"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t CACHE_LINE = 64;
+constexpr size_t LENGTH_SIZE = sizeof(uint32_t);  //!< Each slot starts with the length of its packet
+
+constexpr size_t round_up(const size_t n, const size_t multiple) { return (n + multiple - 1) / multiple * multiple; }
+
+}  // namespace
+
+//! \details Each counter sits on its own cache line, so the producer and the consumer only share a line
+//! when one of them actually needs to see the other's progress.
+struct PacketRing::Control {
+    alignas(CACHE_LINE) atomic<uint64_t> head{0};  //!< Packets published (written only by the producer)
+    alignas(CACHE_LINE) atomic<uint64_t> tail{0};  //!< Packets popped (written only by the consumer)
+    alignas(CACHE_LINE) atomic<bool> armed{true};  //!< Does the consumer want a doorbell for the next packet?
+};
+
+static_assert(atomic<uint64_t>::is_always_lock_free and atomic<bool>::is_always_lock_free,
+              "PacketRing needs atomics that work across processes");
+
+size_t PacketRing::region_size(const size_t slot_count, const size_t slot_size) {
+    return sizeof(Control) + slot_count * round_up(LENGTH_SIZE + slot_size, CACHE_LINE);
+}
+
+PacketRing::PacketRing(void *region, const size_t slot_count, const size_t slot_size)
+    : _control(static_cast<Control *>(region))
+    , _slots(static_cast<char *>(region) + sizeof(Control))
+    , _slot_count(slot_count)
+    , _slot_size(slot_size) {
+    if (slot_count == 0 or (slot_count & (slot_count - 1)) != 0) {
+        throw runtime_error("PacketRing: slot count must be a power of two");
+    }
+}
+
+void PacketRing::initialize() { new (_control) Control; }
+
+char *PacketRing::slot(const uint64_t index) const {
+    return _slots + (index & (_slot_count - 1)) * round_up(LENGTH_SIZE + _slot_size, CACHE_LINE);
+}
+
+char *PacketRing::claim() {
+    const uint64_t head = _control->head.load(memory_order_relaxed);
+    if (head - _control->tail.load(memory_order_acquire) == _slot_count) {
+        return nullptr;
+    }
+    return slot(head) + LENGTH_SIZE;
+}
+
+//! \details The consumer disarms the doorbell by being awake: it rearm()s, then looks for packets. Both
+//! sides' store-then-check are sequentially consistent, so either the consumer's check sees this packet
+//! or the exchange here sees the consumer rearmed, and asks for the doorbell to be rung.
+bool PacketRing::publish(const size_t length) {
+    if (length > _slot_size) {
+        throw runtime_error("PacketRing: packet does not fit in a slot");
+    }
+    const uint64_t head = _control->head.load(memory_order_relaxed);
+    const uint32_t length_field = length;
+    memcpy(slot(head), &length_field, LENGTH_SIZE);
+    _control->head.store(head + 1);
+    return _control->armed.exchange(false);
+}
+
+optional<string_view> PacketRing::peek() const {
+    const uint64_t tail = _control->tail.load(memory_order_relaxed);
+    if (tail == _control->head.load()) {
+        return {};
+    }
+    const char *const packet = slot(tail);
+    uint32_t length = 0;
+    memcpy(&length, packet, LENGTH_SIZE);
+    return string_view{packet + LENGTH_SIZE, length};
+}
+
+void PacketRing::pop() {
+    _control->tail.store(_control->tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void PacketRing::rearm() { _control->armed.store(true); }
+
+//! A memfd mapped into this process
+class PacketRingEndpoint::Region {
+  public:
+    char *const base;
+    const size_t size;
+
+    explicit Region(const size_t length)
+        : base([&] {
+            FileDescriptor memory{SystemCall("memfd_create", memfd_create("sponge-packet-ring", MFD_CLOEXEC))};
+            SystemCall("ftruncate", ftruncate(memory.fd_num(), length));
+            void *const ret = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, memory.fd_num(), 0);
+            if (ret == MAP_FAILED) {
+                throw unix_error("mmap packet ring");
+            }
+            return static_cast<char *>(ret);
+        }())
+        , size(length) {}
+
+    ~Region() { munmap(base, size); }
+
+    Region(const Region &other) = delete;
+    Region &operator=(const Region &other) = delete;
+};
+
+PacketRingEndpoint::PacketRingEndpoint(FileDescriptor &&doorbell,
+                                       shared_ptr<Region> region,
+                                       const PacketRing &incoming,
+                                       const PacketRing &outgoing)
+    : FileDescriptor(move(doorbell)), _region(move(region)), _incoming(incoming), _outgoing(outgoing) {}
+
+//! \details The memfd is closed once mapped: the mapping alone keeps it alive, and is what a forked
+//! child inherits.
+pair<PacketRingEndpoint, PacketRingEndpoint> PacketRingEndpoint::make_pair(const size_t slot_count,
+                                                                           const size_t slot_size) {
+    const size_t ring_size = round_up(PacketRing::region_size(slot_count, slot_size), CACHE_LINE);
+    auto region = make_shared<Region>(2 * ring_size);
+    PacketRing first_to_second{region->base, slot_count, slot_size};
+    PacketRing second_to_first{region->base + ring_size, slot_count, slot_size};
+    first_to_second.initialize();
+    second_to_first.initialize();
+
+    int fds[2];
+    SystemCall("socketpair", socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+    PacketRingEndpoint first{FileDescriptor{fds[0]}, region, second_to_first, first_to_second};
+    PacketRingEndpoint second{FileDescriptor{fds[1]}, move(region), first_to_second, second_to_first};
+    return {move(first), move(second)};
+}
+
+void PacketRingEndpoint::flush() {
+    if (_ring_pending) {
+        write("!");
+        _ring_pending = false;
+    }
+}
+
+//! \details Rearms the peer's next doorbell only after reading this one, so that at most one is ever
+//! outstanding; the caller must then drain the incoming ring, which may already hold packets that
+//! rang no doorbell.
+void PacketRingEndpoint::answer_doorbell() {
+    read(_doorbell, 1);
+    _incoming.rearm();
+}
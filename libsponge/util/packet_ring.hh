@@ -0,0 +1,127 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_RING_HH
+#define SPONGE_LIBSPONGE_PACKET_RING_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+//! \brief A single-producer, single-consumer ring of packets in memory shared between two processes
+//! \details The ring does not own its memory: it is a view over `slot_count` fixed-size slots that follow
+//! a small control block, all inside a region that both processes have mapped. The producer and consumer
+//! each advance their own counter, so neither side ever takes a lock or makes a system call.
+class PacketRing {
+  private:
+    struct Control;  //!< The counters, in the shared region
+
+    Control *_control;
+    char *_slots;
+    size_t _slot_count;  //!< Always a power of two
+    size_t _slot_size;   //!< Largest packet a slot holds
+
+    //! The slot for counter value `index`
+    char *slot(const uint64_t index) const;
+
+  public:
+    //! Bytes of shared memory that a ring with these dimensions occupies
+    static size_t region_size(const size_t slot_count, const size_t slot_size);
+
+    //! View the ring in `region`, which must be region_size() bytes and suitably aligned for a std::atomic
+    //! \note Exactly one of the two processes must then call initialize(), before either side uses the ring
+    PacketRing(void *region, const size_t slot_count, const size_t slot_size);
+
+    //! Construct the (empty) ring's control block
+    void initialize();
+
+    //! Largest packet a slot holds
+    size_t slot_size() const { return _slot_size; }
+
+    //! \name Producer
+    //!@{
+
+    //! \brief Where to write the next packet (up to slot_size() bytes)
+    //! \returns `nullptr` if the ring is full
+    char *claim();
+
+    //! \brief Hand the claimed slot, holding `length` bytes, to the consumer
+    //! \returns `true` if the consumer needs to be woken up (see PacketRingEndpoint)
+    bool publish(const size_t length);
+    //!@}
+
+    //! \name Consumer
+    //!@{
+
+    //! The oldest packet not yet popped, if any
+    std::optional<std::string_view> peek() const;
+
+    //! Give the oldest packet's slot back to the producer (invalidates what peek() returned)
+    void pop();
+
+    //! Note that the consumer is awake: the next publish() should ask for a wakeup again
+    void rearm();
+    //!@}
+};
+
+//! \brief One end of a bidirectional link made of two PacketRings in a memfd, plus a doorbell
+//! \details The doorbell is one end of a SOCK_SEQPACKET socket pair: it becomes readable when the peer
+//! has published packets while this end may have been asleep, so an EventLoop can wait on it. A doorbell
+//! is rung at most once per wakeup, so a busy link costs a system call per burst rather than per packet.
+//!
+//! Both ends are created in one process by make_pair(); the usual way to give one to another process
+//! is to [fork(2)](\ref man2::fork) and keep one end in each (the mapping and the doorbell are inherited).
+class PacketRingEndpoint : public FileDescriptor {
+  private:
+    class Region;  //!< The shared mapping (unmapped once neither end in this process needs it)
+    std::shared_ptr<Region> _region;
+
+    PacketRing _incoming;
+    PacketRing _outgoing;
+    bool _ring_pending = false;  //!< Has a publish() asked for a doorbell that flush() has yet to ring?
+    std::string _doorbell{};     //!< Storage for reading the doorbell
+
+    PacketRingEndpoint(FileDescriptor &&doorbell,
+                       std::shared_ptr<Region> region,
+                       const PacketRing &incoming,
+                       const PacketRing &outgoing);
+
+  public:
+    //! Create both ends of a link whose rings each hold `slot_count` packets of up to `slot_size` bytes
+    static std::pair<PacketRingEndpoint, PacketRingEndpoint> make_pair(const size_t slot_count = 256,
+                                                                       const size_t slot_size = 2048);
+
+    //! Largest packet the link carries
+    size_t slot_size() const { return _outgoing.slot_size(); }
+
+    //! \name Sending
+    //!@{
+
+    //! \brief Where to write the next outgoing packet (see PacketRing::claim())
+    char *claim() { return _outgoing.claim(); }
+
+    //! \brief Hand the claimed slot, holding `length` bytes, to the peer
+    void publish(const size_t length) { _ring_pending |= _outgoing.publish(length); }
+
+    //! \brief Ring the peer's doorbell if anything published since the last flush() needs it
+    void flush();
+    //!@}
+
+    //! \name Receiving
+    //!@{
+
+    //! \brief Consume the doorbell (call once the endpoint is readable, before draining the incoming ring)
+    void answer_doorbell();
+
+    //! \brief The oldest incoming packet not yet popped, if any
+    std::optional<std::string_view> peek() const { return _incoming.peek(); }
+
+    //! \brief Release the oldest incoming packet
+    void pop() { _incoming.pop(); }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_RING_HH
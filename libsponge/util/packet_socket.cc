@@ -0,0 +1,191 @@
+#include "packet_socket.hh"
+
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace {
+
+//! \name Ring geometry
+//!@{
+constexpr size_t RX_BLOCK_SIZE = 1 << 18;                               //!< Bytes per receive block
+constexpr size_t RX_BLOCK_COUNT = 8;                                    //!< Receive blocks in the ring
+constexpr size_t RX_FRAME_SIZE = 2048;                                  //!< Nominal receive frame size
+constexpr unsigned RX_RETIRE_MS = 1;                                    //!< Longest a partly filled block is held back
+constexpr size_t TX_FRAME_SIZE = 2048;                                  //!< Bytes per transmit slot
+constexpr size_t TX_FRAME_COUNT = 256;                                  //!< Transmit slots in the ring
+constexpr size_t TX_BLOCK_SIZE = 1 << 18;                               //!< Bytes per transmit block
+constexpr size_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(tpacket3_hdr));  //!< Where a slot's frame starts
+//!@}
+
+static_assert(TX_FRAME_COUNT * TX_FRAME_SIZE % TX_BLOCK_SIZE == 0, "transmit ring must be whole blocks");
+
+}  // namespace
+
+class PacketSocket::Rings {
+  public:
+    static constexpr size_t RX_LENGTH = RX_BLOCK_SIZE * RX_BLOCK_COUNT;
+    static constexpr size_t LENGTH = RX_LENGTH + TX_FRAME_SIZE * TX_FRAME_COUNT;
+
+    char *const base;  //!< The receive ring, followed by the transmit ring
+
+    size_t rx_next = 0;              //!< The receive block to be read next (or being read)
+    bool rx_holding = false;         //!< Is that block ours until we hand it back?
+    uint32_t rx_frames_left = 0;     //!< Frames of that block not yet returned by receive()
+    const char *rx_frame = nullptr;  //!< The next of them
+
+    size_t tx_next = 0;       //!< The transmit slot that claim() looks at
+    bool tx_pending = false;  //!< Have frames been committed since the last flush()?
+
+    explicit Rings(const int fd)
+        : base(static_cast<char *>(::mmap(nullptr, LENGTH, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))) {
+        if (base == MAP_FAILED) {
+            throw unix_error("mmap packet rings");
+        }
+    }
+
+    ~Rings() { ::munmap(base, LENGTH); }
+
+    Rings(const Rings &other) = delete;
+    Rings &operator=(const Rings &other) = delete;
+
+    tpacket_block_desc *rx_block(const size_t index) const {
+        return reinterpret_cast<tpacket_block_desc *>(base + index * RX_BLOCK_SIZE);
+    }
+
+    tpacket3_hdr *tx_frame(const size_t index) const {
+        return reinterpret_cast<tpacket3_hdr *>(base + RX_LENGTH + index * TX_FRAME_SIZE);
+    }
+};
+
+//! \param[in] interface is the name of the network interface to send and receive on
+PacketSocket::PacketSocket(const string &interface)
+    : FileDescriptor(SystemCall("socket", ::socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL)))), _rings() {
+    const int version = TPACKET_V3;
+    SystemCall("setsockopt", ::setsockopt(fd_num(), SOL_PACKET, PACKET_VERSION, &version, sizeof(version)));
+
+    tpacket_req3 rx_req{};
+    rx_req.tp_block_size = RX_BLOCK_SIZE;
+    rx_req.tp_block_nr = RX_BLOCK_COUNT;
+    rx_req.tp_frame_size = RX_FRAME_SIZE;
+    rx_req.tp_frame_nr = RX_BLOCK_SIZE * RX_BLOCK_COUNT / RX_FRAME_SIZE;
+    rx_req.tp_retire_blk_tov = RX_RETIRE_MS;
+    SystemCall("setsockopt", ::setsockopt(fd_num(), SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)));
+
+    tpacket_req3 tx_req{};
+    tx_req.tp_block_size = TX_BLOCK_SIZE;
+    tx_req.tp_block_nr = TX_FRAME_COUNT * TX_FRAME_SIZE / TX_BLOCK_SIZE;
+    tx_req.tp_frame_size = TX_FRAME_SIZE;
+    tx_req.tp_frame_nr = TX_FRAME_COUNT;
+    SystemCall("setsockopt", ::setsockopt(fd_num(), SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)));
+
+    _rings = make_unique<Rings>(fd_num());
+
+    sockaddr_ll address{};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = static_cast<int>(if_nametoindex(interface.c_str()));
+    if (address.sll_ifindex == 0) {
+        throw unix_error("if_nametoindex " + interface);
+    }
+    SystemCall("bind", ::bind(fd_num(), reinterpret_cast<const sockaddr *>(&address), sizeof(address)));
+}
+
+PacketSocket::~PacketSocket() = default;
+
+PacketSocket::PacketSocket(PacketSocket &&other) noexcept = default;
+
+PacketSocket &PacketSocket::operator=(PacketSocket &&other) noexcept = default;
+
+optional<string_view> PacketSocket::receive() {
+    Rings &rings = *_rings;
+    while (true) {
+        if (rings.rx_frames_left == 0) {
+            tpacket_block_desc *block = rings.rx_block(rings.rx_next);
+            if (rings.rx_holding) {
+                // every frame of the block has been seen: give it back and move on to the next
+                __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+                rings.rx_holding = false;
+                rings.rx_next = (rings.rx_next + 1) % RX_BLOCK_COUNT;
+                block = rings.rx_block(rings.rx_next);
+            }
+            if (not(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+                return {};
+            }
+            register_read();
+            rings.rx_holding = true;
+            rings.rx_frames_left = block->hdr.bh1.num_pkts;
+            rings.rx_frame = reinterpret_cast<const char *>(block) + block->hdr.bh1.offset_to_first_pkt;
+            continue;
+        }
+
+        const char *const frame = rings.rx_frame;
+        const auto *const header = reinterpret_cast<const tpacket3_hdr *>(frame);
+        const auto *const link = reinterpret_cast<const sockaddr_ll *>(frame + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        rings.rx_frame += header->tp_next_offset;
+        rings.rx_frames_left--;
+        if (link->sll_pkttype == PACKET_OUTGOING) {
+            continue;
+        }
+        return string_view{frame + header->tp_mac, header->tp_snaplen};
+    }
+}
+
+char *PacketSocket::claim(const size_t length) {
+    if (length > TX_FRAME_SIZE - TX_DATA_OFFSET) {
+        throw runtime_error("PacketSocket: frame is too long for a transmit slot");
+    }
+    tpacket3_hdr *const slot = _rings->tx_frame(_rings->tx_next);
+    const uint32_t status = __atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE and status != TP_STATUS_WRONG_FORMAT) {
+        return nullptr;
+    }
+    return reinterpret_cast<char *>(slot) + TX_DATA_OFFSET;
+}
+
+void PacketSocket::commit(const size_t length) {
+    tpacket3_hdr *const slot = _rings->tx_frame(_rings->tx_next);
+    slot->tp_len = length;
+    slot->tp_snaplen = length;
+    slot->tp_next_offset = 0;
+    __atomic_store_n(&slot->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    _rings->tx_next = (_rings->tx_next + 1) % TX_FRAME_COUNT;
+    _rings->tx_pending = true;
+}
+
+bool PacketSocket::send(const string_view frame) {
+    char *const out = claim(frame.size());
+    if (out == nullptr) {
+        return false;
+    }
+    frame.copy(out, frame.size());
+    commit(frame.size());
+    return true;
+}
+
+//! \details The kernel sends every slot marked TP_STATUS_SEND_REQUEST, in ring order, and marks each
+//! available again once it is on its way. If the device queue is full (ENOBUFS or EAGAIN), the frames
+//! stay in the ring and the next flush() tries again.
+void PacketSocket::flush() {
+    if (not _rings->tx_pending) {
+        return;
+    }
+    if (::send(fd_num(), nullptr, 0, MSG_DONTWAIT) < 0) {
+        if (errno == ENOBUFS or errno == EAGAIN) {
+            return;
+        }
+        throw unix_error("send");
+    }
+    register_write();
+    _rings->tx_pending = false;
+}
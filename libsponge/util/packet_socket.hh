@@ -0,0 +1,58 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_SOCKET_HH
+#define SPONGE_LIBSPONGE_PACKET_SOCKET_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+//! \brief An [AF_PACKET](\ref man7::packet) socket on one network interface, with TPACKET_V3 rings
+//! \details Frames are exchanged with the kernel through receive and transmit rings mapped into our
+//! memory, rather than through one read(2) or write(2) each. The kernel fills the receive ring a block
+//! (many frames) at a time and hands over a block once it is full or a millisecond has passed, so a
+//! burst is read with no system call at all; frames to send are written into free slots of the transmit
+//! ring, and one flush() hands them all to the kernel. Opening one needs CAP_NET_RAW.
+class PacketSocket : public FileDescriptor {
+  private:
+    class Rings;  //!< The mapped rings (unmapped on destruction)
+    std::unique_ptr<Rings> _rings;
+
+  public:
+    //! Open a packet socket bound to the interface named `interface` (a veth or TAP device, say)
+    explicit PacketSocket(const std::string &interface);
+
+    //! Unmap the rings (the FDWrapper closes the socket)
+    ~PacketSocket();
+
+    //! \name Moving
+    //!@{
+    PacketSocket(PacketSocket &&other) noexcept;
+    PacketSocket &operator=(PacketSocket &&other) noexcept;
+    //!@}
+
+    //! \brief The next frame the interface received, if any (never blocks)
+    //! \details The frame stays in the ring until the following call to receive(), which may hand its
+    //! block back to the kernel; frames this socket sent are skipped.
+    std::optional<std::string_view> receive();
+
+    //! \brief Where to write a frame of `length` bytes for the next flush() to send
+    //! \returns `nullptr` if every slot of the transmit ring is still waiting for the kernel
+    char *claim(const size_t length);
+
+    //! \brief Queue the frame written at the last claim()
+    void commit(const size_t length);
+
+    //! \brief Copy a frame into the transmit ring (see claim())
+    //! \returns `false` if the ring had no room for it
+    bool send(const std::string_view frame);
+
+    //! \brief Hand every committed frame to the kernel with one system call
+    //! \details If the kernel has no room for them yet, they stay committed for the next flush().
+    void flush();
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_SOCKET_HH
@@ -18,36 +18,43 @@ string as_string(const ParseResult r) {
 }
 
 void NetParser::_check_size(const size_t size) {
-    if (size > _buffer.size()) {
+    if (size > _data.size()) {
         set_error(ParseResult::PacketTooShort);
     }
 }
 
 template <typename T>
 T NetParser::_parse_int() {
-    constexpr size_t len = sizeof(T);
-    _check_size(len);
-    if (error()) {
+    const char *const data = take(sizeof(T));
+    if (data == nullptr) {
         return 0;
     }
 
     T ret = 0;
-    for (size_t i = 0; i < len; i++) {
+    for (size_t i = 0; i < sizeof(T); i++) {
         ret <<= 8;
-        ret += uint8_t(_buffer.at(i));
+        ret += uint8_t(data[i]);
     }
+    return ret;
+}
 
-    _buffer.remove_prefix(len);
-
+Buffer NetParser::buffer() const {
+    Buffer ret = _buffer;
+    ret.remove_prefix(_buffer.size() - _data.size());
     return ret;
 }
 
-void NetParser::remove_prefix(const size_t n) {
+void NetParser::remove_prefix(const size_t n) { take(n); }
+
+//! \param[in] n is the number of bytes to consume
+const char *NetParser::take(const size_t n) {
     _check_size(n);
     if (error()) {
-        return;
+        return nullptr;
     }
-    _buffer.remove_prefix(n);
+    const char *const ret = _data.data();
+    _data.remove_prefix(n);
+    return ret;
 }
 
 template <typename T>
@@ -5,7 +5,10 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <endian.h>
 #include <string>
+#include <string_view>
 #include <utility>
 
 //! The result of parsing or unparsing an IP datagram, TCP segment, Ethernet frame, or ARP message
@@ -22,9 +25,14 @@ enum class ParseResult {
 //! Output a string representation of a ParseResult
 std::string as_string(const ParseResult r);
 
+//! \brief Parses headers from the front of a Buffer
+//! \details The parser reads through a view of the Buffer and only produces a new Buffer (the unparsed
+//! remainder) when buffer() is called. Header parsers take() a whole fixed-size header after a single
+//! bounds check and read its fields at fixed offsets with the load_*() functions.
 class NetParser {
   private:
-    Buffer _buffer;
+    Buffer _buffer;                             //!< The buffer being parsed, as given
+    std::string_view _data;                     //!< The part of `_buffer` that has not been parsed yet
     ParseResult _error = ParseResult::NoError;  //!< Result of parsing so far
 
     //! Check that there is sufficient data to parse the next token
@@ -35,9 +43,13 @@ class NetParser {
     T _parse_int();
 
   public:
-    NetParser(Buffer buffer) : _buffer(buffer) {}
+    NetParser(Buffer buffer) : _buffer(std::move(buffer)), _data(_buffer.str()) {}
 
-    Buffer buffer() const { return _buffer; }
+    //! The unparsed remainder, sharing the original storage
+    Buffer buffer() const;
+
+    //! The unparsed remainder, as a view
+    std::string_view view() const { return _data; }
 
     //! Get the current value stored in BaseParser::_error
     ParseResult get_error() const { return _error; }
@@ -60,6 +72,27 @@ class NetParser {
 
     //! Remove n bytes from the buffer
     void remove_prefix(const size_t n);
+
+    //! \brief Consume the next `n` bytes, to be read at fixed offsets
+    //! \returns a pointer to them, or `nullptr` (with the error set) if fewer than `n` bytes remain
+    const char *take(const size_t n);
+
+    //! \name Big-endian loads from bytes returned by take()
+    //!@{
+    static uint8_t load_u8(const char *data) { return static_cast<uint8_t>(*data); }
+
+    static uint16_t load_u16(const char *data) {
+        uint16_t ret;
+        memcpy(&ret, data, sizeof(ret));
+        return be16toh(ret);
+    }
+
+    static uint32_t load_u32(const char *data) {
+        uint32_t ret;
+        memcpy(&ret, data, sizeof(ret));
+        return be32toh(ret);
+    }
+    //!@}
 };
 
 struct NetUnparser {
@@ -74,6 +107,21 @@ struct NetUnparser {
 
     //! Write an 8-bit integer into the data stream in network byte order
     static void u8(std::string &s, const uint8_t val);
+
+    //! \name Big-endian stores at fixed offsets (the counterparts of NetParser's load_*() functions)
+    //!@{
+    static void store_u8(char *data, const uint8_t val) { *data = static_cast<char>(val); }
+
+    static void store_u16(char *data, const uint16_t val) {
+        const uint16_t raw = htobe16(val);
+        memcpy(data, &raw, sizeof(raw));
+    }
+
+    static void store_u32(char *data, const uint32_t val) {
+        const uint32_t raw = htobe32(val);
+        memcpy(data, &raw, sizeof(raw));
+    }
+    //!@}
 };
 
 #endif  // SPONGE_LIBSPONGE_PARSER_HH
@@ -0,0 +1,43 @@
+#include "rcu.hh"
+
+using namespace std;
+
+//! \param[in] domain is the domain whose writers must wait for this reader
+RCUDomain::Reader::Reader(RCUDomain &domain) : _domain(&domain), _slot(nullptr) {
+    lock_guard<mutex> lock{domain._mutex};
+    for (const auto &slot : domain._slots) {
+        if (not slot->active) {
+            _slot = slot.get();
+            break;
+        }
+    }
+    if (_slot == nullptr) {
+        domain._slots.push_back(make_unique<Slot>());
+        _slot = domain._slots.back().get();
+    }
+    _slot->active = true;
+    quiescent();
+}
+
+RCUDomain::Reader::~Reader() {
+    if (_slot != nullptr) {
+        lock_guard<mutex> lock{_domain->_mutex};
+        _slot->active = false;
+    }
+}
+
+RCUDomain::Reader::Reader(Reader &&other) noexcept : _domain(other._domain), _slot(other._slot) {
+    other._slot = nullptr;
+}
+
+//! \details A reader registered after the token was issued cannot have reached the memory, and its
+//! first quiescent state (at registration) already shows as much.
+bool RCUDomain::reclaimable(const uint64_t token) const {
+    lock_guard<mutex> lock{_mutex};
+    for (const auto &slot : _slots) {
+        if (slot->active and slot->seen.load(memory_order_seq_cst) < token) {
+            return false;
+        }
+    }
+    return true;
+}
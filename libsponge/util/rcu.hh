@@ -0,0 +1,71 @@
+#ifndef SPONGE_LIBSPONGE_RCU_HH
+#define SPONGE_LIBSPONGE_RCU_HH
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//! \brief Tells a writer when memory it has unlinked can no longer be in use by any reader
+//! \details Quiescent-state-based read-copy-update: readers never lock or wait, but each reader thread
+//! registers a Reader and calls quiescent() whenever it holds no reference into the shared structure
+//! (between batches of lookups, say). A writer that unlinks some memory takes a retire() token, and may
+//! reuse the memory once reclaimable() says every reader has passed a quiescent state since. A reader
+//! that stops calling quiescent() delays reclamation, but never makes it unsafe.
+class RCUDomain {
+  private:
+    //! One reader's progress, on a cache line of its own
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seen{0};  //!< The latest epoch at which the reader was quiescent
+        bool active = false;            //!< Is a Reader using this slot?
+    };
+
+    std::atomic<uint64_t> _epoch{1};             //!< Advanced by every retire()
+    mutable std::mutex _mutex{};                 //!< Guards `_slots` (readers never take it)
+    std::vector<std::unique_ptr<Slot>> _slots{};  //!< Every slot ever handed out (reused once released)
+
+  public:
+    //! \brief A registered reader thread
+    class Reader {
+      private:
+        RCUDomain *_domain;
+        Slot *_slot;
+
+      public:
+        //! Register a reader of `domain`, initially holding no references
+        explicit Reader(RCUDomain &domain);
+
+        //! Unregister (the reader must hold no references)
+        ~Reader();
+
+        //! \name Moving
+        //!@{
+        Reader(Reader &&other) noexcept;
+        Reader &operator=(Reader &&other) = delete;
+        Reader(const Reader &other) = delete;
+        Reader &operator=(const Reader &other) = delete;
+        //!@}
+
+        //! \brief Announce that this reader holds no reference obtained before now
+        //! \details Wait-free: one load and one store.
+        void quiescent() {
+            _slot->seen.store(_domain->_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+
+        //! Announce that this reader will hold no references until its next quiescent() (while idle, say)
+        void offline() { _slot->seen.store(UINT64_MAX, std::memory_order_seq_cst); }
+    };
+
+    RCUDomain() = default;
+    RCUDomain(const RCUDomain &other) = delete;
+    RCUDomain &operator=(const RCUDomain &other) = delete;
+
+    //! \brief A token for memory that the caller has just unlinked (so that new readers cannot reach it)
+    uint64_t retire() { return _epoch.fetch_add(1, std::memory_order_seq_cst) + 1; }
+
+    //! Has every registered reader been quiescent since `token` was issued?
+    bool reclaimable(const uint64_t token) const;
+};
+
+#endif  // SPONGE_LIBSPONGE_RCU_HH
@@ -2,7 +2,10 @@
 
 #include "util.hh"
 
+#include <array>
 #include <cstddef>
+#include <cstring>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <unistd.h>
 
@@ -84,45 +87,248 @@ void Socket::shutdown(const int how) {
     }
 }
 
+//! Most datagrams one UDP_SEGMENT buffer may carry (UDP_MAX_SEGMENTS on older kernels)
+static constexpr size_t UDP_MAX_GSO_SEGMENTS = 64;
+
+//! Largest UDP payload that fits in an IPv4 datagram, and so the largest UDP_SEGMENT buffer
+static constexpr size_t UDP_MAX_GSO_BYTES = 65507;
+
+//! Properly aligned room for one UDP_SEGMENT or UDP_GRO control message
+union udp_offload_control {
+    char buf[CMSG_SPACE(sizeof(int))];
+    cmsghdr align;
+};
+
+//! \details Setting a segment size of zero leaves every datagram alone; it only tells us whether the kernel
+//! recognizes the option. The size to use is passed with each coalesced buffer instead.
+bool UDPSocket::enable_segmentation_offload() {
+    const int segment_size = 0;
+    _segmentation_offload = ::setsockopt(fd_num(), SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0;
+    return _segmentation_offload;
+}
+
+bool UDPSocket::enable_receive_offload() {
+    const int enable = 1;
+    _receive_offload = ::setsockopt(fd_num(), SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+    return _receive_offload;
+}
+
+//! \returns the size of the datagrams the kernel coalesced into a received buffer, or 0 if it holds only one
+static size_t gro_segment_size(msghdr &message) {
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+            int segment_size;
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            return segment_size;
+        }
+    }
+    return 0;
+}
+
+//! Split a buffer the kernel coalesced back into the datagrams the sender wrote (only the last one may be
+//! shorter than `segment_size`), and hand each to `push`
+template <typename Push>
+static void split_coalesced(const UDPSocket::received_datagram &buffer, const size_t segment_size, const Push &push) {
+    for (size_t offset = 0; offset < buffer.payload.size(); offset += segment_size) {
+        const string_view piece = buffer.payload.str().substr(offset, segment_size);
+        PacketBuffer packet{piece.size()};
+        packet.prepend(piece);
+        push(UDPSocket::received_datagram{buffer.source_address, packet.release()});
+    }
+}
+
+//! \details With receive offload, a buffer the kernel coalesced is split up: its first datagram is returned,
+//! and the rest are held for the following calls (or recv_batch()), which return them without a system call.
 //! \note If `mtu` is too small to hold the received datagram, this method throws a std::runtime_error
 void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
-    // receive source address and payload
+    if (not _held.empty()) {
+        datagram = move(_held.front());
+        _held.pop_front();
+        return;
+    }
+
+    // receive source address and payload (straight into a pooled block, which is not zero-filled first)
     Address::Raw datagram_source_address;
-    datagram.payload.resize(mtu);
+    PacketBuffer packet{mtu};
+    iovec iov{packet.prepend(mtu), mtu};
+    udp_offload_control control;
 
-    socklen_t fromlen = sizeof(datagram_source_address);
+    msghdr message{};
+    message.msg_name = datagram_source_address;
+    message.msg_namelen = sizeof(datagram_source_address);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (_receive_offload) {
+        message.msg_control = control.buf;
+        message.msg_controllen = sizeof(control.buf);
+    }
 
-    const ssize_t recv_len = SystemCall(
-        "recvfrom",
-        ::recvfrom(
-            fd_num(), datagram.payload.data(), datagram.payload.size(), MSG_TRUNC, datagram_source_address, &fromlen));
+    const ssize_t recv_len = SystemCall("recvmsg", ::recvmsg(fd_num(), &message, MSG_TRUNC));
 
     if (recv_len > ssize_t(mtu)) {
-        throw runtime_error("recvfrom (oversized datagram)");
+        throw runtime_error("recvmsg (oversized datagram)");
     }
 
     register_read();
-    datagram.source_address = {datagram_source_address, fromlen};
-    datagram.payload.resize(recv_len);
+    datagram.source_address = {datagram_source_address, message.msg_namelen};
+    packet.truncate(recv_len);
+    datagram.payload = packet.release();
+
+    const size_t segment_size = _receive_offload ? gro_segment_size(message) : 0;
+    if (segment_size != 0 and datagram.payload.size() > segment_size) {
+        split_coalesced(datagram, segment_size, [&](received_datagram &&piece) { _held.push_back(move(piece)); });
+        datagram = move(_held.front());
+        _held.pop_front();
+    }
 }
 
 UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
-    received_datagram ret{{nullptr, 0}, ""};
+    received_datagram ret{{nullptr, 0}, {}};
     recv(ret, mtu);
     return ret;
 }
 
+//! A pooled block to receive each datagram into, and the message header that points at it
+class UDPSocket::ReceiveBatch {
+  public:
+    size_t mtu = 0;                           //!< Capacity of the blocks
+    vector<PacketBuffer> blocks{};            //!< Each either unused so far (mtu bytes long) or handed out
+    vector<Address::Raw> source_addresses{};  //!< Where each datagram came from
+    vector<iovec> iovecs{};                   //!< Each block's room
+    vector<udp_offload_control> controls{};   //!< Room for each datagram's UDP_GRO control message
+    vector<mmsghdr> messages{};               //!< The headers handed to recvmmsg(2)
+
+    //! Get ready to receive up to `count` datagrams of up to `mtu_` bytes (with UDP_GRO, if `offload`)
+    //! \details Only blocks that have been handed out since, or are of the wrong size, are replaced.
+    void prepare(const size_t count, const size_t mtu_, const bool offload) {
+        if (mtu_ != mtu) {
+            blocks.clear();
+            mtu = mtu_;
+        }
+        if (messages.size() < count) {
+            source_addresses.resize(count);
+            iovecs.resize(count);
+            controls.resize(count);
+            messages.resize(count);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (i == blocks.size() or blocks[i].size() != mtu) {
+                PacketBuffer block{mtu};
+                iovecs[i] = {block.prepend(mtu), mtu};
+                if (i == blocks.size()) {
+                    blocks.push_back(move(block));
+                } else {
+                    blocks[i] = move(block);
+                }
+            }
+            msghdr &message = messages[i].msg_hdr;
+            message = {};
+            message.msg_name = source_addresses[i];
+            message.msg_namelen = sizeof(source_addresses[i]);
+            message.msg_iov = &iovecs[i];
+            message.msg_iovlen = 1;
+            if (offload) {
+                message.msg_control = controls[i].buf;
+                message.msg_controllen = sizeof(controls[i].buf);
+            }
+        }
+    }
+};
+
+UDPSocket::UDPSocket() : Socket(AF_INET, SOCK_DGRAM) {}
+
+//! \param[in] fd is the FileDescriptor from which to construct
+UDPSocket::UDPSocket(FileDescriptor &&fd) : Socket(move(fd), AF_INET, SOCK_DGRAM) {}
+
+UDPSocket::~UDPSocket() = default;
+UDPSocket::UDPSocket(UDPSocket &&other) = default;
+UDPSocket &UDPSocket::operator=(UDPSocket &&other) = default;
+
+//! \param[in,out] datagrams holds the received datagrams; it is grown to `max_datagrams` entries if
+//!                 necessary (entries past the returned count are left as they were)
+//! \note If `mtu` is too small to hold a received datagram, this method throws a std::runtime_error
+size_t UDPSocket::recv_batch(vector<received_datagram> &datagrams, const size_t max_datagrams, const size_t mtu) {
+    if (datagrams.size() < max_datagrams) {
+        datagrams.resize(max_datagrams, {{nullptr, 0}, {}});
+    }
+
+    // what recv() held back of a coalesced buffer comes first, and is already here
+    if (not _held.empty()) {
+        size_t taken = 0;
+        for (; taken < max_datagrams and not _held.empty(); taken++) {
+            datagrams[taken] = move(_held.front());
+            _held.pop_front();
+        }
+        return taken;
+    }
+
+    if (not _receive_batch) {
+        _receive_batch = make_unique<ReceiveBatch>();
+    }
+    ReceiveBatch &batch = *_receive_batch;
+    batch.prepare(max_datagrams, mtu, _receive_offload);
+    vector<mmsghdr> &messages = batch.messages;
+
+    // MSG_WAITFORONE: block like recv() for the first datagram, then take only what is already queued
+    size_t received = SystemCall(
+        "recvmmsg", ::recvmmsg(fd_num(), messages.data(), max_datagrams, MSG_TRUNC | MSG_WAITFORONE, nullptr));
+
+    register_read();
+    bool coalesced = false;
+    for (size_t i = 0; i < received; i++) {
+        if (messages[i].msg_len > mtu) {
+            throw runtime_error("recvmmsg (oversized datagram)");
+        }
+        datagrams[i].source_address = {batch.source_addresses[i], messages[i].msg_hdr.msg_namelen};
+        batch.blocks[i].truncate(messages[i].msg_len);
+        datagrams[i].payload = batch.blocks[i].release();
+        coalesced |= _receive_offload and gro_segment_size(messages[i].msg_hdr) != 0;
+    }
+
+    if (not coalesced) {
+        return received;
+    }
+
+    // split coalesced buffers back into the datagrams the sender wrote
+    vector<received_datagram> split;
+    const auto push = [&](received_datagram &&piece) { split.push_back(move(piece)); };
+    for (size_t i = 0; i < received; i++) {
+        const size_t segment_size = gro_segment_size(messages[i].msg_hdr);
+        if (segment_size == 0 or datagrams[i].payload.size() <= segment_size) {
+            push(move(datagrams[i]));
+        } else {
+            split_coalesced(datagrams[i], segment_size, push);
+        }
+    }
+
+    received = split.size();
+    if (datagrams.size() < received) {
+        datagrams.resize(received, {{nullptr, 0}, {}});
+    }
+    move(split.begin(), split.end(), datagrams.begin());
+    return received;
+}
+
 void sendmsg_helper(const int fd_num,
                     const sockaddr *destination_address,
                     const socklen_t destination_address_len,
                     const BufferViewList &payload) {
-    auto iovecs = payload.as_iovecs();
+    // a datagram must go out in one message, so one with too many parts for the array needs a vector
+    array<iovec, 16> iovecs;
+    vector<iovec> more_iovecs;
 
     msghdr message{};
     message.msg_name = const_cast<sockaddr *>(destination_address);
     message.msg_namelen = destination_address_len;
-    message.msg_iov = iovecs.data();
-    message.msg_iovlen = iovecs.size();
+    if (payload.parts() <= iovecs.size()) {
+        message.msg_iov = iovecs.data();
+        message.msg_iovlen = payload.as_iovecs(iovecs.data(), iovecs.size());
+    } else {
+        more_iovecs = payload.as_iovecs();
+        message.msg_iov = more_iovecs.data();
+        message.msg_iovlen = more_iovecs.size();
+    }
 
     const ssize_t bytes_sent = SystemCall("sendmsg", ::sendmsg(fd_num, &message, 0));
 
@@ -131,6 +337,91 @@ void sendmsg_helper(const int fd_num,
     }
 }
 
+//! \param[in,out] segmentation_offload says whether to coalesce runs of equal-size datagrams with UDP_SEGMENT;
+//!                 it is cleared if the outgoing device turns out not to support it
+void sendmmsg_helper(const int fd_num,
+                     const sockaddr *destination_address,
+                     const socklen_t destination_address_len,
+                     const vector<BufferViewList> &payloads,
+                     bool &segmentation_offload) {
+    // a lone datagram needs no batch, and so no allocation
+    if (payloads.size() == 1) {
+        sendmsg_helper(fd_num, destination_address, destination_address_len, payloads.front());
+        return;
+    }
+
+    size_t next_payload = 0;
+    while (next_payload < payloads.size()) {
+        // each message carries one datagram, or (with GSO) a run of equal-size datagrams ended by at most one shorter
+        vector<pair<size_t, size_t>> runs;  // first payload and count of each message
+        for (size_t first = next_payload; first < payloads.size();) {
+            const size_t segment_size = payloads[first].size();
+            size_t count = 1;
+            size_t bytes = segment_size;
+            while (segmentation_offload and segment_size > 0 and first + count < payloads.size() and
+                   count < UDP_MAX_GSO_SEGMENTS and payloads[first + count].size() <= segment_size and
+                   bytes + payloads[first + count].size() <= UDP_MAX_GSO_BYTES) {
+                const size_t size = payloads[first + count].size();
+                bytes += size;
+                count++;
+                if (size < segment_size) {
+                    break;
+                }
+            }
+            runs.emplace_back(first, count);
+            first += count;
+        }
+
+        vector<vector<iovec>> iovecs(runs.size());
+        vector<udp_offload_control> controls(runs.size());
+        vector<mmsghdr> messages(runs.size());
+        for (size_t i = 0; i < runs.size(); i++) {
+            const auto [first, count] = runs[i];
+            for (size_t j = first; j < first + count; j++) {
+                const auto payload_iovecs = payloads[j].as_iovecs();
+                iovecs[i].insert(iovecs[i].end(), payload_iovecs.begin(), payload_iovecs.end());
+            }
+
+            msghdr &message = messages[i].msg_hdr;
+            message.msg_name = const_cast<sockaddr *>(destination_address);
+            message.msg_namelen = destination_address_len;
+            message.msg_iov = iovecs[i].data();
+            message.msg_iovlen = iovecs[i].size();
+            if (count > 1) {
+                const uint16_t segment_size = payloads[first].size();
+                message.msg_control = controls[i].buf;
+                message.msg_controllen = CMSG_SPACE(sizeof(segment_size));
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+                memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+            }
+        }
+
+        // the kernel may stop early (e.g. at UIO_MAXIOV messages), so keep going until everything is sent
+        const int sent = ::sendmmsg(fd_num, messages.data(), messages.size(), 0);
+        if (sent < 0 and errno == EIO and segmentation_offload) {
+            // the route's device can't checksum for us: fall back to one datagram per message
+            segmentation_offload = false;
+            continue;
+        }
+        SystemCall("sendmmsg", sent);
+
+        for (size_t i = 0; i < size_t(sent); i++) {
+            const auto [first, count] = runs[i];
+            size_t bytes = 0;
+            for (size_t j = first; j < first + count; j++) {
+                bytes += payloads[j].size();
+            }
+            if (messages[i].msg_len != bytes) {
+                throw runtime_error("datagram payload too big for sendmmsg()");
+            }
+            next_payload = first + count;
+        }
+    }
+}
+
 void UDPSocket::sendto(const Address &destination, const BufferViewList &payload) {
     sendmsg_helper(fd_num(), destination, destination.size(), payload);
     register_write();
@@ -141,6 +432,16 @@ void UDPSocket::send(const BufferViewList &payload) {
     register_write();
 }
 
+void UDPSocket::sendto_batch(const Address &destination, const vector<BufferViewList> &payloads) {
+    sendmmsg_helper(fd_num(), destination, destination.size(), payloads, _segmentation_offload);
+    register_write();
+}
+
+void UDPSocket::send_batch(const vector<BufferViewList> &payloads) {
+    sendmmsg_helper(fd_num(), nullptr, 0, payloads, _segmentation_offload);
+    register_write();
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen(const int backlog) { SystemCall("listen", ::listen(fd_num(), backlog)); }
@@ -5,9 +5,12 @@
 #include "file_descriptor.hh"
 
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <string>
 #include <sys/socket.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -49,20 +52,53 @@ class Socket : public FileDescriptor {
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
 class UDPSocket : public Socket {
+  public:
+    //! Returned by UDPSocket::recv; carries received data and information about the sender
+    struct received_datagram {
+        Address source_address;  //!< Address from which this datagram was received
+        Buffer payload;          //!< UDP datagram payload
+    };
+
+  private:
+    bool _segmentation_offload = false;  //!< Coalesce runs of equal-size outgoing datagrams (UDP_SEGMENT)?
+    bool _receive_offload = false;       //!< May the kernel coalesce incoming datagrams (UDP_GRO)?
+
+    //! The rest of a coalesced buffer that recv() returned the first datagram of
+    std::deque<received_datagram> _held{};
+
+    //! recv_batch()'s blocks and message headers, kept from one call to the next
+    class ReceiveBatch;
+    std::unique_ptr<ReceiveBatch> _receive_batch{};
+
   protected:
     //! \brief Construct from FileDescriptor (used by TCPOverUDPSocketAdapter)
     //! \param[in] fd is the FileDescriptor from which to construct
-    explicit UDPSocket(FileDescriptor &&fd) : Socket(std::move(fd), AF_INET, SOCK_DGRAM) {}
+    explicit UDPSocket(FileDescriptor &&fd);
 
   public:
     //! Default: construct an unbound, unconnected UDP socket
-    UDPSocket() : Socket(AF_INET, SOCK_DGRAM) {}
+    UDPSocket();
 
-    //! Returned by UDPSocket::recv; carries received data and information about the sender
-    struct received_datagram {
-        Address source_address;  //!< Address from which this datagram was received
-        std::string payload;     //!< UDP datagram payload
-    };
+    ~UDPSocket();
+
+    //! \name Move-only (like FileDescriptor)
+    //!@{
+    UDPSocket(UDPSocket &&other);
+    UDPSocket &operator=(UDPSocket &&other);
+    //!@}
+
+    //! Let send_batch()/sendto_batch() hand runs of equal-size datagrams to the kernel as one buffer
+    //! \returns `false` (and leaves the socket unchanged) if the kernel does not support UDP GSO
+    bool enable_segmentation_offload();
+
+    //! Let the kernel deliver runs of equal-size datagrams as one buffer, which recv() and recv_batch() split
+    //! \returns `false` (and leaves the socket unchanged) if the kernel does not support UDP GRO
+    bool enable_receive_offload();
+
+    //! \brief Datagrams that recv() split from a coalesced buffer and has yet to return
+    //! \details The socket does not poll readable for them: a caller driven by an EventLoop should receive
+    //! until this is zero.
+    size_t held_datagrams() const { return _held.size(); }
 
     //! Receive a datagram and the Address of its sender
     received_datagram recv(const size_t mtu = 65536);
@@ -70,11 +106,23 @@ class UDPSocket : public Socket {
     //! Receive a datagram and the Address of its sender (caller can allocate storage)
     void recv(received_datagram &datagram, const size_t mtu = 65536);
 
+    //! Receive up to `max_datagrams` datagrams with one system call, blocking only until the first arrives
+    //! \returns the number of entries of `datagrams` that were filled in
+    size_t recv_batch(std::vector<received_datagram> &datagrams,
+                      const size_t max_datagrams = 32,
+                      const size_t mtu = 65536);
+
     //! Send a datagram to specified Address
     void sendto(const Address &destination, const BufferViewList &payload);
 
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
+
+    //! Send several datagrams to the specified Address with as few system calls as possible
+    void sendto_batch(const Address &destination, const std::vector<BufferViewList> &payloads);
+
+    //! Send several datagrams to the socket's connected address (must call connect() first)
+    void send_batch(const std::vector<BufferViewList> &payloads);
 };
 
 //! \class UDPSocket
@@ -0,0 +1,70 @@
+#ifndef SPONGE_LIBSPONGE_SPSC_QUEUE_HH
+#define SPONGE_LIBSPONGE_SPSC_QUEUE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//! \brief A bounded queue between one producer thread and one consumer thread, with no lock
+//! \details Each side keeps its own copy of the other side's position, and reads the shared one only
+//! when its copy says the queue is full (or empty): in steady state, the two threads touch each
+//! other's cache line about once per lap of the ring, rather than once per item.
+template <typename T>
+class SPSCQueue {
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> _slots;
+    const size_t _mask;
+
+    alignas(CACHE_LINE) std::atomic<size_t> _head{0};  //!< Items pushed (written by the producer)
+    size_t _tail_seen = 0;                              //!< The producer's copy of `_tail`
+
+    alignas(CACHE_LINE) std::atomic<size_t> _tail{0};  //!< Items popped (written by the consumer)
+    size_t _head_seen = 0;                              //!< The consumer's copy of `_head`
+
+  public:
+    //! \param[in] capacity is the most items the queue holds (a power of two)
+    explicit SPSCQueue(const size_t capacity) : _slots(capacity), _mask(capacity - 1) {
+        if (capacity == 0 or (capacity & (capacity - 1)) != 0) {
+            throw std::runtime_error("SPSCQueue: capacity must be a power of two");
+        }
+    }
+
+    //! \brief Append `item` (producer only)
+    //! \returns `false`, leaving `item` alone, if the queue is full
+    bool push(T &&item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail_seen == _slots.size()) {
+            _tail_seen = _tail.load(std::memory_order_acquire);
+            if (head - _tail_seen == _slots.size()) {
+                return false;
+            }
+        }
+        _slots[head & _mask] = std::move(item);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief Move the oldest item into `item` (consumer only)
+    //! \returns `false` if the queue is empty
+    bool pop(T &item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head_seen) {
+            _head_seen = _head.load(std::memory_order_acquire);
+            if (tail == _head_seen) {
+                return false;
+            }
+        }
+        item = std::move(_slots[tail & _mask]);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! The most items the queue holds
+    size_t capacity() const { return _slots.size(); }
+};
+
+#endif  // SPONGE_LIBSPONGE_SPSC_QUEUE_HH
@@ -0,0 +1,41 @@
+#ifndef SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
+#define SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief A token-bucket rate limiter, driven by tick()
+//! \details Holds up to `burst` tokens, and gains `rate` of them per second of ticks. Each action
+//! that the bucket limits takes one token, or does not happen: over any period, at most `burst`
+//! plus `rate` times its length in seconds take place, however many are attempted.
+class TokenBucket {
+  private:
+    uint64_t _rate;         //!< Tokens gained per second
+    uint64_t _capacity;     //!< Most thousandths of a token held
+    uint64_t _thousandths;  //!< Thousandths of a token held (so that a 1 ms tick gains `_rate` of them)
+
+  public:
+    //! A full bucket of `burst` tokens, gaining `rate` per second
+    TokenBucket(const uint64_t rate, const uint64_t burst)
+        : _rate(rate), _capacity(burst * 1000), _thousandths(_capacity) {}
+
+    //! Take a token, if there is one
+    bool take() {
+        if (_thousandths < 1000) {
+            return false;
+        }
+        _thousandths -= 1000;
+        return true;
+    }
+
+    //! Return a token that was taken but not spent
+    void give_back() { _thousandths = std::min<uint64_t>(_capacity, _thousandths + 1000); }
+
+    //! Gain the tokens due for `ms_since_last_tick` milliseconds
+    void tick(const size_t ms_since_last_tick) {
+        _thousandths = std::min<uint64_t>(_capacity, _thousandths + ms_since_last_tick * _rate);
+    }
+};
+
+#endif  // SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
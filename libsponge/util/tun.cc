@@ -4,16 +4,38 @@
 
 #include <cstring>
 #include <fcntl.h>
+#include <limits>
 #include <linux/if.h>
+#include <linux/if_ether.h>
 #include <linux/if_tun.h>
 #include <sys/ioctl.h>
 
 static constexpr const char *CLONEDEV = "/dev/net/tun";
 
+//! An 802.1Q tag, which a frame on a TAP device may carry after its Ethernet addresses
+static constexpr size_t VLAN_TAG_LENGTH = 4;
+
+static_assert(sizeof(VirtioNetHeader) == 10, "VirtioNetHeader must match struct virtio_net_hdr");
+
 using namespace std;
 
+ParseResult VirtioNetHeader::parse(const string_view packet) {
+    if (packet.size() < sizeof(VirtioNetHeader)) {
+        return ParseResult::PacketTooShort;
+    }
+    memcpy(this, packet.data(), sizeof(VirtioNetHeader));
+    return ParseResult::NoError;
+}
+
+string VirtioNetHeader::serialize() const {
+    return string(reinterpret_cast<const char *>(this), sizeof(VirtioNetHeader));
+}
+
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects Ethernet frames)
+//! \param[in] multi_queue is `true` to attach one more queue to a device created with `multi_queue` (see open_queues())
+//! \param[in] vnet_hdr is `true` to exchange a `struct virtio_net_hdr` with every packet, letting the kernel finish
+//!            TCP checksums and accept (or deliver) TCP super-segments of up to 64 KiB (see vnet_hdr())
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,11 +43,17 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD(const string &devname, const bool is_tun)
-    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))) {
+TunTapFD::TunTapFD(const string &devname, const bool is_tun, const bool multi_queue, const bool vnet_hdr)
+    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))), _vnet_hdr(vnet_hdr), _max_packet_size(0) {
     struct ifreq tun_req {};
 
     tun_req.ifr_flags = (is_tun ? IFF_TUN : IFF_TAP) | IFF_NO_PI;  // tun device with no packetinfo
+    if (multi_queue) {
+        tun_req.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if (vnet_hdr) {
+        tun_req.ifr_flags |= IFF_VNET_HDR;
+    }
 
     // copy devname to ifr_name, making sure to null terminate
 
@@ -33,4 +61,22 @@ TunTapFD::TunTapFD(const string &devname, const bool is_tun)
     tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
     SystemCall("ioctl", ioctl(fd_num(), TUNSETIFF, static_cast<void *>(&tun_req)));
+
+    if (vnet_hdr) {
+        // a plain header (no num_buffers), and permission to hand us partial checksums and TCP super-segments
+        int header_size = sizeof(VirtioNetHeader);
+        SystemCall("ioctl", ioctl(fd_num(), TUNSETVNETHDRSZ, &header_size));
+        const unsigned long offload = TUN_F_CSUM | TUN_F_TSO4;
+        SystemCall("ioctl", ioctl(fd_num(), TUNSETOFFLOAD, offload));
+    }
+
+    // any IP packet can be as long as its 16-bit total length allows: the MTU can be raised after the
+    // device is opened, and a super-segment ignores it anyway (a read shorter than the packet would fail)
+    _max_packet_size = numeric_limits<uint16_t>::max();
+    if (vnet_hdr) {
+        _max_packet_size += sizeof(VirtioNetHeader);
+    }
+    if (not is_tun) {
+        _max_packet_size += ETH_HLEN + VLAN_TAG_LENGTH;
+    }
 }
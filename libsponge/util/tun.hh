@@ -2,28 +2,100 @@
 #define SPONGE_LIBSPONGE_TUN_HH
 
 #include "file_descriptor.hh"
+#include "parser.hh"
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
+
+//! \brief The header in front of every packet on a device opened with `vnet_hdr` (see TunTapFD::vnet_hdr())
+//! \details Same layout as `struct virtio_net_hdr` from `<linux/virtio_net.h>` (which is not valid C++),
+//! in host byte order.
+struct VirtioNetHeader {
+    static constexpr uint8_t F_NEEDS_CSUM = 1;  //!< Checksum from `csum_start` must still be finished
+    static constexpr uint8_t F_DATA_VALID = 2;  //!< Checksum has already been verified
+    static constexpr uint8_t GSO_NONE = 0;      //!< An ordinary packet
+    static constexpr uint8_t GSO_TCPV4 = 1;     //!< A TCP/IPv4 super-segment of `gso_size` pieces
+
+    uint8_t flags;         //!< F_NEEDS_CSUM and/or F_DATA_VALID
+    uint8_t gso_type;      //!< GSO_NONE or GSO_TCPV4
+    uint16_t hdr_len;      //!< Length of the IP and TCP headers
+    uint16_t gso_size;     //!< Payload size of each piece of a super-segment
+    uint16_t csum_start;   //!< Where the checksum coverage begins
+    uint16_t csum_offset;  //!< Where (relative to `csum_start`) the checksum goes
+
+    //! \brief Parse the header at the front of a packet read from the device
+    //! \returns ParseResult::PacketTooShort if the packet is shorter than the header
+    ParseResult parse(const std::string_view packet);
+
+    //! Serialize the header that goes in front of a packet written to the device
+    std::string serialize() const;
+};
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor {
+  private:
+    bool _vnet_hdr;           //!< Does every packet carry a `struct virtio_net_hdr` in front of it?
+    size_t _max_packet_size;  //!< Largest packet one read() can return
+
   public:
-    //! Open an existing persistent [TUN or TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunTapFD(const std::string &devname, const bool is_tun);
+    //! Open an existing persistent [TUN or TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt),
+    //! or one more queue of a multi-queue device.
+    explicit TunTapFD(const std::string &devname,
+                      const bool is_tun,
+                      const bool multi_queue = false,
+                      const bool vnet_hdr = false);
+
+    //! \brief Is checksum and segmentation offload enabled?
+    //! \details If so, every read() and write() begins with a VirtioNetHeader describing which
+    //! checksum the receiver still has to finish and whether the packet is a TCP super-segment
+    //! to be cut into `gso_size` pieces.
+    bool vnet_hdr() const { return _vnet_hdr; }
+
+    //! \brief Largest packet one read() can return: the longest IPv4 packet, whatever the device's MTU,
+    //! plus its link-layer header (with a VLAN tag) on a TAP device and its VirtioNetHeader with `vnet_hdr`
+    size_t max_packet_size() const { return _max_packet_size; }
+
+    //! \brief Read one packet into a pooled block of max_packet_size() (see FileDescriptor::read_buffer())
+    Buffer read_packet() { return read_buffer(_max_packet_size); }
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunFD : public TunTapFD {
   public:
     //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunFD(const std::string &devname) : TunTapFD(devname, true) {}
+    explicit TunFD(const std::string &devname, const bool multi_queue = false, const bool vnet_hdr = false)
+        : TunTapFD(devname, true, multi_queue, vnet_hdr) {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TapFD : public TunTapFD {
   public:
     //! Open an existing persistent [TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TapFD(const std::string &devname) : TunTapFD(devname, false) {}
+    explicit TapFD(const std::string &devname, const bool multi_queue = false)
+        : TunTapFD(devname, false, multi_queue) {}
 };
 
+//! \brief Open `count` queues of a multi-queue TUN or TAP device (DeviceT is TunFD or TapFD)
+//! \details Each queue is an independent FileDescriptor, so each can be served by its own thread.
+//! The kernel picks a flow's queue by automatic flow steering, which is not enough for a connection that
+//! reads only its own queue:
+//! - it learns a flow's queue only from the flow's transmits on it, and forgets it after about three
+//!   seconds without one, falling back to a hash of the flow;
+//! - a new connection's SYN goes to the queue its hash picks, so a listener sees only those SYNs.
+//!
+//! To have each connection see exactly its own traffic, hand the queues to a TunSteering, which reads them
+//! all and steers by 4-tuple. The device must have been created with
+//!
+//!     ip tuntap add mode tun multi_queue user `username` name `devname`
+template <typename DeviceT>
+std::vector<DeviceT> open_queues(const std::string &devname, const size_t count) {
+    std::vector<DeviceT> ret;
+    for (size_t i = 0; i < count; i++) {
+        ret.emplace_back(devname, true);
+    }
+    return ret;
+}
+
 #endif  // SPONGE_LIBSPONGE_TUN_HH
@@ -0,0 +1,179 @@
+#include "tun_steering.hh"
+
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+void FlowTable::add_connection(const Address &local, const Address &remote, const size_t shard) {
+    _connections[{local.ipv4_numeric(), local.port(), remote.ipv4_numeric(), remote.port()}] = shard;
+}
+
+void FlowTable::add_listener(const uint16_t port, const size_t shard) {
+    auto &shards = _listeners[port];
+    if (find(shards.begin(), shards.end(), shard) == shards.end()) {
+        shards.push_back(shard);
+    }
+}
+
+void FlowTable::remove_shard(const size_t shard) {
+    for (auto it = _connections.begin(); it != _connections.end();) {
+        it = it->second == shard ? _connections.erase(it) : next(it);
+    }
+    for (auto it = _listeners.begin(); it != _listeners.end();) {
+        auto &shards = it->second;
+        shards.erase(remove(shards.begin(), shards.end(), shard), shards.end());
+        it = shards.empty() ? _listeners.erase(it) : next(it);
+    }
+}
+
+//! \details A datagram for a listening port goes to the listener chosen by a Fibonacci hash of its
+//! 4-tuple, so the SYN and everything after it (until the connection is registered) reach the same shard.
+optional<size_t> FlowTable::shard_of(const string_view datagram) const {
+    if (datagram.size() < IPv4Header::LENGTH) {
+        return {};
+    }
+    const char *ip = datagram.data();
+    const uint8_t version_and_length = NetParser::load_u8(ip);
+    const size_t header_length = 4 * (version_and_length & 0xf);
+    if (version_and_length >> 4 != 4 or header_length < IPv4Header::LENGTH or
+        datagram.size() < header_length + 2 * sizeof(uint16_t)) {
+        return {};
+    }
+    // only the first fragment carries the ports
+    if (NetParser::load_u8(ip + 9) != IPv4Header::PROTO_TCP or (NetParser::load_u16(ip + 6) & 0x1fff) != 0) {
+        return {};
+    }
+
+    const uint32_t remote = NetParser::load_u32(ip + 12);
+    const uint32_t local = NetParser::load_u32(ip + 16);
+    const uint16_t remote_port = NetParser::load_u16(ip + header_length);
+    const uint16_t local_port = NetParser::load_u16(ip + header_length + sizeof(uint16_t));
+
+    const auto connection = _connections.find({local, local_port, remote, remote_port});
+    if (connection != _connections.end()) {
+        return connection->second;
+    }
+
+    const auto listener = _listeners.find(local_port);
+    if (listener == _listeners.end()) {
+        return {};
+    }
+    const uint32_t hash = (remote ^ local ^ (uint32_t{remote_port} << 16 | local_port)) * 0x9e3779b1U;
+    return listener->second[(hash >> 16) % listener->second.size()];
+}
+
+TunInbox::TunInbox() : FileDescriptor(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+bool TunInbox::push(Buffer &&datagram) {
+    bool was_empty = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_datagrams.size() >= CAPACITY) {
+            return false;
+        }
+        was_empty = _datagrams.empty();
+        _datagrams.push_back(move(datagram));
+    }
+    if (was_empty) {
+        const uint64_t one = 1;
+        SystemCall("write", ::write(fd_num(), &one, sizeof(one)));
+    }
+    return true;
+}
+
+//! \details The wakeup is answered before the datagrams are taken, so a datagram pushed in between
+//! leaves the inbox readable (at worst, for a drain that finds nothing).
+deque<Buffer> TunInbox::drain() {
+    uint64_t count = 0;
+    SystemCall("read", ::read(fd_num(), &count, sizeof(count)), EAGAIN);
+    register_read();
+
+    deque<Buffer> ret;
+    lock_guard<mutex> lock(_mutex);
+    swap(ret, _datagrams);
+    return ret;
+}
+
+//! \param[in] queues are the queues of a multi-queue TUN device (see open_queues()), one per shard
+TunSteering::TunSteering(vector<TunFD> &&queues)
+    : _queues(move(queues))
+    , _inboxes()
+    , _stop(SystemCall("eventfd", ::eventfd(0, EFD_CLOEXEC))) {
+    for (const auto &queue : _queues) {
+        if (queue.vnet_hdr()) {
+            throw runtime_error("TunSteering: queues opened with vnet_hdr are not supported");
+        }
+        _inboxes.push_back(make_shared<TunInbox>());
+    }
+    for (size_t i = 0; i < _queues.size(); i++) {
+        _readers.emplace_back(&TunSteering::steer, this, i);
+    }
+}
+
+TunSteering::~TunSteering() {
+    try {
+        const uint64_t one = 1;
+        SystemCall("write", ::write(_stop.fd_num(), &one, sizeof(one)));
+    } catch (const exception &e) {
+        cerr << "Exception stopping TunSteering: " << e.what() << endl;
+    }
+    for (auto &reader : _readers) {
+        reader.join();
+    }
+}
+
+void TunSteering::add_connection(const Address &local, const Address &remote, const size_t shard) {
+    unique_lock<shared_mutex> lock(_flows_mutex);
+    _flows.add_connection(local, remote, shard);
+}
+
+void TunSteering::add_listener(const uint16_t port, const size_t shard) {
+    unique_lock<shared_mutex> lock(_flows_mutex);
+    _flows.add_listener(port, shard);
+}
+
+void TunSteering::remove_shard(const size_t shard) {
+    unique_lock<shared_mutex> lock(_flows_mutex);
+    _flows.remove_shard(shard);
+}
+
+void TunSteering::steer(const size_t queue) {
+    try {
+        TunFD &device = _queues[queue];
+        array<pollfd, 2> fds{{{device.fd_num(), POLLIN, 0}, {_stop.fd_num(), POLLIN, 0}}};
+        while (true) {
+            if (SystemCall("poll", ::poll(fds.data(), fds.size(), -1), EINTR) < 0) {
+                continue;
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+            if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                throw runtime_error("error on TUN queue " + to_string(queue));
+            }
+
+            Buffer datagram = device.read_packet();
+            optional<size_t> shard;
+            {
+                shared_lock<shared_mutex> lock(_flows_mutex);
+                shard = _flows.shard_of(datagram.str());
+            }
+            if (not shard or not _inboxes[shard.value()]->push(move(datagram))) {
+                ++_dropped;
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Exception in TunSteering reader thread: " << e.what() << "\n";
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef SPONGE_LIBSPONGE_TUN_STEERING_HH
+#define SPONGE_LIBSPONGE_TUN_STEERING_HH
+
+#include "address.hh"
+#include "buffer.hh"
+#include "file_descriptor.hh"
+#include "tun.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+//! \brief Which shard (queue of a multi-queue TUN device) each TCP connection and listening port belongs to
+//! \details Not thread-safe; TunSteering guards it.
+class FlowTable {
+  private:
+    //! Local address, local port, remote address, remote port (all in host byte order)
+    using FourTuple = std::tuple<uint32_t, uint16_t, uint32_t, uint16_t>;
+
+    std::map<FourTuple, size_t> _connections{};            //!< Shard of each registered connection
+    std::map<uint16_t, std::vector<size_t>> _listeners{};  //!< Shards listening on each local port
+
+  public:
+    //! Steer the datagrams of the connection between `local` and `remote` to `shard`
+    void add_connection(const Address &local, const Address &remote, const size_t shard);
+
+    //! Steer the datagrams of new connections to local port `port` to `shard` (or to one of several listeners)
+    void add_listener(const uint16_t port, const size_t shard);
+
+    //! Forget every connection and listener registered for `shard`
+    void remove_shard(const size_t shard);
+
+    //! \brief The shard an IPv4 datagram (arriving from the device) belongs to
+    //! \returns nothing if it is not TCP, is a non-first fragment, or matches no connection or listener
+    std::optional<size_t> shard_of(const std::string_view datagram) const;
+};
+
+//! \brief The datagrams steered to one shard, waiting for its thread
+//! \details Readable (as a FileDescriptor, an [eventfd(2)](\ref man2::eventfd)) while datagrams wait.
+class TunInbox : public FileDescriptor {
+  private:
+    std::mutex _mutex{};
+    std::deque<Buffer> _datagrams{};
+
+  public:
+    //! Datagrams held before further ones are dropped
+    static constexpr size_t CAPACITY = 4096;
+
+    TunInbox();
+
+    //! \brief Queue a datagram (from a reader thread), waking the shard if the inbox was empty
+    //! \returns `false` (dropping it) if the inbox is full
+    bool push(Buffer &&datagram);
+
+    //! Answer the wakeup and take every datagram waiting
+    std::deque<Buffer> drain();
+};
+
+//! \brief Reads every queue of a multi-queue TUN device and hands each datagram to the shard that owns its flow
+//! \details The kernel's own choice of queue follows the flow's last transmit, which it forgets after a few
+//! seconds of silence, and spreads new connections by hash; neither guarantees that a datagram reaches the
+//! queue whose thread owns the connection. TunSteering reads all queues itself (one thread each) and steers
+//! by a FlowTable: an exact 4-tuple match, else a listener on the destination port (picked by a hash of the
+//! 4-tuple, so that a flow stays put), else the datagram is dropped and counted. Shard `i` writes to queue `i`.
+//!
+//! TCPOverIPv4OverSteeredTunAdapter registers its shard's connection (or listener) itself; the TunSteering
+//! must outlive the adapters made from it.
+class TunSteering {
+  private:
+    std::vector<TunFD> _queues;                       //!< One per shard, read only by the reader threads
+    std::vector<std::shared_ptr<TunInbox>> _inboxes;  //!< One per shard
+    mutable std::shared_mutex _flows_mutex{};         //!< Guards `_flows`
+    FlowTable _flows{};                               //!< Which shard owns each flow
+    std::atomic<uint64_t> _dropped{0};                //!< Datagrams that no shard took
+    FileDescriptor _stop;                             //!< eventfd, readable once the readers should exit
+    std::vector<std::thread> _readers{};              //!< One per queue
+
+    //! Reader thread: steer everything that arrives on queue `queue` until stopped
+    void steer(const size_t queue);
+
+  public:
+    //! Start one reader thread per queue (the queues must not use `vnet_hdr`)
+    explicit TunSteering(std::vector<TunFD> &&queues);
+
+    //! Stop and join the reader threads
+    ~TunSteering();
+
+    //! Number of shards (and queues)
+    size_t shards() const { return _queues.size(); }
+
+    //! \name Registration (see FlowTable)
+    //!@{
+    void add_connection(const Address &local, const Address &remote, const size_t shard);
+    void add_listener(const uint16_t port, const size_t shard);
+    void remove_shard(const size_t shard);
+    //!@}
+
+    //! Datagrams dropped because they matched no shard, or found its inbox full
+    uint64_t dropped() const { return _dropped; }
+
+    //! The inbox of `shard`
+    std::shared_ptr<TunInbox> inbox(const size_t shard) const { return _inboxes.at(shard); }
+
+    //! A handle for writing to the queue of `shard`
+    FileDescriptor queue(const size_t shard) { return _queues.at(shard).duplicate(); }
+
+    //! \name Not copyable or movable (the reader threads refer to it)
+    //!@{
+    TunSteering(const TunSteering &other) = delete;
+    TunSteering &operator=(const TunSteering &other) = delete;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_TUN_STEERING_HH
@@ -3,11 +3,19 @@
 #include <array>
 #include <cctype>
 #include <chrono>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <sys/socket.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace std;
 
 //! \returns the number of milliseconds since the program started
@@ -69,6 +77,191 @@ mt19937 get_random_generator() {
     return mt19937(seed);
 }
 
+//! \brief Adds up the bytes at even offsets from `data` and, separately, those at odd offsets
+//! \details The checksum is the sum of big-endian 16-bit words, i.e. 256 times the first sum plus the
+//! second (the other way around if an odd number of bytes has already been added). Each kernel
+//! accumulates both sums exactly, so they all agree with the byte-at-a-time reference. The `copy`
+//! instantiations also store every block they load to `destination`.
+using SumKernel = void (*)(const uint8_t *data, size_t len, uint8_t *destination, uint64_t &even, uint64_t &odd);
+
+//! Sum of the four 16-bit lanes of a word
+static uint64_t sum_lanes(const uint64_t word) {
+    return (word & 0xffff) + ((word >> 16) & 0xffff) + ((word >> 32) & 0xffff) + (word >> 48);
+}
+
+//! Eight bytes at a time, split into even and odd bytes with a mask
+template <bool copy>
+static void sum_word64(const uint8_t *data, size_t len, uint8_t *destination, uint64_t &even, uint64_t &odd) {
+    constexpr uint64_t low_bytes = 0x00ff00ff00ff00ff;
+    constexpr bool little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+    while (len >= 8) {
+        // every 16-bit lane grows by at most 255 per word, so 256 words cannot overflow it
+        const size_t words = min(len / 8, size_t{256});
+        uint64_t low = 0;
+        uint64_t high = 0;
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, data + 8 * i, sizeof(word));
+            if (copy) {
+                memcpy(destination + 8 * i, &word, sizeof(word));
+            }
+            low += word & low_bytes;
+            high += (word >> 8) & low_bytes;
+        }
+        // on a little-endian machine, the low byte of each lane comes first in memory
+        even += sum_lanes(little_endian ? low : high);
+        odd += sum_lanes(little_endian ? high : low);
+        data += 8 * words;
+        destination += copy ? 8 * words : 0;
+        len -= 8 * words;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (copy) {
+            destination[i] = data[i];
+        }
+        (i % 2 ? odd : even) += data[i];
+    }
+}
+
+#if defined(__x86_64__)
+//! Sixteen bytes at a time: PSADBW adds up all the bytes, and again after shifting out the even ones
+template <bool copy>
+static void sum_sse2(const uint8_t *data, size_t len, uint8_t *destination, uint64_t &even, uint64_t &odd) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i all = zero;
+    __m128i high = zero;
+    for (; len >= 16; data += 16, len -= 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        if (copy) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination), block);
+            destination += 16;
+        }
+        all = _mm_add_epi64(all, _mm_sad_epu8(block, zero));
+        high = _mm_add_epi64(high, _mm_sad_epu8(_mm_srli_epi16(block, 8), zero));
+    }
+
+    const uint64_t all_sum = _mm_cvtsi128_si64(all) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(all, all));
+    const uint64_t high_sum = _mm_cvtsi128_si64(high) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(high, high));
+    even += all_sum - high_sum;
+    odd += high_sum;
+
+    sum_word64<copy>(data, len, destination, even, odd);
+}
+
+//! Thirty-two bytes at a time, as in sum_sse2()
+template <bool copy>
+__attribute__((target("avx2"))) static void sum_avx2(const uint8_t *data,
+                                                     size_t len,
+                                                     uint8_t *destination,
+                                                     uint64_t &even,
+                                                     uint64_t &odd) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i all = zero;
+    __m256i high = zero;
+    for (; len >= 32; data += 32, len -= 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        if (copy) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination), block);
+            destination += 32;
+        }
+        all = _mm256_add_epi64(all, _mm256_sad_epu8(block, zero));
+        high = _mm256_add_epi64(high, _mm256_sad_epu8(_mm256_srli_epi16(block, 8), zero));
+    }
+
+    array<uint64_t, 4> all_lanes{};
+    array<uint64_t, 4> high_lanes{};
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(all_lanes.data()), all);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(high_lanes.data()), high);
+    const uint64_t all_sum = all_lanes[0] + all_lanes[1] + all_lanes[2] + all_lanes[3];
+    const uint64_t high_sum = high_lanes[0] + high_lanes[1] + high_lanes[2] + high_lanes[3];
+    even += all_sum - high_sum;
+    odd += high_sum;
+
+    sum_sse2<copy>(data, len, destination, even, odd);
+}
+#endif
+
+#if defined(__aarch64__)
+//! Thirty-two bytes at a time: LD2 separates even and odd bytes, UADALP accumulates them in 16-bit lanes
+template <bool copy>
+static void sum_neon(const uint8_t *data, size_t len, uint8_t *destination, uint64_t &even, uint64_t &odd) {
+    while (len >= 32) {
+        // every 16-bit lane grows by at most 2 * 255 per block, so 128 blocks cannot overflow it
+        const size_t blocks = min(len / 32, size_t{128});
+        uint16x8_t even_lanes = vdupq_n_u16(0);
+        uint16x8_t odd_lanes = vdupq_n_u16(0);
+        for (size_t i = 0; i < blocks; i++) {
+            const uint8x16x2_t block = vld2q_u8(data + 32 * i);
+            if (copy) {
+                vst2q_u8(destination + 32 * i, block);
+            }
+            even_lanes = vpadalq_u8(even_lanes, block.val[0]);
+            odd_lanes = vpadalq_u8(odd_lanes, block.val[1]);
+        }
+        even += vaddlvq_u16(even_lanes);
+        odd += vaddlvq_u16(odd_lanes);
+        data += 32 * blocks;
+        destination += copy ? 32 * blocks : 0;
+        len -= 32 * blocks;
+    }
+
+    sum_word64<copy>(data, len, destination, even, odd);
+}
+#endif
+
+//! \param[in] kernel is a supported kernel other than Kernel::Bytewise
+template <bool copy>
+static SumKernel sum_kernel(const InternetChecksum::Kernel kernel) {
+    switch (kernel) {
+#if defined(__x86_64__)
+        case InternetChecksum::Kernel::SSE2:
+            return sum_sse2<copy>;
+        case InternetChecksum::Kernel::AVX2:
+            return sum_avx2<copy>;
+#endif
+#if defined(__aarch64__)
+        case InternetChecksum::Kernel::NEON:
+            return sum_neon<copy>;
+#endif
+        default:
+            return sum_word64<copy>;
+    }
+}
+
+bool InternetChecksum::supported(const Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Bytewise:
+        case Kernel::Word64:
+            return true;
+#if defined(__x86_64__)
+        case Kernel::SSE2:
+            return true;
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__aarch64__)
+        case Kernel::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+InternetChecksum::Kernel InternetChecksum::best_kernel() {
+    static const Kernel best = [] {
+        for (const Kernel kernel : {Kernel::AVX2, Kernel::NEON, Kernel::SSE2}) {
+            if (supported(kernel)) {
+                return kernel;
+            }
+        }
+        return Kernel::Word64;
+    }();
+    return best;
+}
+
 //! \note This class returns the checksum in host byte order.
 //!       See https://commandcenter.blogspot.com/2012/04/byte-order-fallacy.html for rationale
 //! \details This class can be used to either check or compute an Internet checksum
@@ -86,13 +279,70 @@ mt19937 get_random_generator() {
 //! on the Internet checksum, and consult the [IP](\ref rfc::rfc791) and [TCP](\ref rfc::rfc793) RFCs.
 InternetChecksum::InternetChecksum(const uint32_t initial_sum) : _sum(initial_sum) {}
 
-void InternetChecksum::add(std::string_view data) {
-    for (size_t i = 0; i < data.size(); i++) {
-        uint16_t val = uint8_t(data[i]);
-        if (not _parity) {
-            val <<= 8;
+void InternetChecksum::add(std::string_view data) { add(data, best_kernel()); }
+
+//! \param[in] data is the data to add to the checksum
+//! \param[in] kernel is the implementation to use (see supported())
+void InternetChecksum::add(std::string_view data, const Kernel kernel) {
+    if (kernel == Kernel::Bytewise) {
+        for (size_t i = 0; i < data.size(); i++) {
+            uint16_t val = uint8_t(data[i]);
+            if (not _parity) {
+                val <<= 8;
+            }
+            _sum += val;
+            _parity = !_parity;
         }
-        _sum += val;
+        return;
+    }
+
+    uint64_t even = 0;
+    uint64_t odd = 0;
+    sum_kernel<false>(kernel)(reinterpret_cast<const uint8_t *>(data.data()), data.size(), nullptr, even, odd);
+    add_sums(even, odd, data.size());
+}
+
+//! \details Each block is summed while it is in a register on its way to `destination`, so the data
+//! is read from memory only once.
+//! \param[in] data is the data to add to the checksum
+//! \param[out] destination receives a copy of `data` (and must not overlap it)
+void InternetChecksum::copy_and_checksum(std::string_view data, char *destination) {
+    static const SumKernel kernel = sum_kernel<true>(best_kernel());
+    uint64_t even = 0;
+    uint64_t odd = 0;
+    kernel(reinterpret_cast<const uint8_t *>(data.data()),
+           data.size(),
+           reinterpret_cast<uint8_t *>(destination),
+           even,
+           odd);
+    add_sums(even, odd, data.size());
+}
+
+//! \param[in] other is a checksum, started from zero, of the bytes that follow those already added
+//! \note The bytes added so far must be of even length, as they are in front of any payload
+void InternetChecksum::add(const InternetChecksum &other) {
+    if (_parity) {
+        throw runtime_error("InternetChecksum: cannot append a checksum after an odd number of bytes");
+    }
+    _sum += other._sum;
+    _parity = other._parity;
+}
+
+//! \details [RFC 1624](https://tools.ietf.org/html/rfc1624), eqn. 3: adding the one's complement of the old
+//! word and then the new one updates the sum without going over the rest of the data again. The
+//! running sum is never folded, so value() agrees with a checksum recomputed from scratch (unless
+//! the data has become all zeros, whose sum is +0 rather than -0).
+//! \param[in] old_word is the word's previous value, as it was added (big-endian, at an even offset)
+//! \param[in] new_word is the word's new value
+void InternetChecksum::replace(const uint16_t old_word, const uint16_t new_word) {
+    _sum += static_cast<uint16_t>(~old_word);
+    _sum += new_word;
+}
+
+void InternetChecksum::add_sums(const uint64_t even, const uint64_t odd, const size_t len) {
+    // the even bytes are the high halves of words, unless an earlier add() ended halfway through one
+    _sum += static_cast<uint32_t>(_parity ? (odd << 8) + even : (even << 8) + odd);
+    if (len % 2) {
         _parity = !_parity;
     }
 }
@@ -57,9 +57,35 @@ class InternetChecksum {
     uint32_t _sum;
     bool _parity{};
 
+    //! Fold in the sums of the bytes at even and at odd offsets of `len` new bytes
+    void add_sums(const uint64_t even, const uint64_t odd, const size_t len);
+
   public:
+    //! Implementations of add(); every one gives bit-identical results
+    enum class Kernel {
+        Bytewise,  //!< One byte per iteration (the reference)
+        Word64,    //!< Eight bytes per iteration in a general-purpose register
+        SSE2,      //!< Sixteen bytes per iteration (x86-64)
+        AVX2,      //!< Thirty-two bytes per iteration (x86-64 with AVX2)
+        NEON       //!< Thirty-two bytes per iteration (AArch64)
+    };
+
+    //! Is `kernel` compiled in, and does this CPU support it?
+    static bool supported(const Kernel kernel);
+
+    //! The fastest supported kernel, which add() uses
+    static Kernel best_kernel();
+
     InternetChecksum(const uint32_t initial_sum = 0);
     void add(std::string_view data);
+    //! Add with a specific (supported) kernel, for testing and benchmarking
+    void add(std::string_view data, const Kernel kernel);
+    //! Add the bytes covered by another checksum (started from zero) as if they followed the bytes added so far
+    void add(const InternetChecksum &other);
+    //! Add `data` while copying it to `destination`, in a single pass over memory
+    void copy_and_checksum(std::string_view data, char *destination);
+    //! Account for one aligned 16-bit word of the data changing from `old_word` to `new_word`
+    void replace(const uint16_t old_word, const uint16_t new_word);
     uint16_t value() const;
 };
 
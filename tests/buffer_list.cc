@@ -0,0 +1,89 @@
+#include "buffer.hh"
+#include "util.hh"
+
+#include <array>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! Gather what the iovecs of `views` point at, filling in at most `capacity` of them at a time
+static string gather(BufferViewList views, const size_t capacity) {
+    string ret;
+    array<iovec, 8> iovecs{};
+    while (views.size() > 0) {
+        const size_t count = views.as_iovecs(iovecs.data(), capacity);
+        if (count != min(capacity, views.parts())) {
+            throw runtime_error("as_iovecs() filled in the wrong number of iovecs");
+        }
+        for (size_t i = 0; i < count; i++) {
+            ret.append(static_cast<const char *>(iovecs.at(i).iov_base), iovecs.at(i).iov_len);
+            views.remove_prefix(iovecs.at(i).iov_len);
+        }
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        uniform_int_distribution<size_t> part_size{0, 40};
+        uniform_int_distribution<size_t> capacity{1, 8};
+
+        // lists of up to a dozen parts, which go beyond the inline ones
+        for (unsigned int i = 0; i < 2000; i++) {
+            BufferList list;
+            string expected;
+            const size_t parts = i % 13;
+            for (size_t j = 0; j < parts; j++) {
+                string part(part_size(rd), static_cast<char>('a' + j));
+                expected += part;
+                list.append(move(part));
+            }
+            if (list.buffers().size() != parts or list.concatenate() != expected) {
+                throw runtime_error("BufferList lost or reordered parts");
+            }
+
+            // copies and moves leave the lists independent
+            const BufferList copy = list;
+            BufferList moved = move(list);
+            list = copy;
+
+            const size_t cut = uniform_int_distribution<size_t>{0, expected.size()}(rd);
+            moved.remove_prefix(cut);
+            if (moved.concatenate() != expected.substr(cut) or copy.concatenate() != expected or
+                list.concatenate() != expected) {
+                throw runtime_error("BufferList::remove_prefix gave the wrong result");
+            }
+            moved.append(string("tail"));
+            if (moved.concatenate() != expected.substr(cut) + "tail") {
+                throw runtime_error("BufferList::append after remove_prefix gave the wrong result");
+            }
+
+            if (gather(copy, capacity(rd)) != expected) {
+                throw runtime_error("BufferViewList::as_iovecs gave the wrong result");
+            }
+            if (BufferViewList(copy).as_iovecs().size() != parts) {
+                throw runtime_error("BufferViewList::as_iovecs gave the wrong number of iovecs");
+            }
+        }
+
+        bool threw = false;
+        try {
+            BufferList list{string("abc")};
+            list.remove_prefix(4);
+        } catch (const out_of_range &) {
+            threw = true;
+        }
+        if (not threw) {
+            throw runtime_error("BufferList::remove_prefix went past the end");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "util.hh"
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using Kernel = InternetChecksum::Kernel;
+
+static const char *kernel_name(const Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Bytewise:
+            return "Bytewise";
+        case Kernel::Word64:
+            return "Word64";
+        case Kernel::SSE2:
+            return "SSE2";
+        case Kernel::AVX2:
+            return "AVX2";
+        case Kernel::NEON:
+            return "NEON";
+    }
+    return "unknown";
+}
+
+//! Add the same chunks of `data` with the reference and with `kernel`, comparing after every chunk
+static void check_kernel(const Kernel kernel,
+                         const string_view data,
+                         const vector<size_t> &chunk_sizes,
+                         const uint32_t initial_sum) {
+    InternetChecksum reference{initial_sum};
+    InternetChecksum candidate{initial_sum};
+    size_t offset = 0;
+    for (const size_t chunk_size : chunk_sizes) {
+        reference.add(data.substr(offset, chunk_size), Kernel::Bytewise);
+        candidate.add(data.substr(offset, chunk_size), kernel);
+        if (reference.value() != candidate.value()) {
+            ostringstream ss;
+            ss << "The " << kernel_name(kernel) << " checksum kernel disagrees with the reference\n";
+            ss << "  after adding " << chunk_size << " bytes at offset " << offset << " (initial sum " << initial_sum
+               << "): expected " << reference.value() << ", got " << candidate.value() << "\n";
+            throw runtime_error(ss.str());
+        }
+        offset += chunk_size;
+    }
+}
+
+//! Copy the same chunks of `data` with InternetChecksum::copy_and_checksum, comparing the copy and the sum
+static void check_copy(const string_view data, const vector<size_t> &chunk_sizes, const uint32_t initial_sum) {
+    InternetChecksum reference{initial_sum};
+    InternetChecksum candidate{initial_sum};
+    // one extra byte, so that odd chunks are also copied to odd addresses
+    string copy(data.size() + 1, 0);
+    size_t offset = 0;
+    for (const size_t chunk_size : chunk_sizes) {
+        reference.add(data.substr(offset, chunk_size), Kernel::Bytewise);
+        candidate.copy_and_checksum(data.substr(offset, chunk_size), copy.data() + 1 + offset);
+        offset += chunk_size;
+        if (reference.value() != candidate.value() or data.substr(0, offset) != string_view(copy).substr(1, offset)) {
+            ostringstream ss;
+            ss << "copy_and_checksum disagrees with the reference after " << offset << " bytes\n";
+            throw runtime_error(ss.str());
+        }
+    }
+}
+
+//! Appending a payload's checksum to a header's must match summing the header and payload together
+static void check_append(const string_view header, const string_view payload, const uint32_t initial_sum) {
+    InternetChecksum reference{initial_sum};
+    reference.add(header, Kernel::Bytewise);
+    reference.add(payload, Kernel::Bytewise);
+
+    InternetChecksum payload_checksum;
+    payload_checksum.add(payload);
+    InternetChecksum candidate{initial_sum};
+    candidate.add(header);
+    candidate.add(payload_checksum);
+
+    if (reference.value() != candidate.value()) {
+        ostringstream ss;
+        ss << "appending the checksum of a " << payload.size() << "-byte payload to that of a " << header.size()
+           << "-byte header gave " << candidate.value() << ", expected " << reference.value() << "\n";
+        throw runtime_error(ss.str());
+    }
+}
+
+//! Patching one word with InternetChecksum::replace must match summing the changed data from scratch
+static void check_replace(string data, const size_t word_offset, const uint16_t new_word) {
+    InternetChecksum patched;
+    patched.add(data);
+
+    const uint16_t old_word = (uint8_t(data[word_offset]) << 8) | uint8_t(data[word_offset + 1]);
+    data[word_offset] = static_cast<char>(new_word >> 8);
+    data[word_offset + 1] = static_cast<char>(new_word & 0xff);
+    patched.replace(old_word, new_word);
+
+    // the one exception (RFC 1624 sec. 3): data that is now all zeros sums to +0 instead of -0
+    if (data.find_first_not_of('\0') == string::npos) {
+        return;
+    }
+
+    InternetChecksum reference;
+    reference.add(data, Kernel::Bytewise);
+    if (reference.value() != patched.value()) {
+        ostringstream ss;
+        ss << "replacing " << old_word << " with " << new_word << " at offset " << word_offset << " gave "
+           << patched.value() << ", expected " << reference.value() << "\n";
+        throw runtime_error(ss.str());
+    }
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        uniform_int_distribution<uint32_t> dist32{0, numeric_limits<uint32_t>::max()};
+        uniform_int_distribution<unsigned> byte{0, 255};
+        uniform_int_distribution<size_t> small_chunk{0, 80};
+        uniform_int_distribution<size_t> large_chunk{0, 4000};
+
+        vector<Kernel> kernels;
+        for (const Kernel kernel : {Kernel::Word64, Kernel::SSE2, Kernel::AVX2, Kernel::NEON}) {
+            if (InternetChecksum::supported(kernel)) {
+                kernels.push_back(kernel);
+            }
+        }
+        if (not InternetChecksum::supported(InternetChecksum::best_kernel())) {
+            throw runtime_error("best_kernel() is not supported");
+        }
+
+        // random data in random chunks, so that chunks start at odd offsets and after odd lengths
+        for (unsigned int i = 0; i < 2000; i++) {
+            string data;
+            vector<size_t> chunk_sizes;
+            const size_t chunk_count = 1 + i % 8;
+            for (size_t j = 0; j < chunk_count; j++) {
+                chunk_sizes.push_back(i % 2 ? large_chunk(rd) : small_chunk(rd));
+                for (size_t k = 0; k < chunk_sizes.back(); k++) {
+                    data.push_back(static_cast<char>(byte(rd)));
+                }
+            }
+            const uint32_t initial_sum = dist32(rd);
+            for (const Kernel kernel : kernels) {
+                check_kernel(kernel, data, chunk_sizes, initial_sum);
+            }
+            check_copy(data, chunk_sizes, initial_sum);
+
+            const string_view whole = data;
+            const size_t header_size = 4 * (chunk_sizes.front() % 16);
+            if (header_size <= whole.size()) {
+                check_append(whole.substr(0, header_size), whole.substr(header_size), initial_sum);
+            }
+            if (data.size() >= 2) {
+                const size_t word_offset = 2 * (initial_sum % (data.size() / 2));
+                check_replace(data, word_offset, static_cast<uint16_t>(dist32(rd)));
+                check_replace(data, word_offset, 0);
+                check_replace(data, word_offset, 0xffff);
+            }
+        }
+
+        // long runs of 0xff, which overflow narrow accumulators and wrap the 32-bit running sum
+        const string ones(1 << 20, '\xff');
+        for (const Kernel kernel : kernels) {
+            check_kernel(kernel, ones, {ones.size()}, 0);
+            check_kernel(kernel, ones, {1, ones.size() - 2, 1}, dist32(rd));
+            check_kernel(kernel, ones, {65535, 65536, 65537}, numeric_limits<uint32_t>::max());
+        }
+        check_copy(ones, {1, ones.size() - 2, 1}, dist32(rd));
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
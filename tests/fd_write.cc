@@ -0,0 +1,43 @@
+#include "buffer.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+int main() {
+    try {
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_DGRAM, 0, static_cast<int *>(fds)));
+        FileDescriptor sender{fds[0]}, receiver{fds[1]};
+
+        // on either side of the number of iovecs write() keeps on the stack
+        for (const size_t parts : {1, 16, 17, 40}) {
+            BufferList list;
+            string expected;
+            for (size_t i = 0; i < parts; i++) {
+                string part(i % 7 + 1, static_cast<char>('a' + i % 26));
+                expected += part;
+                list.append(move(part));
+            }
+
+            if (sender.write(list) != expected.size()) {
+                throw runtime_error(to_string(parts) + " parts: write() did not write them all");
+            }
+            if (receiver.read() != expected) {
+                throw runtime_error(to_string(parts) + " parts: did not arrive as one datagram");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include "io_uring.hh"
+#include "test_datagrams.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+using namespace std;
+
+//! Is `fd` readable (waiting up to a second for it)?
+static bool readable(const FileDescriptor &fd) {
+    pollfd pfd{fd.fd_num(), POLLIN, 0};
+    return SystemCall("poll", ::poll(&pfd, 1, 1000)) > 0;
+}
+
+int main() {
+    try {
+        if (not IOUring::available()) {
+            cerr << "io_uring is not available, skipping\n";
+            return 77;
+        }
+
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+        FileDescriptor local{fds[0]}, peer{fds[1]};
+
+        // two posted reads and four write slots, so that writes soon have to wait for slots
+        IOUringEngine engine{local, 2, 1024};
+
+        // these complete the posted reads, which the engine meets while it waits for write slots
+        constexpr uint32_t received = 3;
+        for (uint32_t i = 0; i < received; i++) {
+            peer.write(test_datagram(i));
+        }
+
+        constexpr uint32_t sent = 100;
+        for (uint32_t i = 0; i < sent; i++) {
+            engine.write(BufferList{test_datagram(i)});
+        }
+        engine.flush();
+
+        for (uint32_t i = 0; i < sent; i++) {
+            if (not readable(peer) or peer.read() != test_datagram(i)) {
+                throw runtime_error("datagram " + to_string(i) + " was not written in order");
+            }
+        }
+
+        for (uint32_t i = 0; i < received; i++) {
+            optional<Buffer> datagram = engine.read();
+            while (not datagram) {
+                if (not readable(engine)) {
+                    throw runtime_error("the engine's ring is not readable while datagrams wait to be read");
+                }
+                datagram = engine.read();
+            }
+            if (datagram->str() != test_datagram(i)) {
+                throw runtime_error("datagram " + to_string(i) + " was not read in order");
+            }
+        }
+        if (engine.read()) {
+            throw runtime_error("the engine read a datagram that was never sent");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "datagram_reassembler.hh"
+#include "ipv4_datagram.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static IPv4Datagram make_datagram(const uint32_t src, const uint16_t id, const size_t payload_size) {
+    IPv4Datagram dgram;
+    dgram.header().src = src;
+    dgram.header().dst = 0x0a000002;
+    dgram.header().id = id;
+    dgram.header().df = false;
+    string payload(payload_size, 0);
+    for (size_t i = 0; i < payload_size; i++) {
+        payload[i] = static_cast<char>('a' + (i + id) % 26);
+    }
+    dgram.payload() = move(payload);
+    dgram.header().len = dgram.header().hlen * 4 + payload_size;
+    return dgram;
+}
+
+static string wire(const IPv4Datagram &dgram) { return dgram.serialize().concatenate(); }
+
+//! Push `fragments` in order, and return what comes out
+static vector<IPv4Datagram> push_all(DatagramReassembler &reassembler, const vector<IPv4Datagram> &fragments) {
+    vector<IPv4Datagram> ret;
+    for (const auto &fragment : fragments) {
+        // through the wire and back, as a receiver would see it
+        IPv4Datagram received;
+        if (received.parse(fragment.serialize().concatenate()) != ParseResult::NoError) {
+            throw runtime_error("fragments: a fragment does not parse");
+        }
+        auto whole = reassembler.push(move(received));
+        if (whole.has_value()) {
+            ret.push_back(move(whole.value()));
+        }
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // fragments carry multiples of 8 bytes (but the last), and fit the MTU
+        {
+            const IPv4Datagram dgram = make_datagram(0x0a000001, 1, 1400);
+            const auto fragments = dgram.fragment(576);
+            if (fragments.size() != 3 or fragments[0].payload().size() != 552 or
+                fragments[1].header().offset != 69 or fragments[2].header().offset != 138 or
+                not fragments[1].header().mf or fragments[2].header().mf or fragments[2].header().len != 20 + 296) {
+                throw runtime_error("fragments: wrong split");
+            }
+            if (dgram.fragment(1420).size() != 1 or wire(dgram.fragment(1420)[0]) != wire(dgram)) {
+                throw runtime_error("fragments: a datagram that fits was split");
+            }
+
+            IPv4Datagram dont = dgram;
+            dont.header().df = true;
+            bool threw = false;
+            try {
+                dont.fragment(576);
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            if (not threw) {
+                throw runtime_error("fragments: a datagram with DF set was split");
+            }
+        }
+
+        // fragments in any order, with duplicates and fragments of fragments, come back together
+        for (unsigned int round = 0; round < 200; round++) {
+            const IPv4Datagram dgram = make_datagram(0x0a000001, round, 100 + rd() % 8000);
+            vector<IPv4Datagram> fragments;
+            for (const auto &fragment : dgram.fragment(68 + rd() % (dgram.header().len - 68))) {
+                for (auto &piece : fragment.fragment(68 + rd() % 1500)) {
+                    fragments.push_back(move(piece));
+                }
+            }
+            // (a duplicate of the last fragment to arrive would start another datagram)
+            shuffle(fragments.begin(), fragments.end(), rd);
+            fragments.insert(fragments.end() - 1, fragments.at(rd() % (fragments.size() - 1)));
+
+            DatagramReassembler reassembler;
+            const auto out = push_all(reassembler, fragments);
+            if (out.size() != 1 or wire(out[0]) != wire(dgram)) {
+                throw runtime_error("fragments: datagram not put back together");
+            }
+            if (reassembler.pending() != 0 or reassembler.bytes_held() != 0) {
+                throw runtime_error("fragments: fragments held after the datagram was whole");
+            }
+        }
+
+        // two datagrams alike but for the source are kept apart
+        {
+            auto first = make_datagram(0x0a000001, 7, 3000).fragment(1000);
+            const auto second = make_datagram(0x0a000003, 7, 3000).fragment(1000);
+            first.insert(first.begin() + 1, second.begin(), second.end());
+            DatagramReassembler reassembler;
+            const auto out = push_all(reassembler, first);
+            if (out.size() != 2 or out[0].header().src != 0x0a000003 or out[1].header().src != 0x0a000001) {
+                throw runtime_error("fragments: datagrams mixed up");
+            }
+        }
+
+        // overlapping fragments condemn their datagram
+        {
+            auto fragments = make_datagram(0x0a000001, 8, 3000).fragment(1000);
+            IPv4Datagram overlapping = fragments[1];
+            overlapping.header().offset += 1;
+            fragments.insert(fragments.begin() + 1, overlapping);
+            DatagramReassembler reassembler;
+            if (not push_all(reassembler, fragments).empty() or reassembler.discarded() != 1) {
+                throw runtime_error("fragments: overlapping fragments accepted");
+            }
+        }
+
+        // a datagram whose fragments do not all arrive in time is discarded
+        {
+            const auto fragments = make_datagram(0x0a000001, 9, 3000).fragment(1000);
+            DatagramReassembler reassembler{DatagramReassembler::CAPACITY, 1000};
+            push_all(reassembler, {fragments[0], fragments[1]});
+            reassembler.tick(999);
+            if (reassembler.pending() != 1) {
+                throw runtime_error("fragments: datagram discarded early");
+            }
+            reassembler.tick(1);
+            if (reassembler.pending() != 0 or reassembler.bytes_held() != 0 or reassembler.discarded() != 1) {
+                throw runtime_error("fragments: datagram outlived its timeout");
+            }
+            if (not push_all(reassembler, {fragments[2]}).empty()) {
+                throw runtime_error("fragments: late fragment completed a discarded datagram");
+            }
+        }
+
+        // fragments never take more than the capacity: the oldest datagrams make room
+        {
+            DatagramReassembler reassembler{4 * (1000 + DatagramReassembler::FRAGMENT_OVERHEAD)};
+            vector<vector<IPv4Datagram>> datagrams;
+            for (uint16_t id = 0; id < 6; id++) {
+                datagrams.push_back(make_datagram(0x0a000001, id, 2000).fragment(1020));
+                push_all(reassembler, {datagrams.back()[0]});
+                if (reassembler.bytes_held() > 4 * (1000 + DatagramReassembler::FRAGMENT_OVERHEAD)) {
+                    throw runtime_error("fragments: capacity exceeded");
+                }
+            }
+            if (reassembler.pending() != 4 or reassembler.discarded() != 2 or
+                not push_all(reassembler, {datagrams[0][1]}).empty() or
+                push_all(reassembler, {datagrams[5][1]}).size() != 1) {
+                throw runtime_error("fragments: wrong datagrams evicted");
+            }
+        }
+
+        // link-layer padding past the datagram's length is dropped
+        {
+            const IPv4Datagram dgram = make_datagram(0x0a000001, 10, 6);
+            IPv4Datagram parsed;
+            if (parsed.parse(wire(dgram) + string(20, 0)) != ParseResult::NoError or wire(parsed) != wire(dgram)) {
+                throw runtime_error("fragments: padded datagram not parsed");
+            }
+            if (parsed.parse(wire(dgram).substr(0, 24)) == ParseResult::NoError) {
+                throw runtime_error("fragments: truncated datagram parsed");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
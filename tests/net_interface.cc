@@ -5,6 +5,8 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -313,6 +315,167 @@ int main() {
                            make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5").serialize())});
             test.execute(ExpectNoFrame{});
         }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress old_eth = random_private_ethernet_address();
+            const EthernetAddress new_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "every ARP message refreshes a mapping", local_eth, Address("10.0.0.1", 0)};
+
+            // learn from a request that is not for us, then hear from the same neighbor at a new address
+            for (const auto &eth : {old_eth, new_eth}) {
+                test.execute(ReceiveFrame{
+                    make_frame(eth,
+                               ETHERNET_BROADCAST,
+                               EthernetHeader::TYPE_ARP,
+                               make_arp(ARPMessage::OPCODE_REQUEST, eth, "10.0.0.5", {}, "10.0.0.9").serialize()),
+                    {}});
+                test.execute(ExpectNoFrame{});
+                test.execute(Tick{20000});
+            }
+
+            // 40 seconds after first hearing from it, 20 after the refresh: the new address holds
+            const auto datagram = make_datagram("5.6.7.8", "13.12.11.10");
+            test.execute(SendDatagram{datagram, Address("10.0.0.5", 0)});
+            test.execute(ExpectFrame{make_frame(local_eth, new_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(ExpectNoFrame{});
+
+            test.execute(Tick{10000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.5", 0)});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5").serialize())});
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"the neighbor cache is bounded", local_eth, Address("10.0.0.1", 0)};
+
+            // one neighbor too many: the first heard from is forgotten
+            for (uint32_t n = 0; n <= NetworkInterface::MAX_NEIGHBORS; n++) {
+                const string ip = Address::from_ipv4_numeric(0x0a010000 + n).ip();
+                test.execute(ReceiveFrame{
+                    make_frame(remote_eth,
+                               ETHERNET_BROADCAST,
+                               EthernetHeader::TYPE_ARP,
+                               make_arp(ARPMessage::OPCODE_REQUEST, remote_eth, ip, {}, "10.0.0.9").serialize()),
+                    {}});
+            }
+
+            const auto datagram = make_datagram("5.6.7.8", "13.12.11.10");
+            test.execute(SendDatagram{datagram, Address("10.1.0.1", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(SendDatagram{datagram, Address("10.1.0.0", 0)});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.1.0.0").serialize())});
+            test.execute(ExpectNoFrame{});
+        }
+
+        for (const auto policy : {NetworkInterface::DropPolicy::Tail, NetworkInterface::DropPolicy::Head}) {
+            const bool head = policy == NetworkInterface::DropPolicy::Head;
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{head ? "a full pending queue drops its oldest datagram"
+                                                  : "a full pending queue drops the datagram arriving",
+                                             local_eth,
+                                             Address("10.0.0.1", 0)};
+
+            NetworkInterface::PendingLimits limits{};
+            limits.datagrams_per_neighbor = 2;
+            limits.policy = policy;
+            test.execute(SetPendingLimits{limits});
+
+            const vector<InternetDatagram> datagrams{make_datagram("5.6.7.8", "13.12.11.10"),
+                                                     make_datagram("5.6.7.9", "13.12.11.10"),
+                                                     make_datagram("5.6.7.10", "13.12.11.10")};
+            for (const auto &datagram : datagrams) {
+                test.execute(SendDatagram{datagram, Address("10.0.0.2", 0)});
+            }
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.2").serialize())});
+            test.execute(ExpectNoFrame{});
+            test.execute(ExpectPending{2, 1, 0});
+
+            test.execute(ReceiveFrame{
+                make_frame(
+                    remote_eth,
+                    local_eth,
+                    EthernetHeader::TYPE_ARP,
+                    make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.2", local_eth, "10.0.0.1").serialize()),
+                {}});
+            for (size_t i = head ? 1 : 0; i < (head ? 3 : 2); i++) {
+                test.execute(ExpectFrame{
+                    make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagrams[i].serialize())});
+            }
+            test.execute(ExpectNoFrame{});
+            test.execute(ExpectPending{0, 1, 0});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"pending datagrams are bounded in all", local_eth, Address("10.0.0.1", 0)};
+
+            const auto datagram = make_datagram("5.6.7.8", "13.12.11.10");
+            NetworkInterface::PendingLimits limits{};
+            limits.bytes = 2 * datagram.header().len;
+            test.execute(SetPendingLimits{limits});
+
+            // the third datagram would be one too many, although its next hop holds just one
+            for (const string next_hop : {"10.0.0.2", "10.0.0.3", "10.0.0.2"}) {
+                test.execute(SendDatagram{datagram, Address(next_hop, 0)});
+            }
+            for (const string next_hop : {"10.0.0.2", "10.0.0.3"}) {
+                test.execute(ExpectFrame{
+                    make_frame(local_eth,
+                               ETHERNET_BROADCAST,
+                               EthernetHeader::TYPE_ARP,
+                               make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, next_hop).serialize())});
+            }
+            test.execute(ExpectNoFrame{});
+            test.execute(ExpectPending{2, 1, 0});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "pending datagrams are dropped with their ARP request", local_eth, Address("10.0.0.1", 0)};
+
+            const auto datagram = make_datagram("5.6.7.8", "13.12.11.10");
+            test.execute(SendDatagram{datagram, Address("10.0.0.2", 0)});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.2").serialize())});
+            test.execute(Tick{4000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.2", 0)});
+            test.execute(ExpectPending{2, 0, 0});
+            test.execute(Tick{1000});
+            test.execute(ExpectPending{0, 0, 2});
+
+            // a late reply finds nothing to send
+            test.execute(ReceiveFrame{
+                make_frame(
+                    remote_eth,
+                    local_eth,
+                    EthernetHeader::TYPE_ARP,
+                    make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.2", local_eth, "10.0.0.1").serialize()),
+                {}});
+            test.execute(ExpectNoFrame{});
+        }
     } catch (const exception &e) {
         cerr << e.what() << endl;
         return EXIT_FAILURE;
@@ -170,3 +170,32 @@ void ExpectNoFrame::execute(NetworkInterface &interface) const {
 string Tick::description() const { return to_string(_ms) + " ms pass"; }
 
 void Tick::execute(NetworkInterface &interface) const { interface.tick(_ms); }
+
+string SetPendingLimits::description() const {
+    return "pending limits set to " + to_string(limits.datagrams_per_neighbor) + " datagrams/" +
+           to_string(limits.bytes_per_neighbor) + " bytes per neighbor, " + to_string(limits.datagrams) +
+           " datagrams/" + to_string(limits.bytes) + " bytes in all, dropping the " +
+           (limits.policy == NetworkInterface::DropPolicy::Head ? "oldest" : "newest");
+}
+
+void SetPendingLimits::execute(NetworkInterface &interface) const { interface.set_pending_limits(limits); }
+
+string ExpectPending::description() const {
+    return to_string(datagrams) + " datagrams pending, " + to_string(overflows) + " dropped over the limits, " +
+           to_string(timeouts) + " dropped unresolved";
+}
+
+void ExpectPending::execute(NetworkInterface &interface) const {
+    if (interface.pending_datagrams() != datagrams) {
+        throw NetworkInterfaceExpectationViolation::property("pending_datagrams", datagrams,
+                                                             interface.pending_datagrams());
+    }
+    if (interface.pending_overflows() != overflows) {
+        throw NetworkInterfaceExpectationViolation::property("pending_overflows", overflows,
+                                                             interface.pending_overflows());
+    }
+    if (interface.pending_timeouts() != timeouts) {
+        throw NetworkInterfaceExpectationViolation::property("pending_timeouts", timeouts,
+                                                             interface.pending_timeouts());
+    }
+}
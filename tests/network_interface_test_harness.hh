@@ -78,6 +78,26 @@ struct Tick : public NetworkInterfaceAction {
     Tick(const size_t ms) : _ms(ms) {}
 };
 
+struct SetPendingLimits : public NetworkInterfaceAction {
+    NetworkInterface::PendingLimits limits;
+
+    std::string description() const override;
+    void execute(NetworkInterface &interface) const override;
+
+    SetPendingLimits(const NetworkInterface::PendingLimits &l) : limits(l) {}
+};
+
+struct ExpectPending : public NetworkInterfaceExpectation {
+    size_t datagrams;
+    uint64_t overflows;
+    uint64_t timeouts;
+
+    std::string description() const override;
+    void execute(NetworkInterface &interface) const override;
+
+    ExpectPending(const size_t d, const uint64_t o, const uint64_t t) : datagrams(d), overflows(o), timeouts(t) {}
+};
+
 class NetworkInterfaceTestHarness {
     std::string _test_name;
     NetworkInterface _interface;
@@ -0,0 +1,117 @@
+#include "buffer.hh"
+#include "packet_pool.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! Fill a packet with a pattern that identifies it, so that two packets sharing a block show up
+static Buffer make_packet(const size_t size, const uint8_t tag) {
+    PacketBuffer packet{size};
+    memset(packet.prepend(size), tag, size);
+    return packet.release();
+}
+
+static void check_packet(const Buffer &buffer, const size_t size, const uint8_t tag) {
+    if (buffer.size() != size) {
+        throw runtime_error("packet has the wrong size");
+    }
+    for (const char c : buffer.str()) {
+        if (static_cast<uint8_t>(c) != tag) {
+            throw runtime_error("packet was overwritten (is a pool block in use twice?)");
+        }
+    }
+}
+
+int main() {
+    try {
+        // every size class, and one size too big for any of them
+        const vector<size_t> sizes{0, 1, 40, 400, 1500, 9000, 65536 + 10, 200'000};
+
+        // in steady state, packets are recycled without calling malloc
+        for (unsigned int round = 0; round < 3; round++) {
+            const PacketPool::Stats before = PacketPool::thread_stats();
+            for (unsigned int i = 0; i < 1000; i++) {
+                const Buffer packet = make_packet(sizes.at(i % (sizes.size() - 1)), i % 251);
+                check_packet(packet, sizes.at(i % (sizes.size() - 1)), i % 251);
+            }
+            const PacketPool::Stats after = PacketPool::thread_stats();
+            if (after.allocations - before.allocations != 1000) {
+                throw runtime_error("pool did not count its allocations");
+            }
+            if (round > 0 and after.mallocs != before.mallocs) {
+                throw runtime_error("pool called malloc although freed blocks were available");
+            }
+        }
+
+        // copies share a block, which is freed once (and only once) the last copy is gone
+        Buffer shared = make_packet(100, 7);
+        {
+            Buffer copy = shared;
+            Buffer moved = move(copy);
+            moved.remove_prefix(100);
+            check_packet(shared, 100, 7);
+        }
+        check_packet(shared, 100, 7);
+
+        // strings are taken over without copying
+        string text(5000, 'z');
+        const char *const text_data = text.data();
+        const Buffer adopted{move(text)};
+        if (adopted.str().data() != text_data) {
+            throw runtime_error("Buffer copied the string it was constructed from");
+        }
+
+        // packets made on one thread and freed on another (as between a TCPSpongeSocket's threads),
+        // including by threads that exit and hand their free lists back
+        for (unsigned int round = 0; round < 4; round++) {
+            vector<Buffer> made(2000);
+            thread producer([&] {
+                for (size_t i = 0; i < made.size(); i++) {
+                    made.at(i) = make_packet(sizes.at(i % sizes.size()), i % 251);
+                }
+            });
+            producer.join();
+
+            vector<thread> consumers;
+            for (unsigned int c = 0; c < 4; c++) {
+                consumers.emplace_back([&, c] {
+                    vector<Buffer> mine;
+                    for (size_t i = c; i < made.size(); i += 4) {
+                        check_packet(made.at(i), sizes.at(i % sizes.size()), i % 251);
+                        mine.push_back(move(made.at(i)));
+                    }
+                    // allocate while holding the packets, so that new blocks cannot alias them
+                    for (size_t i = 0; i < 500; i++) {
+                        check_packet(make_packet(1500, 99), 1500, 99);
+                    }
+                    for (size_t i = 0; i < mine.size(); i++) {
+                        check_packet(mine.at(i), sizes.at((c + 4 * i) % sizes.size()), (c + 4 * i) % 251);
+                    }
+                });
+            }
+            for (auto &consumer : consumers) {
+                consumer.join();
+            }
+        }
+
+        // a released packet has no storage, but still truncates to (and reads as) nothing
+        PacketBuffer packet{64};
+        const Buffer released = packet.release();
+        packet.truncate(0);
+        if (packet.size() != 0 or packet.release().size() != 0) {
+            throw runtime_error("a released PacketBuffer is not empty");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
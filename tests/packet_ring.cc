@@ -0,0 +1,146 @@
+#include "packet_ring.hh"
+#include "packet_ring_adapter.hh"
+#include "test_datagrams.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+constexpr size_t packet_count = 100'000;
+constexpr size_t packet_size_spread = 97;  //!< Packets are 4 to 100 bytes long
+
+//! Has the endpoint's doorbell been rung (waiting up to `timeout_ms` for it)?
+static bool rung(const PacketRingEndpoint &endpoint, const int timeout_ms = 0) {
+    pollfd pfd{endpoint.fd_num(), POLLIN, 0};
+    return SystemCall("poll", ::poll(&pfd, 1, timeout_ms)) > 0;
+}
+
+static void send_packet(PacketRingEndpoint &endpoint, const string &packet) {
+    char *slot = endpoint.claim();
+    while (slot == nullptr) {
+        endpoint.flush();
+        slot = endpoint.claim();
+    }
+    packet.copy(slot, packet.size());
+    endpoint.publish(packet.size());
+}
+
+int main() {
+    try {
+        // the ring holds exactly its slot count, and one doorbell covers a burst
+        {
+            auto [a, b] = PacketRingEndpoint::make_pair(8, 128);
+            for (uint32_t i = 0; i < 8; i++) {
+                send_packet(a, test_datagram(i, packet_size_spread));
+            }
+            if (a.claim() != nullptr) {
+                throw runtime_error("PacketRing: claimed a slot in a full ring");
+            }
+            if (rung(b)) {
+                throw runtime_error("PacketRingEndpoint: doorbell rang before flush()");
+            }
+            a.flush();
+            if (not rung(b)) {
+                throw runtime_error("PacketRingEndpoint: flush() did not ring the doorbell");
+            }
+            b.answer_doorbell();
+            for (uint32_t i = 0; i < 8; i++) {
+                const auto packet = b.peek();
+                if (not packet or packet.value() != test_datagram(i, packet_size_spread)) {
+                    throw runtime_error("PacketRing: packets were lost or reordered");
+                }
+                b.pop();
+            }
+            if (b.peek()) {
+                throw runtime_error("PacketRing: popped more packets than were published");
+            }
+
+            // nothing new: no doorbell; one more packet after the consumer woke up: a doorbell again
+            a.flush();
+            if (rung(b)) {
+                throw runtime_error("PacketRingEndpoint: doorbell rang with nothing published");
+            }
+            send_packet(a, test_datagram(8, packet_size_spread));
+            a.flush();
+            if (not rung(b)) {
+                throw runtime_error("PacketRingEndpoint: doorbell did not ring for a packet after a wakeup");
+            }
+        }
+
+        // a stream from another process arrives whole and in order, with no wakeup lost
+        {
+            auto [a, b] = PacketRingEndpoint::make_pair(64, 128);
+            const pid_t producer = SystemCall("fork", fork());
+            if (producer == 0) {
+                for (uint32_t i = 0; i < packet_count; i++) {
+                    send_packet(a, test_datagram(i, packet_size_spread));
+                    if (i % 7 == 0) {
+                        a.flush();
+                    }
+                }
+                a.flush();
+                _exit(EXIT_SUCCESS);
+            }
+
+            for (uint32_t i = 0; i < packet_count;) {
+                if (not rung(b, 5000)) {
+                    throw runtime_error("PacketRingEndpoint: a wakeup was lost");
+                }
+                b.answer_doorbell();
+                while (const auto packet = b.peek()) {
+                    if (packet.value() != test_datagram(i, packet_size_spread)) {
+                        throw runtime_error("PacketRing: packet " + to_string(i) + " arrived damaged or out of order");
+                    }
+                    b.pop();
+                    i++;
+                }
+            }
+            int status = 0;
+            SystemCall("waitpid", waitpid(producer, &status, 0));
+            if (not WIFEXITED(status) or WEXITSTATUS(status) != EXIT_SUCCESS) {
+                throw runtime_error("producer process failed");
+            }
+        }
+
+        // segments cross intact, and a listening adapter waits for a SYN
+        {
+            auto [a, b] = PacketRingEndpoint::make_pair();
+            TCPOverPacketRingAdapter client{move(a)};
+            TCPOverPacketRingAdapter server{move(b)};
+            client.config_mut().source = {"169.254.0.1", 1234};
+            client.config_mut().destination = {"169.254.0.2", 5678};
+            server.set_listening(true);
+
+            TCPSegment stray;
+            stray.header().ack = true;
+            client.write(stray);
+            TCPSegment syn;
+            syn.header().syn = true;
+            syn.payload() = string("hello");
+            client.write(syn);
+            client.flush();
+
+            const auto segments = server.read_batch();
+            if (segments.size() != 1 or not segments.front().header().syn or
+                segments.front().payload().str() != "hello" or segments.front().header().sport != 1234 or
+                segments.front().header().dport != 5678) {
+                throw runtime_error("TCPOverPacketRingAdapter: wrong segments received");
+            }
+            if (server.listening()) {
+                throw runtime_error("TCPOverPacketRingAdapter: still listening after a SYN");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+#include "packet_socket.hh"
+#include "packet_socket_adapter.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+#include "test_datagrams.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <poll.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+constexpr size_t frame_count = 1000;
+constexpr uint16_t test_ethertype = 0x88b5;  // "local experimental" EtherType: nothing else sends it
+
+//! Frame `i` of the stream, from va to vb: an Ethernet header, then the index and a filling that vary with it
+static string make_frame(const uint32_t i) {
+    string ret{"\xff\xff\xff\xff\xff\xff\x02\0\0\0\0\x01", 12};
+    ret += static_cast<char>(test_ethertype >> 8);
+    ret += static_cast<char>(test_ethertype & 0xff);
+    return ret + sized_test_datagram(i, sizeof(i) + 46 + i % 1000);
+}
+
+//! Wait (up to five seconds) for the next test frame to arrive at `socket`, ignoring other traffic
+static string next_test_frame(PacketSocket &socket) {
+    for (unsigned attempt = 0; attempt < 5000; attempt++) {
+        while (const auto frame = socket.receive()) {
+            if (frame->size() >= EthernetHeader::LENGTH and uint8_t(frame->at(12)) == (test_ethertype >> 8) and
+                uint8_t(frame->at(13)) == (test_ethertype & 0xff)) {
+                return string(frame.value());
+            }
+        }
+        pollfd pfd{socket.fd_num(), POLLIN, 0};
+        SystemCall("poll", ::poll(&pfd, 1, 1));
+    }
+    throw runtime_error("PacketSocket: a frame was lost");
+}
+
+int main() {
+    // the test needs a network namespace of its own, in which to make a veth pair
+    if (unshare(CLONE_NEWNET) != 0 or
+        system("ip link add va type veth peer name vb && ip link set va up && ip link set vb up") != 0) {
+        cerr << "skipping: cannot make a veth pair in a new network namespace\n";
+        return 77;
+    }
+
+    try {
+        // frames sent in bursts arrive whole and in order
+        {
+            PacketSocket a{"va"};
+            PacketSocket b{"vb"};
+            for (uint32_t start = 0; start < frame_count; start += 20) {
+                // a burst of 20 frames per flush
+                const uint32_t end = min<uint32_t>(start + 20, frame_count);
+                for (uint32_t i = start; i < end; i++) {
+                    if (not a.send(make_frame(i))) {
+                        throw runtime_error("PacketSocket: transmit ring full after a flush");
+                    }
+                }
+                a.flush();
+                for (uint32_t i = start; i < end; i++) {
+                    if (next_test_frame(b) != make_frame(i)) {
+                        throw runtime_error("PacketSocket: frame " + to_string(i) + " arrived damaged or out of order");
+                    }
+                }
+            }
+            // what a sends, a does not receive
+            while (const auto frame = a.receive()) {
+                if (frame->size() >= EthernetHeader::LENGTH and uint8_t(frame->at(12)) == (test_ethertype >> 8)) {
+                    throw runtime_error("PacketSocket: received a frame it sent");
+                }
+            }
+        }
+
+        // two stacks connect over the veth pair (resolving each other with ARP) and exchange a stream
+        {
+            const string payload = [] {
+                string ret(1 << 20, 0);
+                for (size_t i = 0; i < ret.size(); i++) {
+                    ret[i] = static_cast<char>(i * 7 + i / 1024);
+                }
+                return ret;
+            }();
+
+            FdAdapterConfig client_config;
+            client_config.source = {"10.144.0.1", 1234};
+            client_config.destination = {"10.144.0.2", 5678};
+            FdAdapterConfig server_config;
+            server_config.source = client_config.destination;
+            server_config.destination = client_config.source;
+            TCPConfig tcp_config;
+            tcp_config.rt_timeout = 100;
+
+            TCPOverIPv4OverPacketSocketSpongeSocket server{TCPOverIPv4OverPacketSocketAdapter{
+                PacketSocket{"vb"}, {2, 0, 0, 0, 0, 2}, server_config.source, server_config.destination}};
+            TCPOverIPv4OverPacketSocketSpongeSocket client{TCPOverIPv4OverPacketSocketAdapter{
+                PacketSocket{"va"}, {2, 0, 0, 0, 0, 1}, client_config.source, client_config.destination}};
+
+            string received;
+            thread server_thread([&] {
+                server.listen_and_accept(tcp_config, server_config);
+                while (not server.eof()) {
+                    string chunk;
+                    server.read(chunk);
+                    received += chunk;
+                }
+                server.wait_until_closed();
+            });
+            client.connect(tcp_config, client_config);
+            client.write(payload);
+            client.shutdown(SHUT_WR);
+            client.wait_until_closed();
+            server_thread.join();
+
+            if (received != payload) {
+                throw runtime_error("TCPOverIPv4OverPacketSocketAdapter: stream arrived damaged (" +
+                                    to_string(received.size()) + " of " + to_string(payload.size()) + " bytes)");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,327 @@
+#include "route_cache.hh"
+#include "route_table.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! What a route points to, as compared by the test: <interface, next-hop address>
+using Target = pair<size_t, optional<uint32_t>>;
+
+//! The obvious longest-prefix match, to check RouteTable against
+class ReferenceTable {
+    map<pair<uint32_t, uint8_t>, Target> _routes{};
+
+  public:
+    void add(const uint32_t prefix, const uint8_t prefix_length, const Target &target) {
+        const uint32_t mask = prefix_length == 0 ? 0 : UINT32_MAX << (32 - prefix_length);
+        _routes[{prefix & mask, prefix_length}] = target;
+    }
+
+    void remove(const uint32_t prefix, const uint8_t prefix_length) {
+        const uint32_t mask = prefix_length == 0 ? 0 : UINT32_MAX << (32 - prefix_length);
+        _routes.erase({prefix & mask, prefix_length});
+    }
+
+    optional<Target> lookup(const uint32_t destination) const {
+        for (int prefix_length = 32; prefix_length >= 0; prefix_length--) {
+            const uint32_t mask = prefix_length == 0 ? 0 : UINT32_MAX << (32 - prefix_length);
+            const auto it = _routes.find({destination & mask, prefix_length});
+            if (it != _routes.end()) {
+                return it->second;
+            }
+        }
+        return {};
+    }
+};
+
+static void check(const RouteTable &table, const ReferenceTable &reference, const uint32_t destination) {
+    const RouteTable::NextHop *const hop = table.lookup(destination);
+    const optional<Target> expected = reference.lookup(destination);
+    optional<Target> actual;
+    if (hop != nullptr) {
+        actual = Target{hop->interface_num,
+                        hop->address.has_value() ? optional<uint32_t>{hop->address->ipv4_numeric()} : nullopt};
+    }
+    if (actual != expected) {
+        throw runtime_error("RouteTable: wrong route for " + Address::from_ipv4_numeric(destination).ip());
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        auto rd = get_random_generator();
+
+        // the full-size run takes most of a minute under sanitizers, longer than `make check` allows
+        const bool long_run = argc > 1 and string(argv[1]) == "--long";
+        const unsigned int rounds = long_run ? 20 : 4;
+        const unsigned int routes_per_round = long_run ? 2000 : 1000;
+        const unsigned int spot_checks = long_run ? 1000 : 200;
+        const unsigned int final_checks = long_run ? 100'000 : 10'000;
+        const unsigned int churn_updates = long_run ? 200'000 : 20'000;
+
+        for (unsigned int round = 0; round < rounds; round++) {
+            RouteTable table;
+            ReferenceTable reference;
+
+            // routes crowded into a few /16s, so that they nest and overlap, in random order (with
+            // some prefixes added twice, to replace a route, and some routes removed again)
+            uniform_int_distribution<uint32_t> address_dist;
+            const uint32_t bases[] = {address_dist(rd) & 0xffff0000, address_dist(rd) & 0xffff0000, 0x0a000000};
+            uniform_int_distribution<int> length_dist{0, 32};
+            uniform_int_distribution<size_t> interface_dist{0, 5};
+            const auto random_address = [&] {
+                return bases[address_dist(rd) % size(bases)] | (address_dist(rd) & 0x0003ffff);
+            };
+
+            vector<pair<uint32_t, uint8_t>> added;
+            for (unsigned int i = 0; i < routes_per_round; i++) {
+                const uint8_t prefix_length = round % 2 == 0 and length_dist(rd) < 3 ? 0 : 8 + length_dist(rd) % 25;
+                const uint32_t prefix = random_address();
+                const Target target{interface_dist(rd),
+                                    address_dist(rd) % 2 ? optional<uint32_t>{address_dist(rd) % 16} : nullopt};
+                table.add(prefix,
+                          prefix_length,
+                          {target.first,
+                           target.second.has_value() ? optional<Address>{Address::from_ipv4_numeric(*target.second)}
+                                                     : nullopt});
+                reference.add(prefix, prefix_length, target);
+                added.emplace_back(prefix, prefix_length);
+
+                if (address_dist(rd) % 4 == 0) {
+                    const auto &[removed_prefix, removed_length] = added.at(address_dist(rd) % added.size());
+                    table.remove(removed_prefix, removed_length);
+                    reference.remove(removed_prefix, removed_length);
+                }
+
+                if (i % 100 == 0) {
+                    for (unsigned int j = 0; j < spot_checks; j++) {
+                        check(table, reference, random_address());
+                    }
+                }
+            }
+
+            for (unsigned int j = 0; j < final_checks; j++) {
+                check(table, reference, random_address());
+                check(table, reference, address_dist(rd));
+            }
+
+            // a batched lookup agrees with one lookup at a time (over several batches and a partial one)
+            vector<uint32_t> destinations(10 * RouteTable::BATCH_SIZE + 7);
+            for (auto &destination : destinations) {
+                destination = random_address();
+            }
+            vector<const RouteTable::NextHop *> hops(destinations.size());
+            table.lookup(destinations.data(), hops.data(), destinations.size());
+            for (size_t j = 0; j < destinations.size(); j++) {
+                if (hops.at(j) != table.lookup(destinations.at(j))) {
+                    throw runtime_error("RouteTable: batched lookup disagrees for " +
+                                        Address::from_ipv4_numeric(destinations.at(j)).ip());
+                }
+            }
+
+            // once every route is gone, nothing matches and no group is left in use
+            table.remove(added);
+            for (unsigned int j = 0; j < 10'000; j++) {
+                if (table.lookup(random_address()) != nullptr) {
+                    throw runtime_error("RouteTable: a route outlived its removal");
+                }
+            }
+            if (table.size() != 0 or table.groups_in_use() != 0) {
+                throw runtime_error("RouteTable: routes or groups left over after removing every route");
+            }
+        }
+
+        // routes change while another thread looks them up: every lookup sees one route or the other
+        {
+            RouteTable table;
+            const RouteTable::NextHop stable{1, {}};
+            const RouteTable::NextHop churned{2, {}};
+            table.add(0x0a000000, 8, stable);
+
+            atomic<bool> done{false};
+            string failure;
+            thread reader_thread([&] {
+                RCUDomain::Reader reader{table.rcu()};
+                auto reader_rd = get_random_generator();
+                uniform_int_distribution<uint32_t> address_dist;
+                while (not done) {
+                    for (unsigned int i = 0; i < 1000; i++) {
+                        const uint32_t destination = 0x0a000000 | (address_dist(reader_rd) & 0xffff);
+                        const RouteTable::NextHop *const hop = table.lookup(destination);
+                        if (hop == nullptr or (hop->interface_num != 1 and hop->interface_num != 2)) {
+                            failure = "RouteTable: a lookup saw an entry that no update wrote";
+                            return;
+                        }
+                    }
+                    reader.quiescent();
+                }
+            });
+
+            uniform_int_distribution<uint32_t> address_dist;
+            uniform_int_distribution<int> length_dist{20, 32};
+            vector<pair<uint32_t, uint8_t>> added;
+            for (unsigned int i = 0; i < churn_updates; i++) {
+                added.emplace_back(0x0a000000 | (address_dist(rd) & 0xffff), length_dist(rd));
+                table.add(added.back().first, added.back().second, churned);
+                if (added.size() == 64) {
+                    table.remove(added);
+                    added.clear();
+                }
+            }
+            done = true;
+            reader_thread.join();
+            if (not failure.empty()) {
+                throw runtime_error(failure);
+            }
+            table.remove(added);
+            if (table.groups_in_use() != 0) {
+                throw runtime_error("RouteTable: groups left in use after removing every route longer than /24");
+            }
+        }
+
+        // multipath groups share flows by weight, and changing a group's members moves only the flows
+        // that must move
+        {
+            RouteTable table;
+            const auto member = [](const size_t interface_num, const uint32_t weight) {
+                return RouteTable::Member{{interface_num, {}}, weight};
+            };
+            const auto paths = [&](const uint32_t destination) {
+                vector<size_t> ret;
+                for (uint32_t flow = 0; flow < RouteTable::MULTIPATH_BUCKETS; flow++) {
+                    const RouteTable::NextHop *const hop = table.lookup(destination, flow);
+                    if (hop == nullptr) {
+                        throw runtime_error("RouteTable: no member for a multipath route");
+                    }
+                    ret.push_back(hop->interface_num);
+                }
+                return ret;
+            };
+            const auto expect_shares = [](const vector<size_t> &flows, const map<size_t, long> &shares) {
+                for (const auto &[interface_num, share] : shares) {
+                    if (count(flows.begin(), flows.end(), interface_num) != share) {
+                        throw runtime_error("RouteTable: multipath member has the wrong share of the buckets");
+                    }
+                }
+            };
+
+            const RouteTable::MultipathId id = table.add_multipath({member(1, 1), member(2, 1), member(3, 2)});
+            table.add(0x0a000000, 8, id);
+            table.add(0, 0, id);
+            table.add(0x0a0a0000, 16, {4, {}});
+            const vector<size_t> before = paths(0x0a010203);
+            expect_shares(before, {{1, 256}, {2, 256}, {3, 512}});
+            if (paths(0x01020304) != before or table.lookup(0x0a0a0a0a, 77)->interface_num != 4) {
+                throw runtime_error("RouteTable: routes through a multipath group disagree");
+            }
+
+            vector<uint32_t> destinations(RouteTable::MULTIPATH_BUCKETS, 0x0a010203);
+            vector<uint32_t> flows(destinations.size());
+            for (uint32_t flow = 0; flow < flows.size(); flow++) {
+                flows.at(flow) = flow;
+            }
+            vector<const RouteTable::NextHop *> hops(destinations.size());
+            table.lookup(destinations.data(), hops.data(), destinations.size(), flows.data());
+            for (size_t j = 0; j < hops.size(); j++) {
+                if (hops.at(j)->interface_num != before.at(j)) {
+                    throw runtime_error("RouteTable: batched lookup disagrees for a multipath route");
+                }
+            }
+
+            // without member 2, only its flows move
+            table.set_multipath(id, {member(1, 1), member(3, 2)});
+            const vector<size_t> without = paths(0x0a010203);
+            expect_shares(without, {{1, 341}, {2, 0}, {3, 683}});
+            for (size_t flow = 0; flow < before.size(); flow++) {
+                if (before.at(flow) != 2 and without.at(flow) != before.at(flow)) {
+                    throw runtime_error("RouteTable: removing a multipath member moved another member's flow");
+                }
+            }
+
+            // with a new member 5, only the flows it takes move
+            table.set_multipath(id, {member(1, 1), member(3, 2), member(5, 1)});
+            const vector<size_t> with = paths(0x0a010203);
+            expect_shares(with, {{1, 256}, {3, 512}, {5, 256}});
+            for (size_t flow = 0; flow < before.size(); flow++) {
+                if (with.at(flow) != 5 and with.at(flow) != without.at(flow)) {
+                    throw runtime_error("RouteTable: adding a multipath member moved a flow elsewhere");
+                }
+            }
+        }
+
+        // a route cache answers as the table does, and routes added or removed empty it
+        {
+            RouteTable table;
+            RouteCache cache{64};
+            uniform_int_distribution<uint32_t> address_dist;
+            const auto cached_lookup = [&](const uint32_t destination, const uint32_t flow_hash) {
+                cache.sync(table.generation());
+                RouteTable::Match match;
+                if (not cache.find(destination, match)) {
+                    match = table.match(destination);
+                    cache.insert(destination, match);
+                }
+                return table.next_hop(match, flow_hash);
+            };
+
+            if (RouteCache{0}.entries() != 0 or RouteCache{5}.entries() != 8 or cache.entries() != 64) {
+                throw runtime_error("RouteCache: wrong size");
+            }
+            table.add(0x0a000000, 8, {1, {}});
+            if (cached_lookup(0x0a010101, 0) != table.lookup(0x0a010101) or
+                cached_lookup(0x0a010101, 0) != table.lookup(0x0a010101) or cache.hits() != 1 or
+                cache.misses() != 1) {
+                throw runtime_error("RouteCache: a repeated destination missed");
+            }
+            table.add(0x0a010000, 16, {2, {}});
+            if (cached_lookup(0x0a010101, 0)->interface_num != 2 or cache.misses() != 2) {
+                throw runtime_error("RouteCache: an added route left a stale match");
+            }
+            table.remove(0x0a010000, 16);
+            if (cached_lookup(0x0a010101, 0)->interface_num != 1 or cache.misses() != 3) {
+                throw runtime_error("RouteCache: a removed route left a stale match");
+            }
+
+            // a multipath group's members change under a cached match, which stays valid
+            const RouteTable::MultipathId id = table.add_multipath({{{3, {}}, 1}, {{4, {}}, 1}});
+            table.add(0x0b000000, 8, id);
+            cached_lookup(0x0b000001, 0);
+            table.set_multipath(id, {{{5, {}}, 1}});
+            if (cached_lookup(0x0b000001, 7)->interface_num != 5 or cache.hits() != 2) {
+                throw runtime_error("RouteCache: wrong member after changing a multipath group");
+            }
+
+            // many more destinations than entries, under churn
+            for (unsigned int i = 0; i < 100'000; i++) {
+                const uint32_t destination = 0x0a000000 | (address_dist(rd) & 0x1ff);
+                if (cached_lookup(destination, i) != table.lookup(destination, i)) {
+                    throw runtime_error("RouteCache: answer differs from the table's");
+                }
+                if (i % 1000 == 0) {
+                    table.add(0x0a000000 | (address_dist(rd) & 0x1ff), 24 + address_dist(rd) % 9, {i % 6, {}});
+                }
+            }
+            if (cache.hits() + cache.misses() != 100'006 or cache.hits() == 0) {
+                throw runtime_error("RouteCache: wrong counts");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
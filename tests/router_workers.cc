@@ -0,0 +1,184 @@
+#include "router.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static auto rd = get_random_generator();
+
+static EthernetAddress random_ethernet_address() {
+    EthernetAddress addr;
+    for (auto &byte : addr) {
+        byte = rd();
+    }
+    addr.at(0) |= 0x02;  // private
+    addr.at(0) &= 0xfe;  // unicast
+    return addr;
+}
+
+//! A host on one of the router's networks, sending to the hosts on the others
+struct Host {
+    Address address;
+    Address gateway;
+    NetworkInterface interface{random_ethernet_address(), address};
+    unsigned int sent = 0;
+    map<string, unsigned int> received{};  //!< payload => times received
+};
+
+//! Each host sends `per_host` datagrams through a router run by `workers` workers, and must receive
+//! every datagram sent to it exactly once, with its TTL decremented
+static void forward_everything(const size_t workers, const unsigned int per_host) {
+    Router router;
+    vector<Host> hosts;
+    hosts.push_back({Address{"171.67.76.1"}, Address{"171.67.76.46"}});
+    hosts.push_back({Address{"10.0.0.2"}, Address{"10.0.0.1"}});
+    hosts.push_back({Address{"172.16.0.2"}, Address{"172.16.0.1"}});
+    hosts.push_back({Address{"192.168.0.2"}, Address{"192.168.0.1"}});
+    for (const auto &host : hosts) {
+        router.add_interface({random_ethernet_address(), host.gateway});
+    }
+    router.add_route(0, 0, hosts[0].address, 0);
+    router.add_route(Address{"10.0.0.0"}.ipv4_numeric(), 8, {}, 1);
+    router.add_route(Address{"172.16.0.0"}.ipv4_numeric(), 16, {}, 2);
+    router.add_route(Address{"192.168.0.0"}.ipv4_numeric(), 24, {}, 3);
+
+    // the default route's host receives what goes elsewhere
+    const auto destination = [&](const size_t from, const unsigned int seq) {
+        const size_t to = (from + 1 + seq % (hosts.size() - 1)) % hosts.size();
+        return to == 0 ? Address{"1.2.3.4"} : hosts[to].address;
+    };
+    const auto receiver = [&](const Address &dst) {
+        for (size_t n = 1; n < hosts.size(); n++) {
+            if (hosts[n].address.ipv4_numeric() == dst.ipv4_numeric()) {
+                return n;
+            }
+        }
+        return size_t{0};
+    };
+
+    // few enough datagrams in flight that no queue can fill
+    constexpr unsigned int WINDOW = 128;
+    const unsigned int total = per_host * hosts.size();
+    unsigned int sent = 0, received = 0;
+
+    router.set_route_cache_entries(4096);
+    router.start(workers, 1024);
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(30);
+    while (received < total) {
+        if (chrono::steady_clock::now() > deadline) {
+            throw runtime_error("router workers: only " + to_string(received) + " of " + to_string(total) +
+                                " datagrams arrived");
+        }
+        for (size_t n = 0; n < hosts.size(); n++) {
+            Host &host = hosts[n];
+            while (host.sent < per_host and sent - received < WINDOW) {
+                InternetDatagram dgram;
+                dgram.header().src = host.address.ipv4_numeric();
+                dgram.header().dst = destination(n, host.sent).ipv4_numeric();
+                dgram.payload() = string(host.address.ip() + "#" + to_string(host.sent));
+                dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+                dgram.header().ttl = 64;
+                host.interface.send_datagram(dgram, host.gateway);
+                host.sent++;
+                sent++;
+            }
+
+            // frames cross the "wire" as one buffer each
+            auto &frames = host.interface.frames_out();
+            while (not frames.empty()) {
+                frames.front().payload() = frames.front().payload().concatenate();
+                if (not router.push_frame(n, move(frames.front()))) {
+                    break;
+                }
+                frames.pop();
+            }
+
+            while (auto frame = router.pop_frame(n)) {
+                frame->payload() = frame->payload().concatenate();
+                const auto dgram = host.interface.recv_frame(frame.value());
+                if (not dgram.has_value()) {
+                    continue;
+                }
+                if (dgram->header().ttl != 63) {
+                    throw runtime_error("router workers: TTL not decremented");
+                }
+                if (receiver(Address::from_ipv4_numeric(dgram->header().dst)) != n) {
+                    throw runtime_error("router workers: datagram delivered to the wrong host");
+                }
+                host.received[dgram->payload().concatenate()]++;
+                received++;
+            }
+        }
+    }
+    router.stop();
+
+    for (size_t from = 0; from < hosts.size(); from++) {
+        for (unsigned int seq = 0; seq < per_host; seq++) {
+            const Host &to = hosts[receiver(destination(from, seq))];
+            const auto it = to.received.find(hosts[from].address.ip() + "#" + to_string(seq));
+            if (it == to.received.end() or it->second != 1) {
+                throw runtime_error("router workers: datagram lost or duplicated");
+            }
+        }
+    }
+    if (router.forwarded() != total or router.dropped() != 0) {
+        throw runtime_error("router workers: wrong counts");
+    }
+    // the workers' route caches saw every datagram, and each destination missed in one batch per worker
+    if (router.route_cache_hits() + router.route_cache_misses() != total or
+        router.route_cache_misses() > workers * hosts.size() * RouteTable::BATCH_SIZE) {
+        throw runtime_error("router workers: wrong route cache counts");
+    }
+}
+
+int main() {
+    try {
+        for (const size_t workers : {1, 2, 4}) {
+            forward_everything(workers, 5000);
+        }
+
+        // the interfaces are the caller's again once the workers stop
+        Router router;
+        router.start(2);
+        bool threw = false;
+        try {
+            router.route();
+        } catch (const runtime_error &) {
+            threw = true;
+        }
+        router.stop();
+        router.route();
+        if (not threw) {
+            throw runtime_error("router workers: route() ran alongside the workers");
+        }
+
+        // and there are no worker queues to push frames to, or pop them from
+        for (const bool push : {true, false}) {
+            threw = false;
+            try {
+                if (push) {
+                    router.push_frame(0, EthernetFrame{});
+                } else {
+                    router.pop_frame(0);
+                }
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            if (not threw) {
+                throw runtime_error("router workers: a frame queue was used without workers");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "buffer.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "tcp_segment.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! Back-to-front serialization must produce exactly the bytes of the BufferList serialization
+static void check_same(const string &what, const BufferList &expected, PacketBuffer &packet) {
+    if (packet.size() != expected.size()) {
+        throw runtime_error(what + ": serialize_into() did not fill the packet buffer exactly");
+    }
+    if (packet.release().copy() != expected.concatenate()) {
+        throw runtime_error(what + ": serialize_into() and serialize() disagree");
+    }
+}
+
+static string random_string(mt19937 &rd, const size_t size) {
+    uniform_int_distribution<unsigned> byte{0, 255};
+    string ret;
+    for (size_t i = 0; i < size; i++) {
+        ret.push_back(static_cast<char>(byte(rd)));
+    }
+    return ret;
+}
+
+//! A payload in one to three pieces, as when a datagram's payload holds a segment's header and payload
+static BufferList random_payload(mt19937 &rd, const size_t size) {
+    uniform_int_distribution<size_t> cut{0, size};
+    const size_t first = cut(rd);
+    const size_t second = first + uniform_int_distribution<size_t>{0, size - first}(rd);
+    BufferList ret;
+    ret.append(random_string(rd, first));
+    ret.append(random_string(rd, second - first));
+    ret.append(random_string(rd, size - second));
+    return ret;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        uniform_int_distribution<uint32_t> dist32{0, numeric_limits<uint32_t>::max()};
+        uniform_int_distribution<uint16_t> dist16{0, numeric_limits<uint16_t>::max()};
+        uniform_int_distribution<size_t> payload_size{0, 1500};
+
+        for (unsigned int i = 0; i < 1000; i++) {
+            // a TCP segment, with or without options and a payload checksum from set_payload()
+            TCPSegment seg;
+            seg.header().sport = dist16(rd);
+            seg.header().dport = dist16(rd);
+            seg.header().seqno = WrappingInt32{dist32(rd)};
+            seg.header().ackno = WrappingInt32{dist32(rd)};
+            seg.header().doff = 5 + i % 3;
+            seg.header().ack = i % 2;
+            seg.header().syn = i % 5 == 0;
+            seg.header().win = dist16(rd);
+            const string payload = random_string(rd, payload_size(rd));
+            if (i % 4 == 0) {
+                InternetChecksum payload_checksum;
+                payload_checksum.add(payload);
+                seg.set_payload(string(payload), payload_checksum);
+            } else {
+                seg.payload() = string(payload);
+            }
+
+            const uint32_t pseudo_cksum = dist32(rd);
+            PacketBuffer segment_packet{4 * seg.header().doff + payload.size() + i % 7};
+            seg.serialize_into(segment_packet, pseudo_cksum);
+            check_same("TCPSegment", seg.serialize(pseudo_cksum), segment_packet);
+
+            // an IPv4 datagram, freshly made or parsed (so that its checksum is reused)
+            IPv4Datagram dgram;
+            dgram.header().hlen = 5 + i % 2;
+            dgram.header().ttl = 1 + i % 255;
+            dgram.header().id = dist16(rd);
+            dgram.header().src = dist32(rd);
+            dgram.header().dst = dist32(rd);
+            dgram.payload() = random_payload(rd, payload_size(rd));
+            dgram.header().len = 4 * dgram.header().hlen + dgram.payload().size();
+            if (i % 3 == 0) {
+                IPv4Datagram parsed;
+                if (parsed.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+                    throw runtime_error("IPv4Datagram: could not parse a serialized datagram");
+                }
+                dgram = parsed;
+            }
+
+            PacketBuffer datagram_packet{dgram.header().len};
+            dgram.serialize_into(datagram_packet);
+            check_same("IPv4Datagram", dgram.serialize(), datagram_packet);
+
+            // an Ethernet frame
+            EthernetFrame frame;
+            frame.header().type = dist16(rd);
+            for (auto &byte : frame.header().dst) {
+                byte = static_cast<uint8_t>(dist16(rd));
+            }
+            for (auto &byte : frame.header().src) {
+                byte = static_cast<uint8_t>(dist16(rd));
+            }
+            frame.payload() = dgram.serialize();
+
+            PacketBuffer frame_packet{frame.size()};
+            frame.serialize_into(frame_packet);
+            check_same("EthernetFrame", frame.serialize(), frame_packet);
+        }
+
+        // headers are written in front of a payload already in the buffer, and no further
+        PacketBuffer packet{4};
+        packet.prepend("cd");
+        packet.prepend("ab");
+        if (packet.str() != "abcd") {
+            throw runtime_error("PacketBuffer: prepend() put the bytes in the wrong place");
+        }
+        bool threw = false;
+        try {
+            packet.prepend(1);
+        } catch (const out_of_range &) {
+            threw = true;
+        }
+        if (not threw) {
+            throw runtime_error("PacketBuffer: prepend() went past the start of the buffer");
+        }
+
+        // a receive buffer claims all its room up front, then keeps only what arrived
+        PacketBuffer received{1500};
+        memcpy(received.prepend(1500), "abcdef", 6);
+        received.truncate(6);
+        if (received.size() != 6 or received.release().copy() != "abcdef") {
+            throw runtime_error("PacketBuffer: truncate() kept the wrong bytes");
+        }
+        threw = false;
+        try {
+            packet.truncate(5);
+        } catch (const out_of_range &) {
+            threw = true;
+        }
+        if (not threw) {
+            throw runtime_error("PacketBuffer: truncate() went past the end of the packet");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,20 @@
+#ifndef SPONGE_TESTS_TEST_DATAGRAMS_HH
+#define SPONGE_TESTS_TEST_DATAGRAMS_HH
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+//! Datagram `i` of a run of `size`-byte datagrams: its index, then a filling that varies with it
+inline std::string sized_test_datagram(const uint32_t i, const size_t size) {
+    std::string ret(size, static_cast<char>(i));
+    memcpy(ret.data(), &i, sizeof(i));
+    return ret;
+}
+
+//! Datagram `i` of a stream: its index, then a filling, with up to `spread - 1` bytes of it (varying with `i`)
+inline std::string test_datagram(const uint32_t i, const size_t spread = 61) {
+    return sized_test_datagram(i, sizeof(i) + i % spread);
+}
+
+#endif  // SPONGE_TESTS_TEST_DATAGRAMS_HH
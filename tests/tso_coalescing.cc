@@ -0,0 +1,195 @@
+#include "ipv4_datagram.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "tun.hh"
+#include "tuntap_adapter.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using Adapter = TCPOverIPv4OverTunFdAdapter;
+
+//! A data segment with `size` bytes of payload, acknowledging 1000 with a window of 5000
+static TCPSegment data_segment(const uint32_t seqno, const size_t size) {
+    TCPSegment seg;
+    seg.header().seqno = WrappingInt32{seqno};
+    seg.header().ack = true;
+    seg.header().ackno = WrappingInt32{1000};
+    seg.header().win = 5000;
+    seg.payload() = string(size, static_cast<char>('a' + seqno % 26));
+    return seg;
+}
+
+//! Contiguous data segments of the given payload sizes
+static vector<TCPSegment> stream(const vector<size_t> &sizes, const uint32_t first_seqno = 0) {
+    vector<TCPSegment> ret;
+    uint32_t seqno = first_seqno;
+    for (const size_t size : sizes) {
+        ret.push_back(data_segment(seqno, size));
+        seqno += size;
+    }
+    return ret;
+}
+
+//! The lengths of the runs flush() would send
+static vector<size_t> runs(const vector<TCPSegment> &segments) {
+    vector<size_t> ret;
+    for (size_t first = 0; first < segments.size(); first += ret.back()) {
+        ret.push_back(Adapter::run_length(segments, first));
+    }
+    return ret;
+}
+
+static void check_runs(const vector<TCPSegment> &segments, const vector<size_t> &expected, const string &name) {
+    test_err_if(runs(segments) != expected, name + ": runs were cut in the wrong places");
+}
+
+static void run_boundaries() {
+    check_runs(stream({1000, 1000, 1000, 1000}), {4}, "equal segments");
+    check_runs(stream({1000, 1000, 400}), {3}, "short last segment");
+    check_runs(stream({1000, 400, 1000}), {2, 1}, "short middle segment");
+    check_runs(stream({400, 1000}), {1, 1}, "longer segment after a short first one");
+    check_runs(stream({0, 1000, 1000}), {1, 2}, "bare ACK");
+
+    // a super-segment's IP length must fit in 16 bits
+    check_runs(stream(vector<size_t>(70, 1000)), {65, 5}, "maximum size");
+
+    auto gap = stream({1000, 1000, 1000});
+    gap[2].header().seqno = gap[2].header().seqno + 1;
+    check_runs(gap, {2, 1}, "sequence gap");
+}
+
+//! Segments that the kernel could not recreate from one super-segment's header end a run
+static void mixed_headers() {
+    auto acks = stream({1000, 1000, 1000, 1000});
+    acks[2].header().ackno = WrappingInt32{2000};
+    acks[3].header().ackno = WrappingInt32{2000};
+    check_runs(acks, {2, 2}, "new ackno");
+
+    auto windows = stream({1000, 1000, 1000});
+    windows[1].header().win = 6000;
+    windows[2].header().win = 6000;
+    check_runs(windows, {1, 2}, "new window");
+
+    auto interleaved = stream({1000, 1000});
+    auto other = stream({1000}, 50000);
+    interleaved.insert(interleaved.begin() + 1, other.front());
+    check_runs(interleaved, {1, 1, 1}, "interleaved sequence space");
+}
+
+static void flags() {
+    auto psh = stream({1000, 1000, 1000, 1000});
+    psh[2].header().psh = true;
+    check_runs(psh, {2, 1, 1}, "PSH in the middle");
+    for (auto &seg : psh) {
+        seg.header().psh = true;
+    }
+    check_runs(psh, {4}, "PSH on every segment");
+
+    auto fin = stream({1000, 1000, 1000});
+    fin[2].header().fin = true;
+    check_runs(fin, {2, 1}, "FIN on the last segment");
+    fin[0].header().fin = true;
+    check_runs(fin, {1, 1, 1}, "FIN on the first segment");
+
+    auto syn = stream({1000, 1000});
+    syn[0].header().syn = true;
+    check_runs(syn, {1, 1}, "SYN");
+}
+
+//! The datagram wrap_run() makes, once the kernel has finished its checksum as the vnet header asks
+static void wrapped_datagram() {
+    FdAdapterConfig cfg;
+    cfg.source = {"198.18.0.2", 5000};
+    cfg.destination = {"198.18.0.1", 40000};
+    const auto segments = stream({1000, 1000, 600});
+
+    for (const size_t count : {size_t{1}, size_t{3}}) {
+        string wrapped = Adapter::wrap_run(segments, 0, count, cfg).concatenate();
+
+        VirtioNetHeader vnet{};
+        test_err_if(vnet.parse(wrapped) != ParseResult::NoError, "no vnet header");
+        test_err_if(vnet.flags != VirtioNetHeader::F_NEEDS_CSUM, "the checksum was not left to the kernel");
+        test_err_if(vnet.csum_start != IPv4Header::LENGTH or vnet.csum_offset != 16,
+                    "the checksum is in the wrong place");
+        if (count == 1) {
+            test_err_if(vnet.gso_type != VirtioNetHeader::GSO_NONE or vnet.gso_size != 0 or vnet.hdr_len != 0,
+                        "a single segment asked for segmentation");
+        } else {
+            test_err_if(vnet.gso_type != VirtioNetHeader::GSO_TCPV4 or vnet.gso_size != 1000 or
+                            vnet.hdr_len != IPv4Header::LENGTH + TCPHeader::LENGTH,
+                        "a run did not ask for segmentation into its first segment's size");
+        }
+
+        string datagram = wrapped.substr(sizeof(VirtioNetHeader));
+        InternetChecksum sum;
+        sum.add(string_view(datagram).substr(vnet.csum_start));
+        const uint16_t cksum = sum.value();
+        datagram[vnet.csum_start + vnet.csum_offset] = static_cast<char>(cksum >> 8);
+        datagram[vnet.csum_start + vnet.csum_offset + 1] = static_cast<char>(cksum);
+
+        InternetDatagram ip;
+        test_err_if(ip.parse(Buffer{move(datagram)}) != ParseResult::NoError, "bad IPv4 datagram");
+        test_err_if(ip.header().src != cfg.source.ipv4_numeric() or ip.header().dst != cfg.destination.ipv4_numeric(),
+                    "wrong addresses");
+        TCPSegment seg;
+        test_err_if(seg.parse(ip.payload().concatenate(), ip.header().pseudo_cksum()) != ParseResult::NoError,
+                    "the finished TCP checksum is wrong");
+        test_err_if(seg.header().sport != 5000 or seg.header().dport != 40000, "wrong ports");
+        test_err_if(seg.header().seqno != segments[0].header().seqno, "wrong sequence number");
+
+        string payload;
+        for (size_t i = 0; i < count; i++) {
+            payload += segments[i].payload().str();
+        }
+        test_err_if(seg.payload().str() != payload, "wrong payload");
+    }
+}
+
+static void vnet_header() {
+    VirtioNetHeader vnet{};
+    vnet.flags = VirtioNetHeader::F_NEEDS_CSUM;
+    vnet.gso_type = VirtioNetHeader::GSO_TCPV4;
+    vnet.hdr_len = 0x0102;
+    vnet.gso_size = 0x0304;
+    vnet.csum_start = 0x0506;
+    vnet.csum_offset = 0x0708;
+
+    const string bytes = vnet.serialize();
+    test_err_if(bytes.size() != sizeof(VirtioNetHeader), "the vnet header has the wrong size");
+    test_err_if(bytes[0] != VirtioNetHeader::F_NEEDS_CSUM or bytes[1] != VirtioNetHeader::GSO_TCPV4,
+                "the vnet header's flags are out of place");
+
+    VirtioNetHeader parsed{};
+    test_err_if(parsed.parse(bytes + "payload") != ParseResult::NoError, "the vnet header did not parse");
+    test_err_if(parsed.flags != vnet.flags or parsed.gso_type != vnet.gso_type or parsed.hdr_len != vnet.hdr_len or
+                    parsed.gso_size != vnet.gso_size or parsed.csum_start != vnet.csum_start or
+                    parsed.csum_offset != vnet.csum_offset,
+                "the vnet header did not survive serialization");
+    test_err_if(parsed.parse(bytes.substr(0, sizeof(VirtioNetHeader) - 1)) != ParseResult::PacketTooShort,
+                "a truncated vnet header parsed");
+}
+
+int main() {
+    try {
+        run_boundaries();
+        mixed_headers();
+        flags();
+        wrapped_datagram();
+        vnet_header();
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#include "ipv4_datagram.hh"
+#include "socket.hh"
+#include "test_err_if.hh"
+#include "tun.hh"
+#include "tun_test_device.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+//! A datagram longer than the MTU the device had when it was opened still reads whole
+int main() {
+    try {
+        const string devname = "mtu" + to_string(getpid());
+        optional<TunFD> tun;
+        try {
+            tun.emplace(devname);
+            configure_tun_device(devname, "198.18.31.1");
+        } catch (const unix_error &e) {
+            cerr << "cannot set up a TUN device (" << e.what() << "), skipping\n";
+            return 77;
+        }
+        set_device_mtu(devname, 9000);
+
+        constexpr size_t payload_size = 4000;
+        UDPSocket sender;
+        sender.sendto(Address{"198.18.31.2", 9}, BufferViewList{string(payload_size, 'x')});
+
+        // skip whatever else the kernel sends on a device that has just come up
+        bool received = false;
+        for (unsigned int i = 0; i < 20 and not received; i++) {
+            pollfd pfd{tun->fd_num(), POLLIN, 0};
+            test_err_if(SystemCall("poll", ::poll(&pfd, 1, 2000)) == 0, "the datagram never arrived");
+            InternetDatagram dgram;
+            received = dgram.parse(tun->read_packet()) == ParseResult::NoError and
+                       dgram.header().proto == IPv4Header::PROTO_UDP and
+                       dgram.header().len == IPv4Header::LENGTH + 8 + payload_size;
+        }
+        test_err_if(not received, "the datagram was not read whole");
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
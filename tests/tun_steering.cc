@@ -0,0 +1,158 @@
+#include "ipv4_header.hh"
+#include "tcp_header.hh"
+#include "test_err_if.hh"
+#include "tun.hh"
+#include "tun_steering.hh"
+#include "tun_test_device.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <poll.h>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! A datagram as the device delivers it: from `remote` to `local` (the stack's side)
+static string datagram(const Address &remote,
+                       const Address &local,
+                       const uint8_t proto = IPv4Header::PROTO_TCP,
+                       const uint16_t offset = 0) {
+    IPv4Header ip;
+    ip.src = remote.ipv4_numeric();
+    ip.dst = local.ipv4_numeric();
+    ip.proto = proto;
+    ip.offset = offset;
+    ip.len = IPv4Header::LENGTH + TCPHeader::LENGTH;
+    TCPHeader tcp;
+    tcp.sport = remote.port();
+    tcp.dport = local.port();
+    return ip.serialize() + tcp.serialize();
+}
+
+static void flow_table() {
+    FlowTable flows;
+    const Address local{"198.18.0.2", 5000}, remote{"198.18.0.1", 40000};
+    test_err_if(flows.shard_of(datagram(remote, local)).has_value(), "an empty table steered a datagram");
+
+    flows.add_connection(local, remote, 1);
+    test_err_if(flows.shard_of(datagram(remote, local)) != 1, "a registered connection was not steered");
+    test_err_if(flows.shard_of(datagram(local, remote)).has_value(),
+                "a connection was steered by its reversed 4-tuple");
+    test_err_if(flows.shard_of(datagram(remote, local, 17)).has_value(), "a UDP datagram was steered");
+    test_err_if(flows.shard_of(datagram(remote, local, IPv4Header::PROTO_TCP, 1)).has_value(),
+                "a later fragment was steered");
+    test_err_if(flows.shard_of(datagram(remote, local).substr(0, IPv4Header::LENGTH + 3)).has_value(),
+                "a truncated datagram was steered");
+
+    // a listening port spreads flows over its listeners, each flow always to the same one
+    for (const size_t shard : {0, 2, 3}) {
+        flows.add_listener(80, shard);
+    }
+    const Address server{"198.18.0.2", 80};
+    set<size_t> used;
+    for (uint16_t port = 1024; port < 1124; port++) {
+        const auto shard = flows.shard_of(datagram({"198.18.0.1", port}, server));
+        test_err_if(shard != 0 and shard != 2 and shard != 3, "a flow to a listening port went to a non-listener");
+        test_err_if(shard != flows.shard_of(datagram({"198.18.0.1", port}, server)), "a flow changed shards");
+        used.insert(shard.value());
+    }
+    test_err_if(used.size() != 3, "flows to a listening port did not spread over every listener");
+
+    // an exact match beats a listener
+    flows.add_connection(server, {"198.18.0.1", 1024}, 1);
+    test_err_if(flows.shard_of(datagram({"198.18.0.1", 1024}, server)) != 1, "a listener beat a registered connection");
+
+    flows.remove_shard(1);
+    test_err_if(flows.shard_of(datagram(remote, local)).has_value(), "remove_shard() kept a connection");
+    flows.remove_shard(0);
+    flows.remove_shard(2);
+    for (uint16_t port = 1024; port < 1034; port++) {
+        test_err_if(flows.shard_of(datagram({"198.18.0.1", port}, server)) != 3, "remove_shard() kept a listener");
+    }
+}
+
+//! Start a Linux TCP connection from `source` (if given) to `destination`, without waiting for it
+static FileDescriptor start_connect(const Address &destination, const Address *source = nullptr) {
+    FileDescriptor sock{SystemCall("socket", ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0))};
+    if (source) {
+        SystemCall("bind", ::bind(sock.fd_num(), *source, source->size()));
+    }
+    SystemCall("connect", ::connect(sock.fd_num(), destination, destination.size()), EINPROGRESS);
+    return sock;
+}
+
+static bool readable(const FileDescriptor &fd, const int timeout_ms) {
+    pollfd pfd{fd.fd_num(), POLLIN, 0};
+    return SystemCall("poll", ::poll(&pfd, 1, timeout_ms)) > 0;
+}
+
+//! Does `inbox` receive a SYN to `port`?
+static bool receives_syn(TunInbox &inbox, const uint16_t port) {
+    if (not readable(inbox, 2000)) {
+        return false;
+    }
+    for (auto &datagram : inbox.drain()) {
+        NetParser parser{move(datagram)};
+        IPv4Header ip;
+        TCPHeader tcp;
+        if (ip.parse(parser) == ParseResult::NoError and tcp.parse(parser) == ParseResult::NoError and tcp.syn and
+            tcp.dport == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! The kernel's SYNs, read from a real multi-queue device, reach the shard registered for them
+static int steering() {
+    const string devname = "steer" + to_string(getpid());
+    vector<TunFD> queues;
+    try {
+        queues = open_queues<TunFD>(devname, 2);
+        configure_tun_device(devname, "198.18.29.1");
+    } catch (const unix_error &e) {
+        cerr << "cannot set up a multi-queue TUN device (" << e.what() << "), skipping\n";
+        return 77;
+    }
+
+    TunSteering steering{move(queues)};
+    auto listening = steering.inbox(0), connected = steering.inbox(1);
+
+    steering.add_listener(5000, 0);
+    const auto to_listener = start_connect({"198.18.29.2", 5000});
+    test_err_if(not receives_syn(*listening, 5000), "a SYN to a listening port did not reach the listener");
+    test_err_if(readable(*connected, 0), "a SYN to a listening port reached another shard");
+
+    const Address client{"198.18.29.1", 40001}, server{"198.18.29.2", 6000};
+    steering.add_connection(server, client, 1);
+    const auto to_connection = start_connect(server, &client);
+    test_err_if(not receives_syn(*connected, 6000), "a registered connection's SYN did not reach its shard");
+
+    const uint64_t dropped = steering.dropped();
+    const auto to_nobody = start_connect({"198.18.29.2", 7000});
+    for (int i = 0; i < 100 and steering.dropped() == dropped; i++) {
+        usleep(20000);
+    }
+    test_err_if(steering.dropped() <= dropped, "a SYN nobody registered for was not dropped");
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+    try {
+        flow_table();
+        return steering();
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
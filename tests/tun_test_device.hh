@@ -0,0 +1,42 @@
+#ifndef SPONGE_TESTS_TUN_TEST_DEVICE_HH
+#define SPONGE_TESTS_TUN_TEST_DEVICE_HH
+
+#include "file_descriptor.hh"
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+//! Give TUN device `devname` the address `address`/24 (as the stack's peer) and bring it up
+inline void configure_tun_device(const std::string &devname, const std::string &address) {
+    FileDescriptor sock{SystemCall("socket", ::socket(AF_INET, SOCK_DGRAM, 0))};
+    ifreq req{};
+    strncpy(static_cast<char *>(req.ifr_name), devname.c_str(), IFNAMSIZ - 1);
+
+    auto *addr = reinterpret_cast<sockaddr_in *>(&req.ifr_addr);
+    addr->sin_family = AF_INET;
+    inet_pton(AF_INET, address.c_str(), &addr->sin_addr);
+    SystemCall("ioctl SIOCSIFADDR", ioctl(sock.fd_num(), SIOCSIFADDR, &req));
+    inet_pton(AF_INET, "255.255.255.0", &addr->sin_addr);
+    SystemCall("ioctl SIOCSIFNETMASK", ioctl(sock.fd_num(), SIOCSIFNETMASK, &req));
+
+    SystemCall("ioctl SIOCGIFFLAGS", ioctl(sock.fd_num(), SIOCGIFFLAGS, &req));
+    req.ifr_flags |= IFF_UP;
+    SystemCall("ioctl SIOCSIFFLAGS", ioctl(sock.fd_num(), SIOCSIFFLAGS, &req));
+}
+
+//! Change the MTU of device `devname`
+inline void set_device_mtu(const std::string &devname, const int mtu) {
+    FileDescriptor sock{SystemCall("socket", ::socket(AF_INET, SOCK_DGRAM, 0))};
+    ifreq req{};
+    strncpy(static_cast<char *>(req.ifr_name), devname.c_str(), IFNAMSIZ - 1);
+    req.ifr_mtu = mtu;
+    SystemCall("ioctl SIOCSIFMTU", ioctl(sock.fd_num(), SIOCSIFMTU, &req));
+}
+
+#endif  // SPONGE_TESTS_TUN_TEST_DEVICE_HH
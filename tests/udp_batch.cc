@@ -0,0 +1,158 @@
+#include "fd_adapter.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "test_datagrams.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! More datagrams than one recv_batch() takes by default, so that the second batch comes up short
+constexpr uint32_t datagram_count = 40;
+constexpr size_t batch_size = 32;
+
+//! A pair of connected UDP sockets on the loopback interface
+static pair<UDPSocket, UDPSocket> socket_pair() {
+    UDPSocket sender, receiver;
+    receiver.bind(Address("127.0.0.1", 0));
+    sender.bind(Address("127.0.0.1", 0));
+    sender.connect(receiver.local_address());
+    receiver.connect(sender.local_address());
+    return {move(sender), move(receiver)};
+}
+
+//! send_batch() then recv_batch(): a full batch, then the rest
+static void batch_roundtrip() {
+    auto [sender, receiver] = socket_pair();
+
+    vector<string> payloads;
+    for (uint32_t i = 0; i < datagram_count; i++) {
+        payloads.push_back(test_datagram(i));
+    }
+    sender.send_batch(vector<BufferViewList>(payloads.begin(), payloads.end()));
+
+    vector<UDPSocket::received_datagram> datagrams;
+    uint32_t next = 0;
+    for (const size_t expected : {batch_size, datagram_count - batch_size}) {
+        const size_t received = receiver.recv_batch(datagrams, batch_size);
+        test_err_if(received != expected,
+                    "recv_batch returned " + to_string(received) + " datagrams, expected " + to_string(expected));
+        for (size_t i = 0; i < received; i++, next++) {
+            test_err_if(datagrams[i].payload.str() != payloads[next], "datagram " + to_string(next) + " out of order");
+            test_err_if(datagrams[i].source_address != sender.local_address(), "wrong source address");
+        }
+    }
+
+    // the blocks kept from the last call must not show through in new datagrams
+    sender.send(BufferViewList{payloads.front()});
+    test_err_if(receiver.recv_batch(datagrams, batch_size) != 1 or datagrams[0].payload.str() != payloads.front(),
+                "recv_batch did not return the lone datagram");
+}
+
+//! LossyFdAdapter::read_batch() over a TCPOverUDPSocketAdapter, losing nothing
+static void adapter_read_batch() {
+    auto [sender, receiver] = socket_pair();
+    const Address source = sender.local_address();
+    LossyTCPOverUDPSocketAdapter adapter{TCPOverUDPSocketAdapter{move(receiver)}};
+    adapter.config_mut().destination = source;
+
+    for (uint32_t i = 0; i < datagram_count; i++) {
+        TCPSegment seg;
+        seg.header().seqno = WrappingInt32{i};
+        seg.payload() = string(test_datagram(i));
+        sender.send(seg.serialize());
+    }
+
+    uint32_t next = 0;
+    for (const size_t expected : {batch_size, datagram_count - batch_size}) {
+        const auto segments = adapter.read_batch();
+        test_err_if(segments.size() != expected,
+                    "read_batch returned " + to_string(segments.size()) + " segments, expected " + to_string(expected));
+        for (const auto &seg : segments) {
+            test_err_if(seg.header().seqno != WrappingInt32{next} or seg.payload().str() != test_datagram(next),
+                        "segment " + to_string(next) + " out of order");
+            next++;
+        }
+    }
+}
+
+//! A run of equal-size datagrams, and a shorter one, sent as one UDP_SEGMENT buffer
+static vector<string> gso_run(UDPSocket &sender, const uint32_t first) {
+    vector<string> payloads;
+    for (uint32_t i = first; i < first + 10; i++) {
+        payloads.push_back(sized_test_datagram(i, 1000));
+    }
+    payloads.push_back(sized_test_datagram(first + 10, 400));
+    sender.send_batch(vector<BufferViewList>(payloads.begin(), payloads.end()));
+    return payloads;
+}
+
+//! With UDP GSO and GRO on loopback, recv() and recv_batch() still return the datagrams the sender wrote
+static void offload_roundtrip() {
+    auto [sender, receiver] = socket_pair();
+    if (not sender.enable_segmentation_offload() or not receiver.enable_receive_offload()) {
+        cerr << "UDP GSO/GRO is not supported, skipping the offload cases\n";
+        return;
+    }
+
+    // recv() returns the first datagram of the coalesced buffer, and holds the rest
+    auto payloads = gso_run(sender, 0);
+    for (size_t i = 0; i < payloads.size(); i++) {
+        const auto datagram = receiver.recv();
+        test_err_if(datagram.payload.str() != payloads[i], "recv returned datagram " + to_string(i) + " wrongly");
+        test_err_if(i == 0 and receiver.held_datagrams() != payloads.size() - 1, "the kernel did not coalesce the run");
+    }
+    test_err_if(receiver.held_datagrams() != 0, "recv held datagrams back");
+
+    // recv_batch() returns what recv() held, in order, before receiving more
+    payloads = gso_run(sender, 100);
+    test_err_if(receiver.recv().payload.str() != payloads[0], "recv returned the wrong datagram");
+    vector<UDPSocket::received_datagram> datagrams;
+    const size_t received = receiver.recv_batch(datagrams, batch_size);
+    test_err_if(received != payloads.size() - 1, "recv_batch returned " + to_string(received) + " held datagrams");
+    for (size_t i = 0; i < received; i++) {
+        test_err_if(datagrams[i].payload.str() != payloads[i + 1],
+                    "held datagram " + to_string(i + 1) + " out of order");
+    }
+
+    // and the adapter's read() (unlike before) works with offload enabled
+    auto [tcp_sender, tcp_receiver] = socket_pair();
+    tcp_sender.enable_segmentation_offload();
+    const Address source = tcp_sender.local_address();
+    TCPOverUDPSocketAdapter adapter{move(tcp_receiver), true};
+    adapter.config_mut().destination = source;
+    vector<BufferList> segments;
+    for (uint32_t i = 0; i < 10; i++) {
+        TCPSegment seg;
+        seg.header().seqno = WrappingInt32{i};
+        seg.payload() = sized_test_datagram(i, 1000);
+        segments.push_back(seg.serialize());
+    }
+    tcp_sender.send_batch(vector<BufferViewList>(segments.begin(), segments.end()));
+    for (uint32_t i = 0; i < 10; i++) {
+        const auto seg = adapter.read();
+        test_err_if(not seg.has_value() or seg->header().seqno != WrappingInt32{i},
+                    "read returned segment " + to_string(i));
+    }
+}
+
+int main() {
+    try {
+        batch_roundtrip();
+        adapter_read_batch();
+        offload_roundtrip();
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}